@@ -0,0 +1,53 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// AspectRatioControl::scaleWindow in every aspect mode, run on every setDisplayWindow and setVideoData.
+// A 1280x720 frame is scaled to a full HD screen, the zoom modes use mid range ratios.
+
+#include <memory>
+
+#include "aspectratiocontrol.h"
+#include "benchmark.h"
+
+namespace {
+
+const char *MODE_NAMES[] = {"16_9", "original", "fullwide", "4_3", "verticalzoom", "alldirectionzoom", "32_9", "32_12",
+                            "twinzoom"};
+
+static_assert(sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]) == MODE_T_MAX, "Name every aspect mode");
+
+void aspectRatioBench(bench::Runner &runner)
+{
+    const VideoRect screenRect(1920, 1080);
+    const VideoRect sourceRect(1280, 720);
+
+    for (int mode = MODE_16_9; mode < MODE_T_MAX; mode++) {
+        std::shared_ptr<AspectRatioControl> control = std::make_shared<AspectRatioControl>();
+        control->setParams(static_cast<ARC_MODE_NAME_MAP_T>(mode), 0, AllDirZoomRange / 2, 0, AllDirZoomRange / 2,
+                           VertZoomRange / 2, 0);
+
+        runner.measure(std::string("aspectratio/") + MODE_NAMES[mode], [control, screenRect, sourceRect]() {
+            VideoRect inputRect;
+            VideoRect outputRect;
+            bench::doNotOptimize(control->scaleWindow(screenRect, sourceRect, inputRect, outputRect));
+            bench::doNotOptimize(outputRect);
+        });
+    }
+}
+
+} // namespace
+
+BENCHMARK_SUITE("aspectratio", aspectRatioBench);
@@ -0,0 +1,94 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * Minimal benchmark runner.
+ * Each registered suite calls measure() for every case it wants reported. The operation is repeated
+ * until the minimal run time is reached and the average time and heap allocations per operation are reported.
+ * The operation is then timed in SAMPLES batches, the percentiles are of the time per operation of a batch.
+ */
+class Runner
+{
+public:
+    static const size_t SAMPLES = 100;
+
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        double nsPerOp;
+        double allocationsPerOp;
+        double p50Ns;
+        double p90Ns;
+        double p99Ns;
+    };
+
+    /**
+     * @param out where results are printed as a table while running.
+     */
+    explicit Runner(FILE *out = stdout, std::chrono::milliseconds minTime = std::chrono::milliseconds(200));
+
+    void measure(const std::string &name, const std::function<void()> &operation);
+
+    const std::vector<Result> &results() const { return mResults; }
+
+private:
+    std::vector<double> sample(const std::function<void()> &operation, uint64_t iterations);
+
+    FILE *mOut;
+    std::chrono::milliseconds mMinTime;
+    std::vector<Result> mResults;
+};
+
+// Number of operator new calls in the process, counted by the replacement operator new in main.cpp.
+extern std::atomic<uint64_t> allocationCount;
+
+typedef void (*SuiteFunction)(Runner &runner);
+
+struct Suite {
+    const char *name;
+    SuiteFunction function;
+};
+
+std::vector<Suite> &suites();
+
+/**
+ * Registers a suite in a static initializer, use through BENCHMARK_SUITE.
+ */
+struct SuiteRegistration {
+    SuiteRegistration(const char *name, SuiteFunction function) { suites().push_back({name, function}); }
+};
+
+// Prevent the compiler from optimizing away a computed value.
+template <typename T> inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+} // namespace bench
+
+#define BENCHMARK_SUITE(name, function) static bench::SuiteRegistration benchSuite_##function(name, function)
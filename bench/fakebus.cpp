@@ -0,0 +1,774 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <PmLogLib.h>
+#include <luna-service2/lunaservice.h>
+#include <pbnjson.hpp>
+
+#include "fakebus.h"
+
+// Private in luna-service2, used by ls2-helpers to fill LS::Errors.
+extern "C" bool _LSErrorSetFunc(LSError *lserror, const char *file, int line, const char *function, int error_code,
+                                const char *error_message, ...);
+
+namespace
+{
+
+struct Method {
+    LSMethodFunction function;
+    void *data;
+    bool hasData; // Set with LSMethodSetData, otherwise the category data is passed
+};
+
+struct Category {
+    Category() : data(nullptr) {}
+
+    void *data;
+    std::map<std::string, Method> methods;
+};
+
+struct CancelNotification {
+    LSCancelNotificationFunc function;
+    void *context;
+};
+
+} // namespace
+
+struct LSHandle {
+    uint64_t id;
+    std::string name;
+    GMainContext *context; // nullptr for the default context
+    std::map<std::string, Category> categories;
+    std::vector<CancelNotification> cancelNotifications;
+};
+
+struct LSMessage {
+    std::atomic<int> refs;
+    uint64_t connection; // Handle the message is delivered to
+    std::string category;
+    std::string method;
+    std::string payload;
+    std::string sender;      // Service name of the handle that sent the message
+    std::string uniqueToken; // Requests only
+    LSMessageToken token;    // Call the request or reply belongs to
+    bool subscription;
+    bool hubError;
+};
+
+namespace
+{
+
+struct Call {
+    uint64_t caller;
+    uint64_t callee; // 0 if the service was not registered
+    LSFilterFunc callback;
+    void *context;
+    bool oneReply;
+    std::string uniqueToken;
+};
+
+struct Watch {
+    uint64_t handle;
+    std::string service;
+    LSServerStatusFunc function;
+    void *context;
+    int reported; // Last status delivered, -1 before the first
+};
+
+// Everything below is guarded by busMutex. Callbacks into handlers are made without holding it.
+std::mutex busMutex;
+uint64_t lastId          = 0;
+LSMessageToken lastToken = 0;
+std::map<uint64_t, LSHandle *> handles;
+std::map<std::string, uint64_t> names;
+std::map<LSMessageToken, Call> calls;
+std::map<uint64_t, Watch> watches;
+FakeBus::Stats busStats = {0, 0, 0, 0, 0};
+
+typedef std::shared_ptr<LSMessage> MessagePtr;
+
+bool setError(LSError *lserror, int code, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+bool setError(LSError *lserror, int code, const char *format, ...)
+{
+    if (lserror) {
+        va_list args;
+        va_start(args, format);
+        g_free(lserror->message);
+        lserror->error_code = code;
+        lserror->message    = g_strdup_vprintf(format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+LSHandle *findHandle(uint64_t id)
+{
+    auto it = handles.find(id);
+    return it == handles.end() ? nullptr : it->second;
+}
+
+MessagePtr newMessage(uint64_t connection, LSMessageToken token)
+{
+    LSMessage *message    = new LSMessage();
+    message->refs         = 1;
+    message->connection   = connection;
+    message->token        = token;
+    message->subscription = false;
+    message->hubError     = false;
+    return MessagePtr(message, &LSMessageUnref);
+}
+
+struct Closure {
+    uint64_t handle;
+    std::function<void(LSHandle *)> function;
+};
+
+gboolean runClosure(gpointer data)
+{
+    Closure *closure = static_cast<Closure *>(data);
+    LSHandle *handle;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        handle = findHandle(closure->handle);
+    }
+
+    if (handle) {
+        closure->function(handle);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void freeClosure(gpointer data) { delete static_cast<Closure *>(data); }
+
+// Runs the function on the main context of the handle in a later iteration, like the hub
+// delivers a message. Dropped if the handle is unregistered before it runs.
+void dispatch(uint64_t handleId, std::function<void(LSHandle *)> function)
+{
+    GMainContext *context;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        LSHandle *handle = findHandle(handleId);
+        if (!handle) {
+            return;
+        }
+        context = handle->context;
+    }
+
+    GSource *source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, &runClosure, new Closure{handleId, std::move(function)}, &freeClosure);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
+bool parseUri(const std::string &uri, std::string &service, std::string &category, std::string &method)
+{
+    size_t scheme = uri.find("://");
+    if (scheme == std::string::npos) {
+        return false;
+    }
+
+    size_t pathStart   = uri.find('/', scheme + 3);
+    size_t methodStart = uri.rfind('/');
+    if (pathStart == std::string::npos || methodStart + 1 >= uri.size()) {
+        return false;
+    }
+
+    service  = uri.substr(scheme + 3, pathStart - scheme - 3);
+    category = methodStart == pathStart ? "/" : uri.substr(pathStart, methodStart - pathStart);
+    method   = uri.substr(methodStart + 1);
+    return !service.empty();
+}
+
+bool isSubscription(const char *payload)
+{
+    pbnjson::JValue value = pbnjson::JDomParser::fromString(payload);
+    return value.isObject() && value.hasKey("subscribe") && value["subscribe"].isBoolean() &&
+           value["subscribe"].asBool();
+}
+
+// Delivers the reply to the callback of the call, and ends one reply calls.
+void deliverReply(const MessagePtr &reply)
+{
+    LSMessageToken token = reply->token;
+
+    dispatch(reply->connection, [token, reply](LSHandle *handle) {
+        Call call;
+        {
+            std::lock_guard<std::mutex> lock(busMutex);
+            auto it = calls.find(token);
+            if (it == calls.end()) {
+                busStats.dropped++;
+                return;
+            }
+            call = it->second;
+            if (call.oneReply) {
+                calls.erase(it);
+            }
+        }
+
+        if (call.callback) {
+            call.callback(handle, reply.get(), call.context);
+        }
+    });
+}
+
+void replyError(LSMessage *request, const std::string &errorText)
+{
+    pbnjson::JValue payload = pbnjson::JObject{{"returnValue", false}, {"errorCode", -1}, {"errorText", errorText}};
+    LSMessageRespond(request, payload.stringify().c_str(), nullptr);
+}
+
+void handleRequest(LSHandle *handle, const MessagePtr &request)
+{
+    LSMethodFunction function = nullptr;
+    void *data                = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        auto category = handle->categories.find(request->category);
+        if (category != handle->categories.end()) {
+            auto method = category->second.methods.find(request->method);
+            if (method != category->second.methods.end()) {
+                function = method->second.function;
+                data     = method->second.hasData ? method->second.data : category->second.data;
+            }
+        }
+    }
+
+    if (!function) {
+        replyError(request.get(),
+                   "Unknown method \"" + request->method + "\" for category \"" + request->category + "\"");
+        return;
+    }
+
+    function(handle, request.get(), data);
+}
+
+void notifyCancel(LSHandle *handle, const std::string &uniqueToken)
+{
+    std::vector<CancelNotification> notifications;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        notifications = handle->cancelNotifications;
+    }
+
+    for (const CancelNotification &notification : notifications) {
+        notification.function(handle, uniqueToken.c_str(), notification.context);
+    }
+}
+
+// Reports the current status of the watched service, if it changed since the last report.
+void notifyStatus(uint64_t watchId)
+{
+    uint64_t handleId;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        auto it = watches.find(watchId);
+        if (it == watches.end()) {
+            return;
+        }
+        handleId = it->second.handle;
+    }
+
+    dispatch(handleId, [watchId](LSHandle *handle) {
+        Watch watch;
+        bool connected;
+        {
+            std::lock_guard<std::mutex> lock(busMutex);
+            auto it = watches.find(watchId);
+            if (it == watches.end()) {
+                return;
+            }
+            connected = names.count(it->second.service) > 0;
+            if (it->second.reported == int(connected)) {
+                return;
+            }
+            it->second.reported = int(connected);
+            watch               = it->second;
+        }
+
+        watch.function(handle, watch.service.c_str(), connected, watch.context);
+    });
+}
+
+void notifyWatches(const std::string &service)
+{
+    std::vector<uint64_t> watchIds;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        for (const auto &watch : watches) {
+            if (watch.second.service == service) {
+                watchIds.push_back(watch.first);
+            }
+        }
+    }
+
+    for (uint64_t watchId : watchIds) {
+        notifyStatus(watchId);
+    }
+}
+
+bool makeCall(LSHandle *sh, const char *uri, const char *payload, LSFilterFunc callback, void *context, bool oneReply,
+              LSMessageToken *token, LSError *lserror)
+{
+    std::string service, category, method;
+    if (!sh || !uri || !payload || !parseUri(uri, service, category, method)) {
+        return setError(lserror, -EINVAL, "Invalid call to %s", uri ? uri : "(null)");
+    }
+
+    LSMessageToken callToken;
+    uint64_t callee;
+    std::string sender;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        callToken        = ++lastToken;
+        auto name        = names.find(service);
+        callee           = name == names.end() ? 0 : name->second;
+        sender           = sh->name;
+        calls[callToken] = Call{sh->id, callee, callback, context, oneReply, sender + "." + std::to_string(callToken)};
+        busStats.calls++;
+    }
+
+    if (token) {
+        *token = callToken;
+    }
+
+    if (!callee) {
+        // The hub answers calls to services that are not running.
+        MessagePtr reply = newMessage(sh->id, callToken);
+        reply->category  = "/com/palm/luna/private";
+        reply->method    = "error";
+        reply->sender    = "com.webos.service.bus";
+        reply->hubError  = true;
+        reply->payload   = pbnjson::JObject{{"returnValue", false},
+                                          {"errorCode", -1},
+                                          {"errorText", "Service does not exist: " + service + "."}}
+                             .stringify();
+        deliverReply(reply);
+        return true;
+    }
+
+    MessagePtr request    = newMessage(callee, callToken);
+    request->category     = category;
+    request->method       = method;
+    request->payload      = payload;
+    request->sender       = sender;
+    request->uniqueToken  = sender + "." + std::to_string(callToken);
+    request->subscription = isSubscription(payload);
+
+    dispatch(callee, [request](LSHandle *handle) { handleRequest(handle, request); });
+    return true;
+}
+
+} // namespace
+
+namespace FakeBus
+{
+
+Stats stats()
+{
+    std::lock_guard<std::mutex> lock(busMutex);
+    Stats result     = busStats;
+    result.openCalls = calls.size();
+    return result;
+}
+
+} // namespace FakeBus
+
+extern "C" {
+
+// ---------------------
+// Section: errors
+// ---------------------
+
+bool LSErrorInit(LSError *lserror)
+{
+    memset(lserror, 0, sizeof(*lserror));
+    return true;
+}
+
+void LSErrorFree(LSError *lserror)
+{
+    if (lserror) {
+        g_free(lserror->message);
+        LSErrorInit(lserror);
+    }
+}
+
+bool LSErrorIsSet(LSError *lserror) { return lserror && lserror->message; }
+
+void LSErrorPrint(LSError *lserror, FILE *out)
+{
+    if (LSErrorIsSet(lserror)) {
+        fprintf(out, "LUNASERVICE ERROR %d: %s\n", lserror->error_code, lserror->message);
+    }
+}
+
+void LSErrorLog(PmLogContext context, const char *message_id, LSError *lserror)
+{
+    if (LSErrorIsSet(lserror)) {
+        PmLogError(context, message_id, 1, PMLOGKFV("ERROR_CODE", "%d", lserror->error_code), "%s",
+                   lserror->message);
+    }
+}
+
+void LSErrorLogDefault(const char *message_id, LSError *lserror)
+{
+    LSErrorLog(PmLogGetLibContext(), message_id, lserror);
+}
+
+bool _LSErrorSetFunc(LSError *lserror, const char *file, int line, const char *function, int error_code,
+                     const char *error_message, ...)
+{
+    if (!lserror) {
+        return true;
+    }
+
+    va_list args;
+    va_start(args, error_message);
+    g_free(lserror->message);
+    lserror->error_code = error_code;
+    lserror->message    = g_strdup_vprintf(error_message, args);
+    va_end(args);
+    return true;
+}
+
+// ---------------------
+// Section: handles
+// ---------------------
+
+bool LSRegister(const char *name, LSHandle **sh, LSError *lserror)
+{
+    if (!name || !sh) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        if (names.count(name)) {
+            return setError(lserror, -EEXIST, "Service %s is already registered", name);
+        }
+
+        LSHandle *handle = new LSHandle();
+        handle->id       = ++lastId;
+        handle->name     = name;
+        handle->context  = nullptr;
+
+        handles[handle->id] = handle;
+        names[name]         = handle->id;
+        *sh                 = handle;
+    }
+
+    notifyWatches(name);
+    return true;
+}
+
+bool LSUnregister(LSHandle *sh, LSError *lserror)
+{
+    if (!sh) {
+        return setError(lserror, -EINVAL, "Invalid handle");
+    }
+
+    std::string name = sh->name;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        handles.erase(sh->id);
+        names.erase(name);
+
+        // Calls from the handle end, calls to it stay open until the caller cancels them.
+        for (auto it = calls.begin(); it != calls.end();) {
+            it = it->second.caller == sh->id ? calls.erase(it) : std::next(it);
+        }
+        for (auto it = watches.begin(); it != watches.end();) {
+            it = it->second.handle == sh->id ? watches.erase(it) : std::next(it);
+        }
+    }
+
+    delete sh;
+    notifyWatches(name);
+    return true;
+}
+
+const char *LSHandleGetName(LSHandle *sh) { return sh ? sh->name.c_str() : nullptr; }
+
+bool LSRegisterCategoryAppend(LSHandle *sh, const char *category, LSMethod *methodTable, LSSignal *signalTable,
+                              LSError *lserror)
+{
+    if (!sh || !category) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    Category &entry = sh->categories[category];
+    for (LSMethod *method = methodTable; method && method->name; method++) {
+        entry.methods[method->name] = Method{method->function, nullptr, false};
+    }
+    return true;
+}
+
+bool LSCategorySetData(LSHandle *sh, const char *category, void *user_data, LSError *lserror)
+{
+    if (!sh || !category) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    sh->categories[category].data = user_data;
+    return true;
+}
+
+bool LSMethodSetData(LSHandle *sh, const char *category, const char *method, void *user_data, LSError *lserror)
+{
+    if (!sh || !category || !method) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    auto entry = sh->categories.find(category);
+    if (entry == sh->categories.end() || !entry->second.methods.count(method)) {
+        return setError(lserror, -EINVAL, "Method %s is not registered in %s", method, category);
+    }
+
+    Method &target = entry->second.methods[method];
+    target.data    = user_data;
+    target.hasData = true;
+    return true;
+}
+
+bool LSGmainContextAttach(LSHandle *sh, GMainContext *mainContext, LSError *lserror)
+{
+    if (!sh) {
+        return setError(lserror, -EINVAL, "Invalid handle");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    sh->context = mainContext;
+    return true;
+}
+
+bool LSGmainAttach(LSHandle *sh, GMainLoop *mainLoop, LSError *lserror)
+{
+    return LSGmainContextAttach(sh, mainLoop ? g_main_loop_get_context(mainLoop) : nullptr, lserror);
+}
+
+bool LSGmainDetach(LSHandle *sh, LSError *lserror) { return LSGmainContextAttach(sh, nullptr, lserror); }
+
+bool LSGmainSetPriority(LSHandle *sh, int priority, LSError *lserror) { return sh != nullptr; }
+
+GMainContext *LSGmainGetContext(LSHandle *sh, LSError *lserror)
+{
+    if (!sh) {
+        setError(lserror, -EINVAL, "Invalid handle");
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    return sh->context ? sh->context : g_main_context_default();
+}
+
+bool LSSetDisconnectHandler(LSHandle *sh, LSDisconnectHandler disconnect_handler, void *user_data, LSError *lserror)
+{
+    // The fake bus never goes away.
+    return sh != nullptr;
+}
+
+// ---------------------
+// Section: calls
+// ---------------------
+
+bool LSCall(LSHandle *sh, const char *uri, const char *payload, LSFilterFunc callback, void *user_data,
+            LSMessageToken *ret_token, LSError *lserror)
+{
+    return makeCall(sh, uri, payload, callback, user_data, false, ret_token, lserror);
+}
+
+bool LSCallOneReply(LSHandle *sh, const char *uri, const char *payload, LSFilterFunc callback, void *user_data,
+                    LSMessageToken *ret_token, LSError *lserror)
+{
+    return makeCall(sh, uri, payload, callback, user_data, true, ret_token, lserror);
+}
+
+bool LSCallCancel(LSHandle *sh, LSMessageToken token, LSError *lserror)
+{
+    Call call;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        auto it = calls.find(token);
+        if (it == calls.end()) {
+            return true;
+        }
+        call = it->second;
+        calls.erase(it);
+    }
+
+    if (call.callee) {
+        std::string uniqueToken = call.uniqueToken;
+        dispatch(call.callee, [uniqueToken](LSHandle *handle) { notifyCancel(handle, uniqueToken); });
+    }
+    return true;
+}
+
+bool LSCallCancelNotificationAdd(LSHandle *sh, LSCancelNotificationFunc cancelNotifyFunction, void *ctx,
+                                 LSError *lserror)
+{
+    if (!sh || !cancelNotifyFunction) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    sh->cancelNotifications.push_back(CancelNotification{cancelNotifyFunction, ctx});
+    return true;
+}
+
+bool LSCallCancelNotificationRemove(LSHandle *sh, LSCancelNotificationFunc cancelNotifyFunction, void *ctx,
+                                    LSError *lserror)
+{
+    if (!sh) {
+        return setError(lserror, -EINVAL, "Invalid handle");
+    }
+
+    std::lock_guard<std::mutex> lock(busMutex);
+    std::vector<CancelNotification> &notifications = sh->cancelNotifications;
+    for (auto it = notifications.begin(); it != notifications.end(); ++it) {
+        if (it->function == cancelNotifyFunction && it->context == ctx) {
+            notifications.erase(it);
+            return true;
+        }
+    }
+    return setError(lserror, -ENOENT, "Cancel notification not found");
+}
+
+bool LSSignalSend(LSHandle *sh, const char *uri, const char *payload, LSError *lserror)
+{
+    std::lock_guard<std::mutex> lock(busMutex);
+    busStats.signals++;
+    return true;
+}
+
+bool LSRegisterServerStatusEx(LSHandle *sh, const char *serviceName, LSServerStatusFunc func, void *ctxt,
+                              void **cookie, LSError *lserror)
+{
+    if (!sh || !serviceName || !func || !cookie) {
+        return setError(lserror, -EINVAL, "Invalid parameters");
+    }
+
+    uint64_t watchId;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        watchId          = ++lastId;
+        watches[watchId] = Watch{sh->id, serviceName, func, ctxt, -1};
+    }
+
+    *cookie = reinterpret_cast<void *>(static_cast<uintptr_t>(watchId));
+    notifyStatus(watchId);
+    return true;
+}
+
+bool LSCancelServerStatus(LSHandle *sh, void *cookie, LSError *lserror)
+{
+    std::lock_guard<std::mutex> lock(busMutex);
+    watches.erase(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(cookie)));
+    return true;
+}
+
+// ---------------------
+// Section: messages
+// ---------------------
+
+void LSMessageRef(LSMessage *message) { message->refs.fetch_add(1, std::memory_order_relaxed); }
+
+void LSMessageUnref(LSMessage *message)
+{
+    if (message->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete message;
+    }
+}
+
+LSHandle *LSMessageGetConnection(LSMessage *message)
+{
+    std::lock_guard<std::mutex> lock(busMutex);
+    return findHandle(message->connection);
+}
+
+const char *LSMessageGetCategory(LSMessage *message) { return message->category.c_str(); }
+
+const char *LSMessageGetMethod(LSMessage *message) { return message->method.c_str(); }
+
+const char *LSMessageGetPayload(LSMessage *message) { return message->payload.c_str(); }
+
+const char *LSMessageGetSender(LSMessage *message) { return message->sender.c_str(); }
+
+const char *LSMessageGetSenderServiceName(LSMessage *message) { return message->sender.c_str(); }
+
+const char *LSMessageGetUniqueToken(LSMessage *message) { return message->uniqueToken.c_str(); }
+
+const char *LSMessageGetApplicationID(LSMessage *message) { return nullptr; }
+
+LSMessageToken LSMessageGetToken(LSMessage *message) { return message->token; }
+
+LSMessageToken LSMessageGetResponseToken(LSMessage *message) { return message->token; }
+
+bool LSMessageIsSubscription(LSMessage *message) { return message->subscription; }
+
+bool LSMessageIsHubErrorMessage(LSMessage *message) { return message->hubError; }
+
+bool LSMessageRespond(LSMessage *message, const char *reply_payload, LSError *lserror)
+{
+    uint64_t caller;
+    std::string sender;
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        auto it = calls.find(message->token);
+        if (it == calls.end()) {
+            // Cancelled or already answered, the hub drops these as well.
+            busStats.dropped++;
+            return true;
+        }
+
+        LSHandle *handle = findHandle(message->connection);
+        caller           = it->second.caller;
+        sender           = handle ? handle->name : "";
+        busStats.replies++;
+    }
+
+    MessagePtr reply = newMessage(caller, message->token);
+    reply->category  = message->category;
+    reply->method    = message->method;
+    reply->payload   = reply_payload ? reply_payload : "";
+    reply->sender    = sender;
+    deliverReply(reply);
+    return true;
+}
+
+bool LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload, LSError *lserror)
+{
+    return LSMessageRespond(lsmsg, replyPayload, lserror);
+}
+
+} // extern "C"
@@ -0,0 +1,55 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// In-process luna bus, for running the service without ls-hubd.
+//
+// fakebus.cpp defines the luna-service2 C functions that LS::Handle, LS::Message, LS::Error and
+// ls2-helpers use. Linked into an executable, they take the place of the ones in libluna-service2,
+// so ServicePoint, SubscriptionPoint and PersistentSubscription run unchanged on top of it.
+//
+// Handles registered with LSRegister (LS::Handle) are services on the fake bus. A call is delivered
+// to the handler registered for its category and method on the main context of the called handle,
+// replies are delivered to the callback on the main context of the caller, both through idle sources,
+// so a request and its reply take a main loop iteration each like they would on the hub.
+// Calls to names that are not registered get a hub error reply. Server status watches report
+// services coming up and going down, cancelled calls are reported to the cancel notifications
+// of the called handle.
+//
+// Not covered: signals are counted and dropped, there are no permissions, and the sender of a
+// message is the service name of the caller, not a unique connection name.
+//
+// Multithreading: replies may be sent from any thread. Handles need to be unregistered on the thread
+// that runs their main context.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FakeBus
+{
+
+struct Stats {
+    uint64_t calls;    // Calls made, including ones to services that are not registered
+    uint64_t replies;  // Replies sent to calls
+    uint64_t dropped;  // Replies to calls that were cancelled or finished
+    uint64_t signals;  // Signals sent, not delivered
+    size_t openCalls;  // Calls not finished or cancelled
+};
+
+Stats stats();
+
+} // namespace FakeBus
@@ -0,0 +1,106 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "fakesettings.h"
+#include "errors.h"
+
+using namespace pbnjson;
+
+const char *const FakeSettingsService::SERVICE_NAME = "com.webos.service.settings";
+
+FakeSettingsService::FakeSettingsService(LS::Handle &handle) : mService(&handle)
+{
+    mSettings["picture"] = JObject{{"pictureMode", "normal"},
+                                   {"brightness", 50},
+                                   {"contrast", 95},
+                                   {"color", 55},
+                                   {"tint", 0},
+                                   {"sharpness", 25},
+                                   {"hSharpness", 25},
+                                   {"vSharpness", 25}};
+
+    mSettings["aspectRatio"] = JObject{{"arcPerApp", "16x9"},
+                                       {"justScan", "off"},
+                                       {"allDirZoomHPosition", 0},
+                                       {"allDirZoomHRatio", 0},
+                                       {"allDirZoomVPosition", 0},
+                                       {"allDirZoomVRatio", 0},
+                                       {"vertZoomVRatio", 0},
+                                       {"vertZoomVPosition", 0}};
+
+    for (const auto &category : mSettings) {
+        std::unique_ptr<LSHelpers::SubscriptionPoint> subscription(new LSHelpers::SubscriptionPoint());
+        subscription->setServiceHandle(&handle);
+        mSubscriptions[category.first] = std::move(subscription);
+    }
+
+    mService.registerMethod("/", "getSystemSettings", this, &FakeSettingsService::getSystemSettings);
+}
+
+void FakeSettingsService::set(const std::string &category, const JValue &settings)
+{
+    mSettings[category] = settings;
+
+    auto subscription = mSubscriptions.find(category);
+    if (subscription != mSubscriptions.end()) {
+        JValue reply = buildReply(category, JObject(), settings);
+        reply.put("subscribed", true);
+        subscription->second->post(reply);
+    }
+}
+
+JValue FakeSettingsService::getSystemSettings(LSHelpers::JsonRequest &request)
+{
+    std::string category;
+    JValue dimension;
+    JValue keys;
+    std::string appId;
+    bool subscribe;
+
+    request.get("category", category);
+    request.get("dimension", dimension).optional(true).defaultValue(JObject());
+    request.get("app_id", appId).optional(true);
+    request.get("keys", keys).optional(true);
+    request.get("subscribe", subscribe).optional(true).defaultValue(false);
+
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
+    auto settings = mSettings.find(category);
+    if (settings == mSettings.end()) {
+        return LSHelpers::ErrorResponse(-1, "Unknown category: %s", category.c_str());
+    }
+
+    if (subscribe) {
+        mSubscriptions[category]->addSubscription(request);
+    }
+
+    JValue reply = buildReply(category, dimension, settings->second);
+    reply.put("subscribed", subscribe);
+    if (!appId.empty()) {
+        reply.put("app_id", appId);
+    }
+    return reply;
+}
+
+JValue FakeSettingsService::buildReply(const std::string &category, const JValue &dimension, const JValue &settings)
+{
+    return JObject{{"returnValue", true},
+                   {"method", "getSystemSettings"},
+                   {"category", category},
+                   {"dimension", dimension},
+                   {"settings", settings}};
+}
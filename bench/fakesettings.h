@@ -0,0 +1,49 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "ls2-helpers.hpp"
+
+// Stand-in for com.webos.service.settings, answers getSystemSettings for the "picture" and
+// "aspectRatio" categories with the defaults of a TV. Enough for PictureSettings and
+// AspectRatioSetting to configure the service, so the subscriptions they keep are exercised too.
+class FakeSettingsService
+{
+public:
+    static const char *const SERVICE_NAME;
+
+    explicit FakeSettingsService(LS::Handle &handle);
+    FakeSettingsService(const FakeSettingsService &) = delete;
+    FakeSettingsService &operator=(const FakeSettingsService &) = delete;
+
+    // Replace settings of a category, subscribers of the category get the new values.
+    void set(const std::string &category, const pbnjson::JValue &settings);
+
+    pbnjson::JValue getSystemSettings(LSHelpers::JsonRequest &request);
+
+private:
+    static pbnjson::JValue buildReply(const std::string &category, const pbnjson::JValue &dimension,
+                                      const pbnjson::JValue &settings);
+
+    LSHelpers::ServicePoint mService;
+    std::map<std::string, pbnjson::JValue> mSettings;
+    std::map<std::string, std::unique_ptr<LSHelpers::SubscriptionPoint>> mSubscriptions;
+};
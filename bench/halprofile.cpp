@@ -0,0 +1,217 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Summarizes HAL journals (haljournal.h) into call profiles, and compares profiles.
+//
+// A profile lists, for each luna method, how many calls of the method the journal covers and how many
+// calls of each HAL function they made, per luna call. A client action maps to the luna calls it makes,
+// so a connect shows up under /connect and a resize under /display/setDisplayWindow.
+// HAL calls made outside of luna calls, like for settings changes, are listed under "(none)", per journal.
+//
+// Journals come from debug/getHalJournal, or from the --journal option of videooutput-loadgen and
+// videooutput-replay. Either a journal or a profile can be given to --diff.
+//
+// With --diff, HAL calls per luna call that went up by more than the tolerance, or HAL calls that were
+// not made before, are reported as regressions, and the exit code is 1.
+//
+// Usage: videooutput-halprofile JOURNAL
+//        videooutput-halprofile --diff [--tolerance FRACTION] BASE NEW
+
+#include <cstdio>
+#include <string>
+
+#include <glib.h>
+#include <pbnjson.hpp>
+
+using namespace pbnjson;
+
+namespace
+{
+
+// Method of HAL calls made outside of luna calls.
+const char *const NO_METHOD = "(none)";
+
+gboolean diffMode = FALSE;
+gdouble tolerance = 0.0;
+
+GOptionEntry options[] = {
+    {"diff", 'd', 0, G_OPTION_ARG_NONE, &diffMode, "Compare two journals or profiles", ""},
+    {"tolerance", 't', 0, G_OPTION_ARG_DOUBLE, &tolerance, "Allowed increase of calls per luna call, 0.1 - 10%",
+     "FRACTION"},
+    {NULL, ' ', 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+// {"profile": {method: {"requests": N, "calls": {name: {"count", "perRequest", "durationUs"}}}}, "dropped": N}
+JValue buildProfile(const JValue &journal)
+{
+    JValue requests = journal["requests"];
+    JObject profile;
+
+    for (const JValue &call : journal["calls"].items()) {
+        std::string method = call["method"].asString();
+        if (method.empty()) {
+            method = NO_METHOD;
+        }
+
+        if (!profile.hasKey(method)) {
+            int64_t count = requests.hasKey(method) ? requests[method].asNumber<int64_t>() : 0;
+            profile.put(method, JObject{{"requests", count}, {"calls", JObject()}});
+        }
+
+        JValue calls     = profile[method]["calls"];
+        std::string name = call["name"].asString();
+        if (!calls.hasKey(name)) {
+            calls.put(name, JObject{{"count", 0}, {"durationUs", 0}});
+        }
+
+        JValue stats = calls[name];
+        stats.put("count", stats["count"].asNumber<int64_t>() + 1);
+        stats.put("durationUs", stats["durationUs"].asNumber<int64_t>() + call["durationUs"].asNumber<int64_t>());
+    }
+
+    // Per luna call. Calls outside of luna calls are per journal.
+    for (const JValue::KeyValue &method : profile.children()) {
+        int64_t requestCount = method.second["requests"].asNumber<int64_t>();
+        for (const JValue::KeyValue &call : method.second["calls"].children()) {
+            JValue stats = call.second;
+            double count = static_cast<double>(stats["count"].asNumber<int64_t>());
+            stats.put("perRequest", requestCount > 0 ? count / requestCount : count);
+        }
+    }
+
+    return JObject{{"profile", profile}, {"dropped", journal["dropped"]}};
+}
+
+bool loadProfile(const char *path, JValue &profile)
+{
+    JValue value = JDomParser::fromFile(path);
+    if (!value.isObject()) {
+        fprintf(stderr, "%s: not a JSON object\n", path);
+        return false;
+    }
+
+    if (value.hasKey("profile")) {
+        profile = value;
+    } else if (value.hasKey("calls")) {
+        profile = buildProfile(value);
+    } else {
+        fprintf(stderr, "%s: neither a HAL journal nor a profile\n", path);
+        return false;
+    }
+
+    int64_t dropped = profile["dropped"].isNumber() ? profile["dropped"].asNumber<int64_t>() : 0;
+    if (dropped > 0) {
+        fprintf(stderr, "%s: %lld HAL calls were dropped from the journal, the profile is not complete\n", path,
+                (long long)dropped);
+    }
+    return true;
+}
+
+double perRequest(const JValue &profile, const std::string &method, const std::string &name)
+{
+    JValue stats = profile["profile"][method]["calls"][name];
+    return stats.isObject() ? stats["perRequest"].asNumber<double>() : 0.0;
+}
+
+// Prints one line per method and HAL call of either profile, returns the number of regressions.
+int diff(const JValue &base, const JValue &current)
+{
+    int regressions = 0;
+
+    printf("%-32s %-36s %10s %10s %9s\n", "method", "HAL call", "base", "new", "change");
+
+    JObject methods;
+    for (const JValue &profile : {base, current}) {
+        for (const JValue::KeyValue &method : profile["profile"].children()) {
+            std::string methodName = method.first.asString();
+            if (!methods.hasKey(methodName)) {
+                methods.put(methodName, JObject());
+            }
+            for (const JValue::KeyValue &call : method.second["calls"].children()) {
+                methods[methodName].put(call.first.asString(), true);
+            }
+        }
+    }
+
+    for (const JValue::KeyValue &method : methods.children()) {
+        std::string methodName = method.first.asString();
+        for (const JValue::KeyValue &call : method.second.children()) {
+            std::string name = call.first.asString();
+            double before    = perRequest(base, methodName, name);
+            double after     = perRequest(current, methodName, name);
+
+            const char *verdict = "";
+            if (after > before * (1.0 + tolerance) + 1e-9) {
+                verdict = "REGRESSION";
+                regressions++;
+            } else if (after < before - 1e-9) {
+                verdict = "fewer";
+            }
+
+            char change[16] = "new";
+            if (before > 0) {
+                snprintf(change, sizeof(change), "%+.1f%%", (after - before) / before * 100.0);
+            }
+
+            printf("%-32s %-36s %10.2f %10.2f %9s %s\n", methodName.c_str(), name.c_str(), before, after, change,
+                   verdict);
+        }
+    }
+
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context = g_option_context_new("JOURNAL | --diff BASE NEW");
+    GError *err             = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        fprintf(stderr, "%s\n", err ? err->message : "Invalid options");
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (argc != (diffMode ? 3 : 2)) {
+        fprintf(stderr, "Usage: %s JOURNAL\n       %s --diff [--tolerance FRACTION] BASE NEW\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    if (!diffMode) {
+        JValue profile;
+        if (!loadProfile(argv[1], profile)) {
+            return 2;
+        }
+        printf("%s\n", profile.stringify("  ").c_str());
+        return 0;
+    }
+
+    JValue base;
+    JValue current;
+    if (!loadProfile(argv[1], base) || !loadProfile(argv[2], current)) {
+        return 2;
+    }
+
+    int regressions = diff(base, current);
+    if (regressions > 0) {
+        printf("\n%d regression(s)\n", regressions);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Request decoding of the VideoService luna methods, time and heap allocations per call.
+// "dom" is what a regular handler does: parse the payload to a DOM and pick the fields with JsonParser.
+// "stream" decodes the payload straight into the request struct with JsonStreamParser.
+// Methods with plain get() handlers only have the "dom" case, the get() calls mirror the handlers.
+
+#include <PmLogLib.h>
+
+#include "benchmark.h"
+#include "videorequests.h"
+
+// Log context of the service sources compiled into the benchmark.
+PmLogContext logContext;
+
+namespace {
+
+const char *SET_DISPLAY_WINDOW = "{\"context\":\"pipeline_1234\",\"fullScreen\":false,"
+                                 "\"sourceInput\":{\"x\":0,\"y\":0,\"width\":1920,\"height\":1080},"
+                                 "\"displayOutput\":{\"x\":320,\"y\":180,\"width\":1280,\"height\":720}}";
+
+const char *SET_VIDEO_DATA = "{\"context\":\"pipeline_1234\",\"contentType\":\"media\",\"width\":1920,"
+                             "\"height\":1080,\"frameRate\":29.97,\"scanType\":\"progressive\"}";
+
+const char *BLANK_VIDEO = "{\"sink\":\"MAIN\",\"blank\":false}";
+
+const char *REGISTER = "{\"context\":\"pipeline_1234\"}";
+
+const char *CONNECT = "{\"appId\":\"com.webos.app.player\",\"context\":\"pipeline_1234\",\"source\":\"VDEC\","
+                      "\"sourcePort\":0,\"sink\":\"MAIN\"}";
+
+const char *DISCONNECT = "{\"sink\":\"MAIN\",\"context\":\"pipeline_1234\"}";
+
+const char *SET_COMPOSITING = "{\"composeOrder\":[{\"sink\":\"MAIN\",\"opacity\":255,\"zOrder\":0},"
+                              "{\"sink\":\"SUB0\",\"opacity\":128,\"zOrder\":1}]}";
+
+const char *GET_STATUS = "{\"subscribe\":true}";
+
+const char *GET_PARAM = "{\"command\":\"getVideoSize\",\"sink\":\"MAIN\"}";
+
+// Missing mandatory field, exercises error recording.
+const char *BLANK_VIDEO_INVALID = "{\"sink\":\"MAIN\"}";
+
+void measureDom(bench::Runner &runner, const std::string &name, const char *payload,
+                void (*getFields)(LSHelpers::JsonParser &parser))
+{
+    runner.measure("request/" + name + "/dom", [payload, getFields]() {
+        LSHelpers::JsonParser parser(pbnjson::JDomParser::fromString(payload));
+        getFields(parser);
+        bench::doNotOptimize(parser.finishParse());
+    });
+}
+
+template <typename T> void decodeDom(const char *payload)
+{
+    LSHelpers::JsonParser parser(pbnjson::JDomParser::fromString(payload));
+    T params;
+    LSHelpers::parseJsonFields(parser, params);
+    bench::doNotOptimize(parser.finishParse());
+    bench::doNotOptimize(params);
+}
+
+template <typename T> void decodeStream(const char *payload)
+{
+    LSHelpers::JsonStreamParser parser(payload);
+    T params;
+    bench::doNotOptimize(LSHelpers::decodeJsonFields(parser, params));
+    bench::doNotOptimize(params);
+}
+
+template <typename T> void measureRequest(bench::Runner &runner, const std::string &name, const char *payload)
+{
+    runner.measure("request/" + name + "/dom", [payload]() { decodeDom<T>(payload); });
+    runner.measure("request/" + name + "/stream", [payload]() { decodeStream<T>(payload); });
+}
+
+void requestBench(bench::Runner &runner)
+{
+    measureRequest<SetDisplayWindowRequest>(runner, "setDisplayWindow", SET_DISPLAY_WINDOW);
+    measureRequest<SetVideoDataRequest>(runner, "setVideoData", SET_VIDEO_DATA);
+    measureRequest<BlankVideoRequest>(runner, "blankVideo", BLANK_VIDEO);
+    measureRequest<BlankVideoRequest>(runner, "blankVideo-invalid", BLANK_VIDEO_INVALID);
+
+    measureDom(runner, "register", REGISTER, [](LSHelpers::JsonParser &parser) {
+        std::string clientId;
+        parser.get("context", clientId);
+    });
+    measureDom(runner, "connect", CONNECT, [](LSHelpers::JsonParser &parser) {
+        std::string videoSource, videoSinkName, appId("unknown"), clientId("unknown");
+        uint8_t videoSourcePort;
+        bool cIdSet;
+        parser.get("appId", appId).optional(true);
+        parser.get("context", clientId).optional(true).checkValueRead(cIdSet);
+        parser.get("source", videoSource);
+        parser.get("sourcePort", videoSourcePort);
+        parser.get("sink", videoSinkName);
+    });
+    measureDom(runner, "disconnect", DISCONNECT, [](LSHelpers::JsonParser &parser) {
+        std::string videoSinkName, clientId;
+        bool cIdSet;
+        parser.get("sink", videoSinkName);
+        parser.get("context", clientId).optional(true).checkValueRead(cIdSet);
+    });
+    measureDom(runner, "setCompositing", SET_COMPOSITING, [](LSHelpers::JsonParser &parser) {
+        std::vector<Composition> composeOrdering;
+        parser.getArray("composeOrder", composeOrdering);
+    });
+    measureDom(runner, "getStatus", GET_STATUS, [](LSHelpers::JsonParser &parser) {
+        bool subscribe;
+        parser.get("subscribe", subscribe).optional(true).defaultValue(false);
+    });
+    measureDom(runner, "getParam", GET_PARAM, [](LSHelpers::JsonParser &parser) {
+        std::string command, sinkName;
+        bool sinkNameSet;
+        parser.get("command", command);
+        parser.get("sink", sinkName).optional(true).checkValueRead(sinkNameSet);
+    });
+}
+
+} // namespace
+
+BENCHMARK_SUITE("request", requestBench);
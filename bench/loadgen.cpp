@@ -0,0 +1,453 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Load generator: runs the complete service in-process on the fake bus (fakebus.h) and the VAL
+// implementation it is linked with, and has N simulated apps go through cycles of
+// register, connect, setVideoData, setDisplayWindow resizes, disconnect and unregister.
+// Every app waits for the reply before its next call. Status watchers keep a getStatus
+// subscription open, so every state change also goes through the subscription fan-out.
+//
+// Latency is measured from the call to its reply, so it includes the time the call waits in
+// the main loop behind the calls of other apps. Reported per method as p50/p99/max in microseconds.
+//
+// Heap allocations are counted from the call to its reply, in the service, the bus and the status
+// fan-out to the watchers, and reported per method as allocations per call. Only exact with --apps 1,
+// otherwise the calls of the other apps are counted in as well. Compare runs before and after a change
+// with the same options, for example --apps 1 --watchers 1: with --baseline FILE, the --json output of
+// the run before, the allocations of both runs are reported side by side.
+//
+// With --journal the HAL calls of the run are written to a file, see halprofile.cpp.
+//
+// Usage: videooutput-loadgen [--apps N] [--cycles N] [--resizes N] [--watchers N] [--sinks MAIN,SUB0] [--json]
+//                            [--journal FILE] [--baseline FILE]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+#include <val_api.h>
+
+#include "fakebus.h"
+#include "haljournal.h"
+#include "logging.h"
+#include "serviceundertest.h"
+
+using namespace pbnjson;
+
+PmLogContext logContext;
+
+// Counted by the operator new below.
+static std::atomic<uint64_t> allocationCount(0);
+
+namespace
+{
+
+const char *const METHODS[] = {"register", "connect", "setVideoData", "setDisplayWindow", "disconnect", "unregister"};
+
+gint appCount       = 4;
+gint cycleCount     = 100;
+gint resizeCount    = 5;
+gint watcherCount   = 2;
+gint timeoutSeconds = 120;
+gchar *sinkList     = nullptr;
+gboolean jsonOutput = FALSE;
+gchar *journalFile  = nullptr;
+gchar *baselineFile = nullptr;
+
+// HAL calls kept for --journal, enough for long runs.
+const size_t JOURNAL_CAPACITY = 256 * 1024;
+
+GOptionEntry options[] = {
+    {"apps", 'a', 0, G_OPTION_ARG_INT, &appCount, "Simulated apps", "N"},
+    {"cycles", 'c', 0, G_OPTION_ARG_INT, &cycleCount, "Connect to disconnect cycles per app", "N"},
+    {"resizes", 'r', 0, G_OPTION_ARG_INT, &resizeCount, "setDisplayWindow calls per cycle", "N"},
+    {"watchers", 'w', 0, G_OPTION_ARG_INT, &watcherCount, "getStatus subscribers", "N"},
+    {"sinks", 's', 0, G_OPTION_ARG_STRING, &sinkList, "Sinks the apps connect to, in turn. Default MAIN", "LIST"},
+    {"timeout", 't', 0, G_OPTION_ARG_INT, &timeoutSeconds, "Stop after this many seconds", "SECONDS"},
+    {"json", 'j', 0, G_OPTION_ARG_NONE, &jsonOutput, "Print the results as JSON", ""},
+    {"journal", 0, 0, G_OPTION_ARG_STRING, &journalFile, "Write the HAL calls of the run to FILE", "FILE"},
+    {"baseline", 'b', 0, G_OPTION_ARG_STRING, &baselineFile, "Compare allocations with the --json output in FILE",
+     "FILE"},
+    {NULL, ' ', 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+LSHelpers::Histogram &latency(const std::string &method)
+{
+    return LSHelpers::MetricsRegistry::global().histogram("loadgen." + method + "Us");
+}
+
+LSHelpers::Counter &errors(const std::string &method)
+{
+    return LSHelpers::MetricsRegistry::global().counter("loadgen." + method + ".errors");
+}
+
+LSHelpers::Counter &allocations(const std::string &method)
+{
+    return LSHelpers::MetricsRegistry::global().counter("loadgen." + method + ".allocations");
+}
+
+double allocationsPerCall(const char *method)
+{
+    uint64_t calls = latency(method).count();
+    return calls ? static_cast<double>(allocations(method).value()) / calls : 0;
+}
+
+LSHelpers::Counter &statusUpdates() { return LSHelpers::MetricsRegistry::global().counter("loadgen.statusUpdates"); }
+
+JValue rect(int x, int y, int width, int height)
+{
+    return JObject{{"x", x}, {"y", y}, {"width", width}, {"height", height}};
+}
+
+// One client of the service, goes through its cycles one call at a time.
+class App
+{
+public:
+    App(size_t index, const std::string &sink, GMainLoop *loop, const std::function<void()> &done)
+        : mHandle(("com.webos.app.loadgen" + std::to_string(index)).c_str()), mClient(&mHandle),
+          mContext("pipeline_loadgen" + std::to_string(index)), mSink(sink), mStep(Step::Register), mResizes(0),
+          mCyclesLeft(cycleCount), mDone(done)
+    {
+        mHandle.attachToLoop(loop);
+    }
+
+    App(const App &) = delete;
+    App &operator=(const App &) = delete;
+
+    void start() { issue(); }
+
+private:
+    enum class Step { Register, Connect, SetVideoData, SetDisplayWindow, Disconnect, Unregister };
+
+    void issue()
+    {
+        switch (mStep) {
+        case Step::Register:
+            call("register", "/register", JObject{{"context", mContext}});
+            break;
+        case Step::Connect:
+            call("connect", "/connect",
+                 JObject{{"appId", mHandle.getName()},
+                         {"context", mContext},
+                         {"source", "VDEC"},
+                         {"sourcePort", 0},
+                         {"sink", mSink}});
+            break;
+        case Step::SetVideoData:
+            call("setVideoData", "/setVideoData",
+                 JObject{{"context", mContext},
+                         {"contentType", "media"},
+                         {"width", 1920},
+                         {"height", 1080},
+                         {"frameRate", 29.97},
+                         {"scanType", "progressive"}});
+            break;
+        case Step::SetDisplayWindow: {
+            // Window sizes an app goes through when it is resized, full screen every other time.
+            int width = 640 + (mResizes * 320) % 1280;
+            call("setDisplayWindow", "/display/setDisplayWindow",
+                 JObject{{"context", mContext},
+                         {"fullScreen", mResizes % 2 == 0},
+                         {"sourceInput", rect(0, 0, 1920, 1080)},
+                         {"displayOutput", rect(0, 0, width, width * 9 / 16)}});
+            break;
+        }
+        case Step::Disconnect:
+            call("disconnect", "/disconnect", JObject{{"sink", mSink}, {"context", mContext}});
+            break;
+        case Step::Unregister:
+            call("unregister", "/unregister", JObject{{"context", mContext}});
+            break;
+        }
+    }
+
+    void call(const char *method, const char *path, const JValue &params)
+    {
+        gint64 start          = g_get_monotonic_time();
+        uint64_t allocsBefore = allocationCount.load(std::memory_order_relaxed);
+        mClient.callOneReply(std::string("luna://") + ServiceUnderTest::SERVICE_NAME + path, params,
+                             [this, method, start, allocsBefore](LSHelpers::JsonResponse &response) {
+                                 latency(method).record(static_cast<uint64_t>(g_get_monotonic_time() - start));
+                                 allocations(method).add(allocationCount.load(std::memory_order_relaxed) -
+                                                         allocsBefore);
+                                 if (!response.isSuccess() || !response.getJson()["returnValue"].asBool()) {
+                                     errors(method).add();
+                                 }
+                                 advance();
+                             });
+    }
+
+    // Calls go on after errors, apps sharing a sink take it from each other.
+    void advance()
+    {
+        switch (mStep) {
+        case Step::Register:
+            mStep = Step::Connect;
+            break;
+        case Step::Connect:
+            mStep = Step::SetVideoData;
+            break;
+        case Step::SetVideoData:
+            mStep = resizeCount > 0 ? Step::SetDisplayWindow : Step::Disconnect;
+            break;
+        case Step::SetDisplayWindow:
+            if (++mResizes % resizeCount == 0) {
+                mStep = Step::Disconnect;
+            }
+            break;
+        case Step::Disconnect:
+            mStep = Step::Unregister;
+            break;
+        case Step::Unregister:
+            if (--mCyclesLeft <= 0) {
+                mDone();
+                return;
+            }
+            mStep = Step::Register;
+            break;
+        }
+
+        issue();
+    }
+
+    LS::Handle mHandle;
+    LSHelpers::ServicePoint mClient;
+    std::string mContext;
+    std::string mSink;
+    Step mStep;
+    int mResizes;
+    int mCyclesLeft;
+    std::function<void()> mDone;
+};
+
+// Keeps a getStatus subscription open and counts the updates.
+class StatusWatcher
+{
+public:
+    StatusWatcher(size_t index, GMainLoop *loop)
+        : mHandle(("com.webos.app.loadgenwatcher" + std::to_string(index)).c_str()), mClient(&mHandle)
+    {
+        mHandle.attachToLoop(loop);
+        mClient.callMultiReply(std::string("luna://") + ServiceUnderTest::SERVICE_NAME + "/getStatus",
+                               JObject{{"subscribe", true}}, [](LSHelpers::JsonResponse &) { statusUpdates().add(); });
+    }
+
+    StatusWatcher(const StatusWatcher &) = delete;
+    StatusWatcher &operator=(const StatusWatcher &) = delete;
+
+private:
+    LS::Handle mHandle;
+    LSHelpers::ServicePoint mClient;
+};
+
+std::vector<std::string> splitSinks(const char *list)
+{
+    std::vector<std::string> sinks;
+    std::string rest = list ? list : "MAIN";
+
+    size_t comma;
+    while ((comma = rest.find(',')) != std::string::npos) {
+        sinks.push_back(rest.substr(0, comma));
+        rest = rest.substr(comma + 1);
+    }
+    sinks.push_back(rest);
+    return sinks;
+}
+
+// Allocations per call of the method in the --baseline run, negative if not known.
+double baselineAllocationsPerCall(const JValue &baseline, const char *method)
+{
+    if (!baseline.isObject()) {
+        return -1;
+    }
+
+    JValue allocs = baseline["methods"][method]["allocsPerCall"];
+    return allocs.isNumber() ? allocs.asNumber<double>() : -1;
+}
+
+void printTable(double elapsedSeconds, const JValue &baseline)
+{
+    uint64_t totalCalls = 0;
+
+    printf("%-20s %10s %8s %10s %10s %10s %12s", "method", "calls", "errors", "p50 us", "p99 us", "max us",
+           "allocs/call");
+    printf(baseline.isObject() ? " %12s %8s\n" : "\n", "baseline", "change");
+    for (const char *method : METHODS) {
+        LSHelpers::Histogram &histogram = latency(method);
+        totalCalls += histogram.count();
+        printf("%-20s %10llu %8llu %10llu %10llu %10llu %12.1f", method, (unsigned long long)histogram.count(),
+               (unsigned long long)errors(method).value(), (unsigned long long)histogram.percentile(0.5),
+               (unsigned long long)histogram.percentile(0.99), (unsigned long long)histogram.max(),
+               allocationsPerCall(method));
+
+        double before = baselineAllocationsPerCall(baseline, method);
+        if (!baseline.isObject()) {
+            printf("\n");
+        } else if (before < 0) {
+            printf(" %12s %8s\n", "-", "-");
+        } else {
+            printf(" %12.1f %+8.1f\n", before, allocationsPerCall(method) - before);
+        }
+    }
+
+    FakeBus::Stats bus = FakeBus::stats();
+    printf("\n%llu calls in %.2f s, %.0f calls/s\n", (unsigned long long)totalCalls, elapsedSeconds,
+           totalCalls / elapsedSeconds);
+    printf("%llu status updates, bus: %llu calls, %llu replies, %llu dropped replies, %zu calls open\n",
+           (unsigned long long)statusUpdates().value(), (unsigned long long)bus.calls, (unsigned long long)bus.replies,
+           (unsigned long long)bus.dropped, bus.openCalls);
+}
+
+void printJson(double elapsedSeconds, const JValue &baseline)
+{
+    JObject methods;
+    for (const char *method : METHODS) {
+        JValue stats = latency(method).toJValue();
+        stats.put("errors", static_cast<int64_t>(errors(method).value()));
+        stats.put("allocsPerCall", allocationsPerCall(method));
+        double before = baselineAllocationsPerCall(baseline, method);
+        if (before >= 0) {
+            stats.put("baselineAllocsPerCall", before);
+        }
+        methods.put(method, stats);
+    }
+
+    FakeBus::Stats bus = FakeBus::stats();
+    JObject result{{"elapsedMs", static_cast<int64_t>(elapsedSeconds * 1000)},
+                   {"methods", methods},
+                   {"statusUpdates", static_cast<int64_t>(statusUpdates().value())},
+                   {"bus",
+                    JObject{{"calls", static_cast<int64_t>(bus.calls)},
+                            {"replies", static_cast<int64_t>(bus.replies)},
+                            {"dropped", static_cast<int64_t>(bus.dropped)},
+                            {"openCalls", static_cast<int64_t>(bus.openCalls)}}}};
+    printf("%s\n", result.stringify("  ").c_str());
+}
+
+} // namespace
+
+// Count heap allocations, array and nothrow versions forward to these by default.
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context = g_option_context_new(NULL);
+    GError *err             = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        fprintf(stderr, "%s\n", err ? err->message : "Invalid options");
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (PmLogGetContext("videooutputd", &logContext) != kPmLogErr_None) {
+        fprintf(stderr, "Failed to set up log context\n");
+        return EXIT_FAILURE;
+    }
+
+    // Read before the run, so a bad file does not waste it.
+    JValue baseline;
+    if (baselineFile) {
+        baseline = JDomParser::fromFile(baselineFile);
+        if (!baseline.isObject() || !baseline["methods"].isObject()) {
+            fprintf(stderr, "%s: not the --json output of videooutput-loadgen\n", baselineFile);
+            return EXIT_FAILURE;
+        }
+    }
+
+    GMainLoop *mainLoop = g_main_loop_new(NULL, FALSE);
+
+    VAL *val = VAL::getInstance();
+    if (!val->initialize()) {
+        fprintf(stderr, "VAL initialization failed\n");
+        return EXIT_FAILURE;
+    }
+
+    double elapsedSeconds;
+    bool journalWritten = true;
+    {
+        ServiceUnderTest service(mainLoop);
+        if (journalFile) {
+            // Only the calls of the run, not of the setup.
+            HalJournal::setCapacity(JOURNAL_CAPACITY);
+            HalJournal::clear();
+            HalJournal::setEnabled(true);
+        }
+
+        std::vector<std::unique_ptr<StatusWatcher>> watchers;
+        for (gint i = 0; i < watcherCount; i++) {
+            watchers.emplace_back(new StatusWatcher(i, mainLoop));
+        }
+
+        std::vector<std::string> sinks = splitSinks(sinkList);
+        gint running                   = appCount;
+        std::vector<std::unique_ptr<App>> apps;
+        for (gint i = 0; i < appCount; i++) {
+            apps.emplace_back(new App(i, sinks[i % sinks.size()], mainLoop, [&running, mainLoop]() {
+                if (--running == 0) {
+                    g_main_loop_quit(mainLoop);
+                }
+            }));
+        }
+
+        g_timeout_add_seconds(timeoutSeconds,
+                              [](gpointer loop) -> gboolean {
+                                  fprintf(stderr, "Timed out, results are incomplete\n");
+                                  g_main_loop_quit(static_cast<GMainLoop *>(loop));
+                                  return G_SOURCE_REMOVE;
+                              },
+                              mainLoop);
+
+        gint64 start = g_get_monotonic_time();
+        for (auto &app : apps) {
+            app->start();
+        }
+        if (appCount > 0) {
+            g_main_loop_run(mainLoop);
+        }
+        elapsedSeconds = (g_get_monotonic_time() - start) / 1e6;
+
+        // Before the service is torn down, which disconnects the sinks.
+        journalWritten = !journalFile || writeHalJournal(journalFile);
+    }
+
+    if (jsonOutput) {
+        printJson(elapsedSeconds, baseline);
+    } else {
+        printTable(elapsedSeconds, baseline);
+    }
+
+    g_main_loop_unref(mainLoop);
+    val->deinitialize();
+    return journalWritten ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "benchmark.h"
+
+namespace bench {
+
+std::atomic<uint64_t> allocationCount(0);
+
+std::vector<Suite> &suites()
+{
+    static std::vector<Suite> registered;
+    return registered;
+}
+
+Runner::Runner(FILE *out, std::chrono::milliseconds minTime) : mOut(out), mMinTime(minTime) {}
+
+// Time per operation of SAMPLES batches that together run about iterations operations, sorted.
+std::vector<double> Runner::sample(const std::function<void()> &operation, uint64_t iterations)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    uint64_t batch = std::max<uint64_t>(1, iterations / SAMPLES);
+    std::vector<double> samples;
+    samples.reserve(SAMPLES);
+
+    for (size_t s = 0; s < SAMPLES; s++) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < batch; i++) {
+            operation();
+        }
+        Clock::duration elapsed = Clock::now() - start;
+        samples.push_back(std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count() /
+                          batch);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+void Runner::measure(const std::string &name, const std::function<void()> &operation)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Warm up caches and lazily built state.
+    operation();
+
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t allocations = allocationCount.load(std::memory_order_relaxed);
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            operation();
+        }
+        Clock::duration elapsed = Clock::now() - start;
+        allocations = allocationCount.load(std::memory_order_relaxed) - allocations;
+
+        if (elapsed >= mMinTime || iterations >= (1ull << 30)) {
+            double ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count();
+            double allocationsPerOp = (double)allocations / iterations;
+
+            std::vector<double> samples = sample(operation, iterations);
+            double p50 = samples[SAMPLES / 2];
+            double p90 = samples[SAMPLES * 9 / 10];
+            double p99 = samples[SAMPLES * 99 / 100];
+
+            mResults.push_back({name, iterations, ns / iterations, allocationsPerOp, p50, p90, p99});
+            fprintf(mOut, "%-56s %12llu %14.1f ns/op %8.2f allocs/op %12.1f p50 %12.1f p99\n", name.c_str(),
+                    (unsigned long long)iterations, ns / iterations, allocationsPerOp, p50, p99);
+            fflush(mOut);
+            return;
+        }
+
+        iterations *= 2;
+    }
+}
+
+} // namespace bench
+
+// Count heap allocations, array and nothrow versions forward to these by default.
+void *operator new(size_t size)
+{
+    bench::allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+// Prints the results as JSON, for tracking between releases.
+static void printJson(const std::vector<bench::Runner::Result> &results)
+{
+    printf("{\"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench::Runner::Result &result = results[i];
+        printf("%s\n  {\"name\": \"%s\", \"iterations\": %llu, \"nsPerOp\": %.1f, \"allocsPerOp\": %.2f, "
+               "\"p50Ns\": %.1f, \"p90Ns\": %.1f, \"p99Ns\": %.1f}",
+               i ? "," : "", result.name.c_str(), (unsigned long long)result.iterations, result.nsPerOp,
+               result.allocationsPerOp, result.p50Ns, result.p90Ns, result.p99Ns);
+    }
+    printf("\n]}\n");
+}
+
+// Usage: videooutput-bench [--json] [suite filter]
+// With --json the table goes to stderr and the results are printed to stdout as JSON.
+int main(int argc, char *argv[])
+{
+    const char *filter = nullptr;
+    bool json          = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    FILE *out = json ? stderr : stdout;
+    bench::Runner runner(out);
+    for (const bench::Suite &suite : bench::suites()) {
+        if (filter && !strstr(suite.name, filter)) {
+            continue;
+        }
+
+        fprintf(out, "== %s\n", suite.name);
+        suite.function(runner);
+    }
+
+    if (json) {
+        printJson(runner.results());
+    }
+
+    return 0;
+}
@@ -0,0 +1,447 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Replays a traffic capture (see LSHelpers::Capture and the debug/setCapture method) against the
+// complete service, running in-process on the fake bus (fakebus.h) with the VAL implementation it is
+// linked with. Every captured call is made again from a client named after the captured sender,
+// so rate limits and per app state apply like they did on the device.
+//
+// With --speed 1 the calls are made at the times they were captured, with --speed 2 twice as fast.
+// With --speed 0 they are made as fast as the service answers, with up to --window calls waiting
+// for a reply. Calls to /debug methods are not replayed.
+//
+// Reported are the latencies per method, from the call to its (first) reply, in microseconds,
+// the HAL calls the replay made, and the subscription updates sent compared to the capture.
+//
+// Usage: videooutput-replay [--speed X] [--window N] [--timeout SECONDS] [--json] [--journal FILE] CAPTURE
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+#include <val_api.h>
+
+#include "fakebus.h"
+#include "haljournal.h"
+#include "logging.h"
+#include "serviceundertest.h"
+
+using namespace pbnjson;
+using LSHelpers::Capture;
+
+PmLogContext logContext;
+
+namespace
+{
+
+gdouble speed       = 1.0;
+gint window         = 8;
+gint timeoutSeconds = 600;
+gboolean jsonOutput = FALSE;
+gchar *journalFile  = nullptr;
+
+// HAL calls kept for --journal, enough for long runs.
+const size_t JOURNAL_CAPACITY = 256 * 1024;
+
+GOptionEntry options[] = {
+    {"speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed, "Replay speed, 1 - as captured, 0 - as fast as possible", "X"},
+    {"window", 'w', 0, G_OPTION_ARG_INT, &window, "Calls waiting for a reply at --speed 0", "N"},
+    {"timeout", 't', 0, G_OPTION_ARG_INT, &timeoutSeconds, "Stop after this many seconds", "SECONDS"},
+    {"json", 'j', 0, G_OPTION_ARG_NONE, &jsonOutput, "Print the results as JSON", ""},
+    {"journal", 0, 0, G_OPTION_ARG_STRING, &journalFile, "Write the HAL calls of the run to FILE", "FILE"},
+    {NULL, ' ', 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+// Sender of calls captured without one, or with the name of a service the replay runs itself.
+const char *const UNKNOWN_SENDER = "com.webos.app.replay";
+
+LSHelpers::Histogram &latency(const std::string &path)
+{
+    return LSHelpers::MetricsRegistry::global().histogram("replay." + path + "Us");
+}
+
+LSHelpers::Counter &errors(const std::string &path)
+{
+    return LSHelpers::MetricsRegistry::global().counter("replay." + path + ".errors");
+}
+
+LSHelpers::Histogram &scheduleLag() { return LSHelpers::MetricsRegistry::global().histogram("replay.scheduleLagUs"); }
+
+LSHelpers::Counter &subscriptionUpdates()
+{
+    return LSHelpers::MetricsRegistry::global().counter("replay.subscriptionUpdates");
+}
+
+// One captured sender.
+struct Client {
+    explicit Client(const std::string &name, GMainLoop *loop) : handle(name.c_str()), client(&handle)
+    {
+        handle.attachToLoop(loop);
+    }
+
+    LS::Handle handle;
+    LSHelpers::ServicePoint client;
+};
+
+struct Call {
+    gint64 time; // Since the first call, microseconds
+    std::string path;
+    std::string sender;
+    JValue params;
+    bool subscribe;
+};
+
+class Replay
+{
+public:
+    Replay(std::vector<Call> calls, GMainLoop *loop)
+        : mCalls(std::move(calls)), mLoop(loop), mNext(0), mOutstanding(0), mStart(0), mTimer(0)
+    {
+    }
+
+    ~Replay()
+    {
+        if (mTimer) {
+            g_source_remove(mTimer);
+        }
+    }
+
+    Replay(const Replay &) = delete;
+    Replay &operator=(const Replay &) = delete;
+
+    // Methods in the order they first appear in the capture.
+    std::vector<std::string> methods() const
+    {
+        std::vector<std::string> result;
+        for (const Call &call : mCalls) {
+            if (std::find(result.begin(), result.end(), call.path) == result.end()) {
+                result.push_back(call.path);
+            }
+        }
+        return result;
+    }
+
+    void start()
+    {
+        mStart = g_get_monotonic_time();
+        issueDue();
+    }
+
+private:
+    static gboolean timerCB(gpointer data)
+    {
+        Replay *replay = static_cast<Replay *>(data);
+        replay->mTimer = 0;
+        replay->issueDue();
+        return G_SOURCE_REMOVE;
+    }
+
+    gint64 dueTime(const Call &call) const { return mStart + static_cast<gint64>(call.time / speed); }
+
+    void issueDue()
+    {
+        if (speed <= 0) {
+            while (mNext < mCalls.size() && mOutstanding < window) {
+                issue(mCalls[mNext++]);
+            }
+        } else {
+            gint64 now = g_get_monotonic_time();
+            while (mNext < mCalls.size() && dueTime(mCalls[mNext]) <= now) {
+                scheduleLag().record(static_cast<uint64_t>(now - dueTime(mCalls[mNext])));
+                issue(mCalls[mNext++]);
+            }
+            if (mNext < mCalls.size() && !mTimer) {
+                guint delayMs = static_cast<guint>((dueTime(mCalls[mNext]) - now + 999) / 1000);
+                mTimer        = g_timeout_add(delayMs, &Replay::timerCB, this);
+            }
+        }
+
+        checkDone();
+    }
+
+    void issue(const Call &call)
+    {
+        std::string path = call.path;
+        gint64 start     = g_get_monotonic_time();
+        auto replied     = std::make_shared<bool>(false);
+
+        auto handleReply = [this, path, start, replied](LSHelpers::JsonResponse &response) {
+            // Further replies are subscription updates.
+            if (*replied) {
+                subscriptionUpdates().add();
+                return;
+            }
+            *replied = true;
+
+            latency(path).record(static_cast<uint64_t>(g_get_monotonic_time() - start));
+            if (!response.isSuccess() || !response.getJson()["returnValue"].asBool()) {
+                errors(path).add();
+            }
+            mOutstanding--;
+            issueDue();
+        };
+
+        std::string uri                 = std::string("luna://") + ServiceUnderTest::SERVICE_NAME + call.path;
+        LSHelpers::ServicePoint &client = this->client(call.sender).client;
+        mOutstanding++;
+        if (call.subscribe) {
+            client.callMultiReply(uri, call.params, handleReply);
+        } else {
+            client.callOneReply(uri, call.params, handleReply);
+        }
+    }
+
+    Client &client(const std::string &sender)
+    {
+        std::unique_ptr<Client> &client = mClients[sender];
+        if (!client) {
+            client.reset(new Client(sender, mLoop));
+        }
+        return *client;
+    }
+
+    void checkDone()
+    {
+        if (mNext == mCalls.size() && mOutstanding == 0) {
+            g_main_loop_quit(mLoop);
+        }
+    }
+
+    std::vector<Call> mCalls;
+    GMainLoop *mLoop;
+    size_t mNext;
+    gint mOutstanding;
+    gint64 mStart;
+    guint mTimer;
+    std::map<std::string, std::unique_ptr<Client>> mClients; // By sender, subscriptions stay open
+};
+
+// Calls to replay, in capture order. Counts the subscription updates the capture holds.
+bool loadCalls(const std::string &path, std::vector<Call> &calls, uint64_t &capturedPosts, uint64_t &skipped)
+{
+    std::vector<Capture::Record> records;
+    std::string error;
+    if (!Capture::load(path, records, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return false;
+    }
+
+    gint64 first = -1;
+    for (const Capture::Record &record : records) {
+        if (record.type == Capture::RecordType::Post) {
+            capturedPosts++;
+            continue;
+        }
+
+        JValue params = JDomParser::fromString(record.payload);
+        if (record.type != Capture::RecordType::Call || record.name.compare(0, 7, "/debug/") == 0 ||
+            !params.isObject()) {
+            skipped++;
+            continue;
+        }
+
+        std::string sender = record.sender;
+        if (sender.empty() || sender == ServiceUnderTest::SERVICE_NAME || sender == FakeSettingsService::SERVICE_NAME) {
+            sender = UNKNOWN_SENDER;
+        }
+
+        if (first < 0) {
+            first = record.time;
+        }
+        bool subscribe = params["subscribe"].isBoolean() && params["subscribe"].asBool();
+        calls.push_back(Call{record.time - first, record.name, sender, params, subscribe});
+    }
+
+    return true;
+}
+
+uint64_t replayedPosts() { return LSHelpers::MetricsRegistry::global().counter("subscription.posts").value(); }
+
+// HAL call histograms recorded by VAL_CALL, by name.
+JValue halHistograms()
+{
+    JObject result;
+    for (const JValue::KeyValue &item : LSHelpers::MetricsRegistry::global().toJValue()["histograms"].children()) {
+        if (item.first.asString().compare(0, 4, "val.") == 0) {
+            result.put(item.first.asString(), item.second);
+        }
+    }
+    return result;
+}
+
+// HAL calls made during the service setup, not counted in the results.
+JValue setupHalCalls;
+
+// HAL call histograms, with the calls made during the setup taken out of the counts.
+// The percentiles include the setup calls.
+JValue halCalls()
+{
+    JValue result = halHistograms();
+    for (const JValue::KeyValue &item : setupHalCalls.children()) {
+        std::string name = item.first.asString();
+        int64_t count    = result[name]["count"].asNumber<int64_t>() - item.second["count"].asNumber<int64_t>();
+        if (count > 0) {
+            JValue stats = result[name];
+            stats.put("count", count);
+        } else {
+            result.remove(name);
+        }
+    }
+    return result;
+}
+
+void printTable(const std::vector<std::string> &methods, double elapsedSeconds, uint64_t capturedPosts,
+                uint64_t skipped)
+{
+    uint64_t totalCalls = 0;
+
+    printf("%-32s %10s %8s %10s %10s %10s\n", "method", "calls", "errors", "p50 us", "p99 us", "max us");
+    for (const std::string &method : methods) {
+        LSHelpers::Histogram &histogram = latency(method);
+        totalCalls += histogram.count();
+        printf("%-32s %10llu %8llu %10llu %10llu %10llu\n", method.c_str(), (unsigned long long)histogram.count(),
+               (unsigned long long)errors(method).value(), (unsigned long long)histogram.percentile(0.5),
+               (unsigned long long)histogram.percentile(0.99), (unsigned long long)histogram.max());
+    }
+
+    printf("\n%-32s %10s %10s %10s\n", "HAL call", "calls", "p50 us", "p99 us");
+    for (const JValue::KeyValue &item : halCalls().children()) {
+        printf("%-32s %10lld %10lld %10lld\n", item.first.asString().c_str(),
+               (long long)item.second["count"].asNumber<int64_t>(), (long long)item.second["p50"].asNumber<int64_t>(),
+               (long long)item.second["p99"].asNumber<int64_t>());
+    }
+
+    printf("\n%llu calls in %.2f s, %.0f calls/s, %llu records skipped\n", (unsigned long long)totalCalls,
+           elapsedSeconds, totalCalls / elapsedSeconds, (unsigned long long)skipped);
+    printf("subscription posts: %llu replayed, %llu captured, %llu updates received\n",
+           (unsigned long long)replayedPosts(), (unsigned long long)capturedPosts,
+           (unsigned long long)subscriptionUpdates().value());
+    if (speed > 0) {
+        printf("schedule lag: p99 %llu us, max %llu us\n", (unsigned long long)scheduleLag().percentile(0.99),
+               (unsigned long long)scheduleLag().max());
+    }
+}
+
+void printJson(const std::vector<std::string> &methods, double elapsedSeconds, uint64_t capturedPosts,
+               uint64_t skipped)
+{
+    JObject calls;
+    for (const std::string &method : methods) {
+        JValue stats = latency(method).toJValue();
+        stats.put("errors", static_cast<int64_t>(errors(method).value()));
+        calls.put(method, stats);
+    }
+
+    JObject result{{"elapsedMs", static_cast<int64_t>(elapsedSeconds * 1000)},
+                   {"methods", calls},
+                   {"hal", halCalls()},
+                   {"skipped", static_cast<int64_t>(skipped)},
+                   {"subscriptionPosts",
+                    JObject{{"replayed", static_cast<int64_t>(replayedPosts())},
+                            {"captured", static_cast<int64_t>(capturedPosts)},
+                            {"updatesReceived", static_cast<int64_t>(subscriptionUpdates().value())}}}};
+    if (speed > 0) {
+        result.put("scheduleLagUs", scheduleLag().toJValue());
+    }
+    printf("%s\n", result.stringify("  ").c_str());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context = g_option_context_new("CAPTURE");
+    GError *err             = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        fprintf(stderr, "%s\n", err ? err->message : "Invalid options");
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s [--speed X] [--window N] [--timeout SECONDS] [--json] [--journal FILE] CAPTURE\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Call> calls;
+    uint64_t capturedPosts = 0;
+    uint64_t skipped       = 0;
+    if (!loadCalls(argv[1], calls, capturedPosts, skipped)) {
+        return EXIT_FAILURE;
+    }
+
+    if (PmLogGetContext("videooutputd", &logContext) != kPmLogErr_None) {
+        fprintf(stderr, "Failed to set up log context\n");
+        return EXIT_FAILURE;
+    }
+
+    GMainLoop *mainLoop = g_main_loop_new(NULL, FALSE);
+
+    VAL *val = VAL::getInstance();
+    if (!val->initialize()) {
+        fprintf(stderr, "VAL initialization failed\n");
+        return EXIT_FAILURE;
+    }
+
+    double elapsedSeconds;
+    bool journalWritten = true;
+    std::vector<std::string> methods;
+    {
+        ServiceUnderTest service(mainLoop);
+        setupHalCalls = halHistograms();
+        if (journalFile) {
+            // Only the calls of the run, not of the setup.
+            HalJournal::setCapacity(JOURNAL_CAPACITY);
+            HalJournal::clear();
+            HalJournal::setEnabled(true);
+        }
+        Replay replay(std::move(calls), mainLoop);
+        methods = replay.methods();
+
+        g_timeout_add_seconds(timeoutSeconds,
+                              [](gpointer loop) -> gboolean {
+                                  fprintf(stderr, "Timed out, results are incomplete\n");
+                                  g_main_loop_quit(static_cast<GMainLoop *>(loop));
+                                  return G_SOURCE_REMOVE;
+                              },
+                              mainLoop);
+
+        gint64 start = g_get_monotonic_time();
+        replay.start();
+        g_main_loop_run(mainLoop);
+        elapsedSeconds = (g_get_monotonic_time() - start) / 1e6;
+
+        // Before the service is torn down, which disconnects the sinks.
+        journalWritten = !journalFile || writeHalJournal(journalFile);
+    }
+
+    if (jsonOutput) {
+        printJson(methods, elapsedSeconds, capturedPosts, skipped);
+    } else {
+        printTable(methods, elapsedSeconds, capturedPosts, skipped);
+    }
+
+    g_main_loop_unref(mainLoop);
+    val->deinitialize();
+    return journalWritten ? EXIT_SUCCESS : EXIT_FAILURE;
+}
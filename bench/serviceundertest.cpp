@@ -0,0 +1,57 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+
+#include "haljournal.h"
+#include "serviceundertest.h"
+
+const char *const ServiceUnderTest::SERVICE_NAME = "com.webos.service.videooutput";
+
+ServiceUnderTest::ServiceUnderTest(GMainLoop *loop)
+    : mSettingsHandle(FakeSettingsService::SERVICE_NAME), mServiceHandle(SERVICE_NAME), mSnapshot("")
+{
+    // The settings service answers from the start, the service subscribes to it while it is set up.
+    mSettings.reset(new FakeSettingsService(mSettingsHandle));
+    mSettingsHandle.attachToLoop(loop);
+
+    // VAL is initialized before, so the service is ready right away.
+    mVideo.reset(new VideoService(mServiceHandle));
+    mVideo->halInitialized();
+    mSystemProperties.reset(new SystemPropertyService(mServiceHandle, *mVideo));
+#if !USE_RPI_RESOURCE
+    mPictureSettings.reset(new PictureSettings(mServiceHandle, *mVideo, mSnapshot));
+#endif
+    mArcSetting.reset(new AspectRatioSetting(mServiceHandle, *mVideo, mSnapshot));
+    mServiceHandle.attachToLoop(loop);
+}
+
+bool writeHalJournal(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    std::string journal = HalJournal::toJValue().stringify("  ");
+    bool written        = fputs(journal.c_str(), file) >= 0;
+    written             = fclose(file) == 0 && written;
+    if (!written) {
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    return written;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <memory>
+
+#include <glib.h>
+
+#include "aspectratiosetting.h"
+#include "fakesettings.h"
+#include "picturesettings.h"
+#include "settingssnapshot.h"
+#include "systempropertyservice.h"
+#include "videoservice.h"
+
+// The complete service as main() sets it up, with the fake settings service, on the fake bus
+// (fakebus.h). Used by the tools that drive the service with calls. VAL needs to be initialized first.
+class ServiceUnderTest
+{
+public:
+    static const char *const SERVICE_NAME;
+
+    explicit ServiceUnderTest(GMainLoop *loop);
+    ServiceUnderTest(const ServiceUnderTest &) = delete;
+    ServiceUnderTest &operator=(const ServiceUnderTest &) = delete;
+
+private:
+    // Destroyed in reverse order, the service before the settings it subscribes to.
+    LS::Handle mSettingsHandle;
+    std::unique_ptr<FakeSettingsService> mSettings;
+    LS::Handle mServiceHandle;
+    SettingsSnapshot mSnapshot; // In memory only, so a run does not depend on the ones before
+    std::unique_ptr<VideoService> mVideo;
+    std::unique_ptr<SystemPropertyService> mSystemProperties;
+#if !USE_RPI_RESOURCE
+    std::unique_ptr<PictureSettings> mPictureSettings;
+#endif
+    std::unique_ptr<AspectRatioSetting> mArcSetting;
+};
+
+// Writes the HAL journal (haljournal.h) to a file as JSON, like debug/getHalJournal returns it.
+bool writeHalJournal(const char *path);
@@ -0,0 +1,347 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Startup and shutdown benchmark: starts the complete service on the fake bus (fakebus.h) with the
+// VAL implementation it is linked with, --runs times, each in a new process, and reports how long
+// each startup phase took from the exec of the process.
+//
+// Each run executes this program again with --child. The child sets the service up with the Daemon
+// main() uses (daemon.h), with the fake settings service, makes a first register and connect call,
+// waits --settle milliseconds for the settings subscriptions to be answered, then reads its resident
+// memory and page faults and shuts the service down.
+// It prints the phases and measurements as JSON, the parent collects them over all runs.
+//
+// Phases, in milliseconds since the parent started the child: main, logContext, videoService,
+// busRegistered, halInitStarted, halInitDone, ready, mainLoopEntered, firstConnect, and for each
+// settings subscription <category>Subscribed and <category>Received. VAL is initialized on a worker
+// thread while the loop runs, like on a device, so the first connect waits for it in the service point.
+//
+// The phases depend on the build: with USE_RPI_RESOURCE there are no picture settings. Build the tool
+// for both configurations to compare them, the configuration is part of the report.
+//
+// Usage: videooutput-startup [--runs N] [--settle MS] [--json]
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <glib.h>
+#include <val_api.h>
+
+#include "daemon.h"
+#include "fakebus.h"
+#include "logging.h"
+#include "serviceundertest.h"
+#include "startup.h"
+
+using namespace pbnjson;
+
+PmLogContext logContext;
+
+namespace
+{
+
+gint runCount         = 20;
+gint settleMs         = 500;
+gint timeoutSeconds   = 30;
+gboolean jsonOutput   = FALSE;
+gchar *childSpawnedMs = nullptr;
+
+GOptionEntry options[] = {
+    {"runs", 'r', 0, G_OPTION_ARG_INT, &runCount, "Processes to start", "N"},
+    {"settle", 's', 0, G_OPTION_ARG_INT, &settleMs, "Wait after the first connect before measuring", "MS"},
+    {"timeout", 't', 0, G_OPTION_ARG_INT, &timeoutSeconds, "Fail a run that takes longer", "SECONDS"},
+    {"json", 'j', 0, G_OPTION_ARG_NONE, &jsonOutput, "Print the results as JSON", ""},
+    {"child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &childSpawnedMs, "Run once, started at MS", "MS"},
+    {NULL, ' ', 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
+};
+
+#if USE_RPI_RESOURCE
+const char *const CONFIGURATION = "USE_RPI_RESOURCE";
+#else
+const char *const CONFIGURATION = "default";
+#endif
+
+// Same clock as the Startup phases.
+double sinceBootMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// Resident memory from /proc/self/statm, 0 if it can not be read.
+int64_t residentKb()
+{
+    long pages    = 0;
+    FILE *statm   = fopen("/proc/self/statm", "r");
+    bool readable = statm && fscanf(statm, "%*s %ld", &pages) == 1;
+    if (statm)
+        fclose(statm);
+    return readable ? static_cast<int64_t>(pages) * (sysconf(_SC_PAGESIZE) / 1024) : 0;
+}
+
+// One run, in the child process. Prints the result as JSON on stdout.
+int runChild(double spawnedMs)
+{
+    Startup::mark("main");
+    if (PmLogGetContext("videooutputd", &logContext) != kPmLogErr_None) {
+        fprintf(stderr, "Failed to set up log context\n");
+        return EXIT_FAILURE;
+    }
+    Startup::mark("logContext");
+
+    GMainLoop *mainLoop = g_main_loop_new(NULL, FALSE);
+    VAL *val            = VAL::getInstance();
+    bool connected      = false;
+
+    // The settings service answers from the start, the service subscribes to it once the HAL is initialized.
+    LS::Handle settingsHandle(FakeSettingsService::SERVICE_NAME);
+    FakeSettingsService settings(settingsHandle);
+    settingsHandle.attachToLoop(mainLoop);
+
+    // Set up by the same code as in main(). The settings snapshot is in memory only, so a run does not
+    // depend on the ones before.
+    std::unique_ptr<Daemon> daemon(new Daemon(mainLoop, val, ServiceUnderTest::SERVICE_NAME, "", "", ""));
+
+    // A video app, as the first client after startup.
+    LS::Handle appHandle("com.webos.app.startup");
+    LSHelpers::ServicePoint app(&appHandle);
+    appHandle.attachToLoop(mainLoop);
+
+    const std::string service = std::string("luna://") + ServiceUnderTest::SERVICE_NAME;
+    JObject context{{"context", "pipeline_startup"}};
+    app.callOneReply(service + "/register", context, [&](LSHelpers::JsonResponse &) {
+        app.callOneReply(service + "/connect",
+                         JObject{{"appId", appHandle.getName()},
+                                 {"context", "pipeline_startup"},
+                                 {"source", "VDEC"},
+                                 {"sourcePort", 0},
+                                 {"sink", "MAIN"}},
+                         [&](LSHelpers::JsonResponse &response) {
+                             connected = response.isSuccess() && response.getJson()["returnValue"].asBool();
+                             Startup::mark("firstConnect");
+                             g_timeout_add(settleMs,
+                                           [](gpointer loop) -> gboolean {
+                                               g_main_loop_quit(static_cast<GMainLoop *>(loop));
+                                               return G_SOURCE_REMOVE;
+                                           },
+                                           mainLoop);
+                         });
+    });
+
+    g_idle_add_full(G_PRIORITY_HIGH,
+                    [](gpointer) -> gboolean {
+                        Startup::mark("mainLoopEntered");
+                        return G_SOURCE_REMOVE;
+                    },
+                    nullptr, nullptr);
+    g_timeout_add_seconds(timeoutSeconds,
+                          [](gpointer) -> gboolean {
+                              fprintf(stderr, "Timed out\n");
+                              exit(EXIT_FAILURE);
+                              return G_SOURCE_REMOVE;
+                          },
+                          nullptr);
+    g_main_loop_run(mainLoop);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    int64_t rssKb = residentKb();
+
+    double shutdownStart = sinceBootMs();
+    daemon.reset();
+    val->deinitialize();
+    double shutdownMs = sinceBootMs() - shutdownStart;
+
+    JArray phases;
+    for (const JValue &phase : Startup::toJValue()["phases"].items()) {
+        phases.append(JObject{{"name", phase["name"]},
+                              {"sinceSpawnMs", phase["sinceBootMs"].asNumber<double>() - spawnedMs}});
+    }
+
+    JObject result{{"phases", phases},
+                   {"connected", connected},
+                   {"rssKb", rssKb},
+                   {"maxRssKb", static_cast<int64_t>(usage.ru_maxrss)},
+                   {"minorFaults", static_cast<int64_t>(usage.ru_minflt)},
+                   {"majorFaults", static_cast<int64_t>(usage.ru_majflt)},
+                   {"shutdownMs", shutdownMs}};
+    printf("%s\n", result.stringify().c_str());
+
+    g_main_loop_unref(mainLoop);
+    return EXIT_SUCCESS;
+}
+
+// Samples of one measurement over all runs.
+struct Samples {
+    std::vector<double> values;
+
+    double at(double fraction) const
+    {
+        std::vector<double> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+    }
+
+    JValue toJValue() const
+    {
+        return JObject{{"runs", static_cast<int64_t>(values.size())},
+                       {"min", at(0)},
+                       {"p50", at(0.5)},
+                       {"p90", at(0.9)},
+                       {"max", at(1)}};
+    }
+};
+
+// Runs a child and adds its result to the samples. Phases keep the order they were first seen in.
+bool runOnce(const char *program, std::vector<std::string> &phaseOrder, std::map<std::string, Samples> &phases,
+             std::map<std::string, Samples> &measurements)
+{
+    std::string settle  = std::to_string(settleMs);
+    std::string timeout = std::to_string(timeoutSeconds);
+    gchar *output       = nullptr;
+    gint status         = 0;
+    GError *err         = nullptr;
+
+    // Taken last, right before the child is started.
+    std::string spawned = std::to_string(sinceBootMs());
+    const gchar *argv[] = {program,        "--child",   spawned.c_str(), "--settle",
+                           settle.c_str(), "--timeout", timeout.c_str(), nullptr};
+
+    if (!g_spawn_sync(nullptr, const_cast<gchar **>(argv), nullptr, G_SPAWN_DEFAULT, nullptr, nullptr, &output,
+                      nullptr, &status, &err) ||
+        !g_spawn_check_exit_status(status, &err)) {
+        fprintf(stderr, "Run failed: %s\n", err ? err->message : "unknown error");
+        g_clear_error(&err);
+        g_free(output);
+        return false;
+    }
+
+    JValue result = JDomParser::fromString(output, JSchema::AllSchema());
+    g_free(output);
+    if (!result.isObject() || !result["connected"].asBool()) {
+        fprintf(stderr, "Run failed: no connect\n");
+        return false;
+    }
+
+    for (const JValue &phase : result["phases"].items()) {
+        std::string name = phase["name"].asString();
+        if (phases.find(name) == phases.end())
+            phaseOrder.push_back(name);
+        phases[name].values.push_back(phase["sinceSpawnMs"].asNumber<double>());
+    }
+
+    for (const char *name : {"rssKb", "maxRssKb", "minorFaults", "majorFaults", "shutdownMs"}) {
+        measurements[name].values.push_back(result[name].asNumber<double>());
+    }
+    return true;
+}
+
+void printTable(const std::vector<std::string> &phaseOrder, std::map<std::string, Samples> &phases,
+                std::map<std::string, Samples> &measurements)
+{
+    printf("configuration: %s\n\n", CONFIGURATION);
+    printf("%-28s %6s %10s %10s %10s %10s\n", "phase, ms since exec", "runs", "min", "p50", "p90", "max");
+    for (const std::string &name : phaseOrder) {
+        const Samples &samples = phases[name];
+        printf("%-28s %6zu %10.2f %10.2f %10.2f %10.2f\n", name.c_str(), samples.values.size(), samples.at(0),
+               samples.at(0.5), samples.at(0.9), samples.at(1));
+    }
+
+    printf("\n%-28s %6s %10s %10s %10s %10s\n", "steady state", "runs", "min", "p50", "p90", "max");
+    for (const auto &measurement : measurements) {
+        const Samples &samples = measurement.second;
+        printf("%-28s %6zu %10.2f %10.2f %10.2f %10.2f\n", measurement.first.c_str(), samples.values.size(),
+               samples.at(0), samples.at(0.5), samples.at(0.9), samples.at(1));
+    }
+}
+
+void printJson(const std::vector<std::string> &phaseOrder, std::map<std::string, Samples> &phases,
+               std::map<std::string, Samples> &measurements, int failed)
+{
+    JArray phaseList;
+    for (const std::string &name : phaseOrder) {
+        JValue stats = phases[name].toJValue();
+        stats.put("name", name);
+        phaseList.append(stats);
+    }
+
+    JObject steady;
+    for (const auto &measurement : measurements) {
+        steady.put(measurement.first, measurement.second.toJValue());
+    }
+
+    JObject result{{"configuration", CONFIGURATION}, {"failedRuns", failed}, {"phases", phaseList},
+                   {"steadyState", steady}};
+    printf("%s\n", result.stringify("  ").c_str());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context = g_option_context_new(NULL);
+    GError *err             = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        fprintf(stderr, "%s\n", err ? err->message : "Invalid options");
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (childSpawnedMs)
+        return runChild(g_ascii_strtod(childSpawnedMs, nullptr));
+
+    // The child is found the way this program was, through /proc so a relative argv[0] works too.
+    gchar *program = g_file_read_link("/proc/self/exe", nullptr);
+    if (!program) {
+        fprintf(stderr, "Failed to find the program\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> phaseOrder;
+    std::map<std::string, Samples> phases;
+    std::map<std::string, Samples> measurements;
+    int failed = 0;
+    for (gint i = 0; i < runCount; i++) {
+        if (!runOnce(program, phaseOrder, phases, measurements))
+            failed++;
+    }
+    g_free(program);
+
+    if (failed == runCount) {
+        fprintf(stderr, "All runs failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (jsonOutput) {
+        printJson(phaseOrder, phases, measurements, failed);
+    } else {
+        printTable(phaseOrder, phases, measurements);
+        if (failed > 0)
+            printf("\n%d of %d runs failed\n", failed, runCount);
+    }
+
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// getStatus replies and status subscription updates for N sinks and M registered clients.
+// All sinks are connected, so every sink looks up its client among the M clients.
+// "build" is VideoService::buildStatus, "payload" adds the stringify done once per update before
+// SubscriptionPoint::post hands the same string to every subscriber.
+
+#include <memory>
+
+#include "benchmark.h"
+#include "videoservice.h"
+
+namespace {
+
+VideoServiceState makeState(size_t sinks, size_t clients)
+{
+    VideoServiceState state;
+
+    for (size_t i = 0; i < clients; i++) {
+        VideoClient client("pipeline_" + std::to_string(i));
+        client.available   = true;
+        client.sourceName  = "VDEC";
+        client.contentType = "media";
+        client.frameRate   = 29.97;
+        client.sourceRect  = VideoRect(1920, 1080);
+        state.clients.push_back(client);
+    }
+
+    for (size_t i = 0; i < sinks; i++) {
+        VideoSink sink(i == 0 ? "MAIN" : "SUB" + std::to_string(i - 1), static_cast<uint8_t>(i),
+                       static_cast<VAL_VIDEO_WID_T>(i));
+        sink.connected        = true;
+        sink.muted            = false;
+        sink.scaledOutputRect = VideoRect(0, 0, 1920, 1080);
+        sink.appliedInputRect = VideoRect(0, 0, 1920, 1080);
+
+        // Connected clients are the last ones registered, the worst case for the lookup.
+        VideoClient &client    = state.clients[clients - sinks + i];
+        client.activation      = true;
+        client.sinkName        = sink.name;
+        sink.connectedClientId = client.clientId;
+        state.sinks.push_back(sink);
+    }
+
+    return state;
+}
+
+void measureStatus(bench::Runner &runner, size_t sinks, size_t clients)
+{
+    std::shared_ptr<VideoServiceState> state = std::make_shared<VideoServiceState>(makeState(sinks, clients));
+    std::string name = "status/" + std::to_string(sinks) + "x" + std::to_string(clients);
+
+    runner.measure(name + "/build", [state]() { bench::doNotOptimize(VideoService::buildStatus(*state)); });
+    runner.measure(name + "/payload", [state]() {
+        pbnjson::JValue response = VideoService::buildStatus(*state);
+        response.put("subscribed", true);
+        bench::doNotOptimize(response.stringify());
+    });
+}
+
+void statusBench(bench::Runner &runner)
+{
+    measureStatus(runner, 1, 1);
+    measureStatus(runner, 2, 16);
+    measureStatus(runner, 2, 64);
+}
+
+} // namespace
+
+BENCHMARK_SUITE("status", statusBench);
@@ -0,0 +1,139 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Subscriber bookkeeping with 1k subscribers.
+// "linear" models the previous SubscriptionPoint: a vector scanned on every cancel and copied on every post.
+// "registry" is the SubscriberRegistry used by SubscriptionPoint now.
+// Messages are modelled with shared_ptr, copying one costs an atomic increment just like LSMessageRef.
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <subscriberregistry.hpp>
+
+#include "benchmark.h"
+
+namespace {
+
+const size_t SUBSCRIBERS = 1000;
+const size_t SUBSCRIBERS_PER_SENDER = 10;
+
+typedef std::shared_ptr<int> Message;
+
+std::string tokenName(size_t i) { return "com.webos.app.client-" + std::to_string(i) + ".1234"; }
+std::string senderName(size_t i) { return "com.webos.app.client-" + std::to_string(i / SUBSCRIBERS_PER_SENDER); }
+
+struct LinearItem {
+    std::string token;
+    std::string sender;
+    Message message;
+};
+
+class LinearList
+{
+public:
+    void add(size_t i) { mItems.emplace_back(new LinearItem{tokenName(i), senderName(i), std::make_shared<int>(i)}); }
+
+    void cancel(const char *token)
+    {
+        auto it = std::find_if(mItems.begin(), mItems.end(), [token](std::unique_ptr<LinearItem> &item) {
+            return !strcmp(token, item->token.c_str());
+        });
+        if (it != mItems.end()) {
+            mItems.erase(it);
+        }
+    }
+
+    // Previously every subscription had its own status watch, so a sender going down
+    // triggered one linear removal per subscription.
+    void senderDown(const std::string &sender)
+    {
+        for (size_t n = 0; n < SUBSCRIBERS_PER_SENDER; n++) {
+            auto it = std::find_if(mItems.begin(), mItems.end(),
+                                   [&sender](std::unique_ptr<LinearItem> &item) { return item->sender == sender; });
+            if (it != mItems.end()) {
+                mItems.erase(it);
+            }
+        }
+    }
+
+    std::vector<Message> post() const
+    {
+        std::vector<Message> messages;
+        for (auto &item : mItems) {
+            messages.push_back(item->message);
+        }
+        return messages;
+    }
+
+private:
+    std::vector<std::unique_ptr<LinearItem>> mItems;
+};
+
+void addToRegistry(LSHelpers::SubscriberRegistry<Message> &registry, size_t i)
+{
+    registry.add(tokenName(i), senderName(i), std::make_shared<int>(i));
+}
+
+void subscriptionBench(bench::Runner &runner)
+{
+    LinearList linear;
+    LSHelpers::SubscriberRegistry<Message> registry;
+    for (size_t i = 0; i < SUBSCRIBERS; i++) {
+        linear.add(i);
+        addToRegistry(registry, i);
+    }
+
+    runner.measure("subscriptions/1k/post/linear", [&]() { bench::doNotOptimize(linear.post()); });
+    runner.measure("subscriptions/1k/post/registry", [&]() { bench::doNotOptimize(registry.snapshot()); });
+
+    // Cancel the last subscriber (worst case for the scan) and add it back.
+    const std::string lastToken = tokenName(SUBSCRIBERS - 1);
+    runner.measure("subscriptions/1k/cancel+add/linear", [&]() {
+        linear.cancel(lastToken.c_str());
+        linear.add(SUBSCRIBERS - 1);
+    });
+    runner.measure("subscriptions/1k/cancel+add/registry", [&]() {
+        registry.remove(lastToken);
+        addToRegistry(registry, SUBSCRIBERS - 1);
+    });
+
+    // Cancel and add followed by a post, snapshot has to be rebuilt once.
+    runner.measure("subscriptions/1k/cancel+add+post/registry", [&]() {
+        registry.remove(lastToken);
+        addToRegistry(registry, SUBSCRIBERS - 1);
+        bench::doNotOptimize(registry.snapshot());
+    });
+
+    const std::string lastSender = senderName(SUBSCRIBERS - 1);
+    runner.measure("subscriptions/1k/sender-down+resubscribe/linear", [&]() {
+        linear.senderDown(lastSender);
+        for (size_t i = SUBSCRIBERS - SUBSCRIBERS_PER_SENDER; i < SUBSCRIBERS; i++) {
+            linear.add(i);
+        }
+    });
+    runner.measure("subscriptions/1k/sender-down+resubscribe/registry", [&]() {
+        registry.removeGroup(lastSender);
+        for (size_t i = SUBSCRIBERS - SUBSCRIBERS_PER_SENDER; i < SUBSCRIBERS; i++) {
+            addToRegistry(registry, i);
+        }
+    });
+}
+
+} // namespace
+
+BENCHMARK_SUITE("subscriptions", subscriptionBench);
@@ -0,0 +1,44 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// VideoInfoMedia::set with the videoInfo object of a setVideoData call from a VDEC pipeline.
+// "set" starts from the parsed object, "parse+set" includes parsing the payload like the handler does.
+
+#include <memory>
+
+#include "benchmark.h"
+#include "videoinfotypes.h"
+
+namespace {
+
+const char *VIDEO_INFO = "{\"hdrType\":\"HDR10\",\"afd\":8,\"pixelAspectRatio\":{\"width\":1,\"height\":1},"
+                         "\"rotation\":\"Deg0\",\"adaptive\":true,\"path\":\"network\","
+                         "\"vui\":{\"transferCharacteristics\":16},\"sei\":{\"displayPrimariesX0\":13250}}";
+
+void videoInfoBench(bench::Runner &runner)
+{
+    std::shared_ptr<VideoInfoMedia> info = std::make_shared<VideoInfoMedia>("media", "VDEC");
+    pbnjson::JValue videoInfo            = pbnjson::JDomParser::fromString(VIDEO_INFO);
+
+    runner.measure("videoinfo/media/set", [info, videoInfo]() { bench::doNotOptimize(info->set(videoInfo)); });
+    runner.measure("videoinfo/media/parse+set", [info]() {
+        bench::doNotOptimize(info->set(pbnjson::JDomParser::fromString(VIDEO_INFO)));
+    });
+}
+
+} // namespace
+
+BENCHMARK_SUITE("videoinfo", videoInfoBench);
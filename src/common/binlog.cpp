@@ -0,0 +1,246 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "binlog.h"
+#include "metrics.hpp"
+
+namespace BinLog
+{
+
+// Messages in the ring buffer, a power of two. 128 bytes each.
+const size_t RING_SIZE = 1024;
+
+// How often the background thread writes pending messages and checks the log level.
+const std::chrono::milliseconds FLUSH_INTERVAL(100);
+
+std::atomic<bool> debugEnabled(false);
+
+namespace
+{
+
+// Bounded multi producer queue, after Dmitry Vyukov's. The sequence of a record tells
+// producers and the consumer whether it is free, claimed or committed.
+Record ring[RING_SIZE];
+std::atomic<size_t> enqueuePos(0);
+size_t dequeuePos = 0; // Background thread only
+
+PmLogContext logContext = nullptr;
+std::thread consumer;
+std::mutex mutex;
+std::condition_variable stopCondition;
+bool stopping = false;
+
+LSHelpers::Counter &droppedCounter() { return LSHelpers::MetricsRegistry::global().counter("binlog.dropped"); }
+
+void refreshLevel()
+{
+    int level = 0;
+    bool enabled = PmLogGetContextLevel(logContext, &level) == kPmLogErr_None && level >= kPmLogLevel_Debug;
+    debugEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void drain()
+{
+    for (;;) {
+        Record &record = ring[dequeuePos & (RING_SIZE - 1)];
+        if (record.seq.load(std::memory_order_acquire) != dequeuePos + 1)
+            return;
+
+        std::string text = format(record);
+        PmLogDebug(logContext, "%s:%s() %s", record.site->file, record.site->function, text.c_str());
+
+        record.seq.store(dequeuePos + RING_SIZE, std::memory_order_release);
+        dequeuePos++;
+    }
+}
+
+void run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopCondition.wait_for(lock, FLUSH_INTERVAL, []() { return stopping; })) {
+        refreshLevel();
+        drain();
+    }
+    drain();
+}
+
+// Reads the argument at offset, advancing it.
+template <typename T> T read(const Record &record, size_t &offset)
+{
+    T value;
+    memcpy(&value, record.data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+} // namespace
+
+void start(PmLogContext context)
+{
+    if (consumer.joinable())
+        return;
+
+    for (size_t i = 0; i < RING_SIZE; i++)
+        ring[i].seq.store(i, std::memory_order_relaxed);
+
+    logContext = context;
+    stopping   = false;
+    refreshLevel();
+    consumer = std::thread(&run);
+}
+
+void stop()
+{
+    if (!consumer.joinable())
+        return;
+
+    debugEnabled.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopCondition.notify_all();
+    consumer.join();
+}
+
+Record *claim()
+{
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Record &record = ring[pos & (RING_SIZE - 1)];
+        intptr_t diff = static_cast<intptr_t>(record.seq.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                return &record;
+        } else if (diff < 0) {
+            static LSHelpers::Counter &dropped = droppedCounter();
+            dropped.add();
+            return nullptr;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void checkFormat(const char *, ...) {}
+
+void commit(Record *record)
+{
+    record->seq.store(record->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Formats each conversion of the format with the matching stored argument. Integers are stored
+// with 64 bits, so the length modifier of the format is replaced with "ll".
+std::string format(const Record &record)
+{
+    std::string result;
+    size_t arg    = 0;
+    size_t offset = 0;
+    char buffer[128];
+
+    for (const char *p = record.site->format; *p; p++) {
+        if (*p != '%') {
+            result += *p;
+            continue;
+        }
+
+        if (p[1] == '%') {
+            result += '%';
+            p++;
+            continue;
+        }
+
+        // Flags, width and precision are kept.
+        std::string spec = "%";
+        for (p++; *p && strchr("-+ #0123456789.", *p); p++)
+            spec += *p;
+        while (*p && strchr("hlLqjzt", *p))
+            p++;
+        if (!*p)
+            break;
+
+        char conversion = *p;
+        if (arg >= record.count) {
+            result += "?";
+            continue;
+        }
+
+        ArgType type = record.types[arg++];
+        if (type == ArgType::String) {
+            size_t length = static_cast<uint8_t>(record.data[offset]);
+            std::string value(record.data + offset + 1, length);
+            offset += 1 + length;
+
+            snprintf(buffer, sizeof(buffer), (spec + 's').c_str(), value.c_str());
+            result += conversion == 's' ? buffer : "?";
+            continue;
+        }
+
+        uint64_t bits = read<uint64_t>(record, offset);
+        int64_t intValue;
+        double doubleValue;
+        memcpy(&intValue, &bits, sizeof(bits));
+        memcpy(&doubleValue, &bits, sizeof(bits));
+        if (type != ArgType::Double)
+            doubleValue = type == ArgType::Int ? static_cast<double>(intValue) : static_cast<double>(bits);
+        else
+            intValue = static_cast<int64_t>(doubleValue);
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), static_cast<long long>(intValue));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(),
+                     static_cast<unsigned long long>(intValue));
+            break;
+        case 'c':
+            snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), static_cast<int>(intValue));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), doubleValue);
+            break;
+        case 'p':
+            snprintf(buffer, sizeof(buffer), "%p", reinterpret_cast<void *>(static_cast<uintptr_t>(bits)));
+            break;
+        default:
+            snprintf(buffer, sizeof(buffer), "?");
+            break;
+        }
+        result += buffer;
+    }
+
+    return result;
+}
+
+} // namespace BinLog
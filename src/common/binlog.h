@@ -0,0 +1,193 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Debug logging for hot paths.
+//
+// BINLOG_DEBUG takes a printf format like LOG_DEBUG, but does not format on the calling thread.
+// The format and call site are kept in a static per site, the arguments are copied in binary
+// into a lock free ring buffer, and a background thread formats them and writes them to PmLog.
+// Strings are copied, so they may be freed right after the call. Long strings are cut.
+// When the ring buffer is full, messages are dropped and counted in the "binlog.dropped" counter.
+//
+// Nothing is captured when debug level is not enabled for the log context, or before BinLog::start.
+// Build with -DBINLOG_MIN_LEVEL=BINLOG_LEVEL_INFO to remove debug sites from the binary entirely.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <PmLogLib.h>
+
+#define BINLOG_LEVEL_DEBUG 0
+#define BINLOG_LEVEL_INFO 1
+
+#ifndef BINLOG_MIN_LEVEL
+#define BINLOG_MIN_LEVEL BINLOG_LEVEL_DEBUG
+#endif
+
+#if BINLOG_MIN_LEVEL <= BINLOG_LEVEL_DEBUG
+#define BINLOG_DEBUG(fmt, ...)                                                                                         \
+    do {                                                                                                               \
+        if (BinLog::isDebugEnabled()) {                                                                                \
+            static const BinLog::Site binlogSite = {__FILE__, __FUNCTION__, fmt};                                      \
+            BinLog::write(binlogSite, ##__VA_ARGS__);                                                                  \
+        }                                                                                                              \
+        if (false)                                                                                                     \
+            BinLog::checkFormat(fmt, ##__VA_ARGS__);                                                                   \
+    } while (0)
+#else
+#define BINLOG_DEBUG(fmt, ...)                                                                                         \
+    do {                                                                                                               \
+        if (false)                                                                                                     \
+            BinLog::checkFormat(fmt, ##__VA_ARGS__);                                                                   \
+    } while (0)
+#endif
+
+namespace BinLog
+{
+
+// Static description of a log call site.
+struct Site {
+    const char *file;
+    const char *function;
+    const char *format;
+};
+
+enum class ArgType : uint8_t { Int, UInt, Double, String, Pointer };
+
+const size_t MAX_ARGS  = 8;
+const size_t DATA_SIZE = 96; // Bytes of argument data per message
+
+// One message in the ring buffer.
+struct Record {
+    std::atomic<size_t> seq;
+    const Site *site;
+    uint8_t count;
+    uint8_t size;
+    ArgType types[MAX_ARGS];
+    char data[DATA_SIZE];
+};
+
+// Start the background thread that writes messages to the log context.
+void start(PmLogContext context);
+
+// Write the pending messages and stop the background thread.
+void stop();
+
+extern std::atomic<bool> debugEnabled;
+
+inline bool isDebugEnabled() { return debugEnabled.load(std::memory_order_relaxed); }
+
+// Claim a record, nullptr if the buffer is full.
+Record *claim();
+
+// Hand a claimed record to the background thread.
+void commit(Record *record);
+
+// Formats a record like printf would have formatted the call.
+std::string format(const Record &record);
+
+// Never called, lets the compiler check the format against the arguments.
+void checkFormat(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+class Encoder
+{
+public:
+    explicit Encoder(Record &record) : mRecord(record) {}
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T value)
+    {
+        putScalar(ArgType::Int, static_cast<int64_t>(value));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(T value)
+    {
+        putScalar(ArgType::UInt, static_cast<uint64_t>(value));
+    }
+
+    template <typename T> typename std::enable_if<std::is_enum<T>::value>::type put(T value)
+    {
+        putScalar(ArgType::Int, static_cast<int64_t>(value));
+    }
+
+    void put(double value) { putScalar(ArgType::Double, value); }
+    void put(const char *value) { putString(value, value ? strlen(value) : 0); }
+    void put(const std::string &value) { putString(value.data(), value.size()); }
+    void put(const void *value)
+    {
+        putScalar(ArgType::Pointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+    }
+
+private:
+    template <typename T> void putScalar(ArgType type, T value)
+    {
+        if (mRecord.count >= MAX_ARGS || mRecord.size + sizeof(T) > DATA_SIZE)
+            return;
+
+        memcpy(mRecord.data + mRecord.size, &value, sizeof(T));
+        mRecord.size += sizeof(T);
+        mRecord.types[mRecord.count++] = type;
+    }
+
+    // Stored as a length byte and the characters, cut to the space left.
+    void putString(const char *value, size_t length)
+    {
+        if (mRecord.count >= MAX_ARGS || mRecord.size + 1u > DATA_SIZE)
+            return;
+
+        length = std::min<size_t>(length, DATA_SIZE - mRecord.size - 1u);
+        mRecord.data[mRecord.size] = static_cast<char>(length);
+        memcpy(mRecord.data + mRecord.size + 1, value, length);
+        mRecord.size += 1 + length;
+        mRecord.types[mRecord.count++] = ArgType::String;
+    }
+
+    Record &mRecord;
+};
+
+inline void encode(Encoder &) {}
+
+template <typename T, typename... Args> inline void encode(Encoder &encoder, const T &value, const Args &... args)
+{
+    encoder.put(value);
+    encode(encoder, args...);
+}
+
+template <typename... Args> void write(const Site &site, const Args &... args)
+{
+    static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments for BINLOG_DEBUG");
+
+    Record *record = claim();
+    if (!record)
+        return;
+
+    record->site  = &site;
+    record->count = 0;
+    record->size  = 0;
+
+    Encoder encoder(*record);
+    encode(encoder, args...);
+    commit(record);
+}
+
+} // namespace BinLog
@@ -0,0 +1,185 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdint>
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "handover.h"
+#include "logging.h"
+
+namespace Handover
+{
+
+namespace
+{
+
+bool toAddress(const std::string &socketPath, struct sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+// Waits for the descriptor to become readable. False on timeout or error.
+bool waitReadable(int fd, int timeoutMs)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int result;
+    do {
+        result = poll(&pfd, 1, timeoutMs);
+    } while (result < 0 && errno == EINTR);
+    return result > 0;
+}
+
+// Reads exactly size bytes. False on end of file, timeout or error.
+bool readAll(int fd, char *data, size_t size, int timeoutMs)
+{
+    while (size > 0) {
+        if (!waitReadable(fd, timeoutMs))
+            return false;
+
+        ssize_t count = read(fd, data, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+} // namespace
+
+bool receive(const std::string &socketPath, int timeoutMs, std::string &state)
+{
+    struct sockaddr_un address;
+    if (!toAddress(socketPath, address)) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Socket path too long: %s", socketPath.c_str());
+        return false;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Can't create socket: %s", strerror(errno));
+        return false;
+    }
+
+    // Left over from an earlier handover that did not finish.
+    unlink(socketPath.c_str());
+
+    if (bind(listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, 1) != 0) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Can't listen on %s: %s", socketPath.c_str(), strerror(errno));
+        close(listener);
+        return false;
+    }
+
+    LOG_INFO(MSGID_HANDOVER, 0, "Waiting for the running service to hand over on %s", socketPath.c_str());
+
+    int connection = -1;
+    if (waitReadable(listener, timeoutMs))
+        connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    close(listener);
+    unlink(socketPath.c_str());
+
+    if (connection < 0) {
+        LOG_WARNING(MSGID_HANDOVER_ERROR, 0, "No handover from a running service, starting without");
+        return false;
+    }
+
+    uint32_t size = 0;
+    bool received = readAll(connection, reinterpret_cast<char *>(&size), sizeof(size), timeoutMs);
+    if (received) {
+        state.resize(size);
+        received = readAll(connection, &state[0], size, timeoutMs);
+    }
+
+    if (!received) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Handover state not received");
+        close(connection);
+        return false;
+    }
+
+    // End of file when the running process exited and released the bus name.
+    char byte;
+    if (!waitReadable(connection, timeoutMs) || read(connection, &byte, 1) != 0)
+        LOG_WARNING(MSGID_HANDOVER_ERROR, 0, "Running service did not exit after the handover");
+    close(connection);
+
+    LOG_INFO(MSGID_HANDOVER, 1, PMLOGKFV("BYTES", "%zu", state.size()), "Handover state received");
+    return true;
+}
+
+bool send(const std::string &socketPath, const std::string &state, pid_t &peer)
+{
+    struct sockaddr_un address;
+    if (!toAddress(socketPath, address))
+        return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        LOG_WARNING(MSGID_HANDOVER_ERROR, 0, "No new service waiting on %s: %s", socketPath.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Can't get the new service pid: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+    peer = credentials.pid;
+
+    uint32_t size = static_cast<uint32_t>(state.size());
+    std::string message(reinterpret_cast<const char *>(&size), sizeof(size));
+    message += state;
+
+    const char *data = message.data();
+    size_t left      = message.size();
+    while (left > 0) {
+        ssize_t count = write(fd, data, left);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Can't send the handover state: %s", strerror(errno));
+            close(fd);
+            return false;
+        }
+        data += count;
+        left -= count;
+    }
+
+    // fd is not closed, the new process waits for it to close when this process exits.
+    return true;
+}
+
+} // namespace Handover
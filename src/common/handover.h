@@ -0,0 +1,39 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Handover of the service state from a running process to a new one, over a UNIX socket.
+//
+// The new process listens on the socket and waits, the running one connects to it when asked to hand
+// over (SIGUSR2), sends its state and exits. The running process keeps the connection open until it
+// exits, so the new one knows when the bus name is free: the state is followed by end of file.
+
+#include <string>
+#include <sys/types.h>
+
+namespace Handover
+{
+
+// New process: wait up to timeoutMs for the running process to connect and send its state,
+// then for it to exit, up to the same time again. False if nothing was received.
+bool receive(const std::string &socketPath, int timeoutMs, std::string &state);
+
+// Running process: send the state to the new process, whose pid is stored in peer.
+// The connection stays open until the process exits. False if no new process is waiting.
+bool send(const std::string &socketPath, const std::string &state, pid_t &peer);
+
+} // namespace Handover
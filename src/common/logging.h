@@ -19,6 +19,8 @@
 
 #include <PmLogLib.h>
 
+#include "binlog.h"
+
 extern PmLogContext logContext;
 
 #define LOG_CRITICAL(msgid, kvcount, ...) PmLogCritical(logContext, msgid, kvcount, ##__VA_ARGS__)
@@ -31,6 +33,8 @@ extern PmLogContext logContext;
 
 #define LOG_DEBUG(fmt, ...) PmLogDebug(logContext, "%s:%s() " fmt, __FILE__, __FUNCTION__, ##__VA_ARGS__)
 
+// Use BINLOG_DEBUG from binlog.h instead of LOG_DEBUG in code that runs for every call or in loops.
+
 #define LOG_ESCAPED_ERRMSG(msgid, errmsg)                           \
     do {                                                            \
         gchar *escaped_errtext = g_strescape(errmsg, NULL);         \
@@ -76,5 +80,14 @@ extern PmLogContext logContext;
 #define MSGID_INVALID_PARAMETERS_ERR "INVALID_PARAMETERS"
 #define MSGID_SINK_SETUP_ERROR "SINK_SETUP_ERROR"
 #define MSGID_DISPLAY_NOT_CONNECTED "MSGID_DISPLAY_NOT_CONNECTED"
+#define MSGID_RATE_LIMIT_CONFIG_ERROR "RATE_LIMIT_CONFIG_ERROR"
+#define MSGID_STARTUP_PHASE "STARTUP_PHASE"
+#define MSGID_SETTINGS_SNAPSHOT_ERROR "SETTINGS_SNAPSHOT_ERROR"
+#define MSGID_STATE_JOURNAL_ERROR "STATE_JOURNAL_ERROR"
+#define MSGID_STATE_RESTORED "STATE_RESTORED"
+#define MSGID_HANDOVER "HANDOVER"
+#define MSGID_HANDOVER_ERROR "HANDOVER_ERROR"
+#define MSGID_CAPABILITIES "CAPABILITIES"
+#define MSGID_DISPLAY_HOTPLUG "DISPLAY_HOTPLUG"
 
 #endif // LOGGING_H
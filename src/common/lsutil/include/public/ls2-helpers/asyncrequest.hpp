@@ -0,0 +1,203 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <glib.h>
+
+#include "blockpool.hpp"
+#include "executor.hpp"
+#include "jsonrequest.hpp"
+#include "jsonresponse.hpp"
+
+namespace LSHelpers {
+
+class ServicePoint;
+
+/**
+ * @brief Luna request that is completed asynchronously, in steps.
+ * Obtained with ServicePoint::async from within a method handler.
+ *
+ * Each await runs an operation - a job on an Executor or a one reply luna call - and then calls a continuation
+ * on the luna main loop with the result. The value the continuation returns is sent as the reply,
+ * unless the continuation awaits another operation, in which case the reply is sent when that step completes.
+ * Errors are handled the same way as in a regular handler: throw or return ErrorResponse.
+ *
+ * When the ServicePoint is destroyed, requests not done yet are replied with error 7 right away,
+ * and their pending continuations are not called. A job the Executor drops gets the same error.
+ * A request that no step is waiting for anymore, like when the handler calls async but does not await, gets it too.
+ *
+ * AsyncRequest is a shared handle, copies refer to the same request.
+ * Continuations can capture a copy to await further operations.
+ * The request state and the steps are allocated from block pools, see PoolAllocator.
+ *
+ * Multithreading: await must be called on the luna main loop, from the handler or a continuation.
+ * The handler must not run on an executor, see MethodConfig::runOn.
+ *
+ * Example:
+ * @code
+	pbnjson::JValue MyClass::exportLog(JsonRequest& request)
+	{
+		std::string path;
+		request.get("path", path);
+		request.finishParseOrThrow();
+
+		AsyncRequest async = mLunaClient.async(request);
+		async.await(mFileWriter,
+			[path]() // On the executor thread
+			{
+				return writeLog(path);
+			},
+			[this, async, path](bool& written) -> pbnjson::JValue // On the main loop
+			{
+				if (!written)
+				{
+					return ErrorResponse(104, "Failed to write");
+				}
+
+				async.await("luna://com.webos.service.stuff/notify",
+				            pbnjson::JObject {{"path", path}},
+				            [](JsonResponse& response) -> pbnjson::JValue
+				            {
+					            return true;
+				            });
+
+				return true; // Ignored, the reply is sent after the notify call.
+			});
+
+		return true; // Ignored, the request is deferred.
+	}
+ * @endcode
+ */
+class AsyncRequest
+{
+public:
+	/**
+	 * Run a job on the executor and continue with its result on the main loop.
+	 * @param executor executor to run the job on.
+	 * @param job callable returning the result, run on the executor thread. Must not return void.
+	 * @param then continuation, called with a reference to the result. Returns the reply.
+	 */
+	template<typename Job, typename Then>
+	void await(Executor& executor, Job job, Then then) const
+	{
+		typedef typename std::decay<decltype(job())>::type Result;
+		typedef ExecutorStep<Result, Then> StepType;
+
+		if (isDone())
+		{
+			return;
+		}
+
+		std::shared_ptr<StepType> step = std::allocate_shared<StepType>(PoolAllocator<StepType, StepType>(), then);
+		begin(step);
+
+		std::weak_ptr<StepType> dropped = step;
+		executor.post([job, step]() mutable
+		{
+			try
+			{
+				step->result.reset(new Result(job()));
+			}
+			catch (...)
+			{
+				step->error = std::current_exception();
+			}
+
+			// Hand over the only reference, the step is released on the main loop.
+			schedule(std::move(step));
+		},
+		[dropped]()
+		{
+			std::shared_ptr<StepType> step = dropped.lock();
+			if (step)
+			{
+				step->error = cancelled();
+				schedule(std::move(step));
+			}
+		});
+	}
+
+	/**
+	 * Make a one reply luna call and continue with the response.
+	 * @param uri
+	 * @param params
+	 * @param then continuation, called with the response. Returns the reply.
+	 * @throw LS::Error on luna error
+	 */
+	void await(const std::string& uri,
+	           const pbnjson::JValue& params,
+	           const std::function<pbnjson::JValue(JsonResponse& response)>& then) const;
+
+	/**
+	 * @return true if the request is replied or cancelled, continuations will not be called anymore.
+	 */
+	bool isDone() const;
+
+private:
+	friend class ServicePoint;
+
+	struct State;
+
+	// A suspended continuation.
+	struct Step
+	{
+		virtual ~Step() {}
+		virtual pbnjson::JValue resume() = 0;
+
+		std::shared_ptr<State> state;
+	};
+
+	template<typename Result, typename Then>
+	struct ExecutorStep: public Step
+	{
+		explicit ExecutorStep(const Then& _then) : then(_then) {}
+
+		pbnjson::JValue resume() override
+		{
+			if (error)
+			{
+				std::rethrow_exception(error);
+			}
+
+			return then(*result);
+		}
+
+		Then then;
+		std::unique_ptr<Result> result;
+		std::exception_ptr error;
+	};
+
+	struct CallStep;
+
+	AsyncRequest(ServicePoint* service, JsonRequest& request, GMainContext* context);
+
+	void begin(const std::shared_ptr<Step>& step) const;
+	static void cancel(State& state);
+	static std::exception_ptr cancelled();
+	static void resume(Step& step);
+	static void schedule(std::shared_ptr<Step> step);
+	static gboolean resumeCB(gpointer user_data);
+	static void releaseCB(gpointer user_data);
+
+	std::shared_ptr<State> mState;
+};
+
+} // namespace LSHelpers;
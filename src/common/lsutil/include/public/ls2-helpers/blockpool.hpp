@@ -0,0 +1,144 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+namespace LSHelpers {
+
+/**
+ * Free list of memory blocks of one size. Used for objects allocated on every luna call,
+ * together with their shared_ptr control block, see PoolAllocator.
+ * Released blocks are kept for reuse instead of going back to malloc.
+ */
+class BlockPool
+{
+public:
+	static const size_t MAX_FREE_BLOCKS = 32;
+
+	BlockPool() : mBlockSize(0)
+	{
+		mFree.reserve(MAX_FREE_BLOCKS);
+	}
+
+	BlockPool(const BlockPool&) = delete;
+	BlockPool& operator=(const BlockPool&) = delete;
+
+	void* allocate(size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mBlockSize == 0)
+			{
+				mBlockSize = size;
+			}
+
+			if (size == mBlockSize && !mFree.empty())
+			{
+				void* block = mFree.back();
+				mFree.pop_back();
+				return block;
+			}
+		}
+
+		return ::operator new(size);
+	}
+
+	void deallocate(void* block, size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (size == mBlockSize && mFree.size() < MAX_FREE_BLOCKS)
+			{
+				mFree.push_back(block);
+				return;
+			}
+		}
+
+		::operator delete(block);
+	}
+
+private:
+	std::mutex mMutex;
+	size_t mBlockSize;
+	std::vector<void*> mFree;
+};
+
+/**
+ * Allocator for allocate_shared, takes memory from a BlockPool shared by all allocators with the same Tag.
+ * The object and the control block are allocated in one piece, so the blocks are all of the same size.
+ * Needs to be a friend of T if T has private constructors.
+ *
+ * @tparam T type to allocate.
+ * @tparam Tag selects the pool, usually the pooled object type.
+ */
+template<typename T, typename Tag>
+class PoolAllocator
+{
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef PoolAllocator<U, Tag> other;
+	};
+
+	PoolAllocator() {}
+
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U, Tag>&) {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(pool().allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		pool().deallocate(p, n * sizeof(T));
+	}
+
+	template<typename U, typename... Args>
+	void construct(U* p, Args&&... args)
+	{
+		::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+	}
+
+	template<typename U>
+	void destroy(U* p)
+	{
+		p->~U();
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U, Tag>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const PoolAllocator<U, Tag>&) const { return false; }
+
+private:
+	static BlockPool& pool()
+	{
+		// Never destroyed, pooled objects may be released during static destruction.
+		static BlockPool* blocks = new BlockPool();
+		return *blocks;
+	}
+};
+
+} // namespace LSHelpers
@@ -0,0 +1,166 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+namespace LSHelpers {
+
+/**
+ * @brief Records the luna traffic of the process to a file, so it can be replayed later.
+ *
+ * ServicePoint records every incoming call with the method path, caller and payload,
+ * SubscriptionPoint every update it posts to its subscribers, with the subscription point name.
+ * Nothing is recorded unless a capture was started.
+ *
+ * File format, little endian: the 8 byte magic "LSCAPT01", followed by records of
+ * int64 time since the capture started in microseconds, uint32 payload length, uint16 name length,
+ * uint8 sender length and uint8 record type, followed by the name, sender and payload strings,
+ * without terminating zeros. Senders longer than 255 bytes are cut.
+ *
+ * The file does not grow beyond the size limit given to start(). Records that do not fit are
+ * counted as dropped, so a capture holds the traffic from its start until the limit was reached.
+ *
+ * Example:
+ * @code
+ * Capture::global().start("/tmp/service.capture", 16 * 1024 * 1024);
+ * ...
+ * Capture::global().stop();
+ *
+ * std::vector<Capture::Record> records;
+ * std::string error;
+ * if (!Capture::load("/tmp/service.capture", records, error)) ...
+ * @endcode
+ *
+ * Multithreading: thread safe.
+ */
+class Capture
+{
+public:
+	enum class RecordType : uint8_t
+	{
+		Call = 1, // Incoming call, name is the method path
+		Post = 2, // Subscription update, name is the subscription point name, no sender
+	};
+
+	struct Record
+	{
+		RecordType type;
+		gint64 time; // Microseconds since the capture started
+		std::string name;
+		std::string sender;
+		std::string payload;
+	};
+
+	struct Stats
+	{
+		uint64_t records; // Records written
+		uint64_t dropped; // Records not written for the size limit or a write error
+		uint64_t bytes;   // File size
+	};
+
+	/**
+	 * @return process wide capture. Not destroyed on exit.
+	 */
+	static Capture& global();
+
+	/**
+	 * Start capturing to a file, replacing it. Stops the running capture first.
+	 * @param path file to write.
+	 * @param maxBytes file size limit, including the header.
+	 * @return false if the file could not be created.
+	 */
+	bool start(const std::string& path, size_t maxBytes);
+
+	/**
+	 * Stop capturing and close the file. No-op if not capturing.
+	 */
+	void stop();
+
+	inline bool isEnabled() const
+	{
+		return mEnabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @return counters of the running or last capture.
+	 */
+	Stats getStats() const;
+
+	/**
+	 * @return path of the running or last capture, empty if none.
+	 */
+	std::string getPath() const;
+
+	/**
+	 * Record an incoming call. No-op if not capturing.
+	 * @param path method path, like "/display/setDisplayWindow".
+	 * @param sender caller, may be nullptr.
+	 * @param payload call payload.
+	 */
+	inline void recordCall(const char* path, const char* sender, const char* payload)
+	{
+		if (isEnabled())
+		{
+			write(RecordType::Call, path, sender, payload);
+		}
+	}
+
+	/**
+	 * Record a subscription update. No-op if not capturing.
+	 * @param name subscription point name.
+	 * @param payload posted payload.
+	 */
+	inline void recordPost(const char* name, const char* payload)
+	{
+		if (isEnabled())
+		{
+			write(RecordType::Post, name, nullptr, payload);
+		}
+	}
+
+	/**
+	 * Read all records of a capture file.
+	 * A record cut off at the end of the file, like when the process died while capturing, is ignored.
+	 * @param path file to read.
+	 * @param records receives the records, in the order they were written.
+	 * @param error receives the reason if the file could not be read.
+	 * @return false if the file could not be opened or is not a capture.
+	 */
+	static bool load(const std::string& path, std::vector<Record>& records, std::string& error);
+
+private:
+	Capture();
+
+	void write(RecordType type, const char* name, const char* sender, const char* payload);
+
+	std::atomic<bool> mEnabled;
+	mutable std::mutex mMutex;
+	FILE* mFile;
+	std::string mPath;
+	size_t mMaxBytes;
+	gint64 mStartTime;
+	Stats mStats;
+};
+
+} // namespace LSHelpers;
@@ -0,0 +1,74 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace LSHelpers {
+
+/**
+ * @brief Worker thread for method handlers that should not wait for the luna main loop.
+ * See ServicePoint::MethodConfig::runOn.
+ * Jobs are run one at a time in the order they are posted, so an executor also serializes
+ * access to whatever it wraps.
+ *
+ * Destroying the executor waits for the running job and drops the jobs not started yet.
+ * The drop function of each dropped job is called, so its caller can be replied.
+ *
+ * Multithreading: post is thread safe.
+ */
+class Executor
+{
+public:
+	typedef std::function<void()> Job;
+
+	Executor();
+	~Executor();
+
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	/**
+	 * Queue a job to run on the executor thread.
+	 * @param job the job. Exceptions thrown are logged and ignored.
+	 * @param drop called instead of the job if the executor is destroyed before the job is started,
+	 *        on the destroying thread. Also called if the executor is already stopping.
+	 */
+	void post(Job job, Job drop = nullptr);
+
+private:
+	struct Task
+	{
+		Job job;
+		Job drop;
+	};
+
+	void run();
+	static void dropTask(Task& task);
+
+	std::mutex mMutex;
+	std::condition_variable mWakeup;
+	std::deque<Task> mJobs;
+	bool mStopping;
+	std::thread mThread;
+};
+
+} // namespace LSHelpers;
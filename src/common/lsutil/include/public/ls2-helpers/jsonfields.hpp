@@ -0,0 +1,931 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <pbnjson.hpp>
+
+#include "jsonparser.hpp"
+#include "jsonstreamparser.hpp"
+
+namespace LSHelpers {
+
+/**
+ * @file
+ * @brief Declarative field tables for structs parsed from and serialized to JSON.
+ *
+ * A struct lists its fields, constraints and defaults once, in a static describeJsonFields method.
+ * The same table drives JsonParser parsing (parseJsonFields), streaming decode (decodeJsonFields),
+ * serialization (jsonFieldsToJValue) and schema generation (jsonFieldsSchema).
+ * The table is visited with a template visitor, so every operation compiles to straight code
+ * for the fields, without std::function or virtual calls.
+ *
+ * Field constraints follow JsonParseContext: fields are mandatory unless optional(),
+ * defaultValue() is applied when a field is not read, min(), max() and allowedValues() are checked
+ * when it is read, checkValueRead() stores whether the field was read.
+ *
+ * Supported field types: bool, integers, floating point, std::string, pbnjson::JValue,
+ * structs with describeJsonFields and std::vector of those.
+ *
+ * Example:
+ * @code
+ * struct Rect
+ * {
+ *	int16_t x;
+ *	int16_t y;
+ *	uint16_t width;
+ *	uint16_t height;
+ *	uint8_t opacity;
+ *	bool opacitySet;
+ *
+ *	template<typename Visitor>
+ *	static void describeJsonFields(Visitor& fields)
+ *	{
+ *		fields(jsonField("x", &Rect::x));
+ *		fields(jsonField("y", &Rect::y));
+ *		fields(jsonField("width", &Rect::width).min(1));
+ *		fields(jsonField("height", &Rect::height).min(1));
+ *		fields(jsonField("opacity", &Rect::opacity).optional().defaultValue(255).checkValueRead(&Rect::opacitySet));
+ *	}
+ * };
+ *
+ * Rect rect;
+ * request.get("rect", rect);
+ * @endcode
+ */
+
+/**
+ * Constraint value of field types that do not support defaults and limits.
+ */
+struct JsonNoValue {};
+
+/**
+ * Type used to store defaults, limits and allowed values of a field of type T.
+ * String constraints are stored as literals, so field tables stay constant expressions.
+ */
+template<typename T, typename Enable = void>
+struct JsonFieldValue
+{
+	typedef JsonNoValue type;
+};
+
+template<typename T>
+struct JsonFieldValue<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+	typedef T type;
+};
+
+template<>
+struct JsonFieldValue<std::string>
+{
+	typedef const char* type;
+};
+
+/**
+ * Kind of a field type, selects the parse, decode and serialize implementation.
+ */
+enum JsonFieldKind
+{
+	JSON_FIELD_BOOL,
+	JSON_FIELD_INTEGER,
+	JSON_FIELD_NUMBER,
+	JSON_FIELD_STRING,
+	JSON_FIELD_JVALUE,
+	JSON_FIELD_OBJECT,
+	JSON_FIELD_ARRAY,
+	JSON_FIELD_OTHER
+};
+
+template<typename T>
+struct JsonFieldKindOf : std::integral_constant<JsonFieldKind,
+		std::is_same<T, bool>::value ? JSON_FIELD_BOOL
+		: std::is_integral<T>::value ? JSON_FIELD_INTEGER
+		: std::is_floating_point<T>::value ? JSON_FIELD_NUMBER
+		: std::is_same<T, std::string>::value ? JSON_FIELD_STRING
+		: std::is_same<T, pbnjson::JValue>::value ? JSON_FIELD_JVALUE
+		: HasJsonFields<T>::value ? JSON_FIELD_OBJECT
+		: JSON_FIELD_OTHER>
+{};
+
+template<typename T>
+struct JsonFieldKindOf< std::vector<T> > : std::integral_constant<JsonFieldKind, JSON_FIELD_ARRAY>
+{};
+
+/**
+ * @brief Describes one field of struct S with type T. Use jsonField() to create.
+ * All setters return a modified copy, so a field can be declared in a single expression.
+ */
+template<typename S, typename T>
+class JsonField
+{
+public:
+	typedef T Type;
+	typedef typename JsonFieldValue<T>::type Value;
+
+	constexpr JsonField(const char* _name, T S::* _member)
+			: JsonField(_name, _member, false, nullptr, false, Value(), false, Value(), false, Value(), nullptr, 0)
+	{}
+
+	/** Field is optional. Fields are mandatory by default. */
+	constexpr JsonField optional() const
+	{
+		return JsonField(name, member, true, readFlag, hasDefault, defaultVal, hasMin, minVal, hasMax, maxVal,
+		                 allowed, allowedCount);
+	}
+
+	/** Member set to true if the field was read, false if not or default was used. */
+	constexpr JsonField checkValueRead(bool S::* flag) const
+	{
+		return JsonField(name, member, isOptional, flag, hasDefault, defaultVal, hasMin, minVal, hasMax, maxVal,
+		                 allowed, allowedCount);
+	}
+
+	/** Value to set if the field is not read. */
+	constexpr JsonField defaultValue(Value value) const
+	{
+		return JsonField(name, member, isOptional, readFlag, true, value, hasMin, minVal, hasMax, maxVal,
+		                 allowed, allowedCount);
+	}
+
+	constexpr JsonField min(Value value) const
+	{
+		return JsonField(name, member, isOptional, readFlag, hasDefault, defaultVal, true, value, hasMax, maxVal,
+		                 allowed, allowedCount);
+	}
+
+	constexpr JsonField max(Value value) const
+	{
+		return JsonField(name, member, isOptional, readFlag, hasDefault, defaultVal, hasMin, minVal, true, value,
+		                 allowed, allowedCount);
+	}
+
+	/** List of allowed values. The array needs static storage duration. */
+	template<size_t N>
+	constexpr JsonField allowedValues(const Value (&values)[N]) const
+	{
+		return JsonField(name, member, isOptional, readFlag, hasDefault, defaultVal, hasMin, minVal, hasMax, maxVal,
+		                 values, N);
+	}
+
+	const char* name;
+	T S::* member;
+	bool isOptional;
+	bool S::* readFlag;
+	bool hasDefault;
+	Value defaultVal;
+	bool hasMin;
+	Value minVal;
+	bool hasMax;
+	Value maxVal;
+	const Value* allowed;
+	size_t allowedCount;
+
+private:
+	constexpr JsonField(const char* _name, T S::* _member, bool _isOptional, bool S::* _readFlag,
+	                    bool _hasDefault, Value _defaultVal, bool _hasMin, Value _minVal, bool _hasMax, Value _maxVal,
+	                    const Value* _allowed, size_t _allowedCount)
+			: name(_name)
+			, member(_member)
+			, isOptional(_isOptional)
+			, readFlag(_readFlag)
+			, hasDefault(_hasDefault)
+			, defaultVal(_defaultVal)
+			, hasMin(_hasMin)
+			, minVal(_minVal)
+			, hasMax(_hasMax)
+			, maxVal(_maxVal)
+			, allowed(_allowed)
+			, allowedCount(_allowedCount)
+	{}
+};
+
+/**
+ * Declare a field, for use in describeJsonFields.
+ * @param name JSON key.
+ * @param member pointer to the struct member.
+ */
+template<typename S, typename T>
+constexpr JsonField<S, T> jsonField(const char* name, T S::* member)
+{
+	return JsonField<S, T>(name, member);
+}
+
+/* Constraint helpers, no-ops for types without constraint values */
+
+template<typename T, typename V>
+inline void jsonFieldAssign(T& destination, const V& value) { destination = value; }
+
+template<typename T>
+inline void jsonFieldAssign(T&, const JsonNoValue&) {}
+
+template<typename T, typename V>
+inline bool jsonFieldLess(const T& a, const V& b) { return a < b; }
+
+template<typename T>
+inline bool jsonFieldLess(const T&, const JsonNoValue&) { return false; }
+
+template<typename T, typename V>
+inline bool jsonFieldGreater(const T& a, const V& b) { return a > b; }
+
+template<typename T>
+inline bool jsonFieldGreater(const T&, const JsonNoValue&) { return false; }
+
+template<typename T, typename V>
+inline bool jsonFieldInList(const T& value, const V* list, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (value == list[i])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+template<typename T>
+inline bool jsonFieldInList(const T&, const JsonNoValue*, size_t) { return true; }
+
+/**
+ * Check constraints of a read value.
+ * @return error message or nullptr if the value is valid.
+ */
+template<typename S, typename T>
+inline const char* jsonFieldCheck(const JsonField<S, T>& field, const T& value)
+{
+	if (field.hasMin && jsonFieldLess(value, field.minVal))
+	{
+		return "value less than minimum";
+	}
+
+	if (field.hasMax && jsonFieldGreater(value, field.maxVal))
+	{
+		return "value greater than maximum";
+	}
+
+	if (field.allowed && !jsonFieldInList(value, field.allowed, field.allowedCount))
+	{
+		return "value not in allowed list";
+	}
+
+	return nullptr;
+}
+
+/* Parsing from JValue */
+
+template<typename T>
+void parseJsonFieldValue(const pbnjson::JValue& value, T& destination);
+
+template<typename T>
+inline void parseJsonFieldValue(const pbnjson::JValue& value, T& destination,
+                                std::integral_constant<JsonFieldKind, JSON_FIELD_ARRAY>)
+{
+	if (!value.isArray())
+	{
+		throw JsonParseError("array expected but did not get one.");
+	}
+
+	destination.clear();
+	destination.resize(static_cast<size_t>(value.arraySize()));
+	for (ssize_t i = 0; i < value.arraySize(); i++)
+	{
+		parseJsonFieldValue(value[i], destination[i]);
+	}
+}
+
+template<typename T, JsonFieldKind Kind>
+inline void parseJsonFieldValue(const pbnjson::JValue& value, T& destination, std::integral_constant<JsonFieldKind, Kind>)
+{
+	JsonParser::parseValueOrDataObject(value, destination);
+}
+
+template<typename T>
+void parseJsonFieldValue(const pbnjson::JValue& value, T& destination)
+{
+	parseJsonFieldValue(value, destination, JsonFieldKindOf<T>());
+}
+
+/**
+ * @brief Field visitor that parses fields from a JsonParser. Errors are recorded in the parser.
+ */
+template<typename S>
+class JsonFieldsParser
+{
+public:
+	JsonFieldsParser(JsonParser& parser, S& object)
+			: mParser(parser)
+			, mObject(object)
+	{}
+
+	template<typename T>
+	void operator()(const JsonField<S, T>& field)
+	{
+		T& destination = mObject.*(field.member);
+		const pbnjson::JValue& json = mParser._jsonValue;
+		bool valueRead = false;
+		bool isNull = false;
+
+		if (json.hasKey(field.name))
+		{
+			mParser._numberOfFields++;
+
+			pbnjson::JValue value = json[field.name];
+			isNull = value.isNull();
+			if (!isNull)
+			{
+				try
+				{
+					parseJsonFieldValue(value, destination);
+					valueRead = true;
+				}
+				catch (const JsonParseError& e)
+				{
+					mParser.recordError(field.name, e.message.c_str());
+				}
+			}
+		}
+
+		if (field.readFlag)
+		{
+			mObject.*(field.readFlag) = valueRead;
+		}
+
+		if (valueRead)
+		{
+			const char* error = jsonFieldCheck(field, destination);
+			if (error)
+			{
+				mParser.recordError(field.name, error);
+			}
+			return;
+		}
+
+		if (field.hasDefault)
+		{
+			jsonFieldAssign(destination, field.defaultVal);
+		}
+
+		if (!field.isOptional)
+		{
+			mParser.recordError(field.name, "mandatory but not present");
+		}
+		else if (isNull)
+		{
+			mParser.recordError(field.name, "null value is not allowed");
+		}
+	}
+
+private:
+	JsonParser& mParser;
+	S& mObject;
+};
+
+/**
+ * Parse all described fields of destination from the parser's JSON.
+ * Errors are recorded in the parser, call finishParse() afterwards.
+ */
+template<typename S>
+void parseJsonFields(JsonParser& parser, S& destination)
+{
+	JsonFieldsParser<S> visitor(parser, destination);
+	S::describeJsonFields(visitor);
+}
+
+/**
+ * @brief Field visitor that parses the fields of a nested object, like the value of a field.
+ * Throws JsonParseError with the bare reason of the first error, the enclosing parser adds the field
+ * of the nested object. A member that is missing or has the wrong type gives the message of the value
+ * parse, like "not a number", as JsonParser::parseValue does for the member of a nested object.
+ */
+template<typename S>
+class JsonFieldsNestedParser
+{
+public:
+	JsonFieldsNestedParser(const pbnjson::JValue& json, S& object)
+			: mJson(json)
+			, mObject(object)
+	{}
+
+	template<typename T>
+	void operator()(const JsonField<S, T>& field)
+	{
+		T& destination = mObject.*(field.member);
+		pbnjson::JValue value = mJson[field.name];
+		bool valueRead = mJson.hasKey(field.name) && !value.isNull();
+
+		if (field.readFlag)
+		{
+			mObject.*(field.readFlag) = valueRead;
+		}
+
+		if (valueRead)
+		{
+			parseJsonFieldValue(value, destination);
+
+			const char* error = jsonFieldCheck(field, destination);
+			if (error)
+			{
+				throw JsonParseError("'%s' %s", field.name, error);
+			}
+			return;
+		}
+
+		if (field.hasDefault)
+		{
+			jsonFieldAssign(destination, field.defaultVal);
+		}
+
+		if (!field.isOptional)
+		{
+			// Throws for all types but JValue.
+			parseJsonFieldValue(value, destination);
+			throw JsonParseError("'%s' mandatory but not present", field.name);
+		}
+	}
+
+private:
+	const pbnjson::JValue& mJson;
+	S& mObject;
+};
+
+template<typename S>
+void parseJsonFields(const pbnjson::JValue& value, S& destination)
+{
+	if (!value.isObject())
+	{
+		throw JsonParseError("not an object");
+	}
+
+	JsonFieldsNestedParser<S> visitor(value, destination);
+	S::describeJsonFields(visitor);
+}
+
+/* Streaming decode */
+
+template<typename S>
+bool decodeJsonFieldsObject(JsonStreamParser& parser, S& destination);
+
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_BOOL>)
+{
+	return parser.readBool(destination);
+}
+
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_INTEGER>)
+{
+	return parser.readInteger(destination);
+}
+
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_NUMBER>)
+{
+	double value;
+	if (!parser.readNumber(value))
+	{
+		return false;
+	}
+
+	destination = static_cast<T>(value);
+	return true;
+}
+
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_STRING>)
+{
+	return parser.readString(destination);
+}
+
+// Only the subtree is parsed to a DOM.
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_JVALUE>)
+{
+	JsonStreamParser::StringRef raw;
+	if (!parser.readRawValue(raw))
+	{
+		return false;
+	}
+
+	destination = pbnjson::JDomParser::fromString(raw.str());
+	return destination.isValid() && !destination.isNull();
+}
+
+template<typename T>
+inline bool decodeJsonFieldValue(JsonStreamParser& parser, T& destination,
+                                 std::integral_constant<JsonFieldKind, JSON_FIELD_OBJECT>)
+{
+	return decodeJsonFieldsObject(parser, destination);
+}
+
+// Arrays and other types are left to the JsonParser path.
+template<typename T, JsonFieldKind Kind>
+inline bool decodeJsonFieldValue(JsonStreamParser&, T&, std::integral_constant<JsonFieldKind, Kind>)
+{
+	return false;
+}
+
+/**
+ * @brief Field visitor that decodes fields with a JsonStreamParser.
+ * Gives up (returns false) on anything the JsonParser path would report as an error,
+ * and on duplicate keys.
+ */
+template<typename S>
+class JsonFieldsDecoder
+{
+public:
+	JsonFieldsDecoder(JsonStreamParser& parser, S& object)
+			: mParser(parser)
+			, mObject(object)
+			, mKey(nullptr)
+			, mIndex(0)
+			, mSeen(0)
+			, mMatched(false)
+			, mOk(true)
+	{}
+
+	bool decode()
+	{
+		JsonStreamParser::StringRef key;
+
+		if (!mParser.beginObject())
+		{
+			return false;
+		}
+
+		while (mParser.nextKey(key))
+		{
+			mKey = &key;
+			mIndex = 0;
+			mMatched = false;
+			S::describeJsonFields(*this);
+
+			if (!mOk || (!mMatched && !mParser.skipValue()))
+			{
+				return false;
+			}
+		}
+
+		if (mParser.failed())
+		{
+			return false;
+		}
+
+		// Second pass over the table applies defaults and checks constraints.
+		mKey = nullptr;
+		mIndex = 0;
+		S::describeJsonFields(*this);
+		return mOk;
+	}
+
+	template<typename T>
+	void operator()(const JsonField<S, T>& field)
+	{
+		if (!mOk || mIndex >= 64)
+		{
+			mOk = false;
+			return;
+		}
+
+		uint64_t bit = static_cast<uint64_t>(1) << mIndex++;
+		T& destination = mObject.*(field.member);
+
+		if (mKey)
+		{
+			if (mMatched || *mKey != field.name)
+			{
+				return;
+			}
+
+			mMatched = true;
+			mOk = !(mSeen & bit) && decodeJsonFieldValue(mParser, destination, JsonFieldKindOf<T>());
+			mSeen |= bit;
+			return;
+		}
+
+		bool valueRead = mSeen & bit;
+		if (field.readFlag)
+		{
+			mObject.*(field.readFlag) = valueRead;
+		}
+
+		if (valueRead)
+		{
+			mOk = jsonFieldCheck(field, destination) == nullptr;
+		}
+		else
+		{
+			if (field.hasDefault)
+			{
+				jsonFieldAssign(destination, field.defaultVal);
+			}
+			mOk = field.isOptional;
+		}
+	}
+
+private:
+	JsonStreamParser& mParser;
+	S& mObject;
+	const JsonStreamParser::StringRef* mKey; // Key being matched, nullptr in the final pass.
+	size_t mIndex;
+	uint64_t mSeen;
+	bool mMatched;
+	bool mOk;
+};
+
+template<typename S>
+bool decodeJsonFieldsObject(JsonStreamParser& parser, S& destination)
+{
+	JsonFieldsDecoder<S> decoder(parser, destination);
+	return decoder.decode();
+}
+
+/**
+ * Decode a complete JSON document into destination.
+ * @return false if the input is invalid or not handled by the streaming decoder. The destination is then
+ *         in unspecified state, use parseJsonFields to get the result and error message.
+ */
+template<typename S>
+bool decodeJsonFields(JsonStreamParser& parser, S& destination)
+{
+	return decodeJsonFieldsObject(parser, destination) && parser.end();
+}
+
+/* Serialization */
+
+template<typename T>
+pbnjson::JValue jsonFieldToJValue(const T& value);
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_BOOL>)
+{
+	return pbnjson::JValue(value);
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_INTEGER>)
+{
+	return pbnjson::JValue(static_cast<int64_t>(value));
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_NUMBER>)
+{
+	return pbnjson::JValue(static_cast<double>(value));
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_STRING>)
+{
+	return pbnjson::JValue(value);
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_JVALUE>)
+{
+	return value;
+}
+
+template<typename S>
+pbnjson::JValue jsonFieldsToJValue(const S& object);
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_OBJECT>)
+{
+	return jsonFieldsToJValue(value);
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldToJValue(const T& value, std::integral_constant<JsonFieldKind, JSON_FIELD_ARRAY>)
+{
+	pbnjson::JArray array;
+	for (const auto& item : value)
+	{
+		array.append(jsonFieldToJValue(item));
+	}
+	return array;
+}
+
+template<typename T>
+pbnjson::JValue jsonFieldToJValue(const T& value)
+{
+	return jsonFieldToJValue(value, JsonFieldKindOf<T>());
+}
+
+/**
+ * @brief Field visitor that serializes fields to a JSON object.
+ */
+template<typename S>
+class JsonFieldsSerializer
+{
+public:
+	JsonFieldsSerializer(const S& object, pbnjson::JValue& json)
+			: mObject(object)
+			, mJson(json)
+	{}
+
+	template<typename T>
+	void operator()(const JsonField<S, T>& field)
+	{
+		mJson.put(field.name, jsonFieldToJValue(mObject.*(field.member)));
+	}
+
+private:
+	const S& mObject;
+	pbnjson::JValue& mJson;
+};
+
+/**
+ * Serialize all described fields of the object.
+ */
+template<typename S>
+pbnjson::JValue jsonFieldsToJValue(const S& object)
+{
+	pbnjson::JValue json = pbnjson::JObject();
+	JsonFieldsSerializer<S> visitor(object, json);
+	S::describeJsonFields(visitor);
+	return json;
+}
+
+/* Schema generation */
+
+template<typename T>
+pbnjson::JValue jsonFieldSchema();
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_BOOL>)
+{
+	return pbnjson::JObject {{"type", "boolean"}};
+}
+
+// Integers narrower than 64 bits are limited to the range of the type.
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_INTEGER>)
+{
+	pbnjson::JValue schema = pbnjson::JObject {{"type", "integer"}};
+	if (sizeof(T) < sizeof(int64_t))
+	{
+		schema.put("minimum", static_cast<int64_t>(std::numeric_limits<T>::min()));
+		schema.put("maximum", static_cast<int64_t>(std::numeric_limits<T>::max()));
+	}
+	return schema;
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_NUMBER>)
+{
+	return pbnjson::JObject {{"type", "number"}};
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_STRING>)
+{
+	return pbnjson::JObject {{"type", "string"}};
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_JVALUE>)
+{
+	return pbnjson::JObject();
+}
+
+template<typename S>
+pbnjson::JValue jsonFieldsSchema();
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_OBJECT>)
+{
+	return jsonFieldsSchema<T>();
+}
+
+template<typename T>
+inline pbnjson::JValue jsonFieldSchema(std::integral_constant<JsonFieldKind, JSON_FIELD_ARRAY>)
+{
+	return pbnjson::JObject {{"type", "array"}, {"items", jsonFieldSchema<typename T::value_type>()}};
+}
+
+template<typename T>
+pbnjson::JValue jsonFieldSchema()
+{
+	return jsonFieldSchema<T>(JsonFieldKindOf<T>());
+}
+
+// Constraint values as JSON. String constraints are literals.
+template<typename V>
+inline pbnjson::JValue jsonFieldConstant(const V& value)
+{
+	return jsonFieldToJValue(value);
+}
+
+inline pbnjson::JValue jsonFieldConstant(const char* value)
+{
+	return pbnjson::JValue(value);
+}
+
+inline pbnjson::JValue jsonFieldConstant(const JsonNoValue&)
+{
+	return pbnjson::JValue();
+}
+
+/**
+ * @brief Field visitor that generates a JSON schema.
+ */
+template<typename S>
+class JsonFieldsSchemaBuilder
+{
+public:
+	JsonFieldsSchemaBuilder(pbnjson::JValue& properties, pbnjson::JValue& required)
+			: mProperties(properties)
+			, mRequired(required)
+	{}
+
+	template<typename T>
+	void operator()(const JsonField<S, T>& field)
+	{
+		pbnjson::JValue schema = jsonFieldSchema<T>();
+
+		if (field.hasMin)
+		{
+			schema.put("minimum", jsonFieldConstant(field.minVal));
+		}
+
+		if (field.hasMax)
+		{
+			schema.put("maximum", jsonFieldConstant(field.maxVal));
+		}
+
+		if (field.hasDefault)
+		{
+			schema.put("default", jsonFieldConstant(field.defaultVal));
+		}
+
+		if (field.allowed)
+		{
+			pbnjson::JValue values = pbnjson::JArray();
+			for (size_t i = 0; i < field.allowedCount; i++)
+			{
+				values.append(jsonFieldConstant(field.allowed[i]));
+			}
+			schema.put("enum", values);
+		}
+
+		mProperties.put(field.name, schema);
+
+		if (!field.isOptional)
+		{
+			mRequired.append(pbnjson::JValue(field.name));
+		}
+	}
+
+private:
+	pbnjson::JValue& mProperties;
+	pbnjson::JValue& mRequired;
+};
+
+/**
+ * Generate JSON schema of the described fields. Additional properties are allowed,
+ * same as with JsonParser.
+ * Example: @code pbnjson::JSchemaFragment schema(jsonFieldsSchema<MyParams>().stringify()); @endcode
+ */
+template<typename S>
+pbnjson::JValue jsonFieldsSchema()
+{
+	pbnjson::JValue properties = pbnjson::JObject();
+	pbnjson::JValue required = pbnjson::JArray();
+
+	JsonFieldsSchemaBuilder<S> visitor(properties, required);
+	S::describeJsonFields(visitor);
+
+	pbnjson::JValue schema = pbnjson::JObject {{"type", "object"}, {"properties", properties}};
+	if (required.arraySize() > 0)
+	{
+		schema.put("required", required);
+	}
+	return schema;
+}
+
+} // namespace LSHelpers;
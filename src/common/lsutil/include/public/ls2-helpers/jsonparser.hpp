@@ -20,12 +20,44 @@
 #include <functional>
 #include <string>
 #include <sstream>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <pbnjson.hpp>
 
 namespace LSHelpers {
 
 template<typename T> class JsonParseContext;
+template<typename S> class JsonFieldsParser;
+
+/**
+ * True if T describes its fields with a static describeJsonFields(Visitor&) method.
+ * @see jsonfields.hpp
+ */
+template<typename T>
+class HasJsonFields
+{
+	struct AnyVisitor
+	{
+		template<typename F> void operator()(const F&) {}
+	};
+
+	template<typename U>
+	static char test(decltype(U::describeJsonFields(std::declval<AnyVisitor&>()))*);
+
+	template<typename U>
+	static long test(...);
+
+public:
+	static const bool value = sizeof(test<T>(nullptr)) == sizeof(char);
+};
+
+/**
+ * Parse an object described with describeJsonFields. Defined in jsonfields.hpp.
+ * @throw JsonParseError on parse error
+ */
+template<typename S>
+void parseJsonFields(const pbnjson::JValue& value, S& destination);
 
 /**
  * @brief Base class for parse errors that can be thrown in JsonDataObject::parseFromJson implementation.
@@ -209,12 +241,22 @@ public:
 	 *
 	 * @param name field name
 	 * @param destination reference to variable to store the value in
-	 * @param parserFunc optional custom function for parsing the field.
 	 * @return JsonParseContext for adding more constraints using call chaining.
 	 *         The return value shall not be assigned to a variable. It depends on destructor being called to finalize checks.
 	 * */
 	template<typename T>
-	JsonParseContext<T> get(const char* name, T& destination, const std::function<void(const pbnjson::JValue&, T&)>& parserFunc = &parseValueOrDataObject<T>);
+	JsonParseContext<T> get(const char* name, T& destination);
+
+	/** Look up a json field named *name* and store it's value in the *destination*, using a custom parse function.
+	 *
+	 * @param name field name
+	 * @param destination reference to variable to store the value in
+	 * @param parserFunc custom function for parsing the field.
+	 * @return JsonParseContext for adding more constraints using call chaining.
+	 *         The return value shall not be assigned to a variable. It depends on destructor being called to finalize checks.
+	 * */
+	template<typename T>
+	JsonParseContext<T> get(const char* name, T& destination, const std::function<void(const pbnjson::JValue&, T&)>& parserFunc);
 
 	/** Look up a json string field named *name* and reinterpret it as a JSON payload.
 	 *  Then apply the regular get logic.
@@ -284,7 +326,19 @@ public:
 	 *
 	 * @param name field name
 	 * @param destination reference to array to store the values in
-	 * @param parserFunc optional - a function to parse individual items.
+	 * @return JsonParseContext for adding more constraints using call chaining.
+	 *         The return value shall not be assigned to a variable. It depends on destructor being called to finalize checks.
+	 */
+	template<typename T>
+	JsonParseContext< std::vector<T> > getArray(const char* name, std::vector<T>& destination);
+
+	/**
+	 * Parse array object to std::vector.
+	 * Individual items will be parsed using parserFunc.
+	 *
+	 * @param name field name
+	 * @param destination reference to array to store the values in
+	 * @param parserFunc a function to parse individual items.
 	 *                   Throw JsonParseException to indicate parse error.
 	 * @return JsonParseContext for adding more constraints using call chaining.
 	 *         The return value shall not be assigned to a variable. It depends on destructor being called to finalize checks.
@@ -292,7 +346,7 @@ public:
 	template<typename T>
 	JsonParseContext< std::vector<T> > getArray(const char* name,
 	                                              std::vector<T>& destination,
-	                                              const std::function< void (const pbnjson::JValue& , T& )>& parserFunc = &parseValueOrDataObject<T>);
+	                                              const std::function< void (const pbnjson::JValue& , T& )>& parserFunc);
 
 	/**
 	 * Get a JsonParser object for a sub-object.
@@ -355,8 +409,8 @@ public:
 	static void parseValue(const pbnjson::JValue& value, T& destination);
 
 	/**
-	 * Template method to do the parsing. Accepts both basic types and objects derived from
-	 * JsonDataObject.
+	 * Template method to do the parsing. Accepts basic types, objects derived from
+	 * JsonDataObject and objects with describeJsonFields.
 	 * @param value - the value to parse
 	 * @param destination set this value if parsing successful
 	 * @throw JsonParseException on parse error
@@ -364,15 +418,9 @@ public:
 	template<typename T>
 	static void parseValueOrDataObject(const pbnjson::JValue& value, T& destination)
 	{
-		//This is compile time constant, will compile to one or the other
-		if (std::is_base_of<JsonDataObject,T>::value)
-		{
-			parseValue(value, reinterpret_cast<JsonDataObject&>(destination));
-		}
-		else
-		{
-			parseValue(value, destination);
-		}
+		parseValueByKind(value, destination,
+		                 std::integral_constant<int, HasJsonFields<T>::value ? 2
+		                                           : std::is_base_of<JsonDataObject, T>::value ? 1 : 0>());
 	}
 
 	/**
@@ -398,12 +446,37 @@ protected:
 	 * @param parserFunc
 	 * @return
 	 */
-	template<typename T>
+	template<typename T, typename ParserFunc>
 	JsonParseContext<T> getImpl(const char* name,
 	                            const pbnjson::JValue& value,
 	                            bool found,
 	                            T& destination,
-	                            const std::function<void(const pbnjson::JValue&, T&)>& parserFunc);
+	                            const ParserFunc& parserFunc);
+
+	template<typename T, typename ParserFunc>
+	JsonParseContext< std::vector<T> > getArrayImpl(const char* name,
+	                                                  std::vector<T>& destination,
+	                                                  const ParserFunc& parserFunc);
+
+	template<typename T>
+	static void parseValueByKind(const pbnjson::JValue& value, T& destination, std::integral_constant<int, 0>)
+	{
+		parseValue(value, destination);
+	}
+
+	template<typename T>
+	static void parseValueByKind(const pbnjson::JValue& value, T& destination, std::integral_constant<int, 1>)
+	{
+		parseValue(value, static_cast<JsonDataObject&>(destination));
+	}
+
+	template<typename T>
+	static void parseValueByKind(const pbnjson::JValue& value, T& destination, std::integral_constant<int, 2>)
+	{
+		parseJsonFields(value, destination);
+	}
+
+	template<typename S> friend class JsonFieldsParser;
 
 	std::string _parseError;
 	pbnjson::JValue _jsonValue;
@@ -600,6 +673,26 @@ private:
 
 /* Template method implementations */
 
+template<typename T>
+JsonParseContext<T> JsonParser::get(const char* name, T& destination)
+{
+	if (name == nullptr)
+	{
+		throw std::runtime_error("Internal error in JsonParseContext.get, field name is null");
+	}
+
+	bool hasKey = _jsonValue.hasKey(name);
+	pbnjson::JValue v; // = null
+	if (hasKey)
+	{
+		v = _jsonValue[name];
+		_numberOfFields++;
+	}
+
+	// Plain function pointer, avoids constructing a std::function for every field.
+	return getImpl(name, v, hasKey, destination, &parseValueOrDataObject<T>);
+}
+
 template<typename T>
 JsonParseContext<T> JsonParser::get(const char* name,
                                     T& destination,
@@ -640,12 +733,12 @@ JsonParseContext<T> JsonParser::getFromString(const char* name,
 	return getImpl(name, value, valueSet, destination, parserFunc);
 }
 
-template<typename T>
+template<typename T, typename ParserFunc>
 JsonParseContext<T> JsonParser::getImpl(const char* name,
                                         const pbnjson::JValue& value,
                                         bool hasKey,
                                         T& destination,
-                                        const std::function<void(const pbnjson::JValue&, T&)>& parserFunc)
+                                        const ParserFunc& parserFunc)
 {
 	bool isNull = hasKey && value.isNull();
 
@@ -750,10 +843,24 @@ JsonParseContext<T> JsonParser::getAndMap(const char* name, T& destination, std:
 	return JsonParseContext<T>(*this, name, destination, valueRead && found, false);
 }
 
+template<typename T>
+JsonParseContext< std::vector<T> > JsonParser::getArray(const char* name, std::vector<T>& destination)
+{
+	return getArrayImpl(name, destination, &parseValueOrDataObject<T>);
+}
+
 template<typename T>
 JsonParseContext< std::vector<T> > JsonParser::getArray(const char* name,
                                                         std::vector<T>& destination,
                                                         const std::function<void(const pbnjson::JValue&,T&)>& parserFunc)
+{
+	return getArrayImpl(name, destination, parserFunc);
+}
+
+template<typename T, typename ParserFunc>
+JsonParseContext< std::vector<T> > JsonParser::getArrayImpl(const char* name,
+                                                            std::vector<T>& destination,
+                                                            const ParserFunc& parserFunc)
 {
 	bool valueRead = false;
 	bool isNull = false;
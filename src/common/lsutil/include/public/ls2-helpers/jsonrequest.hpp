@@ -21,7 +21,9 @@
 #include <algorithm>
 #include <luna-service2/lunaservice.hpp>
 
+#include "jsonfields.hpp"
 #include "jsonparser.hpp"
+#include "metrics.hpp"
 
 namespace LSHelpers {
 
@@ -117,11 +119,39 @@ public:
 	 * @param msg the luna message to handle.
 	 * @param handler handler method to call.
 	 * @param schema schema to use for validation (optional).
+	 * @param metrics if set, parse time, handler time and reply size are recorded here.
 	 * @return true if the call was handled. False if an unknown exception was thrown.
 	 */
 	static bool handleLunaCall(LSMessage* msg,
 	                           const Handler& handler,
-	                           const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema());
+	                           const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema(),
+	                           MethodMetrics* metrics = nullptr);
+
+	/**
+	 * Handler method for streaming methods - calls handler without parsing the payload.
+	 * The handler is expected to decode the payload using decode().
+	 * @param msg the luna message to handle.
+	 * @param handler handler method to call.
+	 * @param metrics if set, decode time, handler time and reply size are recorded here.
+	 * @return true if the call was handled. False if an unknown exception was thrown.
+	 */
+	static bool handleStreamingLunaCall(LSMessage* msg, const Handler& handler, MethodMetrics* metrics = nullptr);
+
+	/**
+	 * Calls a handler in-process, without a luna round trip. Used to run the calls of a batch.
+	 * The responses are passed to capture instead of being sent, in the same form they would be sent,
+	 * errors included. If the handler defers the request, capture is called later.
+	 * @param message message of the call the handler is run for, available as getMessage().
+	 * @param params call parameters.
+	 * @param handler handler method to call.
+	 * @param capture called with every response of the call.
+	 * @return true if the call was handled. False if an unknown exception was thrown,
+	 *     capture gets a no response error in that case.
+	 */
+	static bool handleCapturedCall(const LS::Message& message,
+	                               const pbnjson::JValue& params,
+	                               const Handler& handler,
+	                               const DeferredResponseFunction& capture);
 
 	~JsonRequest();
 
@@ -162,13 +192,78 @@ public:
 	 */
 	inline const LS::Message getMessage() const { return mMessage; }
 
+	/**
+	 * @return true if the response is deferred, see defer().
+	 */
+	inline bool isDeferred() const { return mDeferred; }
+
+	/**
+	 * Decode request parameters into a typed struct.
+	 *
+	 * For requests handled by handleStreamingLunaCall the payload is first decoded with
+	 * decodeJsonFields, without building a DOM. If the streaming decoder gives up, the payload is
+	 * parsed to a DOM and decoded with parseJsonFields, so the result and error messages are
+	 * exactly the same as with a regular handler.
+	 *
+	 * @tparam T default constructible struct with describeJsonFields, see jsonfields.hpp.
+	 * @param params struct to decode into.
+	 * @return true on success, false on parse error. See getError().
+	 * @throw ErrorResponse if the payload is not valid JSON.
+	 */
+	template<typename T>
+	bool decode(T& params)
+	{
+		ParseTimer timer(*this);
+
+		if (mPayload)
+		{
+			JsonStreamParser stream(mPayload);
+			if (decodeJsonFields(stream, params))
+			{
+				return true;
+			}
+
+			parsePayload();
+			params = T();
+		}
+
+		parseJsonFields(*this, params);
+		return finishParse();
+	}
+
 private:
+	template<typename T, typename Tag> friend class PoolAllocator;
+
+	// Adds the time spent in scope to the parse time of the request.
+	struct ParseTimer
+	{
+		explicit ParseTimer(JsonRequest& _request) : request(_request), start(g_get_monotonic_time()) {}
+		~ParseTimer() { request.mParseUs += g_get_monotonic_time() - start; }
+
+		JsonRequest& request;
+		gint64 start;
+	};
+
+	// Records parse and handler time of a dispatched request.
+	class DispatchTimer;
+
 	JsonRequest(const LS::Message& message, const pbnjson::JValue params);
+	JsonRequest(const LS::Message& message, const char* payload);
+
+	static bool dispatch(LS::Message& message, std::shared_ptr<JsonRequest> request, const Handler& handler);
+
+	// Build the DOM for a streaming request.
+	void parsePayload();
 
 	// Send response to caller.
 	void respond(const pbnjson::JValue& response);
+	void recordReplySize(size_t size);
 
 	LS::Message mMessage;
+	DeferredResponseFunction mCapture; // Set for in-process calls, gets the responses instead of mMessage.
+	const char* mPayload; // Not parsed payload of a streaming request, owned by mMessage.
+	MethodMetrics* mMetrics; // Optional, see handleLunaCall
+	gint64 mParseUs; // Time spent parsing the payload, microseconds
 	std::weak_ptr<JsonRequest> mWeakPtr; // Weak pointer to self, for use in defer
 	bool mDeferred; // Response deferred.
 	bool mResponded; // If at least one response is sent back.
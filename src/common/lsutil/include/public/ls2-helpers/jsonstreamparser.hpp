@@ -0,0 +1,202 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace LSHelpers {
+
+/**
+ * @brief Pull parser that decodes JSON straight from the payload buffer, without building a DOM.
+ *
+ * Used by streaming method handlers (see ServicePoint::registerMethod with a typed handler) to decode
+ * requests directly into C++ structs. The parser is deliberately conservative: it only accepts the
+ * plain common case and reports failure on anything unusual (null values, numbers given as strings,
+ * fractional or exponent integers, \\u escapes, non-ASCII text, ...). On failure the caller falls back to
+ * the regular JsonParser path, which produces the result and the error messages for those inputs.
+ *
+ * Strings are returned as references into the parsed buffer where possible. No heap allocation
+ * is done by the parser itself.
+ *
+ * Example:
+ * @code
+ * bool MyRequest::decode(JsonStreamParser& parser)
+ * {
+ *	JsonStreamParser::StringRef key;
+ *
+ *	if (!parser.beginObject())
+ *		return false;
+ *
+ *	while (parser.nextKey(key))
+ *	{
+ *		if (key == "id")
+ *		{
+ *			if (!parser.readInteger(id))
+ *				return false;
+ *		}
+ *		else if (!parser.skipValue())
+ *		{
+ *			return false;
+ *		}
+ *	}
+ *
+ *	return parser.end();
+ * }
+ * @endcode
+ */
+class JsonStreamParser
+{
+public:
+	/**
+	 * Reference to a part of the parsed buffer.
+	 */
+	struct StringRef
+	{
+		const char* data;
+		size_t length;
+
+		inline bool operator==(const char* literal) const
+		{
+			return strncmp(data, literal, length) == 0 && literal[length] == '\0';
+		}
+
+		inline bool operator!=(const char* literal) const
+		{
+			return !(*this == literal);
+		}
+
+		inline std::string str() const
+		{
+			return std::string(data, length);
+		}
+	};
+
+	/**
+	 * @param json null terminated JSON text. Needs to outlive the parser and any StringRef returned.
+	 */
+	explicit JsonStreamParser(const char* json)
+			: mPos { json ? json : "" }
+			, mAfterOpen { false }
+			, mFailed { json == nullptr }
+	{}
+
+	/**
+	 * Consume start of an object.
+	 */
+	bool beginObject();
+
+	/**
+	 * Read next key of the current object.
+	 * @param key set to the key name.
+	 * @return true if a key was read, false at the end of the object or on error (see failed()).
+	 */
+	bool nextKey(StringRef& key);
+
+	/**
+	 * Read a string value without escape sequences, as a reference into the buffer.
+	 */
+	bool readString(StringRef& destination);
+
+	/**
+	 * Read a string value. Simple escape sequences are decoded.
+	 */
+	bool readString(std::string& destination);
+
+	bool readBool(bool& destination);
+
+	/**
+	 * Read a number value.
+	 */
+	bool readNumber(double& destination);
+
+	/**
+	 * Read an integer value. Fails on fraction or exponent notation and if the value does not fit the type.
+	 */
+	template<typename T>
+	bool readInteger(T& destination)
+	{
+		int64_t value;
+		if (!readInt64(value))
+		{
+			return false;
+		}
+
+		if (value < static_cast<int64_t>(std::numeric_limits<T>::min()) ||
+		    (value > 0 && static_cast<uint64_t>(value) > static_cast<uint64_t>(std::numeric_limits<T>::max())))
+		{
+			return fail();
+		}
+
+		destination = static_cast<T>(value);
+		return true;
+	}
+
+	/**
+	 * Skip a value of any type, returning the JSON text of it.
+	 */
+	bool readRawValue(StringRef& raw);
+
+	/**
+	 * Skip a value of any type.
+	 */
+	bool skipValue();
+
+	/**
+	 * Check that all input is consumed.
+	 */
+	bool end();
+
+	/**
+	 * True if the parser encountered an error or unsupported input.
+	 */
+	inline bool failed() const
+	{
+		return mFailed;
+	}
+
+private:
+	static const int MAX_DEPTH = 32;
+
+	const char* mPos;
+	bool mAfterOpen; // Just entered an object, no comma expected before the next key.
+	bool mFailed;
+
+	inline bool fail()
+	{
+		mFailed = true;
+		return false;
+	}
+
+	inline void skipWhitespace()
+	{
+		while (*mPos == ' ' || *mPos == '\t' || *mPos == '\n' || *mPos == '\r')
+		{
+			mPos++;
+		}
+	}
+
+	bool scanString(StringRef& raw, bool& hasEscapes);
+	bool scanNumber(StringRef& raw, bool& isInteger);
+	bool scanLiteral(const char* literal, size_t length);
+	bool skipValue(int depth);
+	bool readInt64(int64_t& destination);
+};
+
+} // namespace LSHelpers;
@@ -0,0 +1,170 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <signal.h>
+#include <glib.h>
+
+namespace LSHelpers {
+
+class Histogram;
+
+/**
+ * @brief Measures how late the main loop runs its sources, and reports stalls.
+ *
+ * A high priority timeout source on the loop records how late it was dispatched
+ * in the "mainloop.lagUs" histogram of MetricsRegistry::global(). A watchdog thread checks that the
+ * source keeps running. When it has not run for longer than the stall threshold, the watchdog logs
+ * the activities the loop is in, and the stack of the loop thread, and counts the stall
+ * in "mainloop.stalls" and "mainloop.stalls.<innermost activity>".
+ *
+ * Activities are marked with LoopActivity. ServicePoint marks method handlers by method path.
+ *
+ * Example:
+ * @code
+ * LoopMonitor::global().start(g_main_loop_get_context(mainLoop));
+ * g_main_loop_run(mainLoop);
+ * LoopMonitor::global().stop();
+ * @endcode
+ *
+ * Multithreading: start and stop need to be called on the thread that runs the loop.
+ * Activities of other threads are ignored.
+ */
+class LoopMonitor
+{
+public:
+	static const int MAX_ACTIVITY_DEPTH = 4; // Deeper activities are not tracked
+	static const int MAX_STACK_FRAMES = 32;
+
+	/**
+	 * @return process wide monitor. Not destroyed on exit.
+	 */
+	static LoopMonitor& global();
+
+	/**
+	 * Start monitoring the loop of the calling thread.
+	 * @param context main context the loop runs, nullptr for the default context.
+	 * @param intervalMs how often the lag is measured, milliseconds.
+	 * @param stallMs lag above which the loop is reported as stalled, milliseconds.
+	 * @param stackSignal signal used to capture the stack of the loop thread, 0 to not capture stacks.
+	 *                    Must not be blocked on the loop thread.
+	 */
+	void start(GMainContext* context, guint intervalMs = 100, guint stallMs = 500, int stackSignal = SIGRTMIN);
+
+	/**
+	 * Stop monitoring, joins the watchdog thread.
+	 */
+	void stop();
+
+	/**
+	 * @return true if the calling thread is the monitored loop thread.
+	 */
+	static bool isLoopThread();
+
+private:
+	friend class LoopActivity;
+
+	LoopMonitor();
+
+	static gboolean tickCB(gpointer user_data);
+	static void stackSignalHandler(int signal);
+	void watchdog();
+	void reportStall(gint64 stalledUs);
+	std::string activities(std::string& innermost) const;
+
+	inline void pushActivity(const char* name)
+	{
+		int depth = mDepth.load(std::memory_order_relaxed);
+		if (depth < MAX_ACTIVITY_DEPTH)
+		{
+			mActivities[depth].store(name, std::memory_order_relaxed);
+		}
+		mDepth.store(depth + 1, std::memory_order_release);
+	}
+
+	inline void popActivity()
+	{
+		mDepth.store(mDepth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+	}
+
+	// Loop thread
+	GSource* mTickSource;
+	gint64 mExpectedTick;
+	gint64 mInterval; // Microseconds
+	gint64 mStallThreshold; // Microseconds
+	Histogram* mLag;
+	Histogram* mStalls;
+
+	// Shared with the watchdog
+	std::atomic<gint64> mLastTick;
+	std::atomic<int> mDepth;
+	std::atomic<const char*> mActivities[MAX_ACTIVITY_DEPTH];
+	pthread_t mLoopThread;
+	int mStackSignal;
+
+	// Written by the signal handler, read by the watchdog after mStackReady
+	void* mStack[MAX_STACK_FRAMES];
+	std::atomic<int> mStackDepth;
+	std::atomic<bool> mStackReady;
+
+	std::thread mWatchdog;
+	std::mutex mMutex;
+	std::condition_variable mStopCondition;
+	bool mStopping;
+};
+
+/**
+ * @brief Marks what the loop thread is doing from construction to destruction, see LoopMonitor.
+ */
+class LoopActivity
+{
+public:
+	/**
+	 * @param name activity name. Needs to stay valid as long as the monitor runs,
+	 *             as it may be read by the watchdog after the activity ended.
+	 */
+	explicit LoopActivity(const char* name)
+			: mActive(LoopMonitor::isLoopThread())
+	{
+		if (mActive)
+		{
+			LoopMonitor::global().pushActivity(name);
+		}
+	}
+
+	~LoopActivity()
+	{
+		if (mActive)
+		{
+			LoopMonitor::global().popActivity();
+		}
+	}
+
+	LoopActivity(const LoopActivity&) = delete;
+	LoopActivity& operator=(const LoopActivity&) = delete;
+
+private:
+	bool mActive;
+};
+
+} // namespace LSHelpers;
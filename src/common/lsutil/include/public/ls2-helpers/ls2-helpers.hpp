@@ -19,7 +19,15 @@
 #include <pbnjson.hpp>
 #include <luna-service2/lunaservice.h>
 
+#include "asyncrequest.hpp"
+#include "executor.hpp"
+#include "capture.hpp"
+#include "jsonfields.hpp"
 #include "jsonparser.hpp"
 #include "servicepoint.hpp"
 #include "subscriptionpoint.hpp"
 #include "persistentsubscription.hpp"
+#include "loopmonitor.hpp"
+#include "metrics.hpp"
+#include "ratelimiter.hpp"
+#include "tracer.hpp"
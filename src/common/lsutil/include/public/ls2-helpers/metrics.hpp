@@ -0,0 +1,193 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <glib.h>
+#include <pbnjson.hpp>
+
+namespace LSHelpers {
+
+/**
+ * @brief Monotonic event counter.
+ * Multithreading: thread safe, lock free.
+ */
+class Counter
+{
+public:
+	Counter() : mValue(0) {}
+
+	Counter(const Counter&) = delete;
+	Counter& operator=(const Counter&) = delete;
+
+	inline void add(uint64_t count = 1)
+	{
+		mValue.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	inline uint64_t value() const
+	{
+		return mValue.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> mValue;
+};
+
+/**
+ * @brief Distribution of values in fixed log-linear buckets.
+ * Values below 16 have a bucket each, larger values have 8 buckets per power of two,
+ * so percentiles are within 12.5% of the recorded values. Values from 2^40 up share the last bucket.
+ *
+ * Multithreading: thread safe, lock free. Reads while values are being recorded
+ * may see a value in count and not yet in the buckets.
+ */
+class Histogram
+{
+public:
+	Histogram();
+
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	/**
+	 * Record a value.
+	 */
+	void record(uint64_t value);
+
+	inline uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+	inline uint64_t sum() const { return mSum.load(std::memory_order_relaxed); }
+	inline uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+
+	/**
+	 * @param fraction 0 to 1, for example 0.99.
+	 * @return lower bound of the bucket the percentile falls in, 0 if there are no values.
+	 */
+	uint64_t percentile(double fraction) const;
+
+	/**
+	 * @return {"count", "sum", "max", "p50", "p90", "p99"} object.
+	 */
+	pbnjson::JValue toJValue() const;
+
+private:
+	static const int LINEAR_BUCKETS = 16;
+	static const int SUB_BUCKETS = 8;
+	static const int MAX_EXPONENT = 40;
+	static const int BUCKET_COUNT = LINEAR_BUCKETS + (MAX_EXPONENT - 4 + 1) * SUB_BUCKETS;
+
+	static int bucketOf(uint64_t value);
+	static uint64_t bucketStart(int bucket);
+
+	std::atomic<uint64_t> mCount;
+	std::atomic<uint64_t> mSum;
+	std::atomic<uint64_t> mMax;
+	std::atomic<uint64_t> mBuckets[BUCKET_COUNT];
+};
+
+/**
+ * Metrics of a luna method, see ServicePoint.
+ */
+struct MethodMetrics
+{
+	Counter calls; // Calls received, including rejected and cached ones
+	Counter cachedReplies; // Calls answered from the reply cache
+	Histogram parseUs; // Payload parse or decode time, microseconds
+	Histogram handlerUs; // Handler time without parsing, microseconds
+	Histogram replyBytes; // Size of the first reply
+};
+
+/**
+ * @brief Records the time from construction to destruction in a histogram, in microseconds.
+ */
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(Histogram& histogram)
+			: mHistogram(histogram)
+			, mStart(g_get_monotonic_time())
+	{}
+
+	~ScopedTimer()
+	{
+		mHistogram.record(static_cast<uint64_t>(std::max<gint64>(0, g_get_monotonic_time() - mStart)));
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	Histogram& mHistogram;
+	gint64 mStart;
+};
+
+/**
+ * @brief Named counters and histograms of the process.
+ * Metrics are created on first lookup and live as long as the registry, so callers look them up once
+ * and keep the reference. Recording is lock free, only lookup and reporting take a lock.
+ *
+ * Names are dot separated, like "val.video.connect". Methods are named by their luna path.
+ *
+ * Example:
+ * @code
+ * static Histogram& latency = MetricsRegistry::global().histogram("val.video.connect");
+ * ScopedTimer timer(latency);
+ * @endcode
+ *
+ * Multithreading: thread safe.
+ */
+class MetricsRegistry
+{
+public:
+	MetricsRegistry() {}
+
+	MetricsRegistry(const MetricsRegistry&) = delete;
+	MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+	/**
+	 * @return process wide registry. Not destroyed on exit, so it can be used from static destructors.
+	 */
+	static MetricsRegistry& global();
+
+	Counter& counter(const std::string& name);
+	Histogram& histogram(const std::string& name);
+	MethodMetrics& method(const std::string& path);
+
+	/**
+	 * @return {"counters": {name: value}, "histograms": {name: {...}}, "methods": {path: {...}}} object.
+	 */
+	pbnjson::JValue toJValue() const;
+
+	/**
+	 * Log all metrics with values, one line per metric, with info level.
+	 */
+	void logSummary() const;
+
+private:
+	mutable std::mutex mMutex;
+	std::map<std::string, std::unique_ptr<Counter> > mCounters;
+	std::map<std::string, std::unique_ptr<Histogram> > mHistograms;
+	std::map<std::string, std::unique_ptr<MethodMetrics> > mMethods;
+};
+
+} // namespace LSHelpers;
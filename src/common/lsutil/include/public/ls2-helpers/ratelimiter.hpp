@@ -0,0 +1,175 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace LSHelpers {
+
+/**
+ * What to do with a call that is over the caller's budget.
+ */
+enum class RateLimitOverflow
+{
+	Reject, ///< Respond with an error right away. Default.
+	Coalesce, ///< Hold the newest call until the budget allows it, older held calls are superseded.
+};
+
+/**
+ * Token bucket limit. A caller may make burst calls at once, then rate calls per second.
+ */
+struct RateLimit
+{
+	RateLimit(double _rate = 0, double _burst = 0, RateLimitOverflow _overflow = RateLimitOverflow::Reject)
+			: rate(_rate)
+			, burst(_burst)
+			, overflow(_overflow)
+	{}
+
+	inline bool isUnlimited() const { return rate <= 0; }
+
+	double rate; // Calls per second, 0 for no limit
+	double burst; // Bucket size, at least 1
+	RateLimitOverflow overflow;
+};
+
+/**
+ * @brief Per caller token buckets for the methods of a ServicePoint.
+ * Every caller gets its own bucket for every limited method, so one caller going over
+ * its budget does not take budget from the others.
+ * The limit of a method is the one set with setMethodLimit, or the default limit.
+ *
+ * Configuration file format:
+ * @code
+ * {
+ *   "default": {"rate": 100, "burst": 50}, // Optional, limit of methods not listed
+ *   "methods": [ // Optional
+ *     {"method": "/display/setDisplayWindow", "rate": 60, "burst": 10, "overflow": "coalesce"},
+ *     {"method": "/getStatus", "rate": 20, "burst": 20} // "overflow" is optional, default "reject"
+ *   ],
+ *   "exempt": ["com.webos.media"] // Optional, callers that are not limited
+ * }
+ * @endcode
+ *
+ * Methods are named by their luna path, category and method name, like "/display/setDisplayWindow".
+ * Callers are named by application id, or service name for services.
+ *
+ * Multithreading: All methods are thread safe.
+ */
+class RateLimiter
+{
+public:
+	enum class Decision
+	{
+		Admit, ///< Call is within budget, a token was taken.
+		Reject, ///< Over budget, respond with an error.
+		Coalesce, ///< Over budget, hold the call until a token is available.
+	};
+
+	/**
+	 * Throttling statistics of a caller.
+	 */
+	struct CallerStats
+	{
+		std::string caller;
+		uint64_t rejected; // Calls rejected
+		uint64_t coalesced; // Calls held back, including the ones superseded by a newer call
+	};
+
+	RateLimiter();
+
+	RateLimiter(const RateLimiter&) = delete;
+	RateLimiter& operator=(const RateLimiter&) = delete;
+
+	/**
+	 * Set the limit of methods that do not have their own limit. Unlimited by default.
+	 */
+	void setDefaultLimit(const RateLimit& limit);
+
+	/**
+	 * Set the limit of a method.
+	 * @param method method path, for example "/display/setDisplayWindow".
+	 * @param limit the limit, an unlimited one lifts the default limit for the method.
+	 */
+	void setMethodLimit(const std::string& method, const RateLimit& limit);
+
+	/**
+	 * Do not limit calls from a caller.
+	 */
+	void exemptCaller(const std::string& caller);
+
+	/**
+	 * Load the default limit, method limits and exempt callers from a configuration file,
+	 * in the format described above. The loaded settings are added to the current ones.
+	 * @param path file path.
+	 * @return false if the file could not be read or parsed, no settings are changed then.
+	 */
+	bool loadConfig(const std::string& path);
+
+	/**
+	 * @return true if calls to the method may be limited. Quick check before a caller id is looked up.
+	 */
+	bool isLimited(const std::string& method) const;
+
+	/**
+	 * Take a token for a call. Rejected and coalesced calls are counted in the caller statistics.
+	 * @param caller caller id.
+	 * @param method method path.
+	 * @param now monotonic time, microseconds.
+	 * @param wait set to the time until a token is available, microseconds, if not admitted.
+	 * @return decision.
+	 */
+	Decision admit(const std::string& caller, const std::string& method, int64_t now, int64_t& wait);
+
+	/**
+	 * Take a token for a held call. Not counted in statistics.
+	 * @return true if a token was taken, wait is set to the time until one is available otherwise.
+	 */
+	bool retry(const std::string& caller, const std::string& method, int64_t now, int64_t& wait);
+
+	/**
+	 * @param count maximum number of callers to return.
+	 * @return callers with the most rejected and coalesced calls, worst first.
+	 */
+	std::vector<CallerStats> topOffenders(size_t count) const;
+
+private:
+	struct Bucket
+	{
+		double tokens;
+		int64_t updated; // Microseconds
+	};
+
+	const RateLimit& limitOf(const std::string& method) const;
+	bool take(const std::string& caller, const std::string& method, const RateLimit& limit,
+	          int64_t now, int64_t& wait);
+	void pruneBuckets(int64_t now);
+
+	mutable std::mutex mMutex;
+	RateLimit mDefaultLimit;
+	std::unordered_map<std::string, RateLimit> mMethodLimits;
+	std::unordered_set<std::string> mExempt;
+	std::unordered_map<std::string, Bucket> mBuckets; // By caller and method
+	std::unordered_map<std::string, CallerStats> mStats; // By caller
+};
+
+} // namespace LSHelpers;
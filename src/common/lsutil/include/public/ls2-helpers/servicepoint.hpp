@@ -18,14 +18,33 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <glib.h>
 #include <luna-service2/lunaservice.hpp>
 
+#include "asyncrequest.hpp"
+#include "executor.hpp"
 #include "jsonrequest.hpp"
 #include "jsonresponse.hpp"
+#include "metrics.hpp"
+#include "ratelimiter.hpp"
 
 namespace LSHelpers {
 
+/**
+ * Dispatch priority class of a method, see ServicePoint::MethodConfig::priority.
+ */
+enum class MethodPriority
+{
+	Control, ///< Handled as soon as the call arrives. Default.
+	Query, ///< Queued, handled in time slices when there are no calls to other methods waiting.
+};
+
 /**
  * @brief Luna client object. Manages lifetime of a collection of method handlers and ongoing luna calls.
  * Tracks ongoing calls and cancels them if the ServicePoint is destroyed.
@@ -43,6 +62,10 @@ namespace LSHelpers {
  * The method handler and response callback methods are executed in the context of the event loop
  * used by luna handle regardless of the thread it was called from.
  *
+ * Calls to registered methods are recorded in MetricsRegistry::global(), by method path,
+ * and as spans of Tracer::global(), named by method path. Handlers running on the main loop
+ * are marked as LoopActivity, so LoopMonitor can tell which one stalled the loop.
+ *
  * Example:
  * @code
 	class MyClass
@@ -121,7 +144,103 @@ namespace LSHelpers {
  */
 class ServicePoint
 {
+private:
+	struct MethodInfo;
+
 public:
+	/**
+	 * @brief Options of a registered method, returned by registerMethod.
+	 * Example: @code lunaService.registerMethod("/", "getStatus", this, &MyObj::getStatus).priority(MethodPriority::Query); @endcode
+	 */
+	class MethodConfig
+	{
+	public:
+		/**
+		 * Set dispatch priority. Calls to Query methods are queued and handled after calls to
+		 * Control methods, so a burst of queries does not delay control calls.
+		 * @param priority priority class.
+		 * @return this
+		 */
+		MethodConfig& priority(MethodPriority priority);
+
+		/**
+		 * Run the handler on the executor thread instead of the luna main loop.
+		 * Calls are moved to the executor as they arrive, so they are not held up by a busy main loop handler.
+		 * For handlers that only read state published for concurrent readers, like an immutable snapshot.
+		 * Calls still queued when the executor is destroyed are replied with error 5.
+		 * The executor must be destroyed before the ServicePoint.
+		 * @param executor executor to run the handler on.
+		 * @return this
+		 */
+		MethodConfig& runOn(Executor& executor);
+
+		/**
+		 * Limit how often each caller can call the method, see RateLimiter.
+		 * Over budget calls are rejected with error 9, or held and handled later with RateLimitOverflow::Coalesce.
+		 * A held call is answered with error 11 when a newer call from the same caller with the same target
+		 * replaces it, see setTargetFields.
+		 * Calls made within a batch count against the limit of their method like direct calls.
+		 * Such a call is rejected or held the same way, and the batch waits for a held call.
+		 * @param limit the limit.
+		 * @return this
+		 */
+		MethodConfig& rateLimit(const RateLimit& limit);
+
+		/**
+		 * Answer a repeated call with the previous successful reply, without parsing the payload
+		 * or calling the handler. A reply is reused for a call from the same caller with the same payload,
+		 * as long as nothing it may depend on changed since: no call to a method with cached replies was handled
+		 * for the same target or without a target, and invalidateReplyCache was not called for it.
+		 * Targets are named by the fields set with setTargetFields, without them every such call or
+		 * invalidation drops all replies. Replies sent after the handler returns (deferred) are not cached.
+		 * Repeated calls still count against rateLimit and wait for setReady like handled calls.
+		 * For idempotent methods handled on the luna main loop, not with runOn.
+		 * @return this
+		 */
+		MethodConfig& cacheReplies();
+
+		/**
+		 * Handle calls also while the service is not ready, see setReady.
+		 * For methods that do not depend on what the service is waiting for, like diagnostics.
+		 * @return this
+		 */
+		MethodConfig& availableBeforeReady();
+
+	private:
+		friend class ServicePoint;
+		explicit MethodConfig(MethodInfo& method) : mMethod(method) {}
+
+		MethodInfo& mMethod;
+	};
+
+	/**
+	 * Dispatch statistics of a priority class. Calls to methods run on an executor are not included.
+	 * The delay is measured from the call reaching the method handler, including the wait for setReady.
+	 */
+	struct PriorityStats
+	{
+		uint64_t dispatched; // Calls handled
+		uint64_t totalDelayUs; // Sum of time from arrival to handler, in microseconds
+		uint64_t maxDelayUs; // Longest time from arrival to handler, in microseconds
+		uint64_t aged; // Query calls handled at default priority, the oldest call waited too long
+		size_t queued; // Calls waiting
+	};
+
+	/**
+	 * Reply cache statistics of a method, see MethodConfig::cacheReplies.
+	 */
+	struct ReplyCacheStats
+	{
+		uint64_t hits; // Calls answered from the cache
+		uint64_t misses; // Calls handled
+	};
+
+	/**
+	 * Batch listener function signature.
+	 * @param running true before the first call of a batch is run, false after the last one completes.
+	 */
+	typedef std::function<void(bool running)> BatchListener;
+
 	explicit ServicePoint(LS::Handle* handle);
 	~ServicePoint();
 
@@ -143,12 +262,13 @@ public:
 	 * @param methodName the method name
 	 * @param handler handler method or lambda to call.
 	 * @param schema json schema to use. If set, will validate the request against the schema before calling the handler method.
+	 * @return method options.
 	 * @throws std::logic_error if a method is already registered with specified category and name.
 	 */
-	void registerMethod(const std::string& category,
-	                    const std::string& methodName,
-	                    const JsonRequest::Handler& handler,
-	                    const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema());
+	MethodConfig registerMethod(const std::string& category,
+	                            const std::string& methodName,
+	                            const JsonRequest::Handler& handler,
+	                            const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema());
 
 	/**
 	 * Helper method that accepts a object pointer and method pointer.
@@ -158,18 +278,202 @@ public:
 	 * @param object pointer to the object to call
 	 * @param handler pointer to object's member method
 	 * @param schema json schema to use. If set, will validate the request against the schema before calling the handler method.
+	 * @return method options.
 	 * @throws std::logic_error if a method is already registered with specified category and name.
 	 */
 	template<typename T>
-	void registerMethod(const std::string& category,
-	                    const std::string& methodName,
-	                    T* object,
-	                    pbnjson::JValue (T::* handler) (JsonRequest& request),
-	                    const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema())
+	MethodConfig registerMethod(const std::string& category,
+	                            const std::string& methodName,
+	                            T* object,
+	                            pbnjson::JValue (T::* handler) (JsonRequest& request),
+	                            const pbnjson::JSchema& schema = pbnjson::JSchema::AllSchema())
 	{
-		registerMethod(category, methodName, std::bind(handler, object,  std::placeholders::_1), schema);
+		return registerMethod(category, methodName, std::bind(handler, object,  std::placeholders::_1), schema);
 	};
 
+	/**
+	 * Registers a streaming method, with request parameters decoded into a typed struct.
+	 * The payload is decoded straight into Params with a JsonStreamParser, without building a DOM.
+	 * Inputs the streaming decoder does not handle fall back to JsonParser, see JsonRequest::decode.
+	 * Parse errors are responded with the same error the JsonParser path would give,
+	 * the handler is only called with successfully decoded parameters.
+	 * The handler should not use request.get(), only the decoded parameters.
+	 *
+	 * Example: @code lunaService.registerMethod("/", "myMethod", this, &MyObj::myMethod); @endcode
+	 * @param category category name. For example "/"
+	 * @param methodName the method name
+	 * @param object pointer to the object to call
+	 * @param handler pointer to object's member method
+	 * @return method options.
+	 * @throws std::logic_error if a method is already registered with specified category and name.
+	 */
+	template<typename T, typename Params>
+	MethodConfig registerMethod(const std::string& category,
+	                            const std::string& methodName,
+	                            T* object,
+	                            pbnjson::JValue (T::* handler) (JsonRequest& request, Params& params))
+	{
+		auto decodingHandler = [object, handler](JsonRequest& request) -> pbnjson::JValue
+		{
+			Params params;
+			if (!request.decode(params))
+			{
+				return ErrorResponse(3, request.getError());
+			}
+
+			return (object->*handler)(request, params);
+		};
+
+		return MethodConfig(addMethod(category, methodName, decodingHandler, pbnjson::JSchema::AllSchema(), true));
+	};
+
+	/**
+	 * Registers a method that runs a list of calls to the methods of this ServicePoint in one luna call.
+	 * The calls are run in order, in-process, with the handlers and schemas they are registered with.
+	 * A call that defers its response is waited for before the next one is run.
+	 *
+	 * Request: @code
+	 * {
+	 *   "calls": [{"category": "/", "method": "connect", "params": {...}}, ...],
+	 *   "stopOnError": true // Optional, default true. Do not run the rest of the calls after a failed one.
+	 * }
+	 * @endcode
+	 *
+	 * Response: @code
+	 * {
+	 *   "returnValue": true, // False if any of the calls failed
+	 *   "results": [{...}, ...], // Responses of the calls that were run, in order
+	 *   "failedCall": 1, "errorCode": 3, "errorMessage": "..." // First failed call and its error
+	 * }
+	 * @endcode
+	 *
+	 * Subscriptions and nested batches are not supported, such calls fail.
+	 *
+	 * @param category category name. For example "/"
+	 * @param methodName the method name. For example "batch"
+	 * @param listener called when a batch starts and ends. Can be used to hold back notifications until the end.
+	 * @throws std::logic_error if a method is already registered with specified category and name.
+	 */
+	void registerBatchMethod(const std::string& category,
+	                         const std::string& methodName,
+	                         const BatchListener& listener = nullptr);
+
+	/**
+	 * Set how long queued Query calls are handled in one main loop iteration before
+	 * yielding to other events. At least one call is handled per iteration.
+	 * @param microseconds time slice, default 2000.
+	 */
+	inline void setQueryTimeSlice(unsigned microseconds)
+	{
+		mQueryTimeSlice = microseconds;
+	}
+
+	/**
+	 * Set how long the oldest queued Query call can wait before the queue is drained at default priority,
+	 * alongside Control calls, instead of only when the main loop is idle. So queries are handled also
+	 * while control calls keep arriving. The queue goes back to idle priority once the oldest call
+	 * is younger than this.
+	 * @param microseconds maximum queue delay, default 100000.
+	 */
+	inline void setQueryMaxDelay(unsigned microseconds)
+	{
+		mQueryMaxDelay = microseconds;
+	}
+
+	/**
+	 * @param priority priority class.
+	 * @return dispatch statistics of the class.
+	 */
+	PriorityStats getPriorityStats(MethodPriority priority) const;
+
+	/**
+	 * Set whether calls are handled. Lets the service register on the bus before it finished
+	 * initializing: while not ready, calls are kept in the order they arrived, except calls to methods
+	 * registered with MethodConfig::availableBeforeReady. When set ready, the kept calls are routed
+	 * as if they just arrived. Needs to be called from the luna main loop. Ready by default.
+	 * @param ready true to handle calls.
+	 */
+	void setReady(bool ready);
+
+	inline bool isReady() const
+	{
+		return mReady;
+	}
+
+	/**
+	 * @return number of calls waiting for the service to become ready.
+	 */
+	inline size_t getWaitingCallCount() const
+	{
+		return mWaitingCalls.size();
+	}
+
+	/**
+	 * Rate limits of the methods of this ServicePoint. Use to load the configuration
+	 * and to read the caller statistics.
+	 * Callers are identified by application id, or service name for services.
+	 * @return the rate limiter.
+	 */
+	inline RateLimiter& getRateLimiter()
+	{
+		return mRateLimiter;
+	}
+
+	/**
+	 * Set the payload fields that name what a call acts on, like the sink of a video call.
+	 * Held calls (RateLimitOverflow::Coalesce) are only superseded by calls with the same values
+	 * of these fields, so a call for one target does not replace a call for another. Cached replies
+	 * are dropped per target, see MethodConfig::cacheReplies. None by default,
+	 * a newer call to the same method replaces any held one.
+	 * @param fields top level payload field names.
+	 */
+	inline void setTargetFields(const std::vector<std::string>& fields)
+	{
+		mTargetFields = fields;
+	}
+
+	/**
+	 * Drop all cached replies. Call when state that the replies depend on changes
+	 * outside of the methods with cached replies. Needs to be called from the luna main loop.
+	 */
+	inline void invalidateReplyCache()
+	{
+		mReplyGeneration++;
+	}
+
+	/**
+	 * Drop the cached replies of calls for one target, and of calls without a target, see setTargetFields.
+	 * Call when the state of that target changes outside of the methods with cached replies.
+	 * Replies about other targets stay valid. Needs to be called from the luna main loop.
+	 * Example: @code service.invalidateReplyCache("sink", "MAIN"); @endcode
+	 * @param field target field name.
+	 * @param value value of the field that names the changed target.
+	 */
+	void invalidateReplyCache(const std::string& field, const std::string& value);
+
+	/**
+	 * @param category category name.
+	 * @param methodName the method name.
+	 * @return reply cache statistics of the method, all zero if it is not registered.
+	 */
+	ReplyCacheStats getReplyCacheStats(const std::string& category, const std::string& methodName);
+
+	/**
+	 * @return reply cache statistics of all methods with cached replies, by method path.
+	 */
+	std::map<std::string, ReplyCacheStats> getReplyCacheStats() const;
+
+	/**
+	 * Continue handling a request asynchronously. Defers the request, see AsyncRequest.
+	 * Can be called once per request, from within a method handler running on the luna main loop.
+	 * The return value of the handler is ignored, the reply is sent when the last continuation returns.
+	 * Requests not done when this ServicePoint is destroyed are replied with error 7.
+	 * @param request the request being handled.
+	 * @return handle to await operations with.
+	 * @throw LS::Error on luna error
+	 */
+	AsyncRequest async(JsonRequest& request);
+
 	/**
 	 * Registers a new signal on the bus.
 	 * This just makes the signal visible to introspection.
@@ -322,7 +626,22 @@ public:
 	 */
 	void cancelCall(LSMessageToken token);
 
+	/**
+	 * Path of the method whose handler the calling thread is running, to attribute work to the luna call
+	 * that caused it. Calls in a batch are reported with their own path.
+	 * Not set in continuations of deferred requests.
+	 * @return method path, like "/display/setDisplayWindow", nullptr outside of handlers.
+	 */
+	static const char* currentMethod();
+
+	/**
+	 * @return process wide unique number of the call the calling thread is handling, 0 outside of handlers.
+	 */
+	static uint64_t currentCallId();
+
 private:
+	friend class AsyncRequest;
+
 	// Internal call object
 	struct Call
 	{
@@ -348,12 +667,22 @@ private:
 		           const JsonRequest::Handler& _handler,
 		           const pbnjson::JSchema& _schema,
 		           const std::string& _category,
-		           const std::string& _method)
+		           const std::string& _method,
+		           bool _streaming)
 				: service(_service)
 				, handler(_handler)
 				, schema(_schema)
 				, category(_category)
 				, method(_method)
+				, path(_category == "/" ? "/" + _method : _category + "/" + _method)
+				, streaming(_streaming)
+				, batch(false)
+				, priority(MethodPriority::Control)
+				, executor(nullptr)
+				, cacheReplies(false)
+				, beforeReady(false)
+				, cacheStats()
+				, metrics(&MetricsRegistry::global().method(path))
 		{}
 
 		ServicePoint* service;
@@ -361,14 +690,104 @@ private:
 		pbnjson::JSchema schema;
 		std::string category;
 		std::string method;
+		std::string path; // Category and method, like "/display/setDisplayWindow"
+		bool streaming; // Payload is decoded by the handler, see JsonRequest::handleStreamingLunaCall
+		bool batch; // Batch method, see registerBatchMethod
+		MethodPriority priority;
+		Executor* executor; // Handler runs on this executor, see MethodConfig::runOn
+		bool cacheReplies; // See MethodConfig::cacheReplies
+		bool beforeReady; // See MethodConfig::availableBeforeReady
+		ReplyCacheStats cacheStats;
+		MethodMetrics* metrics; // Owned by the global MetricsRegistry
+	};
+
+	// Call waiting in the query queue, or for the service to become ready.
+	struct QueuedCall
+	{
+		MethodInfo* method;
+		LSMessage* message; // Referenced while queued
+		gint64 arrival; // Monotonic time, microseconds
+	};
+
+	// Batch in progress, see registerBatchMethod
+	struct Batch;
+
+	// Over budget call waiting for a token, see MethodConfig::rateLimit.
+	struct HeldCall
+	{
+		ServicePoint* service;
+		MethodInfo* method;
+		LSMessage* message; // Referenced while held, nullptr for a call in a batch
+		std::shared_ptr<Batch> batch; // Batch the call is made in
+		size_t index; // Index of the call in the batch
+		pbnjson::JValue params; // Validated params of the call in the batch
+		std::string caller;
+		std::string key; // Caller, method path and target
+		GSource* timer;
+	};
+
+	// Successful reply kept for repeated calls, see MethodConfig::cacheReplies.
+	struct CachedReply
+	{
+		std::string payload;
+		uint64_t generation; // mReplyGeneration when the reply was sent
+		std::string target; // Target of the call, see callTarget
+		std::string reply;
 	};
 
 	LSMessageToken makeCall(const std::string& uri, const pbnjson::JValue& params, bool oneReply, const JsonResponse::Handler& handler);
 	void cancelCall(Call* call);
 
+	MethodInfo& addMethod(const std::string& category,
+	                      const std::string& methodName,
+	                      const JsonRequest::Handler& handler,
+	                      const pbnjson::JSchema& schema,
+	                      bool streaming);
+	MethodInfo* findMethod(const std::string& category, const std::string& methodName);
 	void registerMethodImpl(MethodInfo& method);
 	void unregisterMethodImpl(MethodInfo& method);
 
+	pbnjson::JValue handleBatch(JsonRequest& request, const BatchListener& listener);
+	static void runBatch(const std::shared_ptr<Batch>& batch);
+	static void dispatchBatchCall(const std::shared_ptr<Batch>& batch, size_t index);
+	static void handleBatchCall(const std::shared_ptr<Batch>& batch,
+	                            size_t index,
+	                            MethodInfo& method,
+	                            const pbnjson::JValue& params);
+	static void resumeBatchCall(const std::shared_ptr<Batch>& batch,
+	                            size_t index,
+	                            MethodInfo& method,
+	                            const pbnjson::JValue& params);
+	static void completeBatchCall(const std::shared_ptr<Batch>& batch, size_t index, const pbnjson::JValue& response);
+	static void finishBatch(Batch& batch);
+
+	void recordDispatch(MethodPriority priority, gint64 arrival);
+	void queueCall(MethodInfo& method, LSMessage* msg, gint64 arrival);
+	static bool dispatchCall(MethodInfo& method, LSMessage* msg);
+	static gboolean drainQueriesCB(gpointer user_data);
+	void updateDrainPriority();
+	static gboolean queryAgedCB(gpointer user_data);
+
+	bool routeCall(MethodInfo& method, LSMessage* msg, gint64 arrival);
+	bool admitCall(MethodInfo& method, LSMessage* msg);
+	bool admitBatchCall(MethodInfo& method,
+	                    const std::shared_ptr<Batch>& batch,
+	                    size_t index,
+	                    const pbnjson::JValue& params);
+	void holdCall(std::unique_ptr<HeldCall> call, const std::string& target, int64_t wait);
+	static void answerHeldCall(HeldCall& call, const ErrorResponse& error);
+	void scheduleHeldCall(HeldCall& call, int64_t wait);
+	static gboolean heldCallCB(gpointer user_data);
+	static std::string callerId(LSMessage* msg);
+	std::string callTarget(const pbnjson::JValue& params) const;
+	static void respondError(LSMessage* msg, const ErrorResponse& error);
+
+	bool respondFromCache(MethodInfo& method, LSMessage* msg);
+	bool dispatchCachedCall(MethodInfo& method, LSMessage* msg);
+	void storeReply(MethodInfo& method, LSMessage* msg, const std::string& target, const pbnjson::JValue& result);
+	void invalidateTarget(const std::string& target);
+	static std::string replyCacheKey(const MethodInfo& method, LSMessage* msg);
+
 	static bool methodHandler(LSHandle *sh, LSMessage *msg, void *method_context);
 	static bool removedMethodHandler(LSHandle *sh, LSMessage *msg, void *method_context);
 	static bool callResponseHandler(LSHandle *sh, LSMessage *reply, void *ctx);
@@ -380,6 +799,30 @@ private:
 	std::vector<std::unique_ptr<MethodInfo> > mMethods;
 	std::unordered_map<LSMessageToken, std::unique_ptr<Call> > mCalls;
 	std::mutex mCallsMutex; // Lock access to mCalls.
+	std::shared_ptr<void> mLifetime; // Released on destruction, stops batches in progress.
+	std::unordered_set<AsyncRequest::State*> mAsyncRequests; // Not done yet, accessed only from the luna main loop
+
+	// Priority dispatch, accessed only from the luna main loop.
+	std::deque<QueuedCall> mQueries;
+	GSource* mDrainSource;
+	unsigned mQueryTimeSlice; // Microseconds
+	unsigned mQueryMaxDelay; // Microseconds
+	bool mDrainAged; // The drain source runs at default priority
+	GSource* mAgingSource; // Fires when the oldest query reaches mQueryMaxDelay
+	PriorityStats mPriorityStats[2]; // By MethodPriority
+
+	// Rate limiting, held calls are accessed only from the luna main loop.
+	RateLimiter mRateLimiter;
+	std::unordered_map<std::string, std::unique_ptr<HeldCall> > mHeldCalls; // By key
+	std::vector<std::string> mTargetFields; // See setTargetFields
+
+	// Reply cache, accessed only from the luna main loop.
+	std::unordered_map<std::string, CachedReply> mReplyCache; // By method, caller and payload hash
+	uint64_t mReplyGeneration; // Changes whenever cached replies may have become stale
+
+	// Startup, accessed only from the luna main loop, see setReady.
+	bool mReady;
+	std::deque<QueuedCall> mWaitingCalls;
 };
 
 } // namespace LSHelpers;
@@ -0,0 +1,206 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace LSHelpers {
+
+/**
+ * @brief Subscriber bookkeeping used by SubscriptionPoint.
+ * Subscribers are indexed by their unique token and grouped by sender (the owning service),
+ * so cancellation and "sender went down" handling do not need to scan the whole list.
+ *
+ * The list of values is published as an immutable copy-on-write snapshot.
+ * The snapshot is rebuilt lazily on the first snapshot() call after a change,
+ * so a burst of adds/removes costs a single rebuild and repeated posts cost nothing.
+ *
+ * Multithreading: This class is **not** thread safe. Snapshots are immutable and can be
+ * used from any thread after they are obtained.
+ *
+ * @tparam T subscriber value type.
+ */
+template<typename T>
+class SubscriberRegistry
+{
+public:
+	typedef std::vector<T> List;
+	typedef std::shared_ptr<const List> Snapshot;
+
+	SubscriberRegistry()
+			: mSnapshot { std::make_shared<const List>() }
+			, mDirty { false }
+	{}
+
+	SubscriberRegistry(const SubscriberRegistry&) = delete;
+	SubscriberRegistry& operator=(const SubscriberRegistry&) = delete;
+
+	/**
+	 * Add a subscriber.
+	 * @param token unique token of the subscription.
+	 * @param group sender the subscription belongs to.
+	 * @param value value to publish in snapshots.
+	 * @return true if this is the first subscriber in the group.
+	 */
+	bool add(const std::string& token, const std::string& group, T value)
+	{
+		mDirty = true;
+
+		auto iter = mItems.find(token);
+		if (iter != mItems.end())
+		{
+			// Same token subscribed twice, replace the value but keep the group membership.
+			iter->second.value = std::move(value);
+			return false;
+		}
+
+		mItems.emplace(token, Item { std::move(value), group });
+		auto& members = mGroups[group];
+		members.insert(token);
+		return members.size() == 1;
+	}
+
+	/**
+	 * Remove a subscriber by token.
+	 * @param token unique token of the subscription.
+	 * @param emptiedGroup set to the group name if the removed subscriber was the last one in it.
+	 * @return true if the subscriber was found.
+	 */
+	bool remove(const std::string& token, std::string* emptiedGroup = nullptr)
+	{
+		return remove(token, emptiedGroup, [](const T&) {});
+	}
+
+	/**
+	 * Remove a subscriber by token.
+	 * @param token unique token of the subscription.
+	 * @param emptiedGroup set to the group name if the removed subscriber was the last one in it.
+	 * @param onRemove called with the value before it is removed.
+	 * @return true if the subscriber was found.
+	 */
+	template<typename OnRemove>
+	bool remove(const std::string& token, std::string* emptiedGroup, OnRemove onRemove)
+	{
+		auto iter = mItems.find(token);
+		if (iter == mItems.end())
+		{
+			return false;
+		}
+
+		onRemove(iter->second.value);
+
+		auto group = mGroups.find(iter->second.group);
+		if (group != mGroups.end())
+		{
+			group->second.erase(token);
+			if (group->second.empty())
+			{
+				if (emptiedGroup)
+				{
+					*emptiedGroup = group->first;
+				}
+				mGroups.erase(group);
+			}
+		}
+
+		mItems.erase(iter);
+		mDirty = true;
+		return true;
+	}
+
+	/**
+	 * Remove all subscribers of a group.
+	 * @return number of subscribers removed.
+	 */
+	size_t removeGroup(const std::string& group)
+	{
+		return removeGroup(group, [](const T&) {});
+	}
+
+	/**
+	 * Remove all subscribers of a group.
+	 * @param onRemove called with every value before it is removed.
+	 * @return number of subscribers removed.
+	 */
+	template<typename OnRemove>
+	size_t removeGroup(const std::string& group, OnRemove onRemove)
+	{
+		auto iter = mGroups.find(group);
+		if (iter == mGroups.end())
+		{
+			return 0;
+		}
+
+		size_t count = iter->second.size();
+		for (const auto& token : iter->second)
+		{
+			auto item = mItems.find(token);
+			if (item != mItems.end())
+			{
+				onRemove(item->second.value);
+				mItems.erase(item);
+			}
+		}
+
+		mGroups.erase(iter);
+		mDirty = mDirty || count > 0;
+		return count;
+	}
+
+	/**
+	 * @return immutable list of all subscriber values.
+	 */
+	Snapshot snapshot()
+	{
+		if (mDirty)
+		{
+			std::shared_ptr<List> list = std::make_shared<List>();
+			list->reserve(mItems.size());
+			for (const auto& item : mItems)
+			{
+				list->push_back(item.second.value);
+			}
+
+			mSnapshot = list;
+			mDirty = false;
+		}
+
+		return mSnapshot;
+	}
+
+	inline size_t size() const { return mItems.size(); }
+	inline bool empty() const { return mItems.empty(); }
+	inline bool hasGroup(const std::string& group) const { return mGroups.count(group) > 0; }
+
+private:
+	struct Item
+	{
+		T value;
+		std::string group;
+	};
+
+	std::unordered_map<std::string, Item> mItems; // By unique token
+	std::unordered_map<std::string, std::unordered_set<std::string> > mGroups; // Group -> tokens
+	Snapshot mSnapshot;
+	bool mDirty;
+};
+
+} // namespace LSHelpers;
@@ -16,14 +16,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include <algorithm>
 #include <pbnjson.hpp>
 #include <luna-service2/lunaservice.hpp>
 
 #include "serverstatus.hpp"
 #include "jsonrequest.hpp"
+#include "subscriberregistry.hpp"
 
 namespace LSHelpers {
 
@@ -32,6 +38,10 @@ namespace LSHelpers {
  * @details Contains a list of subscribed clients and allows sending subscription updates to them.
  * All sending is performed asynchronously on luna service thread.
  *
+ * Subscribers are indexed by unique token, and a single server status watch is shared by all
+ * subscriptions of the same sender. Posting does not copy the subscriber list, it takes a reference
+ * to an immutable snapshot that is only rebuilt after subscribers were added or removed.
+ *
  * Multithreading: This class is fully thread safe.
  *
  * Example:
@@ -77,38 +87,35 @@ private:
  */
 class SubscriptionPoint
 {
-
-	struct SubscriptionItem
+public:
+	/**
+	 * Counters describing the fan-out, see getStats().
+	 */
+	struct Stats
 	{
-
-		friend class SubscriptionPoint;
-
-	private:
-		SubscriptionItem(LS::Message _message, SubscriptionPoint *_parent)
-				: message { std::move(_message) }
-				, parent { _parent }
-		{ }
-
-	public:
-
-		SubscriptionItem(const SubscriptionItem &) = delete;
-		SubscriptionItem &operator=(const SubscriptionItem &) = delete;
-		SubscriptionItem(const SubscriptionItem &&) = delete;
-		SubscriptionItem &operator=(const SubscriptionItem &&) = delete;
-
-	private:
-		LS::Message message;
-		SubscriptionPoint *parent;
-		ServerStatus status;
+		uint64_t posted;     // Payloads accepted by post()
+		uint64_t sent;       // Responses handed to luna
+		uint64_t collapsed;  // Updates skipped because a newer one replaced them
+		uint64_t failed;     // Responses luna failed to send
+		uint64_t cutOff;     // Subscriptions cancelled for being too slow
+		uint64_t deferred;   // Times a subscriber was passed over, its outstanding updates at the limit
 	};
 
-	friend struct SubscriptionItem;
-
-public:
 	explicit
 	SubscriptionPoint(LS::Handle* service = nullptr)
 			: mServiceHandle {nullptr }
+			, mSubscriberCount { 0 }
 			, mDeduplicate { false }
+			, mMaxOutstanding { 0 }
+			, mDrainRate { 0 }
+			, mSlowSubscriberLimit { 0 }
+			, mMaxResponsesPerIteration { DEFAULT_RESPONSES_PER_ITERATION }
+			, mLastSeq { 0 }
+			, mFlushSource { nullptr }
+			, mRetrySource { nullptr }
+			, mRoundCursor { 0 }
+			, mRoundWaiting { false }
+			, mStats {}
 	{
 		setServiceHandle(service);
 	}
@@ -116,11 +123,9 @@ public:
 	/**
 	 * Delete the subscription point.
 	 * Sends out any pending messages before deletion.
+	 * Needs to be deleted from the luna handle thread if there may be posts in flight.
 	 */
-	~SubscriptionPoint()
-	{
-		unsetCancelNotificationCallback();
-	}
+	~SubscriptionPoint();
 
 	SubscriptionPoint(const SubscriptionPoint &) = delete;
 	SubscriptionPoint &operator=(const SubscriptionPoint &) = delete;
@@ -132,6 +137,66 @@ public:
 		mDeduplicate = deduplicate;
 	}
 
+	/**
+	 * Name the updates are recorded with in a traffic capture, see Capture.
+	 * @param name usually the path of the method that adds the subscriptions.
+	 */
+	void setName(const std::string& name)
+	{
+		mName = name;
+	}
+
+	/**
+	 * Limit the number of updates outstanding per subscriber: queued here and, with setDrainRate,
+	 * handed to luna but not read by the subscriber yet.
+	 * When a subscriber has more queued updates than there is room for, they are collapsed and only
+	 * the newest one is sent. A subscriber without any room keeps its updates queued here, collapsed,
+	 * until it has read some of the ones before.
+	 * Use only if every posted payload is a complete state that supersedes the previous ones.
+	 * @param maxOutstanding maximum number of outstanding updates, 0 - unlimited (default).
+	 */
+	void setMaxOutstanding(size_t maxOutstanding)
+	{
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		mMaxOutstanding = maxOutstanding;
+		trimPending();
+	}
+
+	/**
+	 * Estimate how fast subscribers read their updates.
+	 * Luna does not tell when a response left its queue, so a response handed to luna is counted as
+	 * outstanding until the subscriber could have read it at this rate. Together with setMaxOutstanding
+	 * this bounds what luna queues for a subscriber that stopped reading.
+	 * @param responsesPerSecond 0 - responses count as read once handed to luna (default).
+	 */
+	void setDrainRate(unsigned responsesPerSecond)
+	{
+		mDrainRate = responsesPerSecond;
+	}
+
+	/**
+	 * Cancel chronically slow subscribers.
+	 * A subscriber gets a strike when luna failed to send it an update, and when it is passed over
+	 * because its outstanding updates are at the limit. It is cancelled after this many strikes in a row.
+	 * Collapsed updates alone do not count, they follow from bursts of posts and hit all subscribers alike.
+	 * It receives a final error response with "subscribed": false.
+	 * @param limit number of consecutive strikes, 0 - never cancel (default).
+	 */
+	void setSlowSubscriberLimit(unsigned limit)
+	{
+		mSlowSubscriberLimit = limit;
+	}
+
+	/**
+	 * Maximum number of responses sent from one main loop iteration.
+	 * Larger fan-outs continue in the following iterations, so other sources get to run in between.
+	 * @param count responses per iteration, 0 - send everything in one iteration.
+	 */
+	void setMaxResponsesPerIteration(size_t count)
+	{
+		mMaxResponsesPerIteration = count;
+	}
+
 	/**
 	 * Speficy service to use for sending subscription replies.
 	 * Optional - the service handle will be derived from the first subscription added, if not set.
@@ -169,6 +234,17 @@ public:
 		addSubscription(request.getMessage());
 	}
 
+	/**
+	 * Subscribe sender of the given message and send it a first response in sequence with the posted updates.
+	 * The first response is built under the subscription lock and sent by the fan-out before any update
+	 * posted after it, so the subscriber cannot receive an older state after a newer update.
+	 * Use when subscribing from a thread other than the one that posts, and defer the request,
+	 * the first response is its reply.
+	 * @param message subscription message to process.
+	 * @param firstResponse builds the first response. Must not call into this SubscriptionPoint.
+	 */
+	void addSubscription(const LS::Message& message, const std::function<pbnjson::JValue()>& firstResponse);
+
 	/**
 	 * Post payload to all subscribers
 	 * @param payload posted data
@@ -192,16 +268,91 @@ public:
 	 */
 	bool hasSubscribers() const
 	{
-		// Not locking the mutex here, should be atomic read.
-		return !mSubscriptions.empty();
+		return mSubscriberCount.load(std::memory_order_relaxed) > 0;
+	}
+
+	/**
+	 * Returns number of active subscriptions
+	 */
+	size_t getSubscriberCount() const
+	{
+		return mSubscriberCount.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Returns fan-out counters.
+	 */
+	Stats getStats()
+	{
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		return mStats;
 	}
 
 private:
+	static const size_t DEFAULT_RESPONSES_PER_ITERATION = 64;
+
+	typedef std::shared_ptr<const std::string> Payload;
+
+	// Subscriber state. first, deliveredSeq, inFlight, drainedAt and strikes are only accessed
+	// from the luna handle thread, after the subscriber was added.
+	struct Subscriber
+	{
+		Subscriber(const LS::Message& _message, const std::string& _token, uint64_t _deliveredSeq)
+				: message { _message }
+				, token { _token }
+				, first {}
+				, deliveredSeq { _deliveredSeq }
+				, inFlight { 0 }
+				, drainedAt { 0 }
+				, strikes { 0 }
+				, cancelled { false }
+		{ }
+
+		LS::Message message;
+		std::string token;
+		Payload first; // First response not sent yet, see addSubscription.
+		uint64_t deliveredSeq; // Sequence number of the last update handed to luna.
+		size_t inFlight; // Responses handed to luna and not read yet, estimated with mDrainRate.
+		gint64 drainedAt; // Monotonic time inFlight was last brought up to date.
+		unsigned strikes; // Consecutive failed deliveries or passes without room.
+		std::atomic<bool> cancelled;
+	};
+
+	// Limits a fan-out round delivers with.
+	struct Limits
+	{
+		size_t maxOutstanding;
+		unsigned drainRate; // 0 - not estimated
+	};
+
+	typedef std::shared_ptr<Subscriber> SubscriberPtr;
+
+	struct PendingPost
+	{
+		uint64_t seq;
+		Payload payload;
+	};
+
 	LSHandle *mServiceHandle;
-	std::vector<std::unique_ptr<SubscriptionItem> > mSubscriptions; //Active subscriptions
+	SubscriberRegistry<SubscriberPtr> mSubscriptions; //Active subscriptions by unique token
+	std::unordered_map<std::string, std::shared_ptr<ServerStatus> > mSenderWatches; // One watch per sender
+	std::atomic<size_t> mSubscriberCount;
 	bool mDeduplicate;
+	size_t mMaxOutstanding;
+	std::atomic<unsigned> mDrainRate;
+	std::atomic<unsigned> mSlowSubscriberLimit;
+	std::atomic<size_t> mMaxResponsesPerIteration;
 	std::string mPreviousPayload;
-	std::mutex mSubscriptonsMutex; // Lock to access mSubscriptions and mPreviousPayload
+	std::string mName;
+	std::deque<PendingPost> mPending; // Posted updates not yet delivered to all subscribers.
+	uint64_t mLastSeq; // Sequence number of the last post.
+	GSource* mFlushSource; // Fan-out in progress.
+	GSource* mRetrySource; // Fan-out waiting for subscribers to read their outstanding updates.
+	SubscriberRegistry<SubscriberPtr>::Snapshot mRound; // Subscribers visited by the current fan-out round.
+	size_t mRoundCursor; // Next subscriber of the round.
+	bool mRoundWaiting; // A subscriber of the round was passed over for lack of room.
+	Stats mStats;
+	std::mutex mSubscriptonsMutex; // Lock to access all of the above except the atomics.
 
 	void setCancelNotificationCallback()
 	{
@@ -215,10 +366,21 @@ private:
 			LSCallCancelNotificationRemove(mServiceHandle, subscriberCancelCB, this, LS::Error().get());
 	}
 
+	void addSubscriber(const LS::Message& message, const std::function<pbnjson::JValue()>& firstResponse);
+	void removeSubscription(const std::string& token, std::shared_ptr<ServerStatus>& watch);
+	GSource* addSource(guint delayMs, GSourceFunc callback);
+	bool scheduleFlush();
+	void scheduleRetry(guint delayMs);
+	void trimPending();
+	bool flush(size_t budget, bool final = false);
+	bool deliver(Subscriber& subscriber, const std::vector<PendingPost>& pending,
+	             const Limits& limits, gint64 now, Stats& stats, bool& waiting);
+	static void drain(Subscriber& subscriber, unsigned rate, gint64 now);
+
 	static bool subscriberCancelCB(LSHandle *sh, const char *uniqueToken, void *context);
-	void subscriberStatusCB(SubscriptionItem* item, bool isUp);
-	static bool postSubscriptions(gpointer user_data);
-	static bool doSubscribe(gpointer user_data);
+	void subscriberStatusCB(const std::string& sender, bool isUp);
+	static gboolean flushCB(gpointer user_data);
+	static gboolean retryCB(gpointer user_data);
 };
 
 } // namespace LSHelpers;
@@ -0,0 +1,164 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <pbnjson.hpp>
+
+namespace LSHelpers {
+
+/**
+ * @brief Timeline of spans, for finding where the time of a multi step operation went.
+ *
+ * Every thread records into its own ring buffer of fixed size records, so recording takes no lock
+ * and allocates nothing. The oldest records are overwritten when a buffer is full.
+ * Spans carry a tag, like the sink or pipeline context the work is for, taken from the innermost
+ * TraceTag of the thread. The timeline is exported in Chrome trace event format,
+ * to be loaded in chrome://tracing or Perfetto.
+ *
+ * Example:
+ * @code
+ * TraceTag tag(sinkName);
+ * TraceSpan span("connect");
+ * @endcode
+ *
+ * Multithreading: thread safe. Buffers of threads that exit are reused by new threads, dropping their spans.
+ */
+class Tracer
+{
+public:
+	static const size_t NAME_SIZE = 40; // Including terminating zero, longer names are cut
+	static const size_t TAG_SIZE = 32;
+
+	/**
+	 * @return process wide tracer.
+	 */
+	static Tracer& global();
+
+	struct ThreadBuffer; // Internal
+
+	/**
+	 * Enable or disable recording. Enabled by default.
+	 */
+	inline void setEnabled(bool enabled)
+	{
+		mEnabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	inline bool isEnabled() const
+	{
+		return mEnabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Record a span of the calling thread.
+	 * @param name span name.
+	 * @param tag correlation tag, may be empty.
+	 * @param start start time, monotonic, microseconds.
+	 * @param end end time, monotonic, microseconds.
+	 */
+	void record(const char* name, const char* tag, gint64 start, gint64 end);
+
+	/**
+	 * @return {"traceEvents": [...]} object with the spans of all threads, oldest first.
+	 */
+	pbnjson::JValue toChromeTrace() const;
+
+	/**
+	 * Drop all recorded spans.
+	 */
+	void clear();
+
+	/**
+	 * @return tag of the innermost TraceTag of the calling thread, empty if none.
+	 */
+	static const char* currentTag();
+
+private:
+	friend class TraceTag;
+
+	struct Record
+	{
+		std::atomic<uint32_t> seq; // Odd while being written
+		gint64 start;
+		gint64 duration;
+		char name[NAME_SIZE];
+		char tag[TAG_SIZE];
+	};
+
+	Tracer();
+	ThreadBuffer& threadBuffer();
+	void releaseBuffer(ThreadBuffer* buffer);
+
+	std::atomic<bool> mEnabled;
+	mutable std::mutex mMutex;
+	std::vector<ThreadBuffer*> mBuffers; // Never freed
+	std::vector<ThreadBuffer*> mFreeBuffers; // Buffers of threads that exited
+};
+
+/**
+ * @brief Records a span from construction to destruction, see Tracer.
+ */
+class TraceSpan
+{
+public:
+	/**
+	 * @param name span name, copied when the span is recorded.
+	 */
+	explicit TraceSpan(const char* name)
+			: mName(name)
+			, mStart(Tracer::global().isEnabled() ? g_get_monotonic_time() : 0)
+	{}
+
+	~TraceSpan()
+	{
+		if (mStart)
+		{
+			Tracer::global().record(mName, Tracer::currentTag(), mStart, g_get_monotonic_time());
+		}
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char* mName;
+	gint64 mStart;
+};
+
+/**
+ * @brief Sets the tag of the spans recorded by the thread in this scope, see Tracer.
+ */
+class TraceTag
+{
+public:
+	explicit TraceTag(const std::string& tag);
+	~TraceTag();
+
+	TraceTag(const TraceTag&) = delete;
+	TraceTag& operator=(const TraceTag&) = delete;
+
+private:
+	const char* mPrevious;
+	char mTag[Tracer::TAG_SIZE];
+};
+
+} // namespace LSHelpers;
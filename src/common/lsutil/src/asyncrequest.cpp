@@ -0,0 +1,227 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "asyncrequest.hpp"
+#include "servicepoint.hpp"
+#include "util.hpp"
+
+using namespace pbnjson;
+
+namespace LSHelpers {
+
+struct AsyncRequest::State
+{
+	State(ServicePoint* _service,
+	      const JsonRequest::DeferredResponseFunction& _respond,
+	      GMainContext* _context,
+	      const char* _method)
+			: service(_service)
+			, respond(_respond)
+			, context(_context)
+			, method(_method ? _method : "")
+			, started(0)
+			, done(false)
+	{
+		g_main_context_ref(context);
+		service->mAsyncRequests.insert(this);
+	}
+
+	~State()
+	{
+		if (service)
+		{
+			service->mAsyncRequests.erase(this);
+		}
+
+		if (!done)
+		{
+			// No step is waiting anymore, nothing would reply.
+			reply(API_ERROR_CANCELLED);
+		}
+
+		g_main_context_unref(context);
+	}
+
+	void reply(const JValue& response)
+	{
+		done = true;
+
+		try
+		{
+			respond(response);
+		}
+		catch (LS::Error& e)
+		{
+			e.log(PmLogGetLibContext(), "LS_ASYNC_RESPOND_FAIL");
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Method '%s' async reply throws exception: %s",
+			          method.c_str(), e.what());
+		}
+	}
+
+	ServicePoint* service; // Cleared when the ServicePoint is destroyed
+	JsonRequest::DeferredResponseFunction respond;
+	GMainContext* context; // Continuations are run in this context
+	std::string method;
+	unsigned started; // Number of awaits started
+	bool done; // Replied or cancelled
+};
+
+struct AsyncRequest::CallStep: public AsyncRequest::Step
+{
+	CallStep(const std::function<JValue(JsonResponse& response)>& _then)
+			: then(_then)
+			, response(nullptr)
+	{}
+
+	JValue resume() override
+	{
+		return then(*response);
+	}
+
+	std::function<JValue(JsonResponse& response)> then;
+	JsonResponse* response; // Set while the continuation runs
+};
+
+AsyncRequest::AsyncRequest(ServicePoint* service, JsonRequest& request, GMainContext* context)
+		: mState(std::allocate_shared<State>(PoolAllocator<State, State>(),
+		                                     service,
+		                                     request.defer(),
+		                                     context,
+		                                     request.getMessage().getMethod()))
+{
+}
+
+bool AsyncRequest::isDone() const
+{
+	return mState->done;
+}
+
+void AsyncRequest::begin(const std::shared_ptr<Step>& step) const
+{
+	mState->started++;
+	step->state = mState;
+}
+
+// Called by the destroyed ServicePoint.
+void AsyncRequest::cancel(AsyncRequest::State& state)
+{
+	state.service = nullptr;
+	if (!state.done)
+	{
+		state.reply(API_ERROR_CANCELLED);
+	}
+}
+
+std::exception_ptr AsyncRequest::cancelled()
+{
+	return std::make_exception_ptr(API_ERROR_CANCELLED);
+}
+
+void AsyncRequest::await(const std::string& uri,
+                         const pbnjson::JValue& params,
+                         const std::function<pbnjson::JValue(JsonResponse& response)>& then) const
+{
+	if (unlikely(isDone()))
+	{
+		return;
+	}
+
+	std::shared_ptr<CallStep> step = std::allocate_shared<CallStep>(PoolAllocator<CallStep, CallStep>(), then);
+	begin(step);
+
+	// Calls are cancelled when the ServicePoint is destroyed, the request is replied with a cancel error then.
+	mState->service->callOneReply(uri, params, [step](JsonResponse& response)
+	{
+		step->response = &response;
+		resume(*step);
+		step->response = nullptr;
+	});
+}
+
+// Runs the continuation and replies with its result, unless it started another step.
+void AsyncRequest::resume(Step& step)
+{
+	State& state = *step.state;
+
+	if (state.done)
+	{
+		// Cancelled and replied already.
+		return;
+	}
+
+	unsigned started = state.started;
+
+	try
+	{
+		JValue result = step.resume();
+		if (state.started == started)
+		{
+			state.reply(result);
+		}
+	}
+	catch (const JsonParseError& e)
+	{
+		state.reply(API_ERROR_SCHEMA_VALIDATION(e.what()));
+	}
+	catch (ErrorResponse& e)
+	{
+		state.reply(e);
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Method '%s' async handler throws exception: %s",
+		          state.method.c_str(), e.what());
+		state.reply(API_ERROR_UNKNOWN);
+	}
+	catch (...)
+	{
+		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Method '%s' async handler throws exception",
+		          state.method.c_str());
+		state.reply(API_ERROR_UNKNOWN);
+	}
+}
+
+// Can be called from any thread.
+void AsyncRequest::schedule(std::shared_ptr<AsyncRequest::Step> step)
+{
+	GMainContext* context = step->state->context;
+
+	GSource* source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source,
+	                      &AsyncRequest::resumeCB,
+	                      new std::shared_ptr<Step>(std::move(step)),
+	                      &AsyncRequest::releaseCB);
+	g_source_attach(source, context);
+	g_source_unref(source);
+}
+
+gboolean AsyncRequest::resumeCB(gpointer user_data)
+{
+	std::shared_ptr<Step>& step = *static_cast<std::shared_ptr<Step>*>(user_data);
+	resume(*step);
+	return G_SOURCE_REMOVE;
+}
+
+void AsyncRequest::releaseCB(gpointer user_data)
+{
+	delete static_cast<std::shared_ptr<Step>*>(user_data);
+}
+
+} // namespace LSHelpers
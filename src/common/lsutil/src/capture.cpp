@@ -0,0 +1,212 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#include "capture.hpp"
+#include "util.hpp"
+
+namespace LSHelpers {
+
+namespace {
+
+const char MAGIC[] = "LSCAPT01";
+const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+// time, payload length, name length, sender length, type. The host is little endian on all targets.
+const size_t HEADER_SIZE = 8 + 4 + 2 + 1 + 1;
+
+// Records are buffered, the file is written in blocks.
+const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+}
+
+Capture& Capture::global()
+{
+	static Capture* capture = new Capture();
+	return *capture;
+}
+
+Capture::Capture()
+		: mEnabled(false)
+		, mFile(nullptr)
+		, mMaxBytes(0)
+		, mStartTime(0)
+		, mStats {}
+{}
+
+bool Capture::start(const std::string& path, size_t maxBytes)
+{
+	stop();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mFile = fopen(path.c_str(), "wb");
+	if (!mFile)
+	{
+		LOG_ERROR(MSGID_LS_CAPTURE, 0, "Failed to create capture %s: %s", path.c_str(), strerror(errno));
+		return false;
+	}
+	setvbuf(mFile, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+
+	mPath = path;
+	mMaxBytes = maxBytes;
+	mStartTime = g_get_monotonic_time();
+	mStats = Stats {};
+
+	if (fwrite(MAGIC, 1, MAGIC_SIZE, mFile) != MAGIC_SIZE)
+	{
+		LOG_ERROR(MSGID_LS_CAPTURE, 0, "Failed to write capture %s", path.c_str());
+		fclose(mFile);
+		mFile = nullptr;
+		return false;
+	}
+	mStats.bytes = MAGIC_SIZE;
+
+	mEnabled.store(true, std::memory_order_relaxed);
+	LOG_LS_INFO(MSGID_LS_CAPTURE, 0, "Capturing luna traffic to %s, up to %zu bytes", path.c_str(), maxBytes);
+	return true;
+}
+
+void Capture::stop()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (!mFile)
+	{
+		return;
+	}
+
+	mEnabled.store(false, std::memory_order_relaxed);
+	fclose(mFile);
+	mFile = nullptr;
+
+	LOG_LS_INFO(MSGID_LS_CAPTURE, 0, "Capture %s stopped, %llu records, %llu dropped, %llu bytes", mPath.c_str(),
+	            (unsigned long long)mStats.records, (unsigned long long)mStats.dropped,
+	            (unsigned long long)mStats.bytes);
+}
+
+Capture::Stats Capture::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+std::string Capture::getPath() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPath;
+}
+
+void Capture::write(RecordType type, const char* name, const char* sender, const char* payload)
+{
+	gint64 now = g_get_monotonic_time();
+
+	size_t nameLength = name ? std::min<size_t>(strlen(name), UINT16_MAX) : 0;
+	size_t senderLength = sender ? std::min<size_t>(strlen(sender), UINT8_MAX) : 0;
+	size_t payloadLength = payload ? std::min<size_t>(strlen(payload), UINT32_MAX) : 0;
+	size_t size = HEADER_SIZE + nameLength + senderLength + payloadLength;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Stopped since the check in recordCall or recordPost.
+	if (!mFile)
+	{
+		return;
+	}
+
+	if (mStats.bytes + size > mMaxBytes)
+	{
+		mStats.dropped++;
+		return;
+	}
+
+	char header[HEADER_SIZE];
+	gint64 time = now - mStartTime;
+	uint32_t payloadSize = static_cast<uint32_t>(payloadLength);
+	uint16_t nameSize = static_cast<uint16_t>(nameLength);
+	memcpy(header, &time, 8);
+	memcpy(header + 8, &payloadSize, 4);
+	memcpy(header + 12, &nameSize, 2);
+	header[14] = static_cast<char>(senderLength);
+	header[15] = static_cast<char>(type);
+
+	if (fwrite(header, 1, HEADER_SIZE, mFile) != HEADER_SIZE
+	    || fwrite(name, 1, nameLength, mFile) != nameLength
+	    || fwrite(sender, 1, senderLength, mFile) != senderLength
+	    || fwrite(payload, 1, payloadLength, mFile) != payloadLength)
+	{
+		// The file is likely cut in the middle of a record, later records would not be readable.
+		LOG_ERROR(MSGID_LS_CAPTURE, 0, "Failed to write capture %s, stopping", mPath.c_str());
+		mEnabled.store(false, std::memory_order_relaxed);
+		mMaxBytes = 0;
+		mStats.dropped++;
+		return;
+	}
+
+	mStats.records++;
+	mStats.bytes += size;
+}
+
+bool Capture::load(const std::string& path, std::vector<Record>& records, std::string& error)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		error = path + ": " + strerror(errno);
+		return false;
+	}
+
+	char magic[MAGIC_SIZE];
+	if (fread(magic, 1, MAGIC_SIZE, file) != MAGIC_SIZE || memcmp(magic, MAGIC, MAGIC_SIZE) != 0)
+	{
+		error = path + ": not a capture file";
+		fclose(file);
+		return false;
+	}
+
+	char header[HEADER_SIZE];
+	while (fread(header, 1, HEADER_SIZE, file) == HEADER_SIZE)
+	{
+		Record record;
+		uint32_t payloadSize;
+		uint16_t nameSize;
+		memcpy(&record.time, header, 8);
+		memcpy(&payloadSize, header + 8, 4);
+		memcpy(&nameSize, header + 12, 2);
+		size_t senderSize = static_cast<uint8_t>(header[14]);
+		record.type = static_cast<RecordType>(header[15]);
+
+		record.name.resize(nameSize);
+		record.sender.resize(senderSize);
+		record.payload.resize(payloadSize);
+		if (fread(&record.name[0], 1, nameSize, file) != nameSize
+		    || fread(&record.sender[0], 1, senderSize, file) != senderSize
+		    || fread(&record.payload[0], 1, payloadSize, file) != payloadSize)
+		{
+			break;
+		}
+
+		records.push_back(std::move(record));
+	}
+
+	fclose(file);
+	return true;
+}
+
+} // namespace LSHelpers;
@@ -0,0 +1,117 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "executor.hpp"
+#include "util.hpp"
+
+namespace LSHelpers {
+
+Executor::Executor()
+		: mStopping(false)
+		, mThread(&Executor::run, this)
+{
+}
+
+Executor::~Executor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+
+	mWakeup.notify_all();
+	mThread.join();
+
+	// Jobs not started yet are dropped, so their callers get a reply instead of waiting for a timeout.
+	for (auto& task: mJobs)
+	{
+		dropTask(task);
+	}
+	mJobs.clear();
+}
+
+void Executor::post(Executor::Job job, Executor::Job drop)
+{
+	Task task {std::move(job), std::move(drop)};
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mStopping)
+		{
+			mJobs.push_back(std::move(task));
+			mWakeup.notify_one();
+			return;
+		}
+	}
+
+	dropTask(task);
+}
+
+void Executor::dropTask(Executor::Task& task)
+{
+	if (!task.drop)
+	{
+		return;
+	}
+
+	try
+	{
+		task.drop();
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Executor drop throws exception: %s", e.what());
+	}
+	catch (...)
+	{
+		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Executor drop throws exception");
+	}
+}
+
+void Executor::run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	while (true)
+	{
+		mWakeup.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+		if (mStopping)
+		{
+			return;
+		}
+
+		Job job = std::move(mJobs.front().job);
+		mJobs.pop_front();
+
+		lock.unlock();
+		try
+		{
+			job();
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Executor job throws exception: %s", e.what());
+		}
+		catch (...)
+		{
+			LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Executor job throws exception");
+		}
+		job = nullptr;
+		lock.lock();
+	}
+}
+
+} // namespace LSHelpers
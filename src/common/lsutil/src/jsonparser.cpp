@@ -15,6 +15,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <cmath>
+#include <cstring>
 #include "jsonparser.hpp"
 #include "util.hpp"
 
@@ -56,13 +57,16 @@ void checkConversionResultOrThrow(ConversionResultFlags result)
 
 void JsonParser::recordError(const char* fieldName, const char* message)
 {
-	std::stringstream s;
-	s << "Failed to validate against schema: Field '" << fieldName << "' " << message;
-	LOG_LS_WARNING(MSGID_LS_JSON_PARSE_ERROR, 0, "%s", s.str().c_str());
+	static const char prefix[] = "Failed to validate against schema: Field '";
+
+	std::string error;
+	error.reserve(sizeof(prefix) + strlen(fieldName) + strlen(message) + 2);
+	error.append(prefix).append(fieldName).append("' ").append(message);
+	LOG_LS_WARNING(MSGID_LS_JSON_PARSE_ERROR, 0, "%s", error.c_str());
 
 	if (_parseError.empty())
 	{
-		_parseError = s.str();
+		_parseError = std::move(error);
 	}
 }
 
@@ -15,8 +15,10 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <errno.h>
+#include <string.h>
 #include <sstream>
 
+#include "blockpool.hpp"
 #include "util.hpp"
 
 #include "jsonrequest.hpp"
@@ -25,15 +27,63 @@ using namespace pbnjson;
 
 namespace LSHelpers {
 
+// Stock response for handlers returning plain true.
+static const char* RESPONSE_RETURN_VALUE_TRUE = "{\"returnValue\":true}";
+static const size_t RESPONSE_RETURN_VALUE_TRUE_SIZE = strlen(RESPONSE_RETURN_VALUE_TRUE);
+
+// Parse time is what the request spent in parsing, handler time is the rest of the handler call.
+// Recorded in the destructor, so handlers that throw are included.
+class JsonRequest::DispatchTimer
+{
+public:
+	explicit DispatchTimer(JsonRequest& request)
+			: mRequest(request)
+			, mStart(g_get_monotonic_time())
+			, mParseBefore(request.mParseUs)
+	{}
+
+	~DispatchTimer()
+	{
+		MethodMetrics* metrics = mRequest.mMetrics;
+		if (metrics)
+		{
+			gint64 handlerParse = mRequest.mParseUs - mParseBefore;
+			gint64 elapsed = g_get_monotonic_time() - mStart;
+			metrics->parseUs.record(static_cast<uint64_t>(std::max<gint64>(0, mRequest.mParseUs)));
+			metrics->handlerUs.record(static_cast<uint64_t>(std::max<gint64>(0, elapsed - handlerParse)));
+		}
+	}
+
+private:
+	JsonRequest& mRequest;
+	gint64 mStart;
+	gint64 mParseBefore;
+};
+
 JsonRequest::JsonRequest(const LS::Message& message, const pbnjson::JValue params)
 		: JsonParser(params)
 		, mMessage(message)
+		, mPayload(nullptr)
+		, mMetrics(nullptr)
+		, mParseUs(0)
 		, mDeferred(false)
 		, mResponded(false)
 {
 
 }
 
+JsonRequest::JsonRequest(const LS::Message& message, const char* payload)
+		: JsonParser(pbnjson::JValue())
+		, mMessage(message)
+		, mPayload(payload)
+		, mMetrics(nullptr)
+		, mParseUs(0)
+		, mDeferred(false)
+		, mResponded(false)
+{
+	clearError();
+}
+
 JsonRequest::~JsonRequest()
 {
 	if (unlikely(!mResponded)) // The request was not responded. Send a stock response.
@@ -42,14 +92,19 @@ JsonRequest::~JsonRequest()
 	}
 }
 
-bool JsonRequest::handleLunaCall(LSMessage* msg, const JsonRequest::Handler& handler, const JSchema& schema)
+bool JsonRequest::handleLunaCall(LSMessage* msg,
+                                 const JsonRequest::Handler& handler,
+                                 const JSchema& schema,
+                                 MethodMetrics* metrics)
 {
 	LS::Message message{msg};
 
 	try
 	{
 		const char* payload = message.getPayload();
+		gint64 parseStart = g_get_monotonic_time();
 		JValue value = JDomParser::fromString(payload, schema);
+		gint64 parseUs = g_get_monotonic_time() - parseStart;
 
 		if (unlikely(!value.isValid()))
 		{
@@ -69,47 +124,112 @@ bool JsonRequest::handleLunaCall(LSMessage* msg, const JsonRequest::Handler& han
 			}
 		}
 
-		std::shared_ptr<JsonRequest> request( new JsonRequest{message, value} );
+		std::shared_ptr<JsonRequest> request =
+				std::allocate_shared<JsonRequest>(PoolAllocator<JsonRequest, JsonRequest>(), message, value);
+		request->mMetrics = metrics;
+		request->mParseUs = parseUs;
+
+		return dispatch(message, request, handler);
+	}
+	catch (const JsonParseError& e)
+	{
+		message.respond(API_ERROR_SCHEMA_VALIDATION(e.what()).stringify().c_str());
+		return true;
+	}
+	catch (ErrorResponse& e)
+	{
+		message.respond(e.stringify().c_str());
+		return true;
+	}
+}
+
+bool JsonRequest::handleStreamingLunaCall(LSMessage* msg, const JsonRequest::Handler& handler, MethodMetrics* metrics)
+{
+	LS::Message message{msg};
+	std::shared_ptr<JsonRequest> request =
+			std::allocate_shared<JsonRequest>(PoolAllocator<JsonRequest, JsonRequest>(), message, message.getPayload());
+	request->mMetrics = metrics;
+
+	return dispatch(message, request, handler);
+}
+
+bool JsonRequest::handleCapturedCall(const LS::Message& message,
+                                     const pbnjson::JValue& params,
+                                     const JsonRequest::Handler& handler,
+                                     const JsonRequest::DeferredResponseFunction& capture)
+{
+	LS::Message localMessage = message;
+	std::shared_ptr<JsonRequest> request =
+			std::allocate_shared<JsonRequest>(PoolAllocator<JsonRequest, JsonRequest>(), message, params);
+	request->mCapture = capture;
+
+	return dispatch(localMessage, request, handler);
+}
+
+bool JsonRequest::dispatch(LS::Message& message, std::shared_ptr<JsonRequest> request, const Handler& handler)
+{
+	// Responses go through request->respond, so in-process calls get them captured.
+	// A deferred request may also be responded before the handler returns.
+	try
+	{
 		request->mWeakPtr = request;
-		request->mResponded = true; // For the exception cases
 
-		JValue result = handler(*request.get());
+		JValue result;
+		{
+			DispatchTimer timer(*request);
+			result = handler(*request.get());
+		}
 
 		if (!request->mDeferred)
 		{
 			request->respond(result);
 		}
-		else
-		{
-			request->mResponded = false;
-		}
 
 		return true;
 	}
 	catch (const JsonParseError& e)
 	{
-		message.respond(API_ERROR_SCHEMA_VALIDATION(e.what()).stringify().c_str());
+		request->respond(API_ERROR_SCHEMA_VALIDATION(e.what()));
 		return true;
 	}
 	catch (ErrorResponse& e)
 	{
-		message.respond(e.stringify().c_str());
+		request->respond(e);
 		return true;
 	}
 	catch (const std::exception& e)
 	{
 		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Method '%s' handler throws exception: %s",
 		             message.getMethod(), e.what());
+		// Luna callers get an error from the hub, in-process callers get the stock response.
+		request->mResponded = !request->mCapture;
 		return false;
 	}
 	catch (...)
 	{
 		LOG_ERROR(MSGID_LS_UNEXPECTED_EXCEPTION, 0, "Method '%s' handler throws exception",
 		             message.getMethod());
+		request->mResponded = !request->mCapture;
 		return false;
 	}
 }
 
+void JsonRequest::parsePayload()
+{
+	const char* payload = mPayload;
+	mPayload = nullptr;
+
+	_jsonValue = JDomParser::fromString(payload, JSchema::AllSchema());
+	if (unlikely(!_jsonValue.isValid()))
+	{
+		LOG_ERROR(MSGID_LS_CALL_JSON_PARSE_FAILED, 0,
+		             "Failed to validate luna request against schema: %s, error: %s",
+		             payload,
+		             _jsonValue.errorString().c_str());
+		throw API_ERROR_MALFORMED_JSON;
+	}
+}
+
 JsonRequest::DeferredResponseFunction JsonRequest::defer()
 {
 	if (unlikely(mDeferred))
@@ -142,8 +262,18 @@ void JsonRequest::respond(const pbnjson::JValue& response)
 		if (result.isBoolean() && result.asBool())
 		{
 			// This is just a "true", converted to JValue.
-			// Replace with a basic {"returnValue":true}.
-			result = JObject{{"returnValue", true}};
+			// Reply with a basic {"returnValue":true}, no need to build and serialize an object.
+			if (mCapture)
+			{
+				mCapture(JObject {{"returnValue", true}});
+			}
+			else
+			{
+				mMessage.respond(RESPONSE_RETURN_VALUE_TRUE);
+				recordReplySize(RESPONSE_RETURN_VALUE_TRUE_SIZE);
+			}
+			mResponded = true;
+			return;
 		}
 		else
 		{
@@ -153,10 +283,28 @@ void JsonRequest::respond(const pbnjson::JValue& response)
 		}
 	}
 
-	mMessage.respond(result.stringify().c_str());
+	if (mCapture)
+	{
+		mCapture(result);
+	}
+	else
+	{
+		std::string payload = result.stringify();
+		mMessage.respond(payload.c_str());
+		recordReplySize(payload.size());
+	}
 	mResponded = true;
 }
 
+void JsonRequest::recordReplySize(size_t size)
+{
+	// Only the first reply, subscription updates are not replies to the call.
+	if (mMetrics && !mResponded)
+	{
+		mMetrics->replyBytes.record(size);
+	}
+}
+
 ErrorResponse::ErrorResponse(int error_code, const char* format, ...)
 		: pbnjson::JObject{{"returnValue", false}, {"errorCode", error_code}}
 {
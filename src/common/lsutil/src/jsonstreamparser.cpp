@@ -0,0 +1,518 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdlib>
+
+#include "jsonstreamparser.hpp"
+
+namespace LSHelpers {
+
+static inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool isDelimiter(char c)
+{
+	return c == ',' || c == '}' || c == ']' || c == ':' || c == ' ' || c == '\t' || c == '\n' || c == '\r'
+		|| c == '\0';
+}
+
+bool JsonStreamParser::beginObject()
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	skipWhitespace();
+	if (*mPos != '{')
+	{
+		return fail();
+	}
+
+	mPos++;
+	mAfterOpen = true;
+	return true;
+}
+
+bool JsonStreamParser::nextKey(StringRef& key)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	skipWhitespace();
+	if (*mPos == '}')
+	{
+		mPos++;
+		mAfterOpen = false;
+		return false;
+	}
+
+	if (!mAfterOpen)
+	{
+		if (*mPos != ',')
+		{
+			return fail();
+		}
+
+		mPos++;
+		skipWhitespace();
+	}
+
+	bool hasEscapes;
+	if (!scanString(key, hasEscapes) || hasEscapes)
+	{
+		return fail();
+	}
+
+	skipWhitespace();
+	if (*mPos != ':')
+	{
+		return fail();
+	}
+
+	mPos++;
+	skipWhitespace();
+	return true;
+}
+
+// Scans a string token. Only printable ASCII is accepted, everything else is left to the DOM parser.
+bool JsonStreamParser::scanString(StringRef& raw, bool& hasEscapes)
+{
+	if (*mPos != '"')
+	{
+		return fail();
+	}
+
+	const char* start = ++mPos;
+	hasEscapes = false;
+
+	while (*mPos != '"')
+	{
+		unsigned char c = static_cast<unsigned char>(*mPos);
+		if (c < 0x20 || c >= 0x80)
+		{
+			return fail();
+		}
+
+		if (c == '\\')
+		{
+			hasEscapes = true;
+			mPos++;
+			switch (*mPos)
+			{
+				case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+					break;
+				default: // Includes \u
+					return fail();
+			}
+		}
+
+		mPos++;
+	}
+
+	raw.data = start;
+	raw.length = static_cast<size_t>(mPos - start);
+	mPos++;
+	return true;
+}
+
+bool JsonStreamParser::scanNumber(StringRef& raw, bool& isInteger)
+{
+	const char* start = mPos;
+	isInteger = true;
+
+	if (*mPos == '-')
+	{
+		mPos++;
+	}
+
+	if (*mPos == '0')
+	{
+		mPos++;
+	}
+	else if (isDigit(*mPos))
+	{
+		while (isDigit(*mPos))
+		{
+			mPos++;
+		}
+	}
+	else
+	{
+		return fail();
+	}
+
+	if (*mPos == '.')
+	{
+		isInteger = false;
+		mPos++;
+		if (!isDigit(*mPos))
+		{
+			return fail();
+		}
+		while (isDigit(*mPos))
+		{
+			mPos++;
+		}
+	}
+
+	if (*mPos == 'e' || *mPos == 'E')
+	{
+		isInteger = false;
+		mPos++;
+		if (*mPos == '+' || *mPos == '-')
+		{
+			mPos++;
+		}
+		if (!isDigit(*mPos))
+		{
+			return fail();
+		}
+		while (isDigit(*mPos))
+		{
+			mPos++;
+		}
+	}
+
+	if (!isDelimiter(*mPos))
+	{
+		return fail();
+	}
+
+	raw.data = start;
+	raw.length = static_cast<size_t>(mPos - start);
+	return true;
+}
+
+bool JsonStreamParser::scanLiteral(const char* literal, size_t length)
+{
+	if (strncmp(mPos, literal, length) != 0 || !isDelimiter(mPos[length]))
+	{
+		return fail();
+	}
+
+	mPos += length;
+	return true;
+}
+
+bool JsonStreamParser::readString(StringRef& destination)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	bool hasEscapes;
+	if (!scanString(destination, hasEscapes) || hasEscapes)
+	{
+		return fail();
+	}
+
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::readString(std::string& destination)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	StringRef raw;
+	bool hasEscapes;
+	if (!scanString(raw, hasEscapes))
+	{
+		return false;
+	}
+
+	mAfterOpen = false;
+
+	if (!hasEscapes)
+	{
+		destination.assign(raw.data, raw.length);
+		return true;
+	}
+
+	destination.clear();
+	for (size_t i = 0; i < raw.length; i++)
+	{
+		char c = raw.data[i];
+		if (c == '\\')
+		{
+			switch (raw.data[++i])
+			{
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				default: c = raw.data[i]; break; // '"', '\\' and '/'
+			}
+		}
+		destination.push_back(c);
+	}
+
+	return true;
+}
+
+bool JsonStreamParser::readBool(bool& destination)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	if (*mPos == 't' && scanLiteral("true", 4))
+	{
+		destination = true;
+	}
+	else if (*mPos == 'f' && scanLiteral("false", 5))
+	{
+		destination = false;
+	}
+	else
+	{
+		return fail();
+	}
+
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::readNumber(double& destination)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	StringRef raw;
+	bool isInteger;
+	if (!scanNumber(raw, isInteger))
+	{
+		return false;
+	}
+
+	// The token is validated and followed by a delimiter, strtod stops right at its end.
+	char* end = nullptr;
+	destination = strtod(raw.data, &end);
+	if (end != raw.data + raw.length)
+	{
+		return fail();
+	}
+
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::readInt64(int64_t& destination)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	StringRef raw;
+	bool isInteger;
+	if (!scanNumber(raw, isInteger) || !isInteger)
+	{
+		return fail();
+	}
+
+	const char* digit = raw.data;
+	bool negative = *digit == '-';
+	if (negative)
+	{
+		digit++;
+	}
+
+	// 18 digits always fit in int64_t, longer values are left to the DOM parser.
+	size_t count = static_cast<size_t>(raw.data + raw.length - digit);
+	if (count > 18)
+	{
+		return fail();
+	}
+
+	int64_t value = 0;
+	for (; digit < raw.data + raw.length; digit++)
+	{
+		value = value * 10 + (*digit - '0');
+	}
+
+	destination = negative ? -value : value;
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::readRawValue(StringRef& raw)
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	const char* start = mPos;
+	if (!skipValue(0))
+	{
+		return false;
+	}
+
+	raw.data = start;
+	raw.length = static_cast<size_t>(mPos - start);
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::skipValue()
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	if (!skipValue(0))
+	{
+		return false;
+	}
+
+	mAfterOpen = false;
+	return true;
+}
+
+bool JsonStreamParser::skipValue(int depth)
+{
+	if (depth > MAX_DEPTH)
+	{
+		return fail();
+	}
+
+	StringRef raw;
+	bool flag;
+
+	switch (*mPos)
+	{
+		case '"':
+			return scanString(raw, flag);
+		case 't':
+			return scanLiteral("true", 4);
+		case 'f':
+			return scanLiteral("false", 5);
+		case 'n':
+			return scanLiteral("null", 4);
+		case '{':
+		{
+			mPos++;
+			skipWhitespace();
+			if (*mPos == '}')
+			{
+				mPos++;
+				return true;
+			}
+
+			while (true)
+			{
+				skipWhitespace();
+				if (!scanString(raw, flag))
+				{
+					return false;
+				}
+
+				skipWhitespace();
+				if (*mPos != ':')
+				{
+					return fail();
+				}
+
+				mPos++;
+				skipWhitespace();
+				if (!skipValue(depth + 1))
+				{
+					return false;
+				}
+
+				skipWhitespace();
+				if (*mPos == '}')
+				{
+					mPos++;
+					return true;
+				}
+
+				if (*mPos != ',')
+				{
+					return fail();
+				}
+				mPos++;
+			}
+		}
+		case '[':
+		{
+			mPos++;
+			skipWhitespace();
+			if (*mPos == ']')
+			{
+				mPos++;
+				return true;
+			}
+
+			while (true)
+			{
+				skipWhitespace();
+				if (!skipValue(depth + 1))
+				{
+					return false;
+				}
+
+				skipWhitespace();
+				if (*mPos == ']')
+				{
+					mPos++;
+					return true;
+				}
+
+				if (*mPos != ',')
+				{
+					return fail();
+				}
+				mPos++;
+			}
+		}
+		default:
+			return scanNumber(raw, flag);
+	}
+}
+
+bool JsonStreamParser::end()
+{
+	if (mFailed)
+	{
+		return false;
+	}
+
+	skipWhitespace();
+	if (*mPos != '\0')
+	{
+		return fail();
+	}
+
+	return true;
+}
+
+} // namespace LSHelpers
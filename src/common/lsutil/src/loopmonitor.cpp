@@ -0,0 +1,244 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "loopmonitor.hpp"
+#include "metrics.hpp"
+#include "util.hpp"
+
+namespace LSHelpers {
+
+// How long the watchdog waits for the loop thread to capture its stack.
+static const gint64 STACK_CAPTURE_TIMEOUT = 100000; // Microseconds
+
+static thread_local bool loopThread = false;
+
+LoopMonitor::LoopMonitor()
+		: mTickSource(nullptr)
+		, mExpectedTick(0)
+		, mInterval(0)
+		, mStallThreshold(0)
+		, mLag(&MetricsRegistry::global().histogram("mainloop.lagUs"))
+		, mStalls(&MetricsRegistry::global().histogram("mainloop.stallUs"))
+		, mLastTick(0)
+		, mDepth(0)
+		, mLoopThread()
+		, mStackSignal(0)
+		, mStackDepth(0)
+		, mStackReady(false)
+		, mStopping(false)
+{
+	for (auto& activity : mActivities)
+	{
+		activity.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+LoopMonitor& LoopMonitor::global()
+{
+	static LoopMonitor* monitor = new LoopMonitor();
+	return *monitor;
+}
+
+bool LoopMonitor::isLoopThread()
+{
+	return loopThread;
+}
+
+void LoopMonitor::start(GMainContext* context, guint intervalMs, guint stallMs, int stackSignal)
+{
+	if (mTickSource)
+	{
+		return;
+	}
+
+	loopThread = true;
+	mLoopThread = pthread_self();
+	mInterval = static_cast<gint64>(intervalMs) * 1000;
+	mStallThreshold = static_cast<gint64>(stallMs) * 1000;
+	mStackSignal = stackSignal;
+
+	if (mStackSignal)
+	{
+		// The first backtrace call loads the unwinder, which is not safe in a signal handler.
+		void* frame;
+		backtrace(&frame, 1);
+
+		struct sigaction action = {};
+		action.sa_handler = &LoopMonitor::stackSignalHandler;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(mStackSignal, &action, nullptr);
+	}
+
+	gint64 now = g_get_monotonic_time();
+	mExpectedTick = now + mInterval;
+	mLastTick.store(now, std::memory_order_relaxed);
+
+	mTickSource = g_timeout_source_new(intervalMs);
+	g_source_set_priority(mTickSource, G_PRIORITY_HIGH);
+	g_source_set_callback(mTickSource, &LoopMonitor::tickCB, this, nullptr);
+	g_source_attach(mTickSource, context);
+
+	mStopping = false;
+	mWatchdog = std::thread(&LoopMonitor::watchdog, this);
+}
+
+void LoopMonitor::stop()
+{
+	if (!mTickSource)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mStopCondition.notify_all();
+	mWatchdog.join();
+
+	g_source_destroy(mTickSource);
+	g_source_unref(mTickSource);
+	mTickSource = nullptr;
+
+	if (mStackSignal)
+	{
+		signal(mStackSignal, SIG_DFL);
+	}
+	loopThread = false;
+}
+
+gboolean LoopMonitor::tickCB(gpointer user_data)
+{
+	LoopMonitor* self = static_cast<LoopMonitor*>(user_data);
+	gint64 now = g_get_monotonic_time();
+	gint64 lag = std::max<gint64>(0, now - self->mExpectedTick);
+
+	self->mLag->record(static_cast<uint64_t>(lag));
+	if (lag > self->mStallThreshold)
+	{
+		self->mStalls->record(static_cast<uint64_t>(lag));
+	}
+
+	self->mExpectedTick = now + self->mInterval;
+	self->mLastTick.store(now, std::memory_order_release);
+	return G_SOURCE_CONTINUE;
+}
+
+// Runs on the loop thread, in the middle of whatever it was doing.
+void LoopMonitor::stackSignalHandler(int signal)
+{
+	LoopMonitor& self = global();
+	if (self.mStackReady.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	self.mStackDepth.store(backtrace(self.mStack, MAX_STACK_FRAMES), std::memory_order_relaxed);
+	self.mStackReady.store(true, std::memory_order_release);
+}
+
+void LoopMonitor::watchdog()
+{
+	gint64 reportedTick = 0;
+	auto checkInterval = std::chrono::microseconds(std::max<gint64>(mStallThreshold / 2, 1000));
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mStopCondition.wait_for(lock, checkInterval, [this]() { return mStopping; }))
+	{
+		gint64 lastTick = mLastTick.load(std::memory_order_acquire);
+		gint64 stalled = g_get_monotonic_time() - lastTick - mInterval;
+
+		// Report every stall once, it is measured in full by the tick when the loop gets going again.
+		if (stalled > mStallThreshold && lastTick != reportedTick)
+		{
+			reportedTick = lastTick;
+			lock.unlock();
+			reportStall(stalled);
+			lock.lock();
+		}
+	}
+}
+
+std::string LoopMonitor::activities(std::string& innermost) const
+{
+	int depth = std::min(mDepth.load(std::memory_order_acquire), static_cast<int>(MAX_ACTIVITY_DEPTH));
+	std::string result;
+
+	for (int i = 0; i < depth; i++)
+	{
+		const char* name = mActivities[i].load(std::memory_order_relaxed);
+		innermost = name ? name : "?";
+		result += i ? " > " : "";
+		result += innermost;
+	}
+
+	return result;
+}
+
+// Runs on the watchdog thread.
+void LoopMonitor::reportStall(gint64 stalledUs)
+{
+	std::string innermost = "untracked";
+	std::string inside = activities(innermost);
+
+	MetricsRegistry::global().counter("mainloop.stalls").add();
+	MetricsRegistry::global().counter("mainloop.stalls." + innermost).add();
+
+	std::string stack;
+	if (mStackSignal)
+	{
+		mStackReady.store(false, std::memory_order_relaxed);
+		pthread_kill(mLoopThread, mStackSignal);
+
+		gint64 deadline = g_get_monotonic_time() + STACK_CAPTURE_TIMEOUT;
+		while (!mStackReady.load(std::memory_order_acquire) && g_get_monotonic_time() < deadline)
+		{
+			g_usleep(1000);
+		}
+
+		if (mStackReady.load(std::memory_order_acquire))
+		{
+			int depth = mStackDepth.load(std::memory_order_relaxed);
+			char** symbols = backtrace_symbols(mStack, depth);
+			for (int i = 0; symbols && i < depth; i++)
+			{
+				stack += i ? " | " : "";
+				stack += symbols[i];
+			}
+			free(symbols);
+		}
+		else
+		{
+			// Blocked in the kernel, signals are delivered when the call returns.
+			stack = "not captured";
+		}
+	}
+
+	LOG_LS_WARNING(MSGID_LS_MAINLOOP_STALL, 3,
+	               PMLOGKFV("STALLED_MS", "%lld", static_cast<long long>(stalledUs / 1000)),
+	               PMLOGKS("ACTIVITY", inside.empty() ? innermost.c_str() : inside.c_str()),
+	               PMLOGKS("STACK", stack.c_str()),
+	               "Main loop stalled");
+}
+
+} // namespace LSHelpers
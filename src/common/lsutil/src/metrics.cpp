@@ -0,0 +1,228 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cmath>
+
+#include "metrics.hpp"
+#include "util.hpp"
+
+using namespace pbnjson;
+
+namespace LSHelpers {
+
+Histogram::Histogram()
+		: mCount(0)
+		, mSum(0)
+		, mMax(0)
+{
+	for (auto& bucket : mBuckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+int Histogram::bucketOf(uint64_t value)
+{
+	if (value < LINEAR_BUCKETS)
+	{
+		return static_cast<int>(value);
+	}
+
+	int exponent = 63 - __builtin_clzll(value);
+	if (exponent > MAX_EXPONENT)
+	{
+		return BUCKET_COUNT - 1;
+	}
+
+	// The 3 bits after the leading one select the sub bucket.
+	int sub = static_cast<int>((value >> (exponent - 3)) & (SUB_BUCKETS - 1));
+	return LINEAR_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucketStart(int bucket)
+{
+	if (bucket < LINEAR_BUCKETS)
+	{
+		return static_cast<uint64_t>(bucket);
+	}
+
+	int exponent = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+	uint64_t sub = static_cast<uint64_t>((bucket - LINEAR_BUCKETS) % SUB_BUCKETS);
+	return (SUB_BUCKETS + sub) << (exponent - 3);
+}
+
+void Histogram::record(uint64_t value)
+{
+	mBuckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	mCount.fetch_add(1, std::memory_order_relaxed);
+	mSum.fetch_add(value, std::memory_order_relaxed);
+
+	uint64_t max = mMax.load(std::memory_order_relaxed);
+	while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+uint64_t Histogram::percentile(double fraction) const
+{
+	uint64_t counts[BUCKET_COUNT];
+	uint64_t total = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * total)));
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += counts[i];
+		if (seen >= rank)
+		{
+			return bucketStart(i);
+		}
+	}
+
+	return bucketStart(BUCKET_COUNT - 1);
+}
+
+JValue Histogram::toJValue() const
+{
+	return JObject {{"count", static_cast<int64_t>(count())},
+	                {"sum", static_cast<int64_t>(sum())},
+	                {"max", static_cast<int64_t>(max())},
+	                {"p50", static_cast<int64_t>(percentile(0.5))},
+	                {"p90", static_cast<int64_t>(percentile(0.9))},
+	                {"p99", static_cast<int64_t>(percentile(0.99))}};
+}
+
+MetricsRegistry& MetricsRegistry::global()
+{
+	static MetricsRegistry* registry = new MetricsRegistry();
+	return *registry;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::unique_ptr<Counter>& item = mCounters[name];
+	if (!item)
+	{
+		item.reset(new Counter());
+	}
+	return *item;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::unique_ptr<Histogram>& item = mHistograms[name];
+	if (!item)
+	{
+		item.reset(new Histogram());
+	}
+	return *item;
+}
+
+MethodMetrics& MetricsRegistry::method(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::unique_ptr<MethodMetrics>& item = mMethods[path];
+	if (!item)
+	{
+		item.reset(new MethodMetrics());
+	}
+	return *item;
+}
+
+JValue MetricsRegistry::toJValue() const
+{
+	JObject counters;
+	JObject histograms;
+	JObject methods;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (const auto& item : mCounters)
+	{
+		counters.put(item.first, static_cast<int64_t>(item.second->value()));
+	}
+
+	for (const auto& item : mHistograms)
+	{
+		histograms.put(item.first, item.second->toJValue());
+	}
+
+	for (const auto& item : mMethods)
+	{
+		const MethodMetrics& metrics = *item.second;
+		methods.put(item.first, JObject {{"calls", static_cast<int64_t>(metrics.calls.value())},
+		                                 {"cachedReplies", static_cast<int64_t>(metrics.cachedReplies.value())},
+		                                 {"parseUs", metrics.parseUs.toJValue()},
+		                                 {"handlerUs", metrics.handlerUs.toJValue()},
+		                                 {"replyBytes", metrics.replyBytes.toJValue()}});
+	}
+
+	return JObject {{"counters", counters}, {"histograms", histograms}, {"methods", methods}};
+}
+
+static void logHistogram(const std::string& name, const Histogram& histogram)
+{
+	if (histogram.count() == 0)
+	{
+		return;
+	}
+
+	LOG_LS_INFO(MSGID_LS_METRICS, 5,
+	            PMLOGKS("NAME", name.c_str()),
+	            PMLOGKFV("COUNT", "%llu", static_cast<unsigned long long>(histogram.count())),
+	            PMLOGKFV("P50", "%llu", static_cast<unsigned long long>(histogram.percentile(0.5))),
+	            PMLOGKFV("P99", "%llu", static_cast<unsigned long long>(histogram.percentile(0.99))),
+	            PMLOGKFV("MAX", "%llu", static_cast<unsigned long long>(histogram.max())),
+	            "");
+}
+
+void MetricsRegistry::logSummary() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (const auto& item : mCounters)
+	{
+		if (item.second->value() > 0)
+		{
+			LOG_LS_INFO(MSGID_LS_METRICS, 2,
+			            PMLOGKS("NAME", item.first.c_str()),
+			            PMLOGKFV("VALUE", "%llu", static_cast<unsigned long long>(item.second->value())),
+			            "");
+		}
+	}
+
+	for (const auto& item : mHistograms)
+	{
+		logHistogram(item.first, *item.second);
+	}
+
+	for (const auto& item : mMethods)
+	{
+		logHistogram(item.first + ".parseUs", item.second->parseUs);
+		logHistogram(item.first + ".handlerUs", item.second->handlerUs);
+		logHistogram(item.first + ".replyBytes", item.second->replyBytes);
+	}
+}
+
+} // namespace LSHelpers
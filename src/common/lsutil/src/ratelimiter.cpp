@@ -0,0 +1,286 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "jsonfields.hpp"
+#include "jsonparser.hpp"
+#include "ratelimiter.hpp"
+#include "util.hpp"
+
+namespace LSHelpers {
+
+// Buckets are pruned when there are more than this many. A full bucket is the same as no bucket.
+static const size_t MAX_BUCKETS = 256;
+
+namespace {
+
+struct ConfigLimit
+{
+	ConfigLimit() : rate(0), burst(1) {}
+
+	template<typename Visitor>
+	static void describeJsonFields(Visitor& fields)
+	{
+		static constexpr const char* OVERFLOW_VALUES[] = {"reject", "coalesce"};
+
+		fields(jsonField("method", &ConfigLimit::method).optional());
+		fields(jsonField("rate", &ConfigLimit::rate).min(0.0));
+		fields(jsonField("burst", &ConfigLimit::burst).optional().defaultValue(1.0).min(1.0));
+		fields(jsonField("overflow", &ConfigLimit::overflow).optional().defaultValue("reject")
+				       .allowedValues(OVERFLOW_VALUES));
+	}
+
+	RateLimit toRateLimit() const
+	{
+		return RateLimit(rate, burst, overflow == "coalesce" ? RateLimitOverflow::Coalesce : RateLimitOverflow::Reject);
+	}
+
+	std::string method;
+	double rate;
+	double burst;
+	std::string overflow;
+};
+
+struct Config
+{
+	Config() : defaultSet(false) {}
+
+	template<typename Visitor>
+	static void describeJsonFields(Visitor& fields)
+	{
+		fields(jsonField("default", &Config::defaultLimit).optional().checkValueRead(&Config::defaultSet));
+		fields(jsonField("methods", &Config::methods).optional());
+		fields(jsonField("exempt", &Config::exempt).optional());
+	}
+
+	ConfigLimit defaultLimit;
+	bool defaultSet;
+	std::vector<ConfigLimit> methods;
+	std::vector<std::string> exempt;
+};
+
+} // namespace
+
+RateLimiter::RateLimiter()
+{
+}
+
+void RateLimiter::setDefaultLimit(const RateLimit& limit)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mDefaultLimit = limit;
+}
+
+void RateLimiter::setMethodLimit(const std::string& method, const RateLimit& limit)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMethodLimits[method] = limit;
+}
+
+void RateLimiter::exemptCaller(const std::string& caller)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mExempt.insert(caller);
+}
+
+bool RateLimiter::loadConfig(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+
+	Config config;
+	try
+	{
+		parseJsonFields(pbnjson::JDomParser::fromString(text.str()), config);
+	}
+	catch (const JsonParseError& e)
+	{
+		LOG_LS_WARNING(MSGID_LS_RATE_LIMIT_CONFIG, 2,
+		               PMLOGKS("PATH", path.c_str()),
+		               PMLOGKS("ERROR", e.what()),
+		               "Invalid rate limit configuration");
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (config.defaultSet)
+	{
+		mDefaultLimit = config.defaultLimit.toRateLimit();
+	}
+
+	for (const ConfigLimit& limit : config.methods)
+	{
+		if (limit.method.empty())
+		{
+			continue;
+		}
+		mMethodLimits[limit.method] = limit.toRateLimit();
+	}
+
+	mExempt.insert(config.exempt.begin(), config.exempt.end());
+	return true;
+}
+
+const RateLimit& RateLimiter::limitOf(const std::string& method) const
+{
+	auto iter = mMethodLimits.find(method);
+	return iter != mMethodLimits.end() ? iter->second : mDefaultLimit;
+}
+
+bool RateLimiter::isLimited(const std::string& method) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return !limitOf(method).isUnlimited();
+}
+
+RateLimiter::Decision RateLimiter::admit(const std::string& caller, const std::string& method,
+                                         int64_t now, int64_t& wait)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	const RateLimit& limit = limitOf(method);
+	if (limit.isUnlimited() || mExempt.count(caller) > 0 || take(caller, method, limit, now, wait))
+	{
+		return Decision::Admit;
+	}
+
+	CallerStats& stats = mStats[caller];
+	stats.caller = caller;
+
+	Decision decision = Decision::Reject;
+	if (limit.overflow == RateLimitOverflow::Coalesce)
+	{
+		stats.coalesced++;
+		decision = Decision::Coalesce;
+	}
+	else
+	{
+		stats.rejected++;
+	}
+
+	// Log at 1, 2, 4, 8... throttled calls, so a caller in a tight loop does not flood the log.
+	uint64_t total = stats.rejected + stats.coalesced;
+	if ((total & (total - 1)) == 0)
+	{
+		LOG_LS_WARNING(MSGID_LS_RATE_LIMITED, 3,
+		               PMLOGKS("CALLER", caller.c_str()),
+		               PMLOGKS("METHOD", method.c_str()),
+		               PMLOGKFV("THROTTLED", "%llu", static_cast<unsigned long long>(total)),
+		               "Caller is over its call budget");
+	}
+
+	return decision;
+}
+
+bool RateLimiter::retry(const std::string& caller, const std::string& method, int64_t now, int64_t& wait)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	const RateLimit& limit = limitOf(method);
+	return limit.isUnlimited() || take(caller, method, limit, now, wait);
+}
+
+// Needs to be called with the lock held.
+bool RateLimiter::take(const std::string& caller, const std::string& method, const RateLimit& limit,
+                       int64_t now, int64_t& wait)
+{
+	double burst = std::max(1.0, limit.burst);
+
+	if (mBuckets.size() > MAX_BUCKETS)
+	{
+		pruneBuckets(now);
+	}
+
+	auto result = mBuckets.emplace(caller + '\n' + method, Bucket {burst, now});
+	Bucket& bucket = result.first->second;
+
+	if (!result.second)
+	{
+		bucket.tokens = std::min(burst, bucket.tokens + (now - bucket.updated) * limit.rate / 1000000.0);
+		bucket.updated = now;
+	}
+
+	if (bucket.tokens >= 1.0)
+	{
+		bucket.tokens -= 1.0;
+		return true;
+	}
+
+	wait = static_cast<int64_t>(std::ceil((1.0 - bucket.tokens) * 1000000.0 / limit.rate));
+	return false;
+}
+
+// Needs to be called with the lock held. Drops buckets that have refilled since their last use.
+void RateLimiter::pruneBuckets(int64_t now)
+{
+	for (auto iter = mBuckets.begin(); iter != mBuckets.end();)
+	{
+		const std::string& key = iter->first;
+		const RateLimit& limit = limitOf(key.substr(key.find('\n') + 1));
+		double refill = (now - iter->second.updated) * limit.rate / 1000000.0;
+
+		if (limit.isUnlimited() || iter->second.tokens + refill >= std::max(1.0, limit.burst))
+		{
+			iter = mBuckets.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+std::vector<RateLimiter::CallerStats> RateLimiter::topOffenders(size_t count) const
+{
+	std::vector<CallerStats> result;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		result.reserve(mStats.size());
+		for (const auto& item : mStats)
+		{
+			result.push_back(item.second);
+		}
+	}
+
+	auto worse = [](const CallerStats& a, const CallerStats& b)
+	{
+		return a.rejected + a.coalesced > b.rejected + b.coalesced;
+	};
+
+	if (result.size() > count)
+	{
+		std::partial_sort(result.begin(), result.begin() + count, result.end(), worse);
+		result.resize(count);
+	}
+	else
+	{
+		std::sort(result.begin(), result.end(), worse);
+	}
+
+	return result;
+}
+
+} // namespace LSHelpers
@@ -14,30 +14,130 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <atomic>
 #include <errno.h>
 #include <sstream>
 #include <mutex>
 
 #include "util.hpp"
+#include "capture.hpp"
+#include "loopmonitor.hpp"
 #include "servicepoint.hpp"
+#include "tracer.hpp"
 
 using namespace pbnjson;
 
 namespace LSHelpers  {
 
+// Default time slice for handling queued Query calls in one main loop iteration, microseconds.
+static const unsigned DEFAULT_QUERY_TIME_SLICE = 2000;
+
+// Default time the oldest queued Query call waits before the queue is drained at default priority, microseconds.
+static const unsigned DEFAULT_QUERY_MAX_DELAY = 100000;
+
+// Stale cached replies are dropped when there are more than this many.
+static const size_t MAX_CACHED_REPLIES = 64;
+
+// Stock response for handlers returning plain true.
+static const char* RESPONSE_RETURN_VALUE_TRUE = "{\"returnValue\":true}";
+
+static std::atomic<uint64_t> lastCallId(0);
+static thread_local const char* currentMethodPath = nullptr;
+static thread_local uint64_t currentId = 0;
+
+// Marks the call the thread is handling for currentMethod and currentCallId, restores the outer one
+// when a batch call ends.
+class CurrentCallScope
+{
+public:
+	explicit CurrentCallScope(const std::string& path)
+			: mOuterPath(currentMethodPath)
+			, mOuterId(currentId)
+	{
+		currentMethodPath = path.c_str();
+		currentId = lastCallId.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	~CurrentCallScope()
+	{
+		currentMethodPath = mOuterPath;
+		currentId = mOuterId;
+	}
+
+	CurrentCallScope(const CurrentCallScope&) = delete;
+	CurrentCallScope& operator=(const CurrentCallScope&) = delete;
+
+private:
+	const char* mOuterPath;
+	uint64_t mOuterId;
+};
+
 
 ServicePoint::ServicePoint(LS::Handle* handle)
 		: mHandle(handle)
+		, mLifetime(std::make_shared<char>(0))
+		, mDrainSource(nullptr)
+		, mQueryTimeSlice(DEFAULT_QUERY_TIME_SLICE)
+		, mQueryMaxDelay(DEFAULT_QUERY_MAX_DELAY)
+		, mDrainAged(false)
+		, mAgingSource(nullptr)
+		, mPriorityStats()
+		, mReplyGeneration(0)
+		, mReady(true)
 {
 }
 
 ServicePoint::~ServicePoint()
 {
+	// No more calls from batches in progress.
+	mLifetime.reset();
+
+	// Async requests not done are replied now, their pending continuations are not called anymore.
+	std::vector<AsyncRequest::State*> pending(mAsyncRequests.begin(), mAsyncRequests.end());
+	mAsyncRequests.clear();
+	for (auto state: pending)
+	{
+		AsyncRequest::cancel(*state);
+	}
+
 	for (auto& method: mMethods)
 	{
 		unregisterMethodImpl(*method);
 	}
 
+	if (mDrainSource)
+	{
+		g_source_destroy(mDrainSource);
+		mDrainSource = nullptr;
+	}
+
+	if (mAgingSource)
+	{
+		g_source_destroy(mAgingSource);
+		mAgingSource = nullptr;
+	}
+
+	for (auto& call: mQueries)
+	{
+		respondError(call.message, API_ERROR_REMOVED);
+		LSMessageUnref(call.message);
+	}
+	mQueries.clear();
+
+	for (auto& call: mWaitingCalls)
+	{
+		respondError(call.message, API_ERROR_REMOVED);
+		LSMessageUnref(call.message);
+	}
+	mWaitingCalls.clear();
+
+	for (auto& held: mHeldCalls)
+	{
+		g_source_destroy(held.second->timer);
+		answerHeldCall(*held.second, API_ERROR_REMOVED);
+	}
+	mHeldCalls.clear();
+
 	//TODO: Potential raciness with call responses being dispatched in other threads.
 	// There is no clean way to kill a call (it might be in the callback method).
 
@@ -52,10 +152,49 @@ ServicePoint::~ServicePoint()
 	mCalls.clear();
 }
 
-void ServicePoint::registerMethod(const std::string& category,
-                                      const std::string& methodName,
-                                      const JsonRequest::Handler& handler,
-                                      const JSchema& schema)
+ServicePoint::MethodConfig& ServicePoint::MethodConfig::priority(MethodPriority priority)
+{
+	mMethod.priority = priority;
+	return *this;
+}
+
+ServicePoint::MethodConfig& ServicePoint::MethodConfig::runOn(Executor& executor)
+{
+	mMethod.executor = &executor;
+	return *this;
+}
+
+ServicePoint::MethodConfig& ServicePoint::MethodConfig::rateLimit(const RateLimit& limit)
+{
+	mMethod.service->mRateLimiter.setMethodLimit(mMethod.path, limit);
+	return *this;
+}
+
+ServicePoint::MethodConfig& ServicePoint::MethodConfig::cacheReplies()
+{
+	mMethod.cacheReplies = true;
+	return *this;
+}
+
+ServicePoint::MethodConfig& ServicePoint::MethodConfig::availableBeforeReady()
+{
+	mMethod.beforeReady = true;
+	return *this;
+}
+
+ServicePoint::MethodConfig ServicePoint::registerMethod(const std::string& category,
+                                                        const std::string& methodName,
+                                                        const JsonRequest::Handler& handler,
+                                                        const JSchema& schema)
+{
+	return MethodConfig(addMethod(category, methodName, handler, schema, false));
+}
+
+ServicePoint::MethodInfo& ServicePoint::addMethod(const std::string& category,
+                                                  const std::string& methodName,
+                                                  const JsonRequest::Handler& handler,
+                                                  const JSchema& schema,
+                                                  bool streaming)
 {
 	if (unlikely(!mHandle))
 	{
@@ -65,14 +204,11 @@ void ServicePoint::registerMethod(const std::string& category,
 	}
 
 	// Check for duplicate registration
-	for (auto& method: mMethods)
+	if (findMethod(category, methodName))
 	{
-		if (method->method == methodName && method->category == category)
-		{
-			std::stringstream error;
-			error << "Duplicate registration of method " << category << "/" << methodName;
-			throw std::logic_error(error.str());
-		}
+		std::stringstream error;
+		error << "Duplicate registration of method " << category << "/" << methodName;
+		throw std::logic_error(error.str());
 	}
 
 	//Check if valid names
@@ -90,9 +226,23 @@ void ServicePoint::registerMethod(const std::string& category,
 		throw error;
 	}
 
-	std::unique_ptr<MethodInfo> method {new MethodInfo(this, handler, schema, category, methodName)};
+	std::unique_ptr<MethodInfo> method {new MethodInfo(this, handler, schema, category, methodName, streaming)};
 	registerMethodImpl(*method);
 	mMethods.emplace_back(std::move(method));
+	return *mMethods.back();
+}
+
+ServicePoint::MethodInfo* ServicePoint::findMethod(const std::string& category, const std::string& methodName)
+{
+	for (auto& method: mMethods)
+	{
+		if (method->method == methodName && method->category == category)
+		{
+			return method.get();
+		}
+	}
+
+	return nullptr;
 }
 
 void ServicePoint::registerMethodImpl(ServicePoint::MethodInfo& method)
@@ -153,6 +303,271 @@ void ServicePoint::registerSignal(const std::string& category, const std::string
 	mHandle->registerCategoryAppend(category.c_str(), nullptr, signals);
 }
 
+// ---------------------
+// Section: batch
+// ---------------------
+
+namespace {
+
+struct BatchCall
+{
+	template<typename Visitor> static void describeJsonFields(Visitor& fields)
+	{
+		fields(jsonField("category", &BatchCall::category));
+		fields(jsonField("method", &BatchCall::method));
+		fields(jsonField("params", &BatchCall::params).optional());
+	}
+
+	std::string category;
+	std::string method;
+	JValue params;
+};
+
+} // namespace
+
+struct ServicePoint::Batch
+{
+	Batch()
+			: service(nullptr)
+			, stopOnError(true)
+			, next(0)
+			, running(false)
+			, completed(false)
+			, done(false)
+			, failedCall(-1)
+			, results(JArray())
+	{}
+
+	ServicePoint* service;
+	std::weak_ptr<void> lifetime; // Expires when the ServicePoint is destroyed
+	LS::Message message;
+	JsonRequest::DeferredResponseFunction respond;
+	BatchListener listener;
+	std::vector<BatchCall> calls;
+	bool stopOnError;
+	size_t next; // Index of the call being run
+	bool running; // The call is being dispatched
+	bool completed; // The call has responded
+	bool done; // Batch response sent
+	int failedCall; // Index of the first failed call
+	JValue failure; // Response of the first failed call
+	JValue results;
+};
+
+void ServicePoint::registerBatchMethod(const std::string& category,
+                                       const std::string& methodName,
+                                       const BatchListener& listener)
+{
+	MethodInfo& method = addMethod(category,
+	                               methodName,
+	                               [this, listener](JsonRequest& request) -> JValue { return handleBatch(request, listener); },
+	                               JSchema::AllSchema(),
+	                               false);
+	method.batch = true;
+}
+
+JValue ServicePoint::handleBatch(JsonRequest& request, const BatchListener& listener)
+{
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+
+	request.getArray("calls", batch->calls);
+	request.get("stopOnError", batch->stopOnError).optional(true).defaultValue(true);
+	request.finishParseOrThrow();
+
+	batch->service = this;
+	batch->lifetime = mLifetime;
+	batch->message = request.getMessage();
+	batch->listener = listener;
+	batch->respond = request.defer();
+
+	if (batch->listener)
+	{
+		batch->listener(true);
+	}
+
+	runBatch(batch);
+
+	return true; // Ignored, the request is deferred.
+}
+
+// Runs the calls until one defers, that one resumes the batch from completeBatchCall.
+void ServicePoint::runBatch(const std::shared_ptr<Batch>& batch)
+{
+	while (batch->next < batch->calls.size() && !(batch->stopOnError && batch->failedCall >= 0))
+	{
+		batch->completed = false;
+		batch->running = true;
+		dispatchBatchCall(batch, batch->next);
+		batch->running = false;
+
+		if (!batch->completed)
+		{
+			return;
+		}
+	}
+
+	finishBatch(*batch);
+}
+
+void ServicePoint::dispatchBatchCall(const std::shared_ptr<Batch>& batch, size_t index)
+{
+	const BatchCall& call = batch->calls[index];
+	auto capture = [batch, index](const JValue& response)
+	{
+		completeBatchCall(batch, index, response);
+	};
+
+	MethodInfo* method = batch->service->findMethod(call.category, call.method);
+	if (!method)
+	{
+		capture(API_ERROR_INVALID_BATCH_CALL("Unknown method %s/%s", call.category.c_str(), call.method.c_str()));
+		return;
+	}
+
+	if (method->batch)
+	{
+		capture(API_ERROR_INVALID_BATCH_CALL("Batch calls can not be nested"));
+		return;
+	}
+
+	JValue params = call.params.isNull() ? JValue(JObject()) : call.params;
+	if (!params.isObject())
+	{
+		capture(API_ERROR_INVALID_BATCH_CALL("Params of %s/%s is not an object",
+		                                     call.category.c_str(), call.method.c_str()));
+		return;
+	}
+
+	if (params.hasKey("subscribe") && params["subscribe"].isBoolean() && params["subscribe"].asBool())
+	{
+		capture(API_ERROR_INVALID_BATCH_CALL("Subscriptions are not supported in a batch"));
+		return;
+	}
+
+	if (!method->streaming)
+	{
+		// Same validation as for a luna call.
+		params = JDomParser::fromString(params.stringify(), method->schema);
+		if (!params.isValid())
+		{
+			capture(API_ERROR_SCHEMA_VALIDATION("Failed to validate luna request against schema"));
+			return;
+		}
+	}
+
+	if (!batch->service->admitBatchCall(*method, batch, index, params))
+	{
+		// Rejected, or held and resumed from heldCallCB.
+		return;
+	}
+
+	handleBatchCall(batch, index, *method, params);
+}
+
+void ServicePoint::handleBatchCall(const std::shared_ptr<Batch>& batch,
+                                   size_t index,
+                                   MethodInfo& method,
+                                   const JValue& params)
+{
+	auto capture = [batch, index](const JValue& response)
+	{
+		completeBatchCall(batch, index, response);
+	};
+
+	if (method.cacheReplies)
+	{
+		// Not answered from the cache, but may change what cached replies about its target depend on.
+		batch->service->invalidateTarget(batch->service->callTarget(params));
+	}
+
+	// Counted as a call of the method, so per call figures include batched calls.
+	method.metrics->calls.add();
+	CurrentCallScope scope(method.path);
+	JsonRequest::handleCapturedCall(batch->message, params, method.handler, capture);
+}
+
+// Runs a call that was held for its rate limit, and the rest of the batch after it.
+void ServicePoint::resumeBatchCall(const std::shared_ptr<Batch>& batch,
+                                   size_t index,
+                                   MethodInfo& method,
+                                   const JValue& params)
+{
+	batch->completed = false;
+	batch->running = true;
+	handleBatchCall(batch, index, method, params);
+	batch->running = false;
+
+	if (batch->completed)
+	{
+		runBatch(batch);
+	}
+}
+
+void ServicePoint::completeBatchCall(const std::shared_ptr<Batch>& batch, size_t index, const JValue& response)
+{
+	if (batch->done || index != batch->next)
+	{
+		// Further responses of a deferred call.
+		return;
+	}
+
+	JValue result = response;
+	batch->results.append(result);
+
+	if (!(result["returnValue"].isBoolean() && result["returnValue"].asBool()) && batch->failedCall < 0)
+	{
+		batch->failedCall = static_cast<int>(index);
+		batch->failure = result;
+	}
+
+	batch->next++;
+	batch->completed = true;
+
+	if (batch->running)
+	{
+		// Responded from within the handler, runBatch continues.
+		return;
+	}
+
+	if (batch->lifetime.expired())
+	{
+		batch->done = true;
+		batch->respond(API_ERROR_CANCELLED);
+		return;
+	}
+
+	runBatch(batch);
+}
+
+void ServicePoint::finishBatch(ServicePoint::Batch& batch)
+{
+	batch.done = true;
+
+	// Let the owner send out its held back notifications before the caller gets the response.
+	if (batch.listener)
+	{
+		batch.listener(false);
+	}
+
+	if (batch.failedCall < 0)
+	{
+		batch.respond(JObject {{"returnValue", true}, {"results", batch.results}});
+		return;
+	}
+
+	JObject response {{"returnValue", false}, {"failedCall", batch.failedCall}, {"results", batch.results}};
+	if (batch.failure.hasKey("errorCode"))
+	{
+		response.put("errorCode", batch.failure["errorCode"]);
+	}
+	if (batch.failure.hasKey("errorMessage"))
+	{
+		response.put("errorMessage", batch.failure["errorMessage"]);
+	}
+
+	batch.respond(response);
+}
+
 // ---------------------
 // Section: calls
 // ---------------------
@@ -234,6 +649,24 @@ void ServicePoint::cancelCall(ServicePoint::Call* call)
 	mCalls.erase(call->token);
 }
 
+AsyncRequest ServicePoint::async(JsonRequest& request)
+{
+	LS::Error error;
+	if (unlikely(!mHandle))
+	{
+		_LSErrorSet(error.get(), MSGID_LS_NO_HANDLE, -EINVAL, "Service handle not set");
+		throw error;
+	}
+
+	GMainContext* context = LSGmainGetContext(mHandle->get(), error.get());
+	if (!context)
+	{
+		throw error;
+	}
+
+	return AsyncRequest(this, request, context);
+}
+
 // ---------------------------
 // Section signals:
 // ---------------------------
@@ -276,6 +709,7 @@ void ServicePoint::sendSignal(const std::string& category, const std::string& me
 
 bool ServicePoint::methodHandler(LSHandle *, LSMessage *msg, void *method_context)
 {
+	gint64 arrival = g_get_monotonic_time();
 	MethodInfo* method = static_cast<MethodInfo*>(method_context);
 
 	if (unlikely(!method))
@@ -285,7 +719,627 @@ bool ServicePoint::methodHandler(LSHandle *, LSMessage *msg, void *method_contex
 		return false;
 	}
 
-	return JsonRequest::handleLunaCall(msg, method->handler, method->schema);
+	method->metrics->calls.add();
+
+	// Recorded before the reply cache and rate limits, a replay goes through them again.
+	if (Capture::global().isEnabled())
+	{
+		Capture::global().recordCall(method->path.c_str(), callerId(msg).c_str(), LSMessageGetPayload(msg));
+	}
+
+	if (!method->service->admitCall(*method, msg))
+	{
+		// Rejected or held.
+		return true;
+	}
+
+	return method->service->routeCall(*method, msg, arrival);
+}
+
+bool ServicePoint::routeCall(MethodInfo& method, LSMessage* msg, gint64 arrival)
+{
+	if (!mReady && !method.beforeReady)
+	{
+		LSMessageRef(msg);
+		mWaitingCalls.push_back(QueuedCall {&method, msg, arrival});
+		return true;
+	}
+
+	if (method.executor)
+	{
+		// The message is referenced by the job until it is handled or dropped.
+		LS::Message message{msg};
+		MethodInfo* info = &method;
+		method.executor->post([info, message]() mutable
+		{
+			dispatchCall(*info, message.get());
+		},
+		[message]() mutable
+		{
+			respondError(message.get(), API_ERROR_REMOVED);
+		});
+		return true;
+	}
+
+	if (method.priority == MethodPriority::Query)
+	{
+		queueCall(method, msg, arrival);
+		return true;
+	}
+
+	recordDispatch(method.priority, arrival);
+	return dispatchCall(method, msg);
+}
+
+bool ServicePoint::dispatchCall(MethodInfo& method, LSMessage* msg)
+{
+	TraceSpan span(method.path.c_str());
+	LoopActivity activity(method.path.c_str());
+	CurrentCallScope scope(method.path);
+
+	// Looked up only here, so cached replies go through the rate limits and the ready gate like handled calls.
+	if (method.cacheReplies)
+	{
+		return method.service->respondFromCache(method, msg) || method.service->dispatchCachedCall(method, msg);
+	}
+
+	if (method.streaming)
+	{
+		return JsonRequest::handleStreamingLunaCall(msg, method.handler, method.metrics);
+	}
+
+	return JsonRequest::handleLunaCall(msg, method.handler, method.schema, method.metrics);
+}
+
+// ---------------------------
+// Section: priority dispatch
+// ---------------------------
+
+// Query calls are moved off the bus into a queue as they arrive. The queue is drained by a source
+// with idle priority, so the calls are handled only when the main loop has nothing else to do,
+// which includes dispatching newly arrived Control calls. Each iteration handles queued calls
+// for at most mQueryTimeSlice before yielding.
+// Once the oldest queued call waited mQueryMaxDelay, the source is raised to default priority, so it takes
+// turns with the Control calls instead of waiting for them to stop. mAgingSource raises it in time.
+
+void ServicePoint::recordDispatch(MethodPriority priority, gint64 arrival)
+{
+	PriorityStats& stats = mPriorityStats[static_cast<int>(priority)];
+	uint64_t delay = static_cast<uint64_t>(std::max<gint64>(0, g_get_monotonic_time() - arrival));
+
+	stats.dispatched++;
+	stats.totalDelayUs += delay;
+	stats.maxDelayUs = std::max(stats.maxDelayUs, delay);
+}
+
+void ServicePoint::queueCall(MethodInfo& method, LSMessage* msg, gint64 arrival)
+{
+	LSMessageRef(msg);
+	mQueries.push_back(QueuedCall {&method, msg, arrival});
+
+	if (!mDrainSource)
+	{
+		LS::Error error;
+		GMainContext* context = LSGmainGetContext(mHandle->get(), error.get());
+		if (!context)
+		{
+			error.log(PmLogGetLibContext(), "LS_QUERY_QUEUE_FAIL");
+		}
+
+		mDrainSource = g_idle_source_new();
+		g_source_set_priority(mDrainSource, G_PRIORITY_DEFAULT_IDLE);
+		g_source_set_callback(mDrainSource, &ServicePoint::drainQueriesCB, this, nullptr);
+		g_source_attach(mDrainSource, context);
+		g_source_unref(mDrainSource);
+		mDrainAged = false;
+
+		updateDrainPriority();
+	}
+}
+
+// Sets the drain priority by the age of the oldest queued call, and arms mAgingSource for when it gets too old.
+void ServicePoint::updateDrainPriority()
+{
+	gint64 age = g_get_monotonic_time() - mQueries.front().arrival;
+	bool aged = age >= static_cast<gint64>(mQueryMaxDelay);
+
+	if (aged != mDrainAged)
+	{
+		mDrainAged = aged;
+		g_source_set_priority(mDrainSource, aged ? G_PRIORITY_DEFAULT : G_PRIORITY_DEFAULT_IDLE);
+	}
+
+	if (aged || mAgingSource)
+	{
+		// Raised already, or the timer is pending. If it was armed for an older call, it re-arms when it fires.
+		return;
+	}
+
+	guint delayMs = static_cast<guint>((static_cast<gint64>(mQueryMaxDelay) - age + 999) / 1000);
+	mAgingSource = g_timeout_source_new(delayMs);
+	g_source_set_priority(mAgingSource, G_PRIORITY_DEFAULT);
+	g_source_set_callback(mAgingSource, &ServicePoint::queryAgedCB, this, nullptr);
+	g_source_attach(mAgingSource, g_source_get_context(mDrainSource));
+	g_source_unref(mAgingSource);
+}
+
+gboolean ServicePoint::queryAgedCB(gpointer user_data)
+{
+	ServicePoint* self = static_cast<ServicePoint*>(user_data);
+
+	self->mAgingSource = nullptr;
+	if (!self->mQueries.empty())
+	{
+		self->updateDrainPriority();
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+gboolean ServicePoint::drainQueriesCB(gpointer user_data)
+{
+	ServicePoint* self = static_cast<ServicePoint*>(user_data);
+	gint64 sliceEnd = g_get_monotonic_time() + self->mQueryTimeSlice;
+
+	do
+	{
+		QueuedCall call = self->mQueries.front();
+		self->mQueries.pop_front();
+
+		self->recordDispatch(MethodPriority::Query, call.arrival);
+		if (self->mDrainAged)
+		{
+			self->mPriorityStats[static_cast<int>(MethodPriority::Query)].aged++;
+		}
+		dispatchCall(*call.method, call.message);
+		LSMessageUnref(call.message);
+	}
+	while (!self->mQueries.empty() && g_get_monotonic_time() < sliceEnd);
+
+	if (self->mQueries.empty())
+	{
+		if (self->mAgingSource)
+		{
+			g_source_destroy(self->mAgingSource);
+			self->mAgingSource = nullptr;
+		}
+
+		self->mDrainSource = nullptr;
+		self->mDrainAged = false;
+		return G_SOURCE_REMOVE;
+	}
+
+	self->updateDrainPriority();
+	return G_SOURCE_CONTINUE;
+}
+
+ServicePoint::PriorityStats ServicePoint::getPriorityStats(MethodPriority priority) const
+{
+	PriorityStats stats = mPriorityStats[static_cast<int>(priority)];
+	stats.queued = priority == MethodPriority::Query ? mQueries.size() : 0;
+	return stats;
+}
+
+void ServicePoint::setReady(bool ready)
+{
+	mReady = ready;
+	if (!ready || mWaitingCalls.empty())
+	{
+		return;
+	}
+
+	static Histogram& waitUs = MetricsRegistry::global().histogram("servicepoint.readyWaitUs");
+	LOG_LS_INFO(MSGID_LS_READY, 0, "Service ready, routing %zu waiting calls", mWaitingCalls.size());
+
+	// Routed in arrival order. Control calls are handled right here, Query calls go to the back of the queue.
+	std::deque<QueuedCall> calls;
+	calls.swap(mWaitingCalls);
+	gint64 now = g_get_monotonic_time();
+	for (auto& call: calls)
+	{
+		waitUs.record(static_cast<uint64_t>(std::max<gint64>(0, now - call.arrival)));
+		routeCall(*call.method, call.message, call.arrival);
+		LSMessageUnref(call.message);
+	}
+}
+
+// ---------------------------
+// Section: rate limiting
+// ---------------------------
+
+// Calls are checked against the caller's bucket before they are routed, so an over budget caller
+// costs a hash lookup, not a parse. With RateLimitOverflow::Coalesce only the newest over budget
+// call of a caller is kept, it is routed as usual once the bucket has a token for it.
+
+const char* ServicePoint::currentMethod()
+{
+	return currentMethodPath;
+}
+
+uint64_t ServicePoint::currentCallId()
+{
+	return currentId;
+}
+
+std::string ServicePoint::callerId(LSMessage* msg)
+{
+	const char* id = LSMessageGetApplicationID(msg);
+	if (!id || !*id)
+	{
+		id = LSMessageGetSenderServiceName(msg);
+	}
+	if (!id || !*id)
+	{
+		id = LSMessageGetSender(msg);
+	}
+
+	return id ? id : "";
+}
+
+void ServicePoint::respondError(LSMessage* msg, const ErrorResponse& error)
+{
+	LS::Message message{msg};
+	try
+	{
+		message.respond(error.stringify().c_str());
+	}
+	catch (LS::Error& e)
+	{
+		e.log(PmLogGetLibContext(), "LS_ERROR_RESPOND_FAIL");
+	}
+}
+
+// Returns false if the call was rejected or held.
+bool ServicePoint::admitCall(MethodInfo& method, LSMessage* msg)
+{
+	if (!mRateLimiter.isLimited(method.path))
+	{
+		return true;
+	}
+
+	std::string caller = callerId(msg);
+	int64_t wait = 0;
+
+	switch (mRateLimiter.admit(caller, method.path, g_get_monotonic_time(), wait))
+	{
+		case RateLimiter::Decision::Admit:
+			return true;
+
+		case RateLimiter::Decision::Coalesce:
+		{
+			// The payload is parsed for the target only when the call is held.
+			std::string target;
+			if (!mTargetFields.empty())
+			{
+				target = callTarget(JDomParser::fromString(LSMessageGetPayload(msg), JSchema::AllSchema()));
+			}
+			LSMessageRef(msg);
+			std::unique_ptr<HeldCall> call(new HeldCall {this, &method, msg, nullptr, 0, JValue(),
+			                                             caller, "", nullptr});
+			holdCall(std::move(call), target, wait);
+			return false;
+		}
+
+		case RateLimiter::Decision::Reject:
+			break;
+	}
+
+	respondError(msg, API_ERROR_RATE_LIMITED);
+	return false;
+}
+
+// Same as admitCall, for a call made within a batch. The caller is the one of the batch.
+// Returns false if the call was rejected, it is completed then, or held.
+bool ServicePoint::admitBatchCall(MethodInfo& method,
+                                  const std::shared_ptr<Batch>& batch,
+                                  size_t index,
+                                  const JValue& params)
+{
+	if (!mRateLimiter.isLimited(method.path))
+	{
+		return true;
+	}
+
+	std::string caller = callerId(batch->message.get());
+	int64_t wait = 0;
+
+	switch (mRateLimiter.admit(caller, method.path, g_get_monotonic_time(), wait))
+	{
+		case RateLimiter::Decision::Admit:
+			return true;
+
+		case RateLimiter::Decision::Coalesce:
+		{
+			std::unique_ptr<HeldCall> call(new HeldCall {this, &method, nullptr, batch, index, params,
+			                                             caller, "", nullptr});
+			holdCall(std::move(call), callTarget(params), wait);
+			return false;
+		}
+
+		case RateLimiter::Decision::Reject:
+			break;
+	}
+
+	completeBatchCall(batch, index, API_ERROR_RATE_LIMITED);
+	return false;
+}
+
+// Values of the target fields in the payload, like "sink:MAIN". Empty if none are set.
+std::string ServicePoint::callTarget(const JValue& params) const
+{
+	std::string target;
+	if (!params.isObject())
+	{
+		return target;
+	}
+
+	for (const std::string& field: mTargetFields)
+	{
+		if (!params.hasKey(field))
+		{
+			continue;
+		}
+
+		JValue value = params[field];
+		target += field;
+		target += ':';
+		target += value.isString() ? value.asString() : value.stringify();
+		target += '\n';
+	}
+
+	return target;
+}
+
+void ServicePoint::holdCall(std::unique_ptr<HeldCall> call, const std::string& target, int64_t wait)
+{
+	// Only a call for the same target supersedes a held one, a call for another sink must not drop it.
+	call->key = call->caller + '\n' + call->method->path + '\n' + target;
+
+	std::unique_ptr<HeldCall>& held = mHeldCalls[call->key];
+	if (held)
+	{
+		// Only the newest call is handled, the timer is already running.
+		std::swap(held->message, call->message);
+		std::swap(held->batch, call->batch);
+		std::swap(held->index, call->index);
+		std::swap(held->params, call->params);
+		answerHeldCall(*call, API_ERROR_SUPERSEDED);
+		return;
+	}
+
+	held = std::move(call);
+	scheduleHeldCall(*held, wait);
+}
+
+void ServicePoint::answerHeldCall(HeldCall& call, const ErrorResponse& error)
+{
+	if (call.batch)
+	{
+		completeBatchCall(call.batch, call.index, error);
+		return;
+	}
+
+	respondError(call.message, error);
+	LSMessageUnref(call.message);
+}
+
+void ServicePoint::scheduleHeldCall(HeldCall& call, int64_t wait)
+{
+	LS::Error error;
+	GMainContext* context = LSGmainGetContext(mHandle->get(), error.get());
+	if (!context)
+	{
+		error.log(PmLogGetLibContext(), "LS_HELD_CALL_FAIL");
+	}
+
+	// Rounded up to whole milliseconds, so the token is there when the timer fires.
+	call.timer = g_timeout_source_new(static_cast<guint>((wait + 999) / 1000));
+	g_source_set_callback(call.timer, &ServicePoint::heldCallCB, &call, nullptr);
+	g_source_attach(call.timer, context);
+	g_source_unref(call.timer);
+}
+
+gboolean ServicePoint::heldCallCB(gpointer user_data)
+{
+	HeldCall* call = static_cast<HeldCall*>(user_data);
+	ServicePoint* self = call->service;
+	int64_t wait = 0;
+
+	if (!self->mRateLimiter.retry(call->caller, call->method->path, g_get_monotonic_time(), wait))
+	{
+		self->scheduleHeldCall(*call, wait);
+		return G_SOURCE_REMOVE;
+	}
+
+	// Remove the entry first, the handler may hold a new call from the same caller.
+	auto entry = self->mHeldCalls.find(call->key);
+	std::unique_ptr<HeldCall> held = std::move(entry->second);
+	self->mHeldCalls.erase(entry);
+
+	if (held->batch)
+	{
+		resumeBatchCall(held->batch, held->index, *held->method, held->params);
+		return G_SOURCE_REMOVE;
+	}
+
+	// The time the call was held for its rate limit is not counted as dispatch delay.
+	self->routeCall(*held->method, held->message, g_get_monotonic_time());
+	LSMessageUnref(held->message);
+	return G_SOURCE_REMOVE;
+}
+
+// ---------------------------
+// Section: reply cache
+// ---------------------------
+
+// A cached reply is valid while mReplyGeneration is unchanged and it was not dropped for its target.
+// The generation changes on invalidateReplyCache(). A call to a method with cached replies drops the replies
+// that share a target value with it, like "sink:MAIN", and the ones without a target, which may depend on
+// any target. A call without a target changes the generation. So a reply is only reused if nothing it
+// could depend on changed since the same call was answered, and the cache needs no knowledge of what
+// the handlers do.
+
+namespace {
+
+// True if a target, see ServicePoint::callTarget, contains the "field:value\n" component.
+bool hasTargetComponent(const std::string& target, const char* component, size_t length)
+{
+	for (size_t pos = 0; pos < target.size(); pos = target.find('\n', pos) + 1)
+	{
+		if (target.compare(pos, length, component, length) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+void ServicePoint::invalidateReplyCache(const std::string& field, const std::string& value)
+{
+	invalidateTarget(field + ':' + value + '\n');
+}
+
+void ServicePoint::invalidateTarget(const std::string& target)
+{
+	if (target.empty())
+	{
+		invalidateReplyCache();
+		return;
+	}
+
+	for (auto iter = mReplyCache.begin(); iter != mReplyCache.end();)
+	{
+		const std::string& cached = iter->second.target;
+		bool shared = cached.empty();
+
+		for (size_t pos = 0; !shared && pos < target.size(); pos = target.find('\n', pos) + 1)
+		{
+			size_t end = target.find('\n', pos);
+			shared = hasTargetComponent(cached, target.c_str() + pos, end + 1 - pos);
+		}
+
+		iter = shared ? mReplyCache.erase(iter) : std::next(iter);
+	}
+}
+
+std::string ServicePoint::replyCacheKey(const MethodInfo& method, LSMessage* msg)
+{
+	std::string key = method.path;
+	key += '\n';
+	key += callerId(msg);
+	key += '\n';
+	key += std::to_string(g_str_hash(LSMessageGetPayload(msg)));
+	return key;
+}
+
+bool ServicePoint::respondFromCache(MethodInfo& method, LSMessage* msg)
+{
+	if (mReplyCache.empty())
+	{
+		method.cacheStats.misses++;
+		return false;
+	}
+
+	auto iter = mReplyCache.find(replyCacheKey(method, msg));
+	if (iter == mReplyCache.end()
+	    || iter->second.generation != mReplyGeneration
+	    || iter->second.payload != LSMessageGetPayload(msg))
+	{
+		method.cacheStats.misses++;
+		return false;
+	}
+
+	LS::Message message{msg};
+	try
+	{
+		message.respond(iter->second.reply.c_str());
+	}
+	catch (LS::Error& e)
+	{
+		e.log(PmLogGetLibContext(), "LS_CACHED_REPLY_FAIL");
+	}
+
+	method.cacheStats.hits++;
+	method.metrics->cachedReplies.add();
+	return true;
+}
+
+bool ServicePoint::dispatchCachedCall(MethodInfo& method, LSMessage* msg)
+{
+	std::string target;
+	if (!mTargetFields.empty())
+	{
+		target = callTarget(JDomParser::fromString(LSMessageGetPayload(msg), JSchema::AllSchema()));
+	}
+	invalidateTarget(target);
+
+	MethodInfo* info = &method;
+	JsonRequest::Handler handler = [info, msg, target](JsonRequest& request) -> JValue
+	{
+		JValue result = info->handler(request);
+		if (!request.isDeferred())
+		{
+			info->service->storeReply(*info, msg, target, result);
+		}
+		return result;
+	};
+
+	if (method.streaming)
+	{
+		return JsonRequest::handleStreamingLunaCall(msg, handler, method.metrics);
+	}
+
+	return JsonRequest::handleLunaCall(msg, handler, method.schema, method.metrics);
+}
+
+void ServicePoint::storeReply(MethodInfo& method, LSMessage* msg, const std::string& target, const JValue& result)
+{
+	std::string reply;
+	if (result.isBoolean() && result.asBool())
+	{
+		reply = RESPONSE_RETURN_VALUE_TRUE;
+	}
+	else if (result.isObject() && result["returnValue"].isBoolean() && result["returnValue"].asBool())
+	{
+		reply = result.stringify();
+	}
+	else
+	{
+		return;
+	}
+
+	if (mReplyCache.size() >= MAX_CACHED_REPLIES)
+	{
+		for (auto iter = mReplyCache.begin(); iter != mReplyCache.end();)
+		{
+			iter = iter->second.generation != mReplyGeneration ? mReplyCache.erase(iter) : std::next(iter);
+		}
+	}
+
+	// Handled on the main loop, so the cache still includes the changes made by this call only.
+	mReplyCache[replyCacheKey(method, msg)] = CachedReply {LSMessageGetPayload(msg), mReplyGeneration, target, reply};
+}
+
+ServicePoint::ReplyCacheStats ServicePoint::getReplyCacheStats(const std::string& category,
+                                                               const std::string& methodName)
+{
+	MethodInfo* method = findMethod(category, methodName);
+	return method ? method->cacheStats : ReplyCacheStats {0, 0};
+}
+
+std::map<std::string, ServicePoint::ReplyCacheStats> ServicePoint::getReplyCacheStats() const
+{
+	std::map<std::string, ReplyCacheStats> stats;
+	for (const auto& method: mMethods)
+	{
+		if (method->cacheReplies)
+		{
+			stats[method->path] = method->cacheStats;
+		}
+	}
+	return stats;
 }
 
 /**
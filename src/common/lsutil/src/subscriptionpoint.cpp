@@ -14,19 +14,58 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include "capture.hpp"
 #include "jsonparser.hpp"
+#include "metrics.hpp"
 #include "subscriptionpoint.hpp"
 #include "util.hpp"
 
 namespace LSHelpers {
 
-struct PostData
+// Totals of all subscription points of the process.
+static Counter& postedCount = MetricsRegistry::global().counter("subscription.posts");
+static Counter& postedBytes = MetricsRegistry::global().counter("subscription.postBytes");
+static Counter& sentCount = MetricsRegistry::global().counter("subscription.sent");
+static Counter& sentBytes = MetricsRegistry::global().counter("subscription.sentBytes");
+
+SubscriptionPoint::~SubscriptionPoint()
 {
-	std::string payload;
-	std::vector<LS::Message> messages;
-};
+	unsetCancelNotificationCallback();
+
+	bool sending = false;
+	{
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		for (GSource** source : {&mFlushSource, &mRetrySource})
+		{
+			if (*source)
+			{
+				g_source_destroy(*source);
+				*source = nullptr;
+				sending = true;
+			}
+		}
+	}
+
+	if (sending)
+	{
+		// Send out what is left, no need to spread it over main loop iterations or wait for readers anymore.
+		while (flush(0, true));
+	}
+}
 
 void SubscriptionPoint::addSubscription(const LS::Message& message)
+{
+	addSubscriber(message, nullptr);
+}
+
+void SubscriptionPoint::addSubscription(const LS::Message& message,
+                                        const std::function<pbnjson::JValue()>& firstResponse)
+{
+	addSubscriber(message, firstResponse);
+}
+
+void SubscriptionPoint::addSubscriber(const LS::Message& message,
+                                      const std::function<pbnjson::JValue()>& firstResponse)
 {
 	LSHandle* messageHandle = LSMessageGetConnection(((LS::Message&)message).get());
 
@@ -35,133 +74,455 @@ void SubscriptionPoint::addSubscription(const LS::Message& message)
 		setServiceHandle(messageHandle);
 	}
 
-	std::unique_ptr<SubscriptionItem> item { new SubscriptionItem(message, this) };
-
-	item->status.set(mServiceHandle,
-	                 message.getSender(),
-	                 std::bind(&SubscriptionPoint::subscriberStatusCB, this, item.get(), std::placeholders::_2));
+	std::string token = message.getUniqueToken();
+	std::string sender = message.getSender();
+	std::shared_ptr<ServerStatus> newWatch;
 
 	{
 		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
-		mSubscriptions.push_back(std::move(item));
+		// New subscriber only receives updates posted from now on.
+		SubscriberPtr subscriber = std::make_shared<Subscriber>(message, token, mLastSeq);
+		if (firstResponse)
+		{
+			// Built under the lock, so every update posted after it has a newer state.
+			pbnjson::JValue response = firstResponse();
+			subscriber->first = std::make_shared<const std::string>(response.stringify());
+			scheduleFlush();
+		}
+		mSubscriptions.add(token, sender, subscriber);
+		mSubscriberCount = mSubscriptions.size();
+
+		// All subscriptions from the same sender share one server status watch.
+		if (mSenderWatches.find(sender) == mSenderWatches.end())
+		{
+			newWatch = std::make_shared<ServerStatus>();
+			mSenderWatches[sender] = newWatch;
+		}
+	}
+
+	// Set up the watch outside the lock, the callback may be called in this context.
+	// newWatch keeps it alive meanwhile, the subscription may be cancelled and the watch dropped
+	// from mSenderWatches on another thread.
+	if (newWatch)
+	{
+		try
+		{
+			newWatch->set(mServiceHandle,
+			              sender.c_str(),
+			              std::bind(&SubscriptionPoint::subscriberStatusCB, this, sender, std::placeholders::_2));
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+			mSubscriptions.removeGroup(sender);
+			mSubscriberCount = mSubscriptions.size();
+			auto it = mSenderWatches.find(sender);
+			if (it != mSenderWatches.end() && it->second == newWatch)
+			{
+				mSenderWatches.erase(it);
+			}
+			throw;
+		}
 	}
 }
 
-// Note that this may be run after the subscription is deleted.
-bool SubscriptionPoint::postSubscriptions(gpointer user_data)
+gboolean SubscriptionPoint::flushCB(gpointer user_data)
+{
+	SubscriptionPoint* self = static_cast<SubscriptionPoint*>(user_data);
+	return self->flush(self->mMaxResponsesPerIteration) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+// Hands a response to luna. Returns false if luna failed to send it.
+static bool respond(LS::Message& message, const std::string& payload, SubscriptionPoint::Stats& stats)
 {
-	PostData *data = static_cast<PostData*>(user_data);
 	try
 	{
-		for (auto &message: data->messages)
-		{
-			message.respond(data->payload.c_str());
-		}
+		message.respond(payload.c_str());
+		stats.sent++;
+		sentCount.add();
+		sentBytes.add(payload.size());
+		return true;
 	}
-	catch(LS::Error &e)
+	catch (LS::Error &e)
 	{
 		e.log(PmLogGetLibContext(), "LS_SUBS_POST_FAIL");
+		stats.failed++;
+		return false;
 	}
-	catch(...)
+}
+
+// Takes the responses the subscriber could have read since the last call off its in flight count.
+void SubscriptionPoint::drain(Subscriber& subscriber, unsigned rate, gint64 now)
+{
+	uint64_t drained = rate == 0 ? subscriber.inFlight
+	                             : static_cast<uint64_t>(std::max<gint64>(0, now - subscriber.drainedAt)) * rate / 1000000;
+
+	if (drained >= subscriber.inFlight)
 	{
+		subscriber.inFlight = 0;
+		subscriber.drainedAt = now;
+		return;
 	}
 
-	// remove source from loop
-	return G_SOURCE_REMOVE;
+	subscriber.inFlight -= drained;
+	subscriber.drainedAt += static_cast<gint64>(drained * 1000000 / rate);
 }
 
-// Subscription responses are sent from within the same thread that Luna
-// uses itself to avoid synchronization between other callbacks (like cancel).
-// To avoid race between subscription point, a copy of messages to be responded
-// is made and passed into the timeout callback. This also ensures a correct
-// snapshot of subscriptions is addressed in case of concurrently added
-// subscriptions.
-bool SubscriptionPoint::post(const char *payload) noexcept
+// Hands the first response and the updates the subscriber has not received yet to luna, as far as
+// it has room for them. Sets waiting if it had none and its updates stay queued.
+// Returns false if the subscriber should be cut off.
+bool SubscriptionPoint::deliver(Subscriber& subscriber, const std::vector<PendingPost>& pending,
+                                const Limits& limits, gint64 now, Stats& stats, bool& waiting)
 {
-	if (!mServiceHandle)
-		return false;
+	bool hasFirst = static_cast<bool>(subscriber.first);
+	uint64_t queued = !pending.empty() && subscriber.deliveredSeq < pending.back().seq
+	                  ? pending.back().seq - subscriber.deliveredSeq : 0;
+	if (!hasFirst && queued == 0)
+	{
+		return true;
+	}
 
-	LS::Error error;
-	GMainContext *context = LSGmainGetContext(mServiceHandle, error.get());
-	if (!context)
+	drain(subscriber, limits.drainRate, now);
+	bool failed = false;
+	bool passedOver = false;
+
+	if (hasFirst)
 	{
-		error.log(PmLogGetLibContext(), "LS_SUBS_POST_FAIL");
-		return false;
+		// The reply to the subscription call, sent regardless of room.
+		Payload first = std::move(subscriber.first);
+		subscriber.first.reset();
+		failed = !respond(subscriber.message, *first, stats);
+		subscriber.inFlight += failed ? 0 : 1;
+	}
+
+	if (queued > 0 && !failed)
+	{
+		uint64_t room = queued;
+		if (limits.maxOutstanding > 0)
+		{
+			// Without a drain rate responses count as read once handed to luna.
+			size_t inFlight = limits.drainRate > 0 ? subscriber.inFlight : 0;
+			room = inFlight < limits.maxOutstanding ? limits.maxOutstanding - inFlight : 0;
+		}
+
+		if (room == 0)
+		{
+			// Luna still holds as many of its updates as allowed, they wait here and are collapsed.
+			passedOver = true;
+			stats.deferred++;
+		}
+		else
+		{
+			auto first = pending.begin();
+			if (queued > room)
+			{
+				// Fell behind, skip straight to the newest update.
+				// Not a strike: every subscriber visited by the round has the same backlog after a burst of posts.
+				first = pending.end() - 1;
+				stats.collapsed += queued - 1;
+			}
+			else
+			{
+				while (first->seq <= subscriber.deliveredSeq)
+				{
+					++first;
+				}
+			}
+
+			for (auto it = first; it != pending.end() && !failed; ++it)
+			{
+				failed = !respond(subscriber.message, *it->payload, stats);
+				subscriber.inFlight += failed ? 0 : 1;
+			}
+		}
+	}
+
+	if (queued > 0 && !passedOver)
+	{
+		subscriber.deliveredSeq = pending.back().seq;
+	}
+	subscriber.strikes = failed || passedOver ? subscriber.strikes + 1 : 0;
+	waiting = waiting || passedOver;
+
+	unsigned limit = mSlowSubscriberLimit;
+	return limit == 0 || subscriber.strikes < limit;
+}
+
+// Fan-out is done in rounds over a snapshot of subscribers. Every subscriber visited gets all updates
+// posted so far it has room for, at most budget responses are sent per call. A final flush does not
+// estimate what the subscribers read, everything is handed to luna.
+// Returns true if there is more to send right away.
+bool SubscriptionPoint::flush(size_t budget, bool final)
+{
+	SubscriberRegistry<SubscriberPtr>::Snapshot round;
+	std::vector<PendingPost> pending;
+	Limits limits;
+	size_t cursor;
+
+	{
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		if (!mRound)
+		{
+			mRound = mSubscriptions.snapshot();
+			mRoundCursor = 0;
+			mRoundWaiting = false;
+		}
+
+		round = mRound;
+		cursor = mRoundCursor;
+		pending.assign(mPending.begin(), mPending.end());
+		limits = Limits { mMaxOutstanding, final ? 0 : mDrainRate.load() };
+	}
+
+	Stats stats {};
+	std::vector<SubscriberPtr> slowSubscribers;
+	gint64 now = g_get_monotonic_time();
+	bool waiting = false;
+
+	while (cursor < round->size() && (budget == 0 || stats.sent < budget))
+	{
+		const SubscriberPtr& subscriber = (*round)[cursor++];
+		if (subscriber->cancelled)
+		{
+			continue;
+		}
+
+		if (!deliver(*subscriber, pending, limits, now, stats, waiting))
+		{
+			slowSubscribers.push_back(subscriber);
+		}
 	}
 
-	std::vector<LS::Message> activeMessages;
+	bool more = true;
 	{
 		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		mRoundCursor = cursor;
+		mRoundWaiting = mRoundWaiting || waiting;
+		mStats.sent += stats.sent;
+		mStats.collapsed += stats.collapsed;
+		mStats.failed += stats.failed;
+		mStats.deferred += stats.deferred;
 
-		if (mDeduplicate)
+		if (cursor >= round->size())
 		{
-			if (payload == mPreviousPayload)
+			mRound.reset();
+
+			// Drop updates every current subscriber already has.
+			// Subscribers added during the round may still wait for their first response.
+			uint64_t delivered = mLastSeq;
+			bool firstPending = false;
+			for (const SubscriberPtr& subscriber : *mSubscriptions.snapshot())
+			{
+				delivered = std::min(delivered, subscriber->deliveredSeq);
+				firstPending = firstPending || subscriber->first;
+			}
+
+			while (!mPending.empty() && mPending.front().seq <= delivered)
+			{
+				mPending.pop_front();
+			}
+
+			uint64_t roundSeq = pending.empty() ? 0 : pending.back().seq;
+			if (mPending.empty() && !firstPending)
+			{
+				mFlushSource = nullptr;
+				more = false;
+			}
+			else if (!final && mRoundWaiting && !firstPending && mLastSeq == roundSeq)
 			{
-				return true;
+				// Only subscribers without room are left, try again once they could have read an update.
+				unsigned rate = std::max(1u, limits.drainRate);
+				mFlushSource = nullptr;
+				scheduleRetry((1000 + rate - 1) / rate);
+				more = false;
 			}
-			mPreviousPayload = payload;
 		}
+	}
+
+	for (const SubscriberPtr& subscriber : slowSubscribers)
+	{
+		LOG_LS_WARNING(MSGID_LS_SUBSCRIBER_CUT_OFF, 2,
+		               PMLOGKS("SENDER", subscriber->message.getSender()),
+		               PMLOGKFV("STRIKES", "%u", subscriber->strikes),
+		               "Subscriber is not keeping up with updates, cancelling subscription");
+
+		try
+		{
+			ErrorResponse response = API_ERROR_SUBSCRIBER_TOO_SLOW;
+			response.put("subscribed", false);
+			subscriber->message.respond(response.stringify().c_str());
+		}
+		catch (LS::Error &e)
+		{
+			e.log(PmLogGetLibContext(), "LS_SUBS_POST_FAIL");
+		}
+
+		std::shared_ptr<ServerStatus> watch;
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+		removeSubscription(subscriber->token, watch);
+		mStats.cutOff++;
+	}
 
-		for (auto& item : mSubscriptions)
+	return more;
+}
+
+// Drops updates nobody can need anymore when queued updates are being collapsed.
+void SubscriptionPoint::trimPending()
+{
+	if (mMaxOutstanding == 0)
+	{
+		return;
+	}
+
+	while (mPending.size() > mMaxOutstanding)
+	{
+		mPending.pop_front();
+	}
+}
+
+// Subscription responses are sent from within the same thread that Luna
+// uses itself to avoid synchronization between other callbacks (like cancel).
+// Post only queues the payload, a single main loop source fans it out to the
+// subscribers, spread over several iterations for large subscriber counts.
+bool SubscriptionPoint::post(const char *payload) noexcept
+{
+	if (!mServiceHandle)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+
+	if (mDeduplicate)
+	{
+		if (payload == mPreviousPayload)
 		{
-			activeMessages.push_back(item->message);
+			return true;
 		}
+		mPreviousPayload = payload;
+	}
+
+	if (mSubscriptions.empty())
+	{
+		return true;
 	}
 
-	std::unique_ptr<PostData> data(new PostData());
-	data->payload = payload;
-	data->messages = std::move(activeMessages);
+	Capture::global().recordPost(mName.c_str(), payload);
 
-	GSource* source = g_timeout_source_new(0);
-	g_source_set_callback(source, (GSourceFunc)postSubscriptions, data.release(),
-	                      [](gpointer data)
-	                      {
-		                      delete static_cast<PostData*>(data);
-	                      });
+	mPending.push_back(PendingPost { ++mLastSeq, std::make_shared<const std::string>(payload) });
+	mStats.posted++;
+	postedCount.add();
+	postedBytes.add(mPending.back().payload->size());
+	trimPending();
 
+	return scheduleFlush();
+}
+
+// Needs to be called with the lock held.
+GSource* SubscriptionPoint::addSource(guint delayMs, GSourceFunc callback)
+{
+	LS::Error error;
+	GMainContext *context = LSGmainGetContext(mServiceHandle, error.get());
+	if (!context)
+	{
+		error.log(PmLogGetLibContext(), "LS_SUBS_POST_FAIL");
+		return nullptr;
+	}
+
+	GSource* source = g_timeout_source_new(delayMs);
+	g_source_set_callback(source, callback, this, nullptr);
 	g_source_attach(source, context);
 	g_source_unref(source);
+	return source;
+}
 
-	return true;
+// Needs to be called with the lock held.
+bool SubscriptionPoint::scheduleFlush()
+{
+	if (!mFlushSource)
+	{
+		mFlushSource = addSource(0, flushCB);
+	}
+
+	return mFlushSource != nullptr;
 }
 
-bool SubscriptionPoint::subscriberCancelCB(LSHandle *sh, const char *uniqueToken, void *context)
+// Needs to be called with the lock held. A post meanwhile starts the fan-out right away,
+// subscribers with room do not wait for the others.
+void SubscriptionPoint::scheduleRetry(guint delayMs)
 {
-	SubscriptionPoint *self = static_cast<SubscriptionPoint *>(context);
+	if (!mRetrySource)
+	{
+		mRetrySource = addSource(delayMs, retryCB);
+	}
+}
+
+gboolean SubscriptionPoint::retryCB(gpointer user_data)
+{
+	SubscriptionPoint* self = static_cast<SubscriptionPoint*>(user_data);
 	std::lock_guard<std::mutex> lock(self->mSubscriptonsMutex);
+	self->mRetrySource = nullptr;
+	self->scheduleFlush();
+	return G_SOURCE_REMOVE;
+}
+
+// Needs to be called with the lock held. The watch is returned to be released outside the lock.
+void SubscriptionPoint::removeSubscription(const std::string& token, std::shared_ptr<ServerStatus>& watch)
+{
+	std::string sender;
+	if (!mSubscriptions.remove(token, &sender, [](const SubscriberPtr& subscriber)
+	                           {
+		                           subscriber->cancelled = true;
+	                           }))
+	{
+		return;
+	}
 
-	auto it = std::find_if(self->mSubscriptions.begin(), self->mSubscriptions.end(),
-	                       [uniqueToken](std::unique_ptr<SubscriptionItem>& _item)
-	                       {
-		                       return !strcmp(uniqueToken, _item->message.getUniqueToken());
-	                       }
-	);
+	mSubscriberCount = mSubscriptions.size();
 
-	if (it != self->mSubscriptions.end())
+	// Last subscription of the sender is gone, drop the shared watch.
+	if (!sender.empty())
 	{
-		self->mSubscriptions.erase(it);
+		auto it = mSenderWatches.find(sender);
+		if (it != mSenderWatches.end())
+		{
+			watch = std::move(it->second);
+			mSenderWatches.erase(it);
+		}
 	}
+}
+
+bool SubscriptionPoint::subscriberCancelCB(LSHandle *sh, const char *uniqueToken, void *context)
+{
+	SubscriptionPoint *self = static_cast<SubscriptionPoint *>(context);
+	std::shared_ptr<ServerStatus> watch;
+
+	std::lock_guard<std::mutex> lock(self->mSubscriptonsMutex);
+	self->removeSubscription(uniqueToken, watch);
 
 	return true;
 }
 
-void SubscriptionPoint::subscriberStatusCB(SubscriptionPoint::SubscriptionItem* item, bool isUp)
+void SubscriptionPoint::subscriberStatusCB(const std::string& sender, bool isUp)
 {
 	if (isUp)
 		return;
 
-	std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
-
-	auto it = std::find_if(mSubscriptions.begin(), mSubscriptions.end(),
-	                       [item](std::unique_ptr<SubscriptionItem> & _item)
-	                       {
-		                       return (_item.get() == item);
-	                       }
-	);
+	std::shared_ptr<ServerStatus> watch;
 
-	if (it != mSubscriptions.end())
 	{
-		mSubscriptions.erase(it);
+		std::lock_guard<std::mutex> lock(mSubscriptonsMutex);
+
+		mSubscriptions.removeGroup(sender, [](const SubscriberPtr& subscriber)
+		{
+			subscriber->cancelled = true;
+		});
+		mSubscriberCount = mSubscriptions.size();
+
+		auto it = mSenderWatches.find(sender);
+		if (it != mSenderWatches.end())
+		{
+			watch = std::move(it->second);
+			mSenderWatches.erase(it);
+		}
 	}
 }
 
@@ -0,0 +1,229 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "tracer.hpp"
+
+using namespace pbnjson;
+
+namespace LSHelpers {
+
+// Records per thread. At 96 bytes a record that is about 200KB per thread.
+static const size_t RING_SIZE = 2048;
+
+struct Tracer::ThreadBuffer
+{
+	ThreadBuffer() : tid(0), next(0), clearedAt(0) {}
+
+	pid_t tid;
+	std::atomic<uint64_t> next; // Total records written, the next index is next % RING_SIZE
+	std::atomic<gint64> clearedAt; // Records that started before are dropped from exports
+	Record records[RING_SIZE];
+};
+
+namespace {
+
+// Gives the buffer back to the tracer when the thread exits.
+struct ThreadBufferHolder
+{
+	~ThreadBufferHolder()
+	{
+		if (buffer)
+		{
+			release(buffer);
+		}
+	}
+
+	Tracer::ThreadBuffer* buffer = nullptr;
+	void (*release)(Tracer::ThreadBuffer*) = nullptr;
+};
+
+thread_local ThreadBufferHolder threadBufferHolder;
+thread_local const char* threadTag = "";
+
+inline void copyString(char* target, const char* source, size_t size)
+{
+	strncpy(target, source, size - 1);
+	target[size - 1] = '\0';
+}
+
+} // namespace
+
+Tracer::Tracer() : mEnabled(true)
+{
+}
+
+Tracer& Tracer::global()
+{
+	// Not destroyed on exit, threads may still record while static destructors run.
+	static Tracer* tracer = new Tracer();
+	return *tracer;
+}
+
+Tracer::ThreadBuffer& Tracer::threadBuffer()
+{
+	ThreadBufferHolder& holder = threadBufferHolder;
+	if (holder.buffer)
+	{
+		return *holder.buffer;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mFreeBuffers.empty())
+	{
+		holder.buffer = mFreeBuffers.back();
+		holder.buffer->clearedAt.store(g_get_monotonic_time(), std::memory_order_relaxed);
+		mFreeBuffers.pop_back();
+	}
+	else
+	{
+		holder.buffer = new ThreadBuffer();
+		for (Record& record : holder.buffer->records)
+		{
+			record.seq.store(0, std::memory_order_relaxed);
+		}
+		mBuffers.push_back(holder.buffer);
+	}
+
+	holder.buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+	holder.release = [](ThreadBuffer* buffer) { Tracer::global().releaseBuffer(buffer); };
+	return *holder.buffer;
+}
+
+void Tracer::releaseBuffer(ThreadBuffer* buffer)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFreeBuffers.push_back(buffer);
+}
+
+void Tracer::record(const char* name, const char* tag, gint64 start, gint64 end)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	ThreadBuffer& buffer = threadBuffer();
+	uint64_t index = buffer.next.load(std::memory_order_relaxed);
+	Record& record = buffer.records[index % RING_SIZE];
+
+	// Sequence lock, readers skip records that are odd or changed while they were copied.
+	uint32_t seq = record.seq.load(std::memory_order_relaxed);
+	record.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	record.start = start;
+	record.duration = end - start;
+	copyString(record.name, name, NAME_SIZE);
+	copyString(record.tag, tag ? tag : "", TAG_SIZE);
+
+	record.seq.store(seq + 2, std::memory_order_release);
+	buffer.next.store(index + 1, std::memory_order_release);
+}
+
+JValue Tracer::toChromeTrace() const
+{
+	std::vector<ThreadBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		buffers = mBuffers;
+	}
+
+	JArray events;
+	int64_t pid = getpid();
+
+	for (ThreadBuffer* buffer : buffers)
+	{
+		uint64_t next = buffer->next.load(std::memory_order_acquire);
+		uint64_t first = next > RING_SIZE ? next - RING_SIZE : 0;
+		gint64 clearedAt = buffer->clearedAt.load(std::memory_order_relaxed);
+
+		for (uint64_t index = first; index < next; index++)
+		{
+			const Record& record = buffer->records[index % RING_SIZE];
+
+			uint32_t seq = record.seq.load(std::memory_order_acquire);
+			if (seq & 1)
+			{
+				continue;
+			}
+
+			gint64 start = record.start;
+			gint64 duration = record.duration;
+			char name[NAME_SIZE];
+			char tag[TAG_SIZE];
+			memcpy(name, record.name, NAME_SIZE);
+			memcpy(tag, record.tag, TAG_SIZE);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (record.seq.load(std::memory_order_relaxed) != seq || start < clearedAt)
+			{
+				continue;
+			}
+
+			name[NAME_SIZE - 1] = '\0';
+			tag[TAG_SIZE - 1] = '\0';
+
+			JObject event {{"name", name},
+			               {"cat", "videooutput"},
+			               {"ph", "X"},
+			               {"ts", static_cast<int64_t>(start)},
+			               {"dur", static_cast<int64_t>(duration)},
+			               {"pid", pid},
+			               {"tid", static_cast<int64_t>(buffer->tid)}};
+			if (tag[0])
+			{
+				event.put("args", JObject {{"tag", tag}});
+			}
+			events.append(event);
+		}
+	}
+
+	return JObject {{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+}
+
+void Tracer::clear()
+{
+	gint64 now = g_get_monotonic_time();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (ThreadBuffer* buffer : mBuffers)
+	{
+		buffer->clearedAt.store(now, std::memory_order_relaxed);
+	}
+}
+
+const char* Tracer::currentTag()
+{
+	return threadTag;
+}
+
+TraceTag::TraceTag(const std::string& tag)
+		: mPrevious(threadTag)
+{
+	copyString(mTag, tag.c_str(), Tracer::TAG_SIZE);
+	threadTag = mTag;
+}
+
+TraceTag::~TraceTag()
+{
+	threadTag = mPrevious;
+}
+
+} // namespace LSHelpers
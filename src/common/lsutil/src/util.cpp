@@ -19,21 +19,23 @@
 
 std::string string_format_valist(const std::string& fmt_str, va_list ap)
 {
-	size_t n = fmt_str.size() * 2;
-	std::unique_ptr<char[]> formatted(new char[n]);
+	// Error messages are short, format on stack first and allocate only for the result.
+	char buffer[256];
 	va_list apCopy;
 	va_copy(apCopy, ap);
 
-	int final_n = vsnprintf(&formatted[0], n, fmt_str.c_str(), ap);
-	if (final_n < 0 || final_n >= (int)n)
+	int final_n = vsnprintf(buffer, sizeof(buffer), fmt_str.c_str(), ap);
+	if (final_n >= 0 && final_n < (int)sizeof(buffer))
 	{
-		/* There was not enough space, retry */
-		/* MS implements < 0 as not large enough */
-		n = (size_t) (abs(final_n) + 1);
-
-		formatted.reset(new char[n]);
-		vsnprintf(&formatted[0], n, fmt_str.c_str(), apCopy);
+		va_end(apCopy);
+		return std::string(buffer, (size_t)final_n);
 	}
+
+	/* There was not enough space, retry */
+	/* MS implements < 0 as not large enough */
+	size_t n = final_n < 0 ? fmt_str.size() * 2 + sizeof(buffer) : (size_t)final_n + 1;
+	std::unique_ptr<char[]> formatted(new char[n]);
+	vsnprintf(&formatted[0], n, fmt_str.c_str(), apCopy);
 	va_end(apCopy);
 
 	return std::string(formatted.get());
@@ -49,6 +49,13 @@ std::string string_format_valist(const std::string& fmt_str, va_list ap);
 #define MSGID_LS_RESPONSE_PARAMETERS_ERROR    "LS_RESPONSE_PARAMETERS_ERRO"  /* JsonRespose.get call failed. */
 #define MSGID_LS_INVALID_CATEGORY_NAME        "LS_INVALID_CATEGORY_NAME"  /* Category name not valid. */
 #define MSGID_LS_INVALID_METHOD_NAME          "LS_INVALID_METHOD_NAME"  /* Method name not valid. */
+#define MSGID_LS_SUBSCRIBER_CUT_OFF           "LS_SUBSCRIBER_CUT_OFF"  /* Slow subscriber cancelled. */
+#define MSGID_LS_RATE_LIMITED                 "LS_RATE_LIMITED"  /* Caller went over its call budget. */
+#define MSGID_LS_RATE_LIMIT_CONFIG            "LS_RATE_LIMIT_CONFIG"  /* Rate limit configuration not valid. */
+#define MSGID_LS_METRICS                      "LS_METRICS"  /* Periodic metrics summary. */
+#define MSGID_LS_MAINLOOP_STALL               "LS_MAINLOOP_STALL"  /* Main loop did not run for too long. */
+#define MSGID_LS_CAPTURE                      "LS_CAPTURE"  /* Traffic capture started, stopped or failed. */
+#define MSGID_LS_READY                        "LS_READY"  /* Service became ready, waiting calls routed. */
 
 // API error responses.
 #define API_ERROR_UNKNOWN                    ErrorResponse(1, "Unknown error")
@@ -56,6 +63,11 @@ std::string string_format_valist(const std::string& fmt_str, va_list ap);
 #define API_ERROR_SCHEMA_VALIDATION(...)     ErrorResponse(3, __VA_ARGS__)
 #define API_ERROR_NO_RESPONSE                ErrorResponse(4, "The service did not send a reply")
 #define API_ERROR_REMOVED                    ErrorResponse(5, "Method is removed")
+#define API_ERROR_SUBSCRIBER_TOO_SLOW        ErrorResponse(6, "Subscription cancelled, subscriber is not keeping up")
+#define API_ERROR_CANCELLED                  ErrorResponse(7, "Request cancelled before it completed")
+#define API_ERROR_INVALID_BATCH_CALL(...)    ErrorResponse(8, __VA_ARGS__)
+#define API_ERROR_RATE_LIMITED               ErrorResponse(9, "Too many calls, try again later")
+#define API_ERROR_SUPERSEDED                 ErrorResponse(11, "Call superseded by a newer call from the same caller")
 
 // Copy of LSError utility functions from luna-service2. Used to generate LS::Errors.
 
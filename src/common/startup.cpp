@@ -0,0 +1,106 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "logging.h"
+#include "startup.h"
+
+namespace Startup
+{
+
+namespace
+{
+
+struct Phase {
+    std::string name;
+    double sinceBootMs;
+};
+
+std::mutex mutex;
+std::vector<Phase> phases;
+
+double sinceBootMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// Start time of the process since boot, from field 22 of /proc/self/stat in clock ticks.
+// 0 if it can not be read. Called with the mutex held.
+double processStartMs()
+{
+    static double startMs = -1;
+    if (startMs >= 0)
+        return startMs;
+
+    startMs = 0;
+    std::ifstream file("/proc/self/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // The command name in field 2 may contain spaces, the fields are counted from its closing parenthesis.
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos)
+        return startMs;
+
+    for (int field = 2; field < 22 && pos != std::string::npos; field++)
+        pos = stat.find(' ', pos + 1);
+    if (pos == std::string::npos)
+        return startMs;
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    if (ticks > 0)
+        startMs = std::strtoull(stat.c_str() + pos + 1, nullptr, 10) * 1000.0 / ticks;
+    return startMs;
+}
+
+} // namespace
+
+void mark(const char *phase)
+{
+    double now = sinceBootMs();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    double startMs = processStartMs();
+    phases.push_back(Phase{phase, now});
+
+    LOG_INFO(MSGID_STARTUP_PHASE, 3, PMLOGKS("PHASE", phase), PMLOGKFV("SINCE_BOOT_MS", "%.1f", now),
+             PMLOGKFV("SINCE_START_MS", "%.1f", now - startMs), "Startup phase reached");
+}
+
+pbnjson::JValue toJValue()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double startMs = processStartMs();
+
+    pbnjson::JArray list;
+    for (const Phase &phase : phases) {
+        list.append(pbnjson::JObject{
+            {"name", phase.name}, {"sinceBootMs", phase.sinceBootMs}, {"sinceStartMs", phase.sinceBootMs - startMs}});
+    }
+
+    return pbnjson::JObject{{"processStartMs", startMs}, {"phases", list}};
+}
+
+} // namespace Startup
@@ -0,0 +1,40 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Startup phase timeline.
+//
+// main() marks each phase as it is reached, like the bus name being registered or the HAL being
+// initialized, SubscribeAdapter the first subscription to a setting and its first response. Each mark
+// is logged with the time since boot and since the process started, so the boot-to-ready time can be
+// read from the log, and kept for the "startup" section of getMetrics.
+// Times are CLOCK_BOOTTIME in milliseconds, the clock the kernel reports the process start with.
+//
+// Multithreading: thread safe.
+
+#include <pbnjson.hpp>
+
+namespace Startup
+{
+
+// Record that the phase was reached now. Phases are kept in the order they were marked.
+void mark(const char *phase);
+
+// {processStartMs, phases: [{name, sinceBootMs, sinceStartMs}]}
+pbnjson::JValue toJValue();
+
+} // namespace Startup
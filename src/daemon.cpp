@@ -0,0 +1,110 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <functional>
+#include <thread>
+
+#include "daemon.h"
+#include "logging.h"
+#include "startup.h"
+
+HalInitializer::HalInitializer(VAL *val, GMainContext *context)
+    : mVal(val), mContext(context), mSuccess(false), mSource(0), mCompleted(false)
+{
+    mThread = std::thread(&HalInitializer::run, this);
+}
+
+HalInitializer::~HalInitializer()
+{
+    mThread.join();
+    if (!mCompleted) {
+        GSource *source = g_main_context_find_source_by_id(mContext, mSource);
+        if (source)
+            g_source_destroy(source);
+    }
+}
+
+void HalInitializer::run()
+{
+    Startup::mark("halInitStarted");
+    gint64 start = g_get_monotonic_time();
+
+    try {
+        mSuccess = mVal->initialize();
+    } catch (const std::exception &e) {
+        LOG_ERROR(MSGID_UNEXPECTED_EXCEPTION, 0, "VAL initialization: %s", e.what());
+    } catch (...) {
+        LOG_ERROR(MSGID_UNEXPECTED_EXCEPTION, 0, "VAL initialization: unknown exception");
+    }
+
+    LSHelpers::Tracer::global().record("val.initialize", "", start, g_get_monotonic_time());
+    Startup::mark("halInitDone");
+
+    // Read by the main loop only after the destructor joined the thread.
+    GSource *source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_HIGH);
+    g_source_set_callback(source, &HalInitializer::completeCB, this, nullptr);
+    mSource = g_source_attach(source, mContext);
+    g_source_unref(source);
+}
+
+gboolean HalInitializer::completeCB(gpointer user_data)
+{
+    HalInitializer *self = static_cast<HalInitializer *>(user_data);
+    self->mCompleted     = true;
+    if (self->mDone)
+        self->mDone(self->mSuccess);
+    return G_SOURCE_REMOVE;
+}
+
+Daemon::Daemon(GMainLoop *loop, VAL *val, const std::string &busName, const std::string &journalPath,
+               const std::string &snapshotPath, const std::string &handoverState,
+               std::unique_ptr<HalInitializer> halInitializer)
+    : mServiceHandle(busName.c_str()), mHalInitializer(std::move(halInitializer))
+{
+    mVideo.reset(new VideoService(mServiceHandle, journalPath));
+    Startup::mark("videoService");
+    mSystemProperties.reset(new SystemPropertyService(mServiceHandle, *mVideo));
+    if (!handoverState.empty())
+        mVideo->adoptState(handoverState);
+
+    mServiceHandle.attachToLoop(loop);
+    Startup::mark("busRegistered");
+
+    // Settings are applied to the HAL as soon as they arrive, they are subscribed to once it is initialized.
+    // The ones of the last run are applied right away from the snapshot.
+    mSnapshot.reset(new SettingsSnapshot(snapshotPath));
+    if (!mHalInitializer)
+        mHalInitializer.reset(new HalInitializer(val, g_main_loop_get_context(loop)));
+    mHalInitializer->setCallback([this](bool success) { halInitialized(success); });
+}
+
+Daemon::~Daemon() {}
+
+void Daemon::halInitialized(bool success)
+{
+    if (!success) {
+        LOG_ERROR(MSGID_HAL_INIT_ERROR, 0,
+                  "VAL initialization failed! Service is starting, but some functionality might not work.");
+    }
+
+    mVideo->halInitialized();
+#if !USE_RPI_RESOURCE
+    mPictureSettings.reset(new PictureSettings(mServiceHandle, *mVideo, *mSnapshot));
+#endif
+    mArcSetting.reset(new AspectRatioSetting(mServiceHandle, *mVideo, *mSnapshot));
+    Startup::mark("ready");
+}
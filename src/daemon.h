@@ -0,0 +1,110 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <glib.h>
+#include <val_api.h>
+
+#include "ls2-helpers.hpp"
+#include "settingssnapshot.h"
+#include "systempropertyservice.h"
+#include "videoservice.h"
+
+/**
+ * Runs VAL::initialize on a worker thread, so the service can register on the bus meanwhile.
+ * The completion callback is called on the main loop, set it before the loop runs.
+ * Marks the halInitStarted and halInitDone startup phases.
+ */
+class HalInitializer
+{
+public:
+    typedef std::function<void(bool success)> Callback;
+
+    HalInitializer(VAL *val, GMainContext *context);
+    HalInitializer(const HalInitializer &) = delete;
+    HalInitializer &operator=(const HalInitializer &) = delete;
+
+    /**
+     * Waits for the initialization to finish. The callback is not called if it did not run yet.
+     */
+    ~HalInitializer();
+
+    void setCallback(const Callback &done) { mDone = done; }
+
+private:
+    void run();
+    static gboolean completeCB(gpointer user_data);
+
+    VAL *mVal;
+    GMainContext *mContext;
+    Callback mDone;  // Main loop only
+    bool mSuccess;   // Written by the worker before the completion source is attached
+    guint mSource;   // Written by the worker, read after it is joined
+    bool mCompleted; // Main loop only
+    std::thread mThread;
+};
+
+// The service as main() runs it. Methods are registered and the name is on the bus before the HAL is
+// initialized, VAL::initialize runs on a worker thread meanwhile. Once it returned, the sinks are set up
+// on the main loop and the settings are subscribed to. Calls that need the HAL wait in the service point
+// until then, see VideoService::halInitialized.
+//
+// Marks the videoService, busRegistered, halInitStarted, halInitDone and ready startup phases.
+class Daemon
+{
+public:
+    /**
+     * @param journalPath   State journal, "" for none.
+     * @param snapshotPath  Settings of the last run, applied until the subscriptions answer. "" keeps them in memory.
+     * @param handoverState Exported by the process that handed over, "" to start anew.
+     * @param halInitializer HAL initialization started before, like while waiting for a handover.
+     *                       nullptr to start it here, once the service is on the bus.
+     * @throw LS::Error if the bus name can not be registered.
+     */
+    Daemon(GMainLoop *loop, VAL *val, const std::string &busName, const std::string &journalPath,
+           const std::string &snapshotPath, const std::string &handoverState,
+           std::unique_ptr<HalInitializer> halInitializer = nullptr);
+    Daemon(const Daemon &) = delete;
+    Daemon &operator=(const Daemon &) = delete;
+
+    /**
+     * Waits for the HAL initialization to finish, if it still runs.
+     */
+    ~Daemon();
+
+    LS::Handle &handle() { return mServiceHandle; }
+    VideoService &video() { return *mVideo; }
+
+private:
+    void halInitialized(bool success);
+
+    // Destroyed in reverse order, the HAL initializer is joined first.
+    LS::Handle mServiceHandle;
+    std::unique_ptr<VideoService> mVideo;
+    std::unique_ptr<SystemPropertyService> mSystemProperties;
+    std::unique_ptr<SettingsSnapshot> mSnapshot;
+#if !USE_RPI_RESOURCE
+    std::unique_ptr<PictureSettings> mPictureSettings;
+#endif
+    std::unique_ptr<AspectRatioSetting> mArcSetting;
+    std::unique_ptr<HalInitializer> mHalInitializer;
+};
@@ -15,12 +15,15 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <glib.h>
+#include <memory>
 #include <string>
 #include <sys/signalfd.h>
+#include <unistd.h>
 
+#include "daemon.h"
+#include "handover.h"
 #include "logging.h"
-#include "systemproperty/systempropertyservice.h"
-#include "video/videoservice.h"
+#include "startup.h"
 #include <val_api.h>
 
 PmLogContext logContext;
@@ -29,12 +32,20 @@ static const char *const logContextName = "videooutputd";
 static const char *const logPrefix      = "[videooutputd] ";
 static const std::string busName        = "com.webos.service.videooutput";
 
-static gboolean option_version = FALSE;
-static GMainLoop *mainLoop     = nullptr;
-static bool terminated         = false;
+// How long a new process waits for the running one to hand over, and then for it to exit.
+static const int handoverTimeoutMs = 5000;
+
+static gboolean option_version  = FALSE;
+static gboolean option_handover = FALSE;
+static GMainLoop *mainLoop      = nullptr;
+static bool terminated          = false;
+static bool handedOver          = false;
+static VideoService *service    = nullptr;
 
 static GOptionEntry options[] = {
     {"version", 'v', 0, G_OPTION_ARG_NONE, &option_version, "Show version information and exit", ""},
+    {"handover", 0, 0, G_OPTION_ARG_NONE, &option_handover,
+     "Take the video over from the running service, which is sent SIGUSR2 to hand over", ""},
     {NULL, ' ', 0, G_OPTION_ARG_NONE, NULL, NULL, NULL},
 };
 
@@ -44,6 +55,40 @@ static void lunaBusDisconnected(LSHandle *sh, void *user_data)
     g_main_loop_quit(mainLoop);
 }
 
+/**
+ * Stores the pid of the process serving the bus name, systemd reads it again when that process exits.
+ */
+static void write_pid_file(pid_t pid)
+{
+    GError *error           = nullptr;
+    const std::string value = std::to_string(pid) + "\n";
+    if (!g_file_set_contents(PID_FILE, value.c_str(), value.size(), &error)) {
+        LOG_WARNING(MSGID_HANDOVER_ERROR, 0, "Can't write %s: %s", PID_FILE, error->message);
+        g_error_free(error);
+    }
+}
+
+/**
+ * Hands the sinks and clients over to a new process started with --handover, and exits without
+ * disconnecting the sinks. Keeps running if no new process is waiting.
+ * The pid file names the new process before this one exits, so systemd keeps the service running.
+ */
+static void hand_over()
+{
+    if (!service || terminated)
+        return;
+
+    pid_t next = 0;
+    if (!Handover::send(HANDOVER_SOCKET, service->exportState(), next))
+        return;
+
+    write_pid_file(next);
+    service->handOver();
+    handedOver = true;
+    terminated = true;
+    g_main_loop_quit(mainLoop);
+}
+
 static gboolean signal_handler(GIOChannel *channel, GIOCondition cond, gpointer user_data)
 {
     struct signalfd_siginfo si;
@@ -78,6 +123,10 @@ static gboolean signal_handler(GIOChannel *channel, GIOCondition cond, gpointer
         terminated = 1;
         break;
 
+    case SIGUSR2:
+        hand_over();
+        break;
+
     default:
         break;
     }
@@ -100,6 +149,7 @@ static guint setup_signalfd()
     sigaddset(&mask, SIGINT);
     sigaddset(&mask, SIGTERM);
     sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
 
     if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
         std::cerr << "Failed to set signal mask";
@@ -161,30 +211,44 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    BinLog::start(logContext);
+    Startup::mark("main");
+
     mainLoop     = g_main_loop_new(NULL, FALSE);
     guint signal = setup_signalfd();
 
     // Initiate val object
     VAL *val = VAL::getInstance();
-    try {
-        if (!val->initialize()) {
-            LOG_ERROR(MSGID_HAL_INIT_ERROR, 0,
-                      "VAL initialization failed! Service is still starting, but some functionality might not work.");
-        }
-
-        LS::Handle serviceHandle{busName.c_str()};
 
-        // Initialize categories
-        VideoService video(serviceHandle);
-        SystemPropertyService systemproperties(serviceHandle, video);
-#if !USE_RPI_RESOURCE
-        PictureSettings pictureSettings(serviceHandle, video);
-#endif
-        AspectRatioSetting arcSetting(serviceHandle, video);
+    // The running service holds the bus name and the planes until it handed over and exited.
+    // The HAL is initialized meanwhile, so it is not part of the time no process serves requests.
+    std::string handoverState;
+    std::unique_ptr<HalInitializer> halInitializer;
+    if (option_handover) {
+        halInitializer.reset(new HalInitializer(val, g_main_loop_get_context(mainLoop)));
+        if (Handover::receive(HANDOVER_SOCKET, handoverTimeoutMs, handoverState))
+            Startup::mark("handoverReceived");
+    }
 
-        serviceHandle.attachToLoop(mainLoop);
-        serviceHandle.setDisconnectHandler(lunaBusDisconnected, nullptr);
+    try {
+        Daemon daemon(mainLoop, val, busName, STATE_JOURNAL_FILE, SETTINGS_SNAPSHOT_FILE, handoverState,
+                      std::move(halInitializer));
+        daemon.handle().setDisconnectHandler(lunaBusDisconnected, nullptr);
+        service = &daemon.video();
+        write_pid_file(getpid());
+
+        g_idle_add_full(G_PRIORITY_HIGH,
+                        [](gpointer) -> gboolean {
+                            Startup::mark("mainLoopEntered");
+                            return G_SOURCE_REMOVE;
+                        },
+                        nullptr, nullptr);
+
+        // Started last, so the setup above is not reported as a stall of the loop.
+        LSHelpers::LoopMonitor::global().start(g_main_loop_get_context(mainLoop));
         g_main_loop_run(mainLoop);
+        LSHelpers::LoopMonitor::global().stop();
+        service = nullptr;
     } catch (const std::exception &e) {
         std::cerr << logPrefix << "Caught exception: '" << e.what() << "' exiting" << std::endl;
         LOG_ERROR(MSGID_UNEXPECTED_EXCEPTION, 0, "%s, exiting.", e.what());
@@ -200,9 +264,14 @@ int main(int argc, char **argv)
     g_source_remove(signal);
     g_main_loop_unref(mainLoop);
 
-    if (!val->deinitialize()) {
+    // After a handover the HAL keeps showing the video for the next process, which owns the pid file.
+    if (!handedOver)
+        unlink(PID_FILE);
+    if (!handedOver && !val->deinitialize()) {
         LOG_ERROR(MSGID_HAL_DEINIT_ERROR, 0, "VAL deinitialization error. See logs for details.");
     }
 
+    BinLog::stop();
+
     return EXIT_SUCCESS;
 }
@@ -17,10 +17,12 @@
 #include "aspectratiosetting.h"
 #include "videoservice.h"
 
-AspectRatioSetting::AspectRatioSetting(LS::Handle &serviceHandle, VideoService &video)
-    : mAdapter(serviceHandle, this, &AspectRatioSetting::handleResponseCb), mVideoService(video),
-      mCurrentAspectMode(MINUMUM), mAllDirZoomVRatio(12), mAllDirZoomVPosition(0), mAllDirZoomHRatio(12),
-      mAllDirZoomHPosition(0), mVertZoomVRatio(0), mVertZoomVPosition(0), mJustScan(false)
+AspectRatioSetting::AspectRatioSetting(LS::Handle &serviceHandle, VideoService &video,
+                                       SettingsSnapshot &snapshot)
+    : mAdapter(serviceHandle, "aspectRatio", this, &AspectRatioSetting::handleResponseCb), mVideoService(video),
+      mSnapshot(snapshot), mApplied(), mAppliedValid(false), mCurrentAspectMode(MINUMUM), mAllDirZoomVRatio(12),
+      mAllDirZoomVPosition(0), mAllDirZoomHRatio(12), mAllDirZoomHPosition(0), mVertZoomVRatio(0),
+      mVertZoomVPosition(0), mJustScan(false)
 
 {
     video.setAppIdChangedObserver(this, &AspectRatioSetting::fetchAspectRatioforApp);
@@ -92,13 +94,53 @@ void AspectRatioSetting::handleResponseCb(pbnjson::JValue &settingsResponse)
         "Aspect Ratio configured as : mCurrentAspectMode: %d alldirZooms: %d %d %d %d VertZooms:%d %d justscan:%d",
         mCurrentAspectMode, mAllDirZoomHPosition, mAllDirZoomHRatio, mAllDirZoomVPosition, mAllDirZoomVRatio,
         mVertZoomVRatio, mVertZoomVPosition, mJustScan);
+    applyAspectRatio();
+    mSnapshot.setAspectRatio(mAppId, current());
+    return;
+}
+
+void AspectRatioSetting::applyAspectRatio()
+{
+    static Counter &unchanged = MetricsRegistry::global().counter("settings.unchanged");
+
+    SettingsSnapshot::AspectRatio values = current();
+    if (mAppliedValid && values == mApplied) {
+        unchanged.add();
+        return;
+    }
+
     mVideoService.setAspectRatio(mCurrentAspectMode, mAllDirZoomHPosition, mAllDirZoomHRatio, mAllDirZoomVPosition,
                                  mAllDirZoomVRatio, mVertZoomVRatio, mVertZoomVPosition);
-    return;
+    mApplied      = values;
+    mAppliedValid = true;
+}
+
+SettingsSnapshot::AspectRatio AspectRatioSetting::current() const
+{
+    return SettingsSnapshot::AspectRatio{mCurrentAspectMode,   mAllDirZoomHPosition, mAllDirZoomHRatio,
+                                         mAllDirZoomVPosition, mAllDirZoomVRatio,    mVertZoomVRatio,
+                                         mVertZoomVPosition,   mJustScan};
 }
 
 void AspectRatioSetting::fetchAspectRatioforApp(std::string &appId)
 {
+    mAppId        = appId;
+    mAppliedValid = false;
+
+    // Settings of the last time the app was used are applied right away, the subscription corrects them.
+    SettingsSnapshot::AspectRatio kept;
+    if (mSnapshot.getAspectRatio(appId, kept)) {
+        mCurrentAspectMode   = static_cast<ARC_MODE_NAME_MAP_T>(kept.mode);
+        mAllDirZoomHPosition = kept.allDirZoomHPosition;
+        mAllDirZoomHRatio    = kept.allDirZoomHRatio;
+        mAllDirZoomVPosition = kept.allDirZoomVPosition;
+        mAllDirZoomVRatio    = kept.allDirZoomVRatio;
+        mVertZoomVRatio      = kept.vertZoomVRatio;
+        mVertZoomVPosition   = kept.vertZoomVPosition;
+        mJustScan            = kept.justScan;
+        applyAspectRatio();
+    }
+
     // cancel ARC subscription for previous appId and subscribe with new appId.
     mAdapter.subscribeTo(
         pbnjson::JObject{{"subscribe", true},
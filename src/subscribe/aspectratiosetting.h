@@ -17,6 +17,7 @@
 #pragma once
 
 #include "aspectratiocontrol.h"
+#include "settingssnapshot.h"
 #include "subscribeadapter.h"
 #include "ls2-helpers.hpp"
 
@@ -28,15 +29,22 @@ class AspectRatioSetting
 public:
     const std::string SettingService = "luna://com.webos.service.settings/getSystemSettings";
 
-    AspectRatioSetting(LS::Handle &serviceHandle, VideoService &video);
+    AspectRatioSetting(LS::Handle &serviceHandle, VideoService &video, SettingsSnapshot &snapshot);
     pbnjson::JValue responseParserCb(JsonResponse &response);
 
 private:
     void handleResponseCb(pbnjson::JValue &settingsResponse);
     void fetchAspectRatioforApp(std::string &appId);
+    // Sends the current values to the video service, unless they were sent already for the app.
+    void applyAspectRatio();
 
     SubscribeAdapter<AspectRatioSetting> mAdapter;
     VideoService &mVideoService;
+    SettingsSnapshot &mSnapshot;
+
+    std::string mAppId;
+    SettingsSnapshot::AspectRatio mApplied; // Values last sent for mAppId
+    bool mAppliedValid;
 
     ARC_MODE_NAME_MAP_T mCurrentAspectMode;
 
@@ -50,4 +58,6 @@ private:
     int32_t mVertZoomVPosition; //-18 or -17 to 18
 
     bool mJustScan;
+
+    SettingsSnapshot::AspectRatio current() const;
 };
@@ -20,10 +20,25 @@
 
 using namespace LSHelpers;
 
-PictureSettings::PictureSettings(LS::Handle &handle, VideoService &video)
-    : mModeData(PictureMode::defaultJson), mAdapter(handle, this, &PictureSettings::handleResponseCb),
-      mVideoService(video)
+PictureSettings::PictureSettings(LS::Handle &handle, VideoService &video, SettingsSnapshot &snapshot)
+    : mModeData(PictureMode::defaultJson), mAdapter(handle, "picture", this, &PictureSettings::handleResponseCb),
+      mVideoService(video), mSnapshot(snapshot), mApplied(), mBasicApplied(false), mSharpnessApplied(false)
 {
+    // Values of the last run are applied right away, the settings service answers seconds later.
+    // mCurrentMode stays empty, so the values of the current mode are still fetched and compared.
+    SettingsSnapshot::Picture picture;
+    if (mSnapshot.getPicture(picture)) {
+        LOG_DEBUG("applying picture mode %s from snapshot", picture.mode.c_str());
+        mModeData.setProperties(pbnjson::JObject{{"brightness", picture.brightness},
+                                                 {"contrast", picture.contrast},
+                                                 {"color", picture.color},
+                                                 {"tint", picture.tint},
+                                                 {"sharpness", picture.sharpness},
+                                                 {"hSharpness", picture.hSharpness},
+                                                 {"vSharpness", picture.vSharpness}});
+        applyPicture(true, true);
+    }
+
     mAdapter.subscribeTo(pbnjson::JObject{{"subscribe", true}, {"category", "picture"}}, SettingService, this,
                          &PictureSettings::responseParserCb);
 }
@@ -93,16 +108,51 @@ void PictureSettings::handleResponseCb(JValue &settingsRespone)
         mModeData.setProperties(settingsObj.getJson());
 
         // Update Settings that were changed
-        if (settingsObj.hasKey("brightness") || settingsObj.hasKey("contrast") || settingsObj.hasKey("color") ||
-            settingsObj.hasKey("tint")) {
-            mVideoService.setBasicPictureCtrl(mModeData.brightness(), mModeData.contrast(), mModeData.color(),
-                                              mModeData.tint());
+        applyPicture(settingsObj.hasKey("brightness") || settingsObj.hasKey("contrast") ||
+                         settingsObj.hasKey("color") || settingsObj.hasKey("tint"),
+                     settingsObj.hasKey("sharpness") || settingsObj.hasKey("hSharpness") ||
+                         settingsObj.hasKey("vSharpness"));
+
+        mSnapshot.setPicture(SettingsSnapshot::Picture{mCurrentMode, mModeData.brightness(), mModeData.contrast(),
+                                                       mModeData.color(), mModeData.tint(), mModeData.sharpness(),
+                                                       mModeData.hSharpness(), mModeData.vSharpness()});
+    }
+    return;
+}
+
+void PictureSettings::applyPicture(bool basic, bool sharpness)
+{
+    static Counter &unchanged = MetricsRegistry::global().counter("settings.unchanged");
+
+    if (basic) {
+        if (mBasicApplied && mApplied.brightness == mModeData.brightness() &&
+            mApplied.contrast == mModeData.contrast() && mApplied.color == mModeData.color() &&
+            mApplied.tint == mModeData.tint()) {
+            unchanged.add();
+        } else if (mVideoService
+                       .setBasicPictureCtrl(mModeData.brightness(), mModeData.contrast(), mModeData.color(),
+                                            mModeData.tint())
+                       .asBool()) {
+            mBasicApplied       = true;
+            mApplied.brightness = mModeData.brightness();
+            mApplied.contrast   = mModeData.contrast();
+            mApplied.color      = mModeData.color();
+            mApplied.tint       = mModeData.tint();
         }
-        if (settingsObj.hasKey("sharpness") || settingsObj.hasKey("hSharpness") || settingsObj.hasKey("vSharpness")) {
-            mVideoService.setSharpness(mModeData.sharpness(), mModeData.hSharpness(), mModeData.vSharpness());
+    }
+
+    if (sharpness) {
+        if (mSharpnessApplied && mApplied.sharpness == mModeData.sharpness() &&
+            mApplied.hSharpness == mModeData.hSharpness() && mApplied.vSharpness == mModeData.vSharpness()) {
+            unchanged.add();
+        } else if (mVideoService.setSharpness(mModeData.sharpness(), mModeData.hSharpness(), mModeData.vSharpness())
+                       .asBool()) {
+            mSharpnessApplied   = true;
+            mApplied.sharpness  = mModeData.sharpness();
+            mApplied.hSharpness = mModeData.hSharpness();
+            mApplied.vSharpness = mModeData.vSharpness();
         }
     }
-    return;
 }
 
 // This cancels previous fetch call.
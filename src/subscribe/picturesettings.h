@@ -18,6 +18,7 @@
 
 #include "ls2-helpers.hpp"
 #include "picturemode.h"
+#include "settingssnapshot.h"
 #include "subscribeadapter.h"
 
 using namespace pbnjson;
@@ -28,12 +29,14 @@ class PictureSettings
 public:
     const std::string SettingService = "luna://com.webos.service.settings/getSystemSettings";
 
-    PictureSettings(LS::Handle &serviceHandle, VideoService &video);
+    PictureSettings(LS::Handle &serviceHandle, VideoService &video, SettingsSnapshot &snapshot);
     pbnjson::JValue responseParserCb(JsonResponse &response);
 
 private:
     void handleResponseCb(JValue &settingsJValue);
     void fetchPictureModeParams(const std::string &modeName);
+    // Sends the values of mModeData to the HAL, unless they were sent already.
+    void applyPicture(bool basic, bool sharpness);
 
     // TODO::Where and how to load the Tables.
 
@@ -42,4 +45,10 @@ private:
 
     SubscribeAdapter<PictureSettings> mAdapter;
     VideoService &mVideoService;
+    SettingsSnapshot &mSnapshot;
+
+    // Values last sent to the HAL.
+    SettingsSnapshot::Picture mApplied;
+    bool mBasicApplied;
+    bool mSharpnessApplied;
 };
@@ -0,0 +1,233 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "settingssnapshot.h"
+
+// "VOSS", changed whenever Data changes.
+const uint32_t SNAPSHOT_MAGIC   = 0x53534f56;
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// Apps whose aspect ratio settings are kept.
+const size_t ARC_APPS = 32;
+
+// Longest kept picture mode and app id, longer ones are not kept.
+const size_t MODE_SIZE   = 32;
+const size_t APP_ID_SIZE = 128;
+
+// File layout. Only fixed size fields, the file is written and read as is.
+struct SettingsSnapshot::Data {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t checksum; // FNV-1a of everything after this field
+    uint32_t useCount; // Ordering of the app entries, most recent is highest
+
+    uint8_t hasPicture;
+    char pictureMode[MODE_SIZE];
+    uint8_t brightness;
+    uint8_t contrast;
+    uint8_t color;
+    int8_t tint;
+    uint8_t sharpness;
+    uint8_t hSharpness;
+    uint8_t vSharpness;
+
+    struct App {
+        char appId[APP_ID_SIZE]; // Empty if the entry is free
+        uint32_t lastUse;
+        int32_t values[7]; // AspectRatio fields in order, without justScan
+        uint8_t justScan;
+    } apps[ARC_APPS];
+};
+
+bool SettingsSnapshot::AspectRatio::operator==(const AspectRatio &other) const
+{
+    return mode == other.mode && allDirZoomHPosition == other.allDirZoomHPosition &&
+           allDirZoomHRatio == other.allDirZoomHRatio && allDirZoomVPosition == other.allDirZoomVPosition &&
+           allDirZoomVRatio == other.allDirZoomVRatio && vertZoomVRatio == other.vertZoomVRatio &&
+           vertZoomVPosition == other.vertZoomVPosition && justScan == other.justScan;
+}
+
+SettingsSnapshot::SettingsSnapshot(const std::string &path) : mData(nullptr), mMapped(false)
+{
+    if (!path.empty()) {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        struct stat st;
+
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            LOG_WARNING(MSGID_SETTINGS_SNAPSHOT_ERROR, 0, "Can't open %s: %s, settings are not kept", path.c_str(),
+                        strerror(errno));
+        } else if (st.st_size != sizeof(Data) && ftruncate(fd, sizeof(Data)) != 0) {
+            LOG_WARNING(MSGID_SETTINGS_SNAPSHOT_ERROR, 0, "Can't resize %s: %s, settings are not kept",
+                        path.c_str(), strerror(errno));
+        } else {
+            void *mapping = mmap(nullptr, sizeof(Data), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) {
+                LOG_WARNING(MSGID_SETTINGS_SNAPSHOT_ERROR, 0, "Can't map %s: %s, settings are not kept",
+                            path.c_str(), strerror(errno));
+            } else {
+                mData   = static_cast<Data *>(mapping);
+                mMapped = true;
+            }
+        }
+
+        if (fd >= 0)
+            close(fd);
+    }
+
+    if (!mData)
+        mData = new Data();
+
+    if (mData->magic != SNAPSHOT_MAGIC || mData->version != SNAPSHOT_VERSION || mData->checksum != checksum()) {
+        if (mData->magic != 0)
+            LOG_WARNING(MSGID_SETTINGS_SNAPSHOT_ERROR, 0, "Snapshot %s not valid, starting over", path.c_str());
+        reset();
+    }
+}
+
+SettingsSnapshot::~SettingsSnapshot()
+{
+    if (mMapped)
+        munmap(mData, sizeof(Data));
+    else
+        delete mData;
+}
+
+bool SettingsSnapshot::getPicture(Picture &picture) const
+{
+    if (!mData->hasPicture)
+        return false;
+
+    picture.mode       = std::string(mData->pictureMode, strnlen(mData->pictureMode, MODE_SIZE));
+    picture.brightness = mData->brightness;
+    picture.contrast   = mData->contrast;
+    picture.color      = mData->color;
+    picture.tint       = mData->tint;
+    picture.sharpness  = mData->sharpness;
+    picture.hSharpness = mData->hSharpness;
+    picture.vSharpness = mData->vSharpness;
+    return true;
+}
+
+void SettingsSnapshot::setPicture(const Picture &picture)
+{
+    Picture current;
+    if (getPicture(current) && current.mode == picture.mode && current.brightness == picture.brightness &&
+        current.contrast == picture.contrast && current.color == picture.color && current.tint == picture.tint &&
+        current.sharpness == picture.sharpness && current.hSharpness == picture.hSharpness &&
+        current.vSharpness == picture.vSharpness)
+        return;
+
+    memset(mData->pictureMode, 0, MODE_SIZE);
+    if (picture.mode.size() < MODE_SIZE)
+        memcpy(mData->pictureMode, picture.mode.data(), picture.mode.size());
+
+    mData->hasPicture = 1;
+    mData->brightness = picture.brightness;
+    mData->contrast   = picture.contrast;
+    mData->color      = picture.color;
+    mData->tint       = picture.tint;
+    mData->sharpness  = picture.sharpness;
+    mData->hSharpness = picture.hSharpness;
+    mData->vSharpness = picture.vSharpness;
+    commit();
+}
+
+bool SettingsSnapshot::getAspectRatio(const std::string &appId, AspectRatio &aspectRatio) const
+{
+    if (appId.empty() || appId.size() >= APP_ID_SIZE)
+        return false;
+
+    for (const Data::App &app : mData->apps) {
+        if (appId.compare(0, std::string::npos, app.appId, strnlen(app.appId, APP_ID_SIZE)) != 0)
+            continue;
+
+        aspectRatio.mode                = app.values[0];
+        aspectRatio.allDirZoomHPosition = app.values[1];
+        aspectRatio.allDirZoomHRatio    = app.values[2];
+        aspectRatio.allDirZoomVPosition = app.values[3];
+        aspectRatio.allDirZoomVRatio    = app.values[4];
+        aspectRatio.vertZoomVRatio      = app.values[5];
+        aspectRatio.vertZoomVPosition   = app.values[6];
+        aspectRatio.justScan            = app.justScan != 0;
+        return true;
+    }
+
+    return false;
+}
+
+void SettingsSnapshot::setAspectRatio(const std::string &appId, const AspectRatio &aspectRatio)
+{
+    if (appId.empty() || appId.size() >= APP_ID_SIZE)
+        return;
+
+    // The entry of the app, or the free or least recently used one.
+    Data::App *entry = &mData->apps[0];
+    for (Data::App &app : mData->apps) {
+        if (appId.compare(0, std::string::npos, app.appId, strnlen(app.appId, APP_ID_SIZE)) == 0) {
+            entry = &app;
+            break;
+        }
+        if (app.lastUse < entry->lastUse)
+            entry = &app;
+    }
+
+    memset(entry->appId, 0, APP_ID_SIZE);
+    memcpy(entry->appId, appId.data(), appId.size());
+    entry->lastUse   = ++mData->useCount;
+    entry->values[0] = aspectRatio.mode;
+    entry->values[1] = aspectRatio.allDirZoomHPosition;
+    entry->values[2] = aspectRatio.allDirZoomHRatio;
+    entry->values[3] = aspectRatio.allDirZoomVPosition;
+    entry->values[4] = aspectRatio.allDirZoomVRatio;
+    entry->values[5] = aspectRatio.vertZoomVRatio;
+    entry->values[6] = aspectRatio.vertZoomVPosition;
+    entry->justScan  = aspectRatio.justScan ? 1 : 0;
+    commit();
+}
+
+void SettingsSnapshot::reset()
+{
+    memset(mData, 0, sizeof(Data));
+    mData->magic   = SNAPSHOT_MAGIC;
+    mData->version = SNAPSHOT_VERSION;
+    commit();
+}
+
+void SettingsSnapshot::commit()
+{
+    mData->checksum = checksum();
+}
+
+uint32_t SettingsSnapshot::checksum() const
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&mData->useCount);
+    const uint8_t *end   = reinterpret_cast<const uint8_t *>(mData + 1);
+
+    uint32_t hash = 2166136261u;
+    for (; bytes < end; bytes++) {
+        hash ^= *bytes;
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Last applied picture and aspect ratio settings, kept across restarts.
+//
+// The settings service answers seconds after boot. PictureSettings and AspectRatioSetting apply the
+// values kept here right away, and compare what the settings service sends with them, so the HAL
+// is programmed again only when something changed.
+//
+// The values are kept in a small file mapped into memory. Changes are written to the mapping and
+// left to the kernel to write back. The file carries a checksum, a file that was cut or is from
+// an other version is ignored and started over. When the file can not be mapped, the values are
+// kept in memory only.
+//
+// Multithreading: luna main loop only.
+
+#include <cstdint>
+#include <string>
+
+class SettingsSnapshot
+{
+public:
+    struct Picture {
+        std::string mode;
+        uint8_t brightness;
+        uint8_t contrast;
+        uint8_t color;
+        int8_t tint;
+        uint8_t sharpness;
+        uint8_t hSharpness;
+        uint8_t vSharpness;
+    };
+
+    struct AspectRatio {
+        int32_t mode; // ARC_MODE_NAME_MAP_T
+        int32_t allDirZoomHPosition;
+        int32_t allDirZoomHRatio;
+        int32_t allDirZoomVPosition;
+        int32_t allDirZoomVRatio;
+        int32_t vertZoomVRatio;
+        int32_t vertZoomVPosition;
+        bool justScan;
+
+        bool operator==(const AspectRatio &other) const;
+        bool operator!=(const AspectRatio &other) const { return !(*this == other); }
+    };
+
+    // Maps the file, creating it if needed. An empty path keeps the values in memory only.
+    explicit SettingsSnapshot(const std::string &path);
+    ~SettingsSnapshot();
+
+    SettingsSnapshot(const SettingsSnapshot &) = delete;
+    SettingsSnapshot &operator=(const SettingsSnapshot &) = delete;
+
+    // False if no picture settings were kept yet.
+    bool getPicture(Picture &picture) const;
+    void setPicture(const Picture &picture);
+
+    // Settings of an app. False if none were kept for it.
+    bool getAspectRatio(const std::string &appId, AspectRatio &aspectRatio) const;
+    // Keeps the settings of the apps used most recently, see ARC_APPS in the source.
+    void setAspectRatio(const std::string &appId, const AspectRatio &aspectRatio);
+
+    bool isPersistent() const { return mMapped; }
+
+private:
+    struct Data;
+
+    void reset();
+    void commit();
+    uint32_t checksum() const;
+
+    Data *mData;
+    bool mMapped; // mData is the file mapping, otherwise it is allocated
+};
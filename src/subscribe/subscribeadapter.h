@@ -21,6 +21,7 @@
 #include "ls2-helpers.hpp"
 #include "errors.h"
 #include "logging.h"
+#include "startup.h"
 
 using namespace pbnjson;
 using namespace LSHelpers;
@@ -32,8 +33,11 @@ public:
     typedef std::function<void(JValue &responseJValue)> ResponseHandler;
     typedef std::function<pbnjson::JValue(JsonResponse &response)> ResponseParser;
 
-    SubscribeAdapter(LS::Handle &handle, T *object, void (T::*callbackHandler)(JValue &responseJval))
-        : mLunaClient(&handle), mSubscription(), mCallToken(0), mService("unknown")
+    // name: the first subscription and its first response are startup phases "<name>Subscribed" and
+    // "<name>Received", see Startup.
+    SubscribeAdapter(LS::Handle &handle, const std::string &name, T *object,
+                     void (T::*callbackHandler)(JValue &responseJval))
+        : mLunaClient(&handle), mSubscription(), mCallToken(0), mService("unknown"), mName(name), mPhase(Phase::None)
     {
         mResponseHandler = std::bind(callbackHandler, object, std::placeholders::_1);
     };
@@ -48,6 +52,11 @@ public:
         mService        = service;
         mResponseParser = std::bind(callbackHandler, object, std::placeholders::_1);
         mSubscription.subscribe(mLunaClient, mService, jobject, this, &SubscribeAdapter::responseHandler);
+
+        if (mPhase == Phase::None) {
+            mPhase = Phase::Subscribed;
+            Startup::mark((mName + "Subscribed").c_str());
+        }
     };
 
     // Cancels previous call if still in progress.
@@ -66,6 +75,11 @@ public:
     void responseHandler(JsonResponse &response)
     {
         LOG_DEBUG("Got response from %s", mService.c_str());
+        if (mPhase == Phase::Subscribed) {
+            mPhase = Phase::Received;
+            Startup::mark((mName + "Received").c_str());
+        }
+
         pbnjson::JValue retResponse;
 
         retResponse = mResponseParser(response);
@@ -73,10 +87,14 @@ public:
     };
 
 private:
+    enum class Phase { None, Subscribed, Received };
+
     LSHelpers::ServicePoint mLunaClient;
     PersistentSubscription mSubscription;
     ResponseHandler mResponseHandler;
     ResponseParser mResponseParser;
     LSMessageToken mCallToken;
     std::string mService;
+    std::string mName;
+    Phase mPhase;
 };
@@ -0,0 +1,71 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "capabilitycache.h"
+#include "logging.h"
+#include "metrics.hpp"
+#include "tracer.hpp"
+#include "valcall.h"
+
+using namespace pbnjson;
+
+CapabilityCache::CapabilityCache() : mCapabilities(std::make_shared<VideoCapabilities>()) {}
+
+void CapabilityCache::refresh(VAL *val)
+{
+    LSHelpers::TraceSpan span("capabilities.refresh");
+    static LSHelpers::Counter &refreshes = LSHelpers::MetricsRegistry::global().counter("capabilities.refreshes");
+    refreshes.add();
+
+    std::shared_ptr<VideoCapabilities> capabilities = std::make_shared<VideoCapabilities>();
+    capabilities->device          = val->getDevice();
+    capabilities->planes          = VAL_CALL("video.getVideoPlanes", val->video, getVideoPlanes);
+    capabilities->connectorsKnown = false;
+
+    JValue reply = VAL_CALL("video.getParam", val->video, getParam, VAL_CTRL_NUM_CONNECTOR, JValue());
+    if (reply["returnValue"].asBool() && reply["numConnector"].isNumber()) {
+        capabilities->connectorsKnown = true;
+
+        int numConnector = reply["numConnector"].asNumber<int>();
+        for (int i = 0; i < numConnector; i++) {
+            std::vector<DisplayMode> modes;
+            for (const VAL_VIDEO_SIZE_T &size :
+                 VAL_CALL("video.getSupportedResolutions", val->video, getSupportedResolutions, i)) {
+                modes.push_back(DisplayMode{std::to_string(size.w) + "x" + std::to_string(size.h), size.w, size.h});
+            }
+            capabilities->modes.push_back(std::move(modes));
+        }
+    }
+
+    // Only the Raspberry Pi HAL knows this command.
+    if (capabilities->device == VAL_DEV_RPI) {
+        for (size_t i = 0; i < capabilities->planes.size(); i++) {
+            int wId = static_cast<int>(VAL_VIDEO_WID_0) + static_cast<int>(i);
+            reply   = VAL_CALL("video.getParam", val->video, getParam, VAL_CTRL_DRM_RESOURCES, JObject{{"wId", wId}});
+            if (!reply["returnValue"].asBool())
+                continue;
+
+            capabilities->drmResources[wId] = DrmResources{reply["planeId"].asNumber<int>(),
+                                                           reply["crtcId"].asNumber<int>(),
+                                                           reply["connId"].asNumber<int>()};
+        }
+    }
+
+    LOG_INFO(MSGID_CAPABILITIES, 2, PMLOGKFV("PLANES", "%zu", capabilities->planes.size()),
+             PMLOGKFV("CONNECTORS", "%zu", capabilities->modes.size()), "Video capabilities read");
+
+    std::atomic_store(&mCapabilities, std::shared_ptr<const VideoCapabilities>(std::move(capabilities)));
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Capabilities of the video HAL: the device it drives, the planes with their scaling limits, the
+// connectors with their display modes and, on the Raspberry Pi, the DRM resources behind each window.
+//
+// They only change when a display is plugged in or its mode is changed, so they are read from the HAL
+// once and the handlers use them from here without HAL calls. refresh() reads them again, on display
+// hotplug (DisplayHotplug) and after the service changed the display mode.
+//
+// Multithreading: refresh() on the luna main loop, like all HAL calls. get() from any thread, a refresh
+// publishes new capabilities, the ones returned before stay valid.
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <val_api.h>
+
+struct DisplayMode {
+    std::string name; // Like "1920x1080"
+    uint16_t w;
+    uint16_t h;
+};
+
+struct DrmResources {
+    int planeId;
+    int crtcId;
+    int connId;
+};
+
+struct VideoCapabilities {
+    VAL_DEVICE_T device; // So handlers off the main loop need not ask the HAL
+    std::vector<VAL_PLANE_T> planes;
+    bool connectorsKnown; // False if the HAL did not tell the number of connectors
+    std::vector<std::vector<DisplayMode>> modes; // By connector
+    std::map<int, DrmResources> drmResources;    // By window id, only the ones the HAL returned
+};
+
+class CapabilityCache
+{
+public:
+    CapabilityCache();
+    CapabilityCache(const CapabilityCache &) = delete;
+    CapabilityCache &operator=(const CapabilityCache &) = delete;
+
+    // Reads the capabilities from the HAL. Empty until called the first time.
+    void refresh(VAL *val);
+
+    std::shared_ptr<const VideoCapabilities> get() const { return std::atomic_load(&mCapabilities); }
+
+private:
+    std::shared_ptr<const VideoCapabilities> mCapabilities;
+};
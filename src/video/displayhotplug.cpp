@@ -0,0 +1,154 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstring>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "displayhotplug.h"
+#include "logging.h"
+
+namespace
+{
+
+// Quiet time after the last event before the callback.
+const guint SETTLE_MS = 200;
+
+// Uevent multicast group of the kernel.
+const unsigned int UEVENT_GROUP_KERNEL = 1;
+
+// "change@/devices/...\0ACTION=change\0SUBSYSTEM=drm\0HOTPLUG=1\0..."
+bool isDisplayHotplug(const char *event, size_t size)
+{
+    bool drm     = false;
+    bool hotplug = false;
+    for (const char *field = event; field < event + size; field += strlen(field) + 1) {
+        drm     = drm || strcmp(field, "SUBSYSTEM=drm") == 0;
+        hotplug = hotplug || strcmp(field, "HOTPLUG=1") == 0;
+    }
+    return drm && hotplug;
+}
+
+} // namespace
+
+DisplayHotplug::DisplayHotplug(GMainContext *context, const Callback &changed)
+    : mContext(context), mChanged(changed), mSocket(-1), mWatch(0), mSettle(0)
+{
+    mSocket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (mSocket < 0) {
+        LOG_WARNING(MSGID_DISPLAY_HOTPLUG, 0, "Display hotplug not watched: %s", strerror(errno));
+        return;
+    }
+
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = UEVENT_GROUP_KERNEL;
+    if (bind(mSocket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        LOG_WARNING(MSGID_DISPLAY_HOTPLUG, 0, "Display hotplug not watched: %s", strerror(errno));
+        close(mSocket);
+        mSocket = -1;
+        return;
+    }
+
+    GIOChannel *channel = g_io_channel_unix_new(mSocket);
+    GSource *source     = g_io_create_watch(channel, G_IO_IN);
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(&DisplayHotplug::receiveCB), this, nullptr);
+    mWatch = g_source_attach(source, mContext);
+    g_source_unref(source);
+    g_io_channel_unref(channel);
+}
+
+DisplayHotplug::~DisplayHotplug()
+{
+    for (guint id : {mWatch, mSettle}) {
+        GSource *source = id ? g_main_context_find_source_by_id(mContext, id) : nullptr;
+        if (source)
+            g_source_destroy(source);
+    }
+
+    if (mSocket >= 0)
+        close(mSocket);
+}
+
+gboolean DisplayHotplug::receiveCB(GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    DisplayHotplug *self = static_cast<DisplayHotplug *>(data);
+    char event[8192];
+
+    for (;;) {
+        struct sockaddr_nl sender;
+        socklen_t senderSize = sizeof(sender);
+        ssize_t size         = recvfrom(self->mSocket, event, sizeof(event) - 1, 0,
+                                        reinterpret_cast<struct sockaddr *>(&sender), &senderSize);
+        if (size < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            // The socket buffer overflowed, a hotplug event may be among the ones dropped.
+            if (errno == ENOBUFS) {
+                LOG_WARNING(MSGID_DISPLAY_HOTPLUG, 0, "Uevents lost, reading the displays again");
+                self->scheduleChanged();
+                continue;
+            }
+
+            LOG_WARNING(MSGID_DISPLAY_HOTPLUG, 0, "Display hotplug not watched anymore: %s", strerror(errno));
+            self->mWatch = 0;
+            return G_SOURCE_REMOVE;
+        }
+
+        // Only the kernel sends from port 0, other processes can send to the group too.
+        if (senderSize != sizeof(sender) || sender.nl_pid != 0)
+            continue;
+
+        event[size] = '\0';
+        if (!isDisplayHotplug(event, size))
+            continue;
+
+        LOG_DEBUG("display hotplug: %s", event);
+        self->scheduleChanged();
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+void DisplayHotplug::scheduleChanged()
+{
+    if (mSettle) {
+        GSource *source = g_main_context_find_source_by_id(mContext, mSettle);
+        if (source)
+            g_source_destroy(source);
+    }
+
+    GSource *source = g_timeout_source_new(SETTLE_MS);
+    g_source_set_callback(source, &DisplayHotplug::settledCB, this, nullptr);
+    mSettle = g_source_attach(source, mContext);
+    g_source_unref(source);
+}
+
+gboolean DisplayHotplug::settledCB(gpointer data)
+{
+    DisplayHotplug *self = static_cast<DisplayHotplug *>(data);
+    self->mSettle        = 0;
+
+    LOG_INFO(MSGID_DISPLAY_HOTPLUG, 0, "Displays changed");
+    self->mChanged();
+    return G_SOURCE_REMOVE;
+}
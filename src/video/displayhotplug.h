@@ -0,0 +1,55 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Watches the kernel for display hotplug events, the uevents of the DRM subsystem with HOTPLUG=1,
+// and calls back on the luna main loop once a burst of them is over. A display being plugged in or
+// out sends several events while it is probed. If events were lost because the socket buffer
+// overflowed, the callback is called as well.
+//
+// Without access to the uevent socket, like in a container, no events are reported.
+//
+// Multithreading: not thread safe, used on the main loop.
+
+#include <functional>
+
+#include <glib.h>
+
+class DisplayHotplug
+{
+public:
+    typedef std::function<void()> Callback;
+
+    DisplayHotplug(GMainContext *context, const Callback &changed);
+    ~DisplayHotplug();
+
+    DisplayHotplug(const DisplayHotplug &) = delete;
+    DisplayHotplug &operator=(const DisplayHotplug &) = delete;
+
+private:
+    static gboolean receiveCB(GIOChannel *channel, GIOCondition condition, gpointer data);
+    static gboolean settledCB(gpointer data);
+
+    // Calls back once no event came for SETTLE_MS.
+    void scheduleChanged();
+
+    GMainContext *mContext;
+    Callback mChanged;
+    int mSocket;
+    guint mWatch;
+    guint mSettle; // Pending callback after the last event
+};
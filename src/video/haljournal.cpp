@@ -0,0 +1,186 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "haljournal.h"
+#include "servicepoint.hpp"
+
+using namespace pbnjson;
+
+namespace HalJournal
+{
+
+namespace
+{
+
+// Calls kept by default, about 100 bytes each with the arguments.
+const size_t DEFAULT_CAPACITY = 4096;
+
+struct Entry {
+    uint64_t seq;
+    const char *name;
+    std::string args;
+    std::string method;
+    uint64_t callId;
+    gint64 start;
+    gint64 duration;
+};
+
+std::atomic<bool> enabled(false);
+std::mutex mutex;
+std::deque<Entry> entries;
+size_t capacity  = DEFAULT_CAPACITY;
+uint64_t nextSeq = 0;
+uint64_t dropped = 0;
+JValue requestBaseline; // Luna call counts when last cleared, by method path
+
+// Luna calls of every method so far, from the process metrics.
+std::map<std::string, int64_t> requestCounts()
+{
+    std::map<std::string, int64_t> counts;
+    for (const JValue::KeyValue &item : LSHelpers::MetricsRegistry::global().toJValue()["methods"].children()) {
+        counts[item.first.asString()] = item.second["calls"].asNumber<int64_t>();
+    }
+    return counts;
+}
+
+} // namespace
+
+Site::Site(const char *name, const char *metricName)
+    : name(name), metricName(metricName), latency(LSHelpers::MetricsRegistry::global().histogram(metricName))
+{
+}
+
+void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+void setCapacity(size_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = value;
+    while (entries.size() > capacity) {
+        entries.pop_front();
+        dropped++;
+    }
+}
+
+void record(const Site &site, std::string args, gint64 start, gint64 duration)
+{
+    const char *method = LSHelpers::ServicePoint::currentMethod();
+    uint64_t callId    = LSHelpers::ServicePoint::currentCallId();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity == 0) {
+        dropped++;
+        return;
+    }
+    if (entries.size() >= capacity) {
+        entries.pop_front();
+        dropped++;
+    }
+    entries.push_back(Entry{nextSeq++, site.name, std::move(args), method ? method : "", callId, start, duration});
+}
+
+JValue toJValue()
+{
+    std::map<std::string, int64_t> counts = requestCounts();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    JArray calls;
+    for (const Entry &entry : entries) {
+        calls.append(JObject{{"seq", static_cast<int64_t>(entry.seq)},
+                             {"name", entry.name},
+                             {"args", entry.args},
+                             {"method", entry.method},
+                             {"callId", static_cast<int64_t>(entry.callId)},
+                             {"startUs", static_cast<int64_t>(entry.start)},
+                             {"durationUs", static_cast<int64_t>(entry.duration)}});
+    }
+
+    JObject requests;
+    for (const auto &count : counts) {
+        int64_t since = count.second;
+        if (requestBaseline.isObject() && requestBaseline.hasKey(count.first))
+            since -= requestBaseline[count.first].asNumber<int64_t>();
+        if (since > 0)
+            requests.put(count.first, since);
+    }
+
+    return JObject{{"calls", calls}, {"requests", requests}, {"dropped", static_cast<int64_t>(dropped)}};
+}
+
+void clear()
+{
+    std::map<std::string, int64_t> counts = requestCounts();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    dropped = 0;
+
+    requestBaseline = JObject();
+    for (const auto &count : counts) {
+        requestBaseline.put(count.first, count.second);
+    }
+}
+
+void appendArg(std::string &out, bool value) { out += value ? "true" : "false"; }
+
+void appendArg(std::string &out, double value) { out += std::to_string(value); }
+
+void appendArg(std::string &out, const char *value)
+{
+    out += '"';
+    out += value ? value : "";
+    out += '"';
+}
+
+void appendArg(std::string &out, const std::string &value) { appendArg(out, value.c_str()); }
+
+void appendArg(std::string &out, const JValue &value) { out += value.stringify(); }
+
+void appendArg(std::string &out, const VAL_VIDEO_SIZE_T &value)
+{
+    out += std::to_string(value.w) + "x" + std::to_string(value.h);
+}
+
+void appendArg(std::string &out, const VAL_VIDEO_RECT_T &value)
+{
+    out += std::to_string(value.x) + "," + std::to_string(value.y) + " " + std::to_string(value.w) + "x" +
+           std::to_string(value.h);
+}
+
+void appendArg(std::string &out, const VAL_VSC_INPUT_SRC_INFO_T &value)
+{
+    out += "{type " + std::to_string(value.type) + ", attr " + std::to_string(value.attr) + ", index " +
+           std::to_string(value.resourceIndex) + "}";
+}
+
+void appendArg(std::string &out, const VAL_WINDOW_INFO_T &value)
+{
+    out += "{wId " + std::to_string(value.wId) + ", alpha " + std::to_string(value.uAlpha) + ", in ";
+    appendArg(out, value.inputRegion);
+    out += ", out ";
+    appendArg(out, value.outputRegion);
+    out += "}";
+}
+
+} // namespace HalJournal
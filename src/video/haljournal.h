@@ -0,0 +1,154 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Journal of the calls made to the VAL HAL.
+//
+// VAL_CALL (valcall.h) adds every call to the journal with its arguments, its duration and the luna
+// call whose handler made it (ServicePoint::currentMethod). The journal keeps the newest calls
+// in memory, older ones are dropped and counted. It is exported with the number of luna calls of each
+// method since it was cleared, so the HAL calls per luna call can be worked out from it
+// (see bench/halprofile.cpp).
+//
+// Arguments are formatted as text when the call is made, so the journal is off by default and
+// costs VAL_CALL a single flag check. It is turned on with the "enable" parameter of debug/getHalJournal,
+// or by the bench tools with --journal. Pointers are not followed.
+//
+// Multithreading: thread safe.
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <glib.h>
+#include <pbnjson.hpp>
+#include <val_api.h>
+
+#include "loopmonitor.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+
+namespace HalJournal
+{
+
+// Static description of a VAL_CALL call site.
+struct Site {
+    Site(const char *name, const char *metricName);
+
+    const char *name;       // Like "video.connect"
+    const char *metricName; // Like "val.video.connect", histogram, span and loop activity name
+    LSHelpers::Histogram &latency;
+};
+
+// Disabled by default.
+void setEnabled(bool enabled);
+bool isEnabled();
+
+// Number of calls kept, older calls are dropped. 4096 by default.
+void setCapacity(size_t capacity);
+
+// Adds a call made by the calling thread.
+void record(const Site &site, std::string args, gint64 start, gint64 duration);
+
+// {"calls": [{"seq", "name", "args", "method", "callId", "startUs", "durationUs"}], "requests": {path: count},
+//  "dropped": count}, oldest call first.
+pbnjson::JValue toJValue();
+
+// Drops the recorded calls and restarts the luna call counts.
+void clear();
+
+void appendArg(std::string &out, bool value);
+void appendArg(std::string &out, double value);
+void appendArg(std::string &out, const char *value);
+void appendArg(std::string &out, const std::string &value);
+void appendArg(std::string &out, const pbnjson::JValue &value);
+void appendArg(std::string &out, const VAL_VIDEO_SIZE_T &value);
+void appendArg(std::string &out, const VAL_VIDEO_RECT_T &value);
+void appendArg(std::string &out, const VAL_VSC_INPUT_SRC_INFO_T &value);
+void appendArg(std::string &out, const VAL_WINDOW_INFO_T &value);
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type appendArg(std::string &out,
+                                                                                                T value)
+{
+    out += std::to_string(static_cast<long long>(value));
+}
+
+template <typename T> void appendArg(std::string &out, const T *value) { out += value ? "&" : "null"; }
+
+template <typename T> void appendArg(std::string &out, const std::vector<T> &values)
+{
+    out += '[';
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0)
+            out += ", ";
+        appendArg(out, values[i]);
+    }
+    out += ']';
+}
+
+inline void appendArgs(std::string &) {}
+
+template <typename T, typename... Args> void appendArgs(std::string &out, const T &value, const Args &... args)
+{
+    appendArg(out, value);
+    if (sizeof...(args) > 0)
+        out += ", ";
+    appendArgs(out, args...);
+}
+
+// Records a VAL call from construction to destruction, if the journal is enabled.
+class CallRecorder
+{
+public:
+    template <typename... Args> CallRecorder(const Site &site, const Args &... args) : mSite(site), mStart(0)
+    {
+        if (isEnabled()) {
+            appendArgs(mArgs, args...);
+            mStart = g_get_monotonic_time();
+        }
+    }
+
+    ~CallRecorder()
+    {
+        if (mStart)
+            record(mSite, std::move(mArgs), mStart, g_get_monotonic_time() - mStart);
+    }
+
+    CallRecorder(const CallRecorder &) = delete;
+    CallRecorder &operator=(const CallRecorder &) = delete;
+
+private:
+    const Site &mSite;
+    std::string mArgs;
+    gint64 mStart;
+};
+
+// Calls a VAL method with the metrics, trace span, loop activity and journal entry of VAL_CALL.
+template <typename T, typename R, typename... Params, typename... Args>
+R invoke(const Site &site, T *object, R (T::*method)(Params...), Args &&... args)
+{
+    LSHelpers::ScopedTimer timer(site.latency);
+    LSHelpers::TraceSpan span(site.metricName);
+    LSHelpers::LoopActivity activity(site.metricName);
+    CallRecorder recorder(site, args...);
+    return (object->*method)(std::forward<Args>(args)...);
+}
+
+} // namespace HalJournal
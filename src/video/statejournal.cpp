@@ -0,0 +1,294 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "metrics.hpp"
+#include "statejournal.h"
+
+// "VOSJ", changed whenever the layout changes.
+const uint32_t JOURNAL_MAGIC   = 0x4a534f56;
+const uint32_t JOURNAL_VERSION = 1;
+
+const uint8_t OP_PUT    = 1;
+const uint8_t OP_REMOVE = 2;
+
+// Record: uint32 body length, uint32 FNV-1a of the body, then the body:
+// uint8 op, uint16 key length, key, value.
+const size_t RECORD_HEADER_SIZE = 4 + 4;
+const size_t BODY_HEADER_SIZE   = 1 + 2;
+
+struct StateJournal::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t used; // Bytes of records after the header, the commit point
+    uint32_t restoring; // 1 while the entries are restored, see beginRestore. Was reserved and 0 before.
+};
+
+namespace
+{
+
+uint32_t fnv1a(const uint8_t *bytes, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+StateJournal::StateJournal(const std::string &path, size_t capacity)
+    : mPath(path), mCapacity(capacity), mData(nullptr), mRestoring(false)
+{
+    if (mPath.empty())
+        return;
+
+    if (!map(mPath, false) && !map(mPath, true))
+        return;
+
+    replay();
+}
+
+StateJournal::~StateJournal() { unmap(); }
+
+bool StateJournal::map(const std::string &path, bool create)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0600);
+    if (fd < 0) {
+        if (create)
+            LOG_WARNING(MSGID_STATE_JOURNAL_ERROR, 0, "Can't create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, mCapacity) == 0)
+        mapping = mmap(nullptr, mCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        LOG_WARNING(MSGID_STATE_JOURNAL_ERROR, 0, "Can't map %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    mData          = static_cast<uint8_t *>(mapping);
+    Header *header = reinterpret_cast<Header *>(mData);
+    if (create) {
+        header->magic     = JOURNAL_MAGIC;
+        header->version   = JOURNAL_VERSION;
+        header->used      = 0;
+        header->restoring = mRestoring;
+    }
+    return true;
+}
+
+void StateJournal::unmap()
+{
+    if (mData) {
+        munmap(mData, mCapacity);
+        mData = nullptr;
+    }
+}
+
+// Reads the committed records. A journal of an other version is started over.
+void StateJournal::replay()
+{
+    Header *header = reinterpret_cast<Header *>(mData);
+    if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION ||
+        header->used > mCapacity - sizeof(Header)) {
+        LOG_WARNING(MSGID_STATE_JOURNAL_ERROR, 0, "%s not valid, starting over", mPath.c_str());
+        unmap();
+        map(mPath, true);
+        return;
+    }
+
+    const uint8_t *pos = mData + sizeof(Header);
+    const uint8_t *end = pos + header->used;
+    while (end - pos >= static_cast<ptrdiff_t>(RECORD_HEADER_SIZE)) {
+        uint32_t length, checksum;
+        memcpy(&length, pos, 4);
+        memcpy(&checksum, pos + 4, 4);
+
+        const uint8_t *body = pos + RECORD_HEADER_SIZE;
+        if (length < BODY_HEADER_SIZE || length > static_cast<size_t>(end - body) || fnv1a(body, length) != checksum)
+            break;
+
+        uint16_t keyLength;
+        memcpy(&keyLength, body + 1, 2);
+        if (keyLength > length - BODY_HEADER_SIZE)
+            break;
+
+        const char *key = reinterpret_cast<const char *>(body + BODY_HEADER_SIZE);
+        std::string name(key, keyLength);
+        if (body[0] == OP_PUT)
+            mEntries[name].assign(key + keyLength, length - BODY_HEADER_SIZE - keyLength);
+        else
+            mEntries.erase(name);
+
+        pos = body + length;
+    }
+
+    if (pos != end) {
+        // Should not happen, records are committed whole. Keep what was read.
+        LOG_WARNING(MSGID_STATE_JOURNAL_ERROR, 0, "%s has a damaged record, compacting", mPath.c_str());
+        compact();
+    }
+}
+
+void StateJournal::put(const std::string &key, const std::string &value)
+{
+    auto entry = mEntries.find(key);
+    if (entry != mEntries.end() && entry->second == value)
+        return;
+
+    mEntries[key] = value;
+    append(OP_PUT, key, value);
+}
+
+void StateJournal::remove(const std::string &key)
+{
+    if (mEntries.erase(key) == 0)
+        return;
+
+    append(OP_REMOVE, key, "");
+}
+
+void StateJournal::replace(const std::map<std::string, std::string> &entries)
+{
+    mEntries = entries;
+    if (mData)
+        compact();
+}
+
+bool StateJournal::beginRestore()
+{
+    if (!mData)
+        return true;
+
+    Header *header = reinterpret_cast<Header *>(mData);
+    if (header->restoring) {
+        LOG_ERROR(MSGID_STATE_JOURNAL_ERROR, 0, "Restoring %s failed in the previous run, starting over",
+                  mPath.c_str());
+        mRestoring = false;
+        replace({});
+        return false;
+    }
+
+    // A shared mapping, the mark is in the file even if the process dies right after.
+    mRestoring        = true;
+    header->restoring = 1;
+    return true;
+}
+
+void StateJournal::endRestore()
+{
+    mRestoring = false;
+    if (mData)
+        reinterpret_cast<Header *>(mData)->restoring = 0;
+}
+
+void StateJournal::discard()
+{
+    if (!mData)
+        return;
+
+    unmap();
+    unlink(mPath.c_str());
+}
+
+void StateJournal::append(uint8_t op, const std::string &key, const std::string &value)
+{
+    if (!mData)
+        return;
+
+    static LSHelpers::Counter &appends = LSHelpers::MetricsRegistry::global().counter("journal.appends");
+    appends.add();
+
+    if (write(op, key, value))
+        return;
+
+    // Full. The compacted journal already holds the change.
+    compact();
+}
+
+bool StateJournal::write(uint8_t op, const std::string &key, const std::string &value)
+{
+    Header *header = reinterpret_cast<Header *>(mData);
+    size_t keyLength = std::min<size_t>(key.size(), UINT16_MAX);
+    size_t length    = BODY_HEADER_SIZE + keyLength + value.size();
+
+    if (sizeof(Header) + header->used + RECORD_HEADER_SIZE + length > mCapacity)
+        return false;
+
+    uint8_t *record = mData + sizeof(Header) + header->used;
+    uint8_t *body   = record + RECORD_HEADER_SIZE;
+    uint32_t size   = static_cast<uint32_t>(length);
+    uint16_t size16 = static_cast<uint16_t>(keyLength);
+
+    body[0] = op;
+    memcpy(body + 1, &size16, 2);
+    memcpy(body + BODY_HEADER_SIZE, key.data(), keyLength);
+    memcpy(body + BODY_HEADER_SIZE + keyLength, value.data(), value.size());
+
+    uint32_t checksum = fnv1a(body, length);
+    memcpy(record, &size, 4);
+    memcpy(record + 4, &checksum, 4);
+
+    // Committed last, a crash before leaves the record out.
+    header->used += static_cast<uint32_t>(RECORD_HEADER_SIZE + length);
+    return true;
+}
+
+// Writes the current entries to a new file and puts it in place of the journal.
+void StateJournal::compact()
+{
+    static LSHelpers::Counter &compactions = LSHelpers::MetricsRegistry::global().counter("journal.compactions");
+    compactions.add();
+
+    std::string tmpPath = mPath + ".tmp";
+    unmap();
+    if (!map(tmpPath, true)) {
+        unlink(mPath.c_str());
+        return;
+    }
+
+    for (const auto &entry : mEntries) {
+        if (!write(OP_PUT, entry.first, entry.second)) {
+            LOG_ERROR(MSGID_STATE_JOURNAL_ERROR, 0, "State does not fit in %zu bytes, not journaled", mCapacity);
+            unmap();
+            unlink(tmpPath.c_str());
+            unlink(mPath.c_str());
+            return;
+        }
+    }
+
+    if (rename(tmpPath.c_str(), mPath.c_str()) != 0) {
+        // The old journal is out of date, it must not be restored.
+        LOG_ERROR(MSGID_STATE_JOURNAL_ERROR, 0, "Can't replace %s: %s", mPath.c_str(), strerror(errno));
+        unmap();
+        unlink(tmpPath.c_str());
+        unlink(mPath.c_str());
+    }
+}
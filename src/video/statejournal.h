@@ -0,0 +1,88 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Journal of the service state, for restoring it after a crash.
+//
+// The state is kept as entries of a key and a text value, like "sink/MAIN" and the sink as JSON.
+// Every change is appended to a file mapped into memory as a record. A record counts once the
+// header of the file is updated to include it, so a record cut off by a crash is ignored. When the
+// file fills up, it is compacted: the current entries are written to a new file, which replaces it.
+//
+// The file is meant for /run, it does not outlive a reboot. The entries found in it when it is
+// opened are the state of the previous run; a clean shutdown removes the file with discard().
+// Without a path or when the file can not be mapped, nothing is kept.
+//
+// Restoring is marked in the file with beginRestore() and endRestore(). If the state crashes the
+// process while it is restored, the mark is still set on the next start and the state is not
+// restored again, so the process is not respawned into the same crash.
+//
+// Multithreading: not thread safe.
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+class StateJournal
+{
+public:
+    // Opens the journal and reads the entries kept in it. An empty path disables the journal.
+    explicit StateJournal(const std::string &path, size_t capacity = 256 * 1024);
+    ~StateJournal();
+
+    StateJournal(const StateJournal &) = delete;
+    StateJournal &operator=(const StateJournal &) = delete;
+
+    // Current entries, by key. Right after opening, the ones of the previous run.
+    const std::map<std::string, std::string> &entries() const { return mEntries; }
+
+    // Sets an entry. Nothing is written if the value did not change.
+    void put(const std::string &key, const std::string &value);
+    void remove(const std::string &key);
+
+    // Replaces all entries, like with the state handed over by another process. Rewrites the file.
+    void replace(const std::map<std::string, std::string> &entries);
+
+    // Marks the entries as being restored. Returns false, and drops the entries, if a previous
+    // restore did not end: the process died restoring them.
+    bool beginRestore();
+
+    // Clears the mark, the restored state is safe.
+    void endRestore();
+
+    // Removes the file, called on clean shutdown. Nothing is kept afterwards.
+    void discard();
+
+    bool isEnabled() const { return mData != nullptr; }
+
+private:
+    struct Header;
+
+    bool map(const std::string &path, bool create);
+    void unmap();
+    void replay();
+    void append(uint8_t op, const std::string &key, const std::string &value);
+    bool write(uint8_t op, const std::string &key, const std::string &value);
+    void compact();
+
+    std::string mPath;
+    size_t mCapacity;
+    uint8_t *mData; // File mapping, mCapacity bytes
+    bool mRestoring; // Between beginRestore and endRestore, kept in the header of the file
+    std::map<std::string, std::string> mEntries;
+};
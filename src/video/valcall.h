@@ -0,0 +1,34 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <type_traits>
+
+#include "haljournal.h"
+
+// Calls a VAL method and records its latency in the "val.<name>" histogram of the process metrics,
+// and as a "val.<name>" span of the tracer. The call is marked as loop activity for the stall detector,
+// and added to the HAL journal with its arguments (haljournal.h).
+// The histogram is looked up once per call site. Evaluates to the result of the call.
+// Example: if (!VAL_CALL("video.connect", val->video, connect, wId, input, mode, &plane)) ...
+#define VAL_CALL(name, object, method, ...)                                                                            \
+    HalJournal::invoke(                                                                                                \
+        []() -> const HalJournal::Site & {                                                                             \
+            static const HalJournal::Site valCallSite(name, "val." name);                                              \
+            return valCallSite;                                                                                        \
+        }(),                                                                                                           \
+        object, &std::remove_pointer<decltype(object)>::type::method, ##__VA_ARGS__)
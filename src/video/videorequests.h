@@ -0,0 +1,111 @@
+// Copyright (c) 2016-2019 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <string>
+
+#include "ls2-helpers.hpp"
+#include "videoservicetypes.h"
+
+// Parameters of the luna methods called for every frame geometry / video format change.
+// These are decoded straight from the payload, see LSHelpers::JsonRequest::decode.
+
+class SetDisplayWindowRequest
+{
+public:
+    SetDisplayWindowRequest()
+        : context("unknown"), contextSet(false), fullScreen(false), displayOutputSet(false), sourceInputSet(false),
+          opacity(0), opacitySet(false)
+    {
+    }
+
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
+    {
+        using LSHelpers::jsonField;
+        typedef SetDisplayWindowRequest R;
+
+        fields(jsonField("sink", &R::sink).optional());
+        fields(jsonField("context", &R::context).optional().checkValueRead(&R::contextSet));
+        fields(jsonField("fullScreen", &R::fullScreen));
+        fields(jsonField("displayOutput", &R::displayOutput).optional().checkValueRead(&R::displayOutputSet));
+        fields(jsonField("sourceInput", &R::sourceInput).optional().checkValueRead(&R::sourceInputSet));
+        fields(jsonField("opacity", &R::opacity).optional().defaultValue(0).checkValueRead(&R::opacitySet));
+    }
+
+    std::string sink;
+    std::string context;
+    bool contextSet;
+    bool fullScreen;
+    VideoRect displayOutput;
+    bool displayOutputSet;
+    VideoRect sourceInput;
+    bool sourceInputSet;
+    uint8_t opacity;
+    bool opacitySet;
+};
+
+class SetVideoDataRequest
+{
+public:
+    SetVideoDataRequest()
+        : contextSet(false), contentType("unknown"), width(0), height(0), frameRate(0), videoInfoSet(false)
+    {
+    }
+
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
+    {
+        using LSHelpers::jsonField;
+        typedef SetVideoDataRequest R;
+        static constexpr const char *SCAN_TYPES[] = {"interlaced", "progressive", "VIDEO_PROGRESSIVE",
+                                                     "VIDEO_INTERLACED"};
+
+        fields(jsonField("sink", &R::sink).optional());
+        fields(jsonField("context", &R::context).optional().checkValueRead(&R::contextSet));
+        fields(jsonField("contentType", &R::contentType).optional().defaultValue("unknown"));
+        fields(jsonField("width", &R::width));
+        fields(jsonField("height", &R::height));
+        fields(jsonField("frameRate", &R::frameRate).min(0.0));
+        fields(jsonField("scanType", &R::scanType).optional().allowedValues(SCAN_TYPES));
+        fields(jsonField("videoInfo", &R::videoInfo).optional().checkValueRead(&R::videoInfoSet));
+    }
+
+    std::string sink;
+    std::string context;
+    bool contextSet;
+    std::string contentType;
+    uint16_t width;
+    uint16_t height;
+    double frameRate;
+    std::string scanType;
+    pbnjson::JValue videoInfo;
+    bool videoInfoSet;
+};
+
+class BlankVideoRequest
+{
+public:
+    BlankVideoRequest() : blank(false) {}
+
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
+    {
+        fields(LSHelpers::jsonField("sink", &BlankVideoRequest::sink));
+        fields(LSHelpers::jsonField("blank", &BlankVideoRequest::blank));
+    }
+
+    std::string sink;
+    bool blank;
+};
@@ -14,7 +14,7 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
-#include <sstream>
+#include <algorithm>
 #include <string>
 #include <unordered_set>
 #include <val/val_video.h>
@@ -22,12 +22,163 @@
 
 #include "errors.h"
 #include "logging.h"
+#include "startup.h"
+#include "valcall.h"
 #include "videoservice.h"
 
 using namespace pbnjson;
 using namespace LSHelpers;
 
-VideoService::VideoService(LS::Handle &handle) : val(NULL), mService(&handle), mDualVideoEnabled(false)
+// Number of status updates outstanding per getStatus subscriber before they are collapsed to the newest one.
+const size_t STATUS_MAX_OUTSTANDING = 4;
+
+// Status updates a getStatus subscriber is assumed to read per second, more are held back and collapsed.
+// Well above the updates of a window resize animation.
+const unsigned STATUS_DRAIN_RATE = 200;
+
+// Interval of the metrics summary in the log, seconds.
+const guint METRICS_LOG_INTERVAL = 300;
+
+// Number of callers listed in the rate limit section of getMetrics.
+const size_t METRICS_TOP_OFFENDERS = 10;
+
+// Default and largest size of a traffic capture started with setCapture, bytes.
+const int64_t CAPTURE_DEFAULT_BYTES = 16 * 1024 * 1024;
+const int64_t CAPTURE_MAX_BYTES     = 256 * 1024 * 1024;
+
+// Journal keys of the sinks and clients, followed by the name or client id.
+const std::string JOURNAL_SINK   = "sink/";
+const std::string JOURNAL_CLIENT = "client/";
+
+// Handed over next to the journal entries: when the handing over process stopped answering calls.
+const std::string HANDOVER_START = "handover/startUs";
+
+namespace
+{
+
+bool toVscInput(const std::string &videoSource, uint8_t videoSourcePort, VAL_VSC_INPUT_SRC_INFO_T &vscInput)
+{
+    vscInput = {VAL_VSC_INPUTSRC_MAX, 0, 0};
+
+    if (videoSource == "VDEC") {
+        vscInput.type          = VAL_VSC_INPUTSRC_VDEC;
+        vscInput.attr          = 1; // Not used for VDEC
+        vscInput.resourceIndex = videoSourcePort;
+    } else if (videoSource == "HDMI") {
+        vscInput.type          = VAL_VSC_INPUTSRC_HDMI;
+        vscInput.resourceIndex = videoSourcePort; // HDMI port number
+    } else if (videoSource == "JPEG") {
+        vscInput.type = VAL_VSC_INPUTSRC_JPEG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+JValue sinkToJournal(const VideoSink &sink)
+{
+    return JObject{{"connected", sink.connected},
+                   {"muted", sink.muted},
+                   {"context", sink.connectedClientId},
+                   {"opacity", sink.opacity},
+                   {"zOrder", sink.zOrder},
+                   {"displayOutput", sink.scaledOutputRect.toJValue()},
+                   {"sourceInput", sink.appliedInputRect.toJValue()}};
+}
+
+bool sinkFromJournal(const std::string &text, VideoSink &sink)
+{
+    JsonParser parser{JDomParser::fromString(text, JSchema::AllSchema())};
+    parser.get("connected", sink.connected);
+    parser.get("muted", sink.muted);
+    parser.get("context", sink.connectedClientId);
+    parser.get("opacity", sink.opacity);
+    parser.get("zOrder", sink.zOrder);
+    parser.get("displayOutput", sink.scaledOutputRect);
+    parser.get("sourceInput", sink.appliedInputRect);
+    return parser.finishParse();
+}
+
+JValue clientToJournal(const VideoClient &client)
+{
+    return JObject{{"activation", client.activation},
+                   {"available", client.available},
+                   {"fullScreen", client.fullScreen},
+                   {"frameRate", client.frameRate},
+                   {"sinkName", client.sinkName},
+                   {"sourceName", client.sourceName},
+                   {"sourcePort", client.sourcePort},
+                   {"sourceRect", client.sourceRect.toJValue()},
+                   {"inputRect", client.inputRect.toJValue()},
+                   {"outputRect", client.outputRect.toJValue()},
+                   {"interlaced", client.scanType == ScanType::INTERLACED},
+                   {"contentType", client.contentType}};
+}
+
+bool clientFromJournal(const std::string &text, VideoClient &client)
+{
+    bool interlaced = false;
+
+    JsonParser parser{JDomParser::fromString(text, JSchema::AllSchema())};
+    parser.get("activation", client.activation);
+    parser.get("available", client.available);
+    parser.get("fullScreen", client.fullScreen);
+    parser.get("frameRate", client.frameRate);
+    parser.get("sinkName", client.sinkName);
+    parser.get("sourceName", client.sourceName);
+    parser.get("sourcePort", client.sourcePort);
+    parser.get("sourceRect", client.sourceRect);
+    parser.get("inputRect", client.inputRect);
+    parser.get("outputRect", client.outputRect);
+    parser.get("interlaced", interlaced);
+    parser.get("contentType", client.contentType);
+    if (!parser.finishParse())
+        return false;
+
+    client.scanType = interlaced ? ScanType::INTERLACED : ScanType::PROGRESSIVE;
+    return true;
+}
+
+// Whether the fields kept in the journal differ, compared before building the journal entry.
+bool journalDiffers(const VideoSink &a, const VideoSink &b)
+{
+    return a.connected != b.connected || a.muted != b.muted || a.connectedClientId != b.connectedClientId ||
+           a.opacity != b.opacity || a.zOrder != b.zOrder || !(a.scaledOutputRect == b.scaledOutputRect) ||
+           !(a.appliedInputRect == b.appliedInputRect);
+}
+
+bool journalDiffers(const VideoClient &a, const VideoClient &b)
+{
+    return a.activation != b.activation || a.available != b.available || a.fullScreen != b.fullScreen ||
+           a.frameRate != b.frameRate || a.sinkName != b.sinkName || a.sourceName != b.sourceName ||
+           a.sourcePort != b.sourcePort || !(a.sourceRect == b.sourceRect) || !(a.inputRect == b.inputRect) ||
+           !(a.outputRect == b.outputRect) || a.scanType != b.scanType || a.contentType != b.contentType;
+}
+
+const VideoSink *findSink(const std::vector<VideoSink> &sinks, const std::string &name)
+{
+    for (const VideoSink &sink : sinks) {
+        if (sink.name == name)
+            return &sink;
+    }
+    return nullptr;
+}
+
+const VideoClient *findClient(const std::vector<VideoClient> &clients, const std::string &clientId)
+{
+    for (const VideoClient &client : clients) {
+        if (client.clientId == clientId)
+            return &client;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+VideoService::VideoService(LS::Handle &handle, const std::string &journalPath)
+    : val(NULL), mService(&handle), mDualVideoEnabled(false), mHoldStatusUpdates(false), mStatusUpdateHeld(false),
+      mMetricsLogSource(0), mJournal(journalPath), mJournaling(false), mHandedOver(false), mAdopted(false),
+      mHandoverStart(0)
 {
     val = VAL::getInstance();
     if (!val) {
@@ -35,39 +186,273 @@ VideoService::VideoService(LS::Handle &handle) : val(NULL), mService(&handle), m
         return;
     }
 
-    std::vector<VAL_PLANE_T> supportedPlanes = val->video->getVideoPlanes();
+    // Calls wait until the HAL is initialized, see halInitialized. The sinks are not known before.
+    mService.setReady(false);
+    publishState();
 
-    // setup the sinks
-    uint32_t wid = static_cast<uint32_t>(VAL_VIDEO_WID_0);
-    for (uint8_t i = 0; i < supportedPlanes.size(); i++, wid++) {
-        std::string plane = supportedPlanes[i].planeName;
-        LOG_DEBUG("push to mSink. planes name:%s", plane.c_str());
-        mSinks.push_back(VideoSink(plane, i, static_cast<VAL_VIDEO_WID_T>(wid)));
-    }
+    // Status updates carry the complete sink state, a subscriber that falls behind only needs the newest one.
+    mSinkStatusSubscription.setMaxOutstanding(STATUS_MAX_OUTSTANDING);
+    mSinkStatusSubscription.setDrainRate(STATUS_DRAIN_RATE);
+    // Subscriptions are added from the reader thread, set the handle up front.
+    mSinkStatusSubscription.setServiceHandle(&handle);
+    mSinkStatusSubscription.setName("/getStatus");
 
     mService.registerMethod("/", "register", this, &VideoService::_register);
     mService.registerMethod("/", "unregister", this, &VideoService::unregister);
     mService.registerMethod("/", "connect", this, &VideoService::connect);
     mService.registerMethod("/", "disconnect", this, &VideoService::disconnect);
+    // Typed handlers, parameters are decoded straight from the payload. Called on every video geometry change.
     mService.registerMethod("/", "setVideoData", this, &VideoService::setVideoData);
-    mService.registerMethod("/", "blankVideo", this, &VideoService::blankVideo);
-    mService.registerMethod("/", "getStatus", this, &VideoService::getStatus);
+    // Apps resend the same control calls on focus changes and resume, repeats are answered from the reply cache.
+    mService.registerMethod("/", "blankVideo", this, &VideoService::blankVideo).cacheReplies();
+    // Read-only methods are served from the published state on the reader thread,
+    // so status queries are not held up by control calls waiting on the HAL.
+    mService.registerMethod("/", "getStatus", this, &VideoService::getStatus).runOn(mReader);
 
     // TODO(ekwang): defined but not used except setCompositing and setDisplayWindow
     //mService.registerMethod("/display", "getVideoLimits", this, &VideoService::getVideoLimits);
-    mService.registerMethod("/display", "getOutputCapabilities", this, &VideoService::getOutputCapabilities);
+    mService.registerMethod("/display", "getOutputCapabilities", this, &VideoService::getOutputCapabilities)
+        .runOn(mReader);
     //mService.registerMethod("/display", "getSupportedResolutions", this, &VideoService::getSupportedResolutions);
-    mService.registerMethod("/display", "setDisplayWindow", this, &VideoService::setDisplayWindow);
+    mService.registerMethod("/display", "setDisplayWindow", this, &VideoService::setDisplayWindow).cacheReplies();
     //mService.registerMethod("/display", "setDisplayResolution", this, &VideoService::setDisplayResolution);
-    mService.registerMethod("/display", "setCompositing", this, &VideoService::setCompositing);
+    mService.registerMethod("/display", "setCompositing", this, &VideoService::setCompositing).cacheReplies();
     //mService.registerMethod("/display", "setParam", this, &VideoService::setParam);
-    mService.registerMethod("/display", "getParam", this, &VideoService::getParam);
+    mService.registerMethod("/display", "getParam", this, &VideoService::getParam).runOn(mReader);
+
+    // Diagnostics do not use the sinks, they answer also while the HAL is initializing.
+    mService.registerMethod("/debug", "getMetrics", this, &VideoService::getMetrics)
+        .priority(MethodPriority::Query)
+        .availableBeforeReady();
+    mService.registerMethod("/debug", "getTrace", this, &VideoService::getTrace)
+        .priority(MethodPriority::Query)
+        .availableBeforeReady();
+    mService.registerMethod("/debug", "setCapture", this, &VideoService::setCapture).availableBeforeReady();
+    mService.registerMethod("/debug", "getHalJournal", this, &VideoService::getHalJournal)
+        .priority(MethodPriority::Query)
+        .availableBeforeReady();
+    mMetricsLogSource = g_timeout_add_seconds(METRICS_LOG_INTERVAL, &VideoService::logMetricsCB, nullptr);
+
+    // Per app call budgets, so one app calling in a tight loop does not hold up video control for the others.
+    // A held call is replaced only by a newer one for the same sink or client.
+    mService.setTargetFields({"sink", "context"});
+    if (!mService.getRateLimiter().loadConfig(RATE_LIMIT_CONFIG_FILE)) {
+        LOG_WARNING(MSGID_RATE_LIMIT_CONFIG_ERROR, 0, "Rate limits not loaded from %s, calls are not limited",
+                    RATE_LIMIT_CONFIG_FILE);
+    }
+
+    // Pipeline setup (register, connect, setVideoData, setDisplayWindow) in one call.
+    // Subscribers get a single status update when the whole batch is done.
+    mService.registerBatchMethod("/", "batch", [this](bool running) {
+        mHoldStatusUpdates = running;
+        if (!running && mStatusUpdateHeld) {
+            mStatusUpdateHeld = false;
+            sendSinkUpdateToSubscribers();
+        }
+    });
 }
 
-VideoService::~VideoService()
+void VideoService::halInitialized()
+{
+    if (!val)
+        return;
+
+    mCapabilities.refresh(val);
+    mHotplug.reset(new DisplayHotplug(g_main_context_default(), [this]() { refreshCapabilities(); }));
+
+    // setup the sinks
+    std::shared_ptr<const VideoCapabilities> capabilities = mCapabilities.get();
+    uint32_t wid                                          = static_cast<uint32_t>(VAL_VIDEO_WID_0);
+    for (uint8_t i = 0; i < capabilities->planes.size(); i++, wid++) {
+        std::string plane = capabilities->planes[i].planeName;
+        LOG_DEBUG("push to mSink. planes name:%s", plane.c_str());
+        mSinks.push_back(VideoSink(plane, i, static_cast<VAL_VIDEO_WID_T>(wid)));
+    }
+
+    restoreState();
+    mJournaling = true;
+    journalState(nullptr);
+
+    publishState();
+    mService.setReady(true);
+
+    if (mHandoverStart) {
+        // Monotonic time is system wide, so the start taken by the previous process compares with ours.
+        static Histogram &unavailable = MetricsRegistry::global().histogram("video.handoverUnavailableUs");
+        gint64 duration = std::max<gint64>(0, g_get_monotonic_time() - mHandoverStart);
+        unavailable.record(static_cast<uint64_t>(duration));
+        LOG_INFO(MSGID_HANDOVER, 1, PMLOGKFV("UNAVAILABLE_MS", "%lld", static_cast<long long>(duration / 1000)),
+                 "Handover done");
+        mHandoverStart = 0;
+    }
+}
+
+std::string VideoService::exportState()
+{
+    if (mJournaling)
+        journalState(nullptr);
+
+    JObject state;
+    for (const auto &entry : mJournal.entries()) {
+        state.put(entry.first, entry.second);
+    }
+    // Calls are not answered anymore from here on, handOver follows once the state is sent.
+    state.put(HANDOVER_START, std::to_string(g_get_monotonic_time()));
+    return state.stringify();
+}
+
+void VideoService::handOver()
+{
+    mService.setReady(false);
+    mJournaling = false;
+    mHandedOver = true;
+    LOG_INFO(MSGID_HANDOVER, 0, "Handed over to the next process");
+}
+
+void VideoService::adoptState(const std::string &state)
 {
-    for (auto sink : mSinks) {
+    JValue parsed = JDomParser::fromString(state, JSchema::AllSchema());
+    if (!parsed.isObject()) {
+        LOG_ERROR(MSGID_HANDOVER_ERROR, 0, "Handover state is not valid");
+        return;
+    }
+
+    std::map<std::string, std::string> entries;
+    for (const auto &entry : parsed.children()) {
+        if (entry.first.asString() == HANDOVER_START)
+            mHandoverStart = g_ascii_strtoll(entry.second.asString().c_str(), nullptr, 10);
+        else
+            entries[entry.first.asString()] = entry.second.asString();
+    }
+    mJournal.replace(entries);
+    mAdopted = true;
+}
+
+// Brings back the clients and sinks of a previous run that did not shut down cleanly, and sets the HAL
+// up for the connected sinks again, so the video comes back without the clients calling again.
+// Sinks the HAL can not set up are left disconnected, their clients call connect again.
+// A handed over state is adopted instead: the previous process left its planes connected and showing.
+// A state that crashed the previous attempt to restore it is dropped instead, see StateJournal::beginRestore.
+void VideoService::restoreState()
+{
+    const std::map<std::string, std::string> &entries = mJournal.entries();
+    if (entries.empty() || !mJournal.beginRestore())
+        return;
+
+    TraceSpan span("restoreState");
+
+    for (const auto &entry : entries) {
+        if (entry.first.compare(0, JOURNAL_CLIENT.size(), JOURNAL_CLIENT) != 0)
+            continue;
+
+        VideoClient client(entry.first.substr(JOURNAL_CLIENT.size()));
+        if (clientFromJournal(entry.second, client))
+            mClients.push_back(client);
+    }
+
+    size_t restoredSinks = 0;
+    for (VideoSink &sink : mSinks) {
+        auto entry = entries.find(JOURNAL_SINK + sink.name);
+        VideoSink saved(sink);
+        if (entry == entries.end() || !sinkFromJournal(entry->second, saved) || !saved.connected)
+            continue;
+
+        if (mAdopted ? adoptSink(sink, saved) : restoreSink(sink, saved)) {
+            restoredSinks++;
+            continue;
+        }
+
+        LOG_WARNING(MSGID_STATE_RESTORED, 0, "Sink %s not restored", sink.name.c_str());
+        VideoClient *client = getClientInfo(saved.connectedClientId);
+        if (client)
+            client->activation = false;
+    }
+
+    if (restoredSinks > 0 && !mAdopted && !applyCompositing())
+        LOG_WARNING(MSGID_STATE_RESTORED, 0, "Compositing not restored");
+    mJournal.endRestore();
+
+    LOG_INFO(MSGID_STATE_RESTORED, 2, PMLOGKFV("CLIENTS", "%zu", mClients.size()),
+             PMLOGKFV("SINKS", "%zu", restoredSinks), "State of the previous run restored");
+}
+
+bool VideoService::restoreSink(VideoSink &sink, const VideoSink &saved)
+{
+    VideoClient *client = getClientInfo(saved.connectedClientId);
+    VAL_VSC_INPUT_SRC_INFO_T vscInput;
+    if (!client || !client->activation || !toVscInput(client->sourceName, client->sourcePort, vscInput))
+        return false;
+
+    bool dual = sink.name.find("SUB") != std::string::npos;
+    if (dual && !setDualVideo(true))
+        return false;
+
+    unsigned int plane;
+    if (!VAL_CALL("video.connect", val->video, connect, sink.wId, vscInput, VAL_VSC_OUTPUT_DISPLAY_MODE, &plane)) {
+        if (dual)
+            setDualVideo(false);
+        return false;
+    }
+
+    sink.connected         = true;
+    sink.connectedClientId = client->clientId;
+    sink.opacity           = saved.opacity;
+    sink.zOrder            = saved.zOrder;
+    readVideoCapabilities(sink);
+    applyVideoFilters(sink, client->sourceName);
+
+    VideoRect input  = saved.appliedInputRect;
+    VideoRect output = saved.scaledOutputRect;
+    if (!applyVideoOutputRects(sink, *client, input, output, client->sourceRect) ||
+        !VAL_CALL("video.setWindowBlanking", val->video, setWindowBlanking, sink.wId, saved.muted,
+                  sink.appliedInputRect.toVALRect(), sink.scaledOutputRect.toVALRect())) {
+        // Not left half restored: the caller treats the sink as not connected.
         doDisconnectVideo(sink);
+        sink.connectedClientId.clear();
+        return false;
+    }
+    sink.muted = saved.muted;
+
+    return true;
+}
+
+// Takes over a sink the previous process handed over connected, without any HAL call. Connecting
+// the plane again could fail on a plane that is still connected, and would interrupt the video.
+// VAL has no query for the connection of a plane, the handed over state is trusted.
+bool VideoService::adoptSink(VideoSink &sink, const VideoSink &saved)
+{
+    VideoClient *client = getClientInfo(saved.connectedClientId);
+    if (!client || !client->activation)
+        return false;
+
+    if (sink.name.find("SUB") != std::string::npos)
+        mDualVideoEnabled = true;
+
+    sink.connected         = true;
+    sink.connectedClientId = client->clientId;
+    sink.opacity           = saved.opacity;
+    sink.zOrder            = saved.zOrder;
+    sink.muted             = saved.muted;
+    sink.appliedInputRect  = saved.appliedInputRect;
+    sink.scaledOutputRect  = saved.scaledOutputRect;
+    readVideoCapabilities(sink);
+    return true;
+}
+
+VideoService::~VideoService()
+{
+    if (mMetricsLogSource) {
+        g_source_remove(mMetricsLogSource);
+    }
+
+    // Clean shutdown, the sinks are disconnected. Nothing to restore on the next start.
+    // After a handover the next process shows the video and owns the journal.
+    if (!mHandedOver) {
+        mJournal.discard();
+
+        for (auto sink : mSinks) {
+            doDisconnectVideo(sink);
+        }
     }
     mSinks.clear();
     mClients.clear();
@@ -127,23 +512,16 @@ pbnjson::JValue VideoService::connect(LSHelpers::JsonRequest &request)
     LOG_DEBUG("Video connect source:%s, sourcePort:%d, sinkname:%s, clientId:%s", videoSource.c_str(), videoSourcePort,
               videoSinkName.c_str(), clientId.c_str());
 
+    TraceTag traceTag(videoSinkName);
+    gint64 connectStart = g_get_monotonic_time();
+
     VideoSink *videoSink = getVideoSink(videoSinkName);
     if (!videoSink) {
         return API_ERROR_INVALID_PARAMETERS("Invalid sink: %s", videoSinkName.c_str());
     }
 
-    VAL_VSC_INPUT_SRC_INFO_T vscInput = {VAL_VSC_INPUTSRC_MAX, 0, 0};
-
-    if (videoSource == "VDEC") {
-        vscInput.type          = VAL_VSC_INPUTSRC_VDEC;
-        vscInput.attr          = 1; // Not used for VDEC
-        vscInput.resourceIndex = videoSourcePort;
-    } else if (videoSource == "HDMI") {
-        vscInput.type          = VAL_VSC_INPUTSRC_HDMI;
-        vscInput.resourceIndex = videoSourcePort; // HDMI port number
-    } else if (videoSource == "JPEG") {
-        vscInput.type = VAL_VSC_INPUTSRC_JPEG;
-    } else {
+    VAL_VSC_INPUT_SRC_INFO_T vscInput;
+    if (!toVscInput(videoSource, videoSourcePort, vscInput)) {
         return API_ERROR_INVALID_PARAMETERS("unsupported videoSource type:%s", videoSource.c_str());
     }
 
@@ -161,11 +539,13 @@ pbnjson::JValue VideoService::connect(LSHelpers::JsonRequest &request)
     }
 
     unsigned int plane;
-    if (!val->video->connect(videoSink->wId, vscInput, VAL_VSC_OUTPUT_DISPLAY_MODE, &plane)) {
+    if (!VAL_CALL("video.connect", val->video, connect, videoSink->wId, vscInput, VAL_VSC_OUTPUT_DISPLAY_MODE,
+                  &plane)) {
         return API_ERROR_HAL_ERROR;
     }
 
-    videoSink->connected = true;
+    videoSink->connected   = true;
+    videoSink->connectedAt = connectStart;
 
     this->readVideoCapabilities(*videoSink);
 
@@ -204,8 +584,8 @@ pbnjson::JValue VideoService::connect(LSHelpers::JsonRequest &request)
             return API_ERROR_HAL_ERROR;
 
         // TODO(ekwang) : unmute?
-        if (!val->video->setWindowBlanking(videoSink->wId, false, videoSink->appliedInputRect.toVALRect(),
-                                           videoSink->scaledOutputRect.toVALRect()))
+        if (!VAL_CALL("video.setWindowBlanking", val->video, setWindowBlanking, videoSink->wId, false,
+                      videoSink->appliedInputRect.toVALRect(), videoSink->scaledOutputRect.toVALRect()))
             return API_ERROR_HAL_ERROR;
     }
     else
@@ -253,13 +633,14 @@ pbnjson::JValue VideoService::getVideoLimits(LSHelpers::JsonRequest &request)
                    {"maxUpscaleSize", videoSink->maxUpscaleSize.toJValue()}};
 }
 
+// Runs on the reader thread.
 pbnjson::JValue VideoService::getOutputCapabilities(LSHelpers::JsonRequest &request)
 {
-    std::vector<VAL_PLANE_T> valPlanes = val->video->getVideoPlanes();
-    size_t planeCount                  = valPlanes.size();
+    std::shared_ptr<const VideoCapabilities> capabilities = mCapabilities.get();
+    size_t planeCount                                     = capabilities->planes.size();
     JArray planesInfo;
 
-    for (auto plane : valPlanes) {
+    for (const VAL_PLANE_T &plane : capabilities->planes) {
         planesInfo.append(pbnjson::JValue{
             {"sinkId", plane.planeName},
             {"maxDownscaleSize", pbnjson::JValue{{"width", plane.minSizeT.w}, {"height", plane.minSizeT.h}}},
@@ -315,6 +696,20 @@ pbnjson::JValue VideoService::disconnect(LSHelpers::JsonRequest &request)
     return true;
 }
 
+// Records the time from connect to the first unblank of the session, the time to the first visible frame.
+void VideoService::recordFirstUnblank(VideoSink &video)
+{
+    if (!video.connectedAt)
+        return;
+
+    static Histogram &latency = MetricsRegistry::global().histogram("video.connectToFirstUnblankUs");
+    gint64 now = g_get_monotonic_time();
+
+    latency.record(static_cast<uint64_t>(std::max<gint64>(0, now - video.connectedAt)));
+    Tracer::global().record("connectToFirstUnblank", video.name.c_str(), video.connectedAt, now);
+    video.connectedAt = 0;
+}
+
 bool VideoService::doDisconnectVideo(VideoSink &video)
 {
     if (!video.connected) {
@@ -327,6 +722,7 @@ bool VideoService::doDisconnectVideo(VideoSink &video)
 
     // Reset all video sink related fields
     video.connected        = false;
+    video.connectedAt      = 0;
     video.muted            = false;
     video.opacity          = 0;
     video.zOrder           = 0;
@@ -337,7 +733,7 @@ bool VideoService::doDisconnectVideo(VideoSink &video)
 
     bool success = true;
 
-    success &= val->video->disconnect(video.wId);
+    success &= VAL_CALL("video.disconnect", val->video, disconnect, video.wId);
 
     if (video.name.find("SUB") != std::string::npos)
         success &= this->setDualVideo(false);
@@ -345,17 +741,13 @@ bool VideoService::doDisconnectVideo(VideoSink &video)
     return success;
 }
 
-pbnjson::JValue VideoService::blankVideo(LSHelpers::JsonRequest &request)
+pbnjson::JValue VideoService::blankVideo(LSHelpers::JsonRequest &request, BlankVideoRequest &params)
 {
-    std::string sinkName;
-    bool enableBlank;
-
-    request.get("sink", sinkName);
-    request.get("blank", enableBlank);
-    if (!request.finishParse())
-        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+    const std::string &sinkName = params.sink;
+    bool enableBlank            = params.blank;
 
     LOG_DEBUG("blankVideo sink:%s, set blank to %d", sinkName.c_str(), enableBlank);
+    TraceTag traceTag(sinkName);
 
     VideoSink *videoSink = getVideoSink(sinkName);
 
@@ -372,43 +764,31 @@ pbnjson::JValue VideoService::blankVideo(LSHelpers::JsonRequest &request)
         return true;
     }
 
-    if (!val->video->setWindowBlanking(videoSink->wId, enableBlank, videoSink->appliedInputRect.toVALRect(),
-                                       videoSink->scaledOutputRect.toVALRect())) {
+    if (!VAL_CALL("video.setWindowBlanking", val->video, setWindowBlanking, videoSink->wId, enableBlank,
+                  videoSink->appliedInputRect.toVALRect(), videoSink->scaledOutputRect.toVALRect())) {
         return API_ERROR_HAL_ERROR;
     }
 
     videoSink->muted = enableBlank;
+    if (!enableBlank)
+        recordFirstUnblank(*videoSink);
     this->sendSinkUpdateToSubscribers();
 
     return true;
 }
 
-pbnjson::JValue VideoService::setVideoData(LSHelpers::JsonRequest &request)
+pbnjson::JValue VideoService::setVideoData(LSHelpers::JsonRequest &request, SetVideoDataRequest &params)
 {
-    std::string videoSinkName;
-    std::string clientId;
-    std::string contentType;
-    uint16_t width;
-    uint16_t height;
-    std::string scanType;
-    bool cIdSet;
-    bool videoInfoSet;
-    double frameRate;
-    JValue videoInfo;
-
-    request.get("sink", videoSinkName).optional(true);
-    request.get("context", clientId).optional(true).checkValueRead(cIdSet);
-    request.get("contentType", contentType).optional(true).defaultValue("unknown");
-    request.get("width", width);
-    request.get("height", height);
-    request.get("frameRate", frameRate).min(0.0);
-    request.get("scanType", scanType)
-        .optional(true)
-        .allowedValues({"interlaced", "progressive", "VIDEO_PROGRESSIVE", "VIDEO_INTERLACED"});
-    request.get("videoInfo", videoInfo).optional(true).checkValueRead(videoInfoSet);
-
-    if (!request.finishParse())
-        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+    const std::string &videoSinkName = params.sink;
+    std::string &clientId            = params.context;
+    const std::string &contentType   = params.contentType;
+    uint16_t width                   = params.width;
+    uint16_t height                  = params.height;
+    const std::string &scanType      = params.scanType;
+    bool cIdSet                      = params.contextSet;
+    bool videoInfoSet                = params.videoInfoSet;
+    double frameRate                 = params.frameRate;
+    const JValue &videoInfo          = params.videoInfo;
 
     LOG_DEBUG("setVideoData called for sink %s with contentType %s, width %u, height %u, scanType %s",
               videoSinkName.c_str(), contentType.c_str(), width, height, scanType.c_str());
@@ -417,6 +797,7 @@ pbnjson::JValue VideoService::setVideoData(LSHelpers::JsonRequest &request)
         clientId = videoSinkName;
     }
 
+    TraceTag traceTag(clientId);
     VideoClient *client = getClientInfo(clientId);
 
     if (!client) {
@@ -471,27 +852,19 @@ pbnjson::JValue VideoService::setVideoData(LSHelpers::JsonRequest &request)
     return true;
 }
 
-pbnjson::JValue VideoService::setDisplayWindow(LSHelpers::JsonRequest &request)
+pbnjson::JValue VideoService::setDisplayWindow(LSHelpers::JsonRequest &request, SetDisplayWindowRequest &params)
 {
-    std::string videoSinkName, clientId("unknown");
-    bool supportNegativePos = false;
-    bool fullScreen;
-    bool opacitySet;
-    bool cIdSet;
-    uint8_t opacity;
-    bool displayOutputSet, sourceInputSet;
-    VideoRect displayOutput;
-    VideoRect inputRect;
-
-    request.get("sink", videoSinkName).optional(true);
-    request.get("context", clientId).optional(true).checkValueRead(cIdSet);
-    request.get("fullScreen", fullScreen);
-    request.get("displayOutput", displayOutput).optional(true).checkValueRead(displayOutputSet);
-    request.get("sourceInput", inputRect).optional(true).checkValueRead(sourceInputSet);
-    request.get("opacity", opacity).optional(true).defaultValue(0).checkValueRead(opacitySet);
-
-    if (!request.finishParse())
-        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+    const std::string &videoSinkName = params.sink;
+    std::string &clientId            = params.context;
+    bool supportNegativePos          = false;
+    bool fullScreen                  = params.fullScreen;
+    bool cIdSet                      = params.contextSet;
+    uint8_t opacity                  = params.opacity;
+    bool opacitySet                  = params.opacitySet;
+    bool displayOutputSet            = params.displayOutputSet;
+    bool sourceInputSet              = params.sourceInputSet;
+    VideoRect &displayOutput         = params.displayOutput;
+    VideoRect &inputRect             = params.sourceInput;
 
     LOG_DEBUG("setDisplayWindow called for sink %s with fullScreen %d, displayOutput {x:%d, y:%d, w:%u, h:%u},"
               "inputRect {x:%d, y:%d, w:%u, h:%u}, opacity %u",
@@ -501,6 +874,7 @@ pbnjson::JValue VideoService::setDisplayWindow(LSHelpers::JsonRequest &request)
     if (!cIdSet)
         clientId = videoSinkName;
 
+    TraceTag traceTag(clientId);
     VideoClient *client = getClientInfo(clientId);
 
     if (!client)
@@ -564,63 +938,63 @@ pbnjson::JValue VideoService::setDisplayWindow(LSHelpers::JsonRequest &request)
                                                                         //: (double)inputRect.h /
                                                                         //(double)displayOutput.h;
 
-        LOG_DEBUG("w_ratio:%f, h_ratio:%f", w_ratio, h_ratio);
+        BINLOG_DEBUG("w_ratio:%f, h_ratio:%f", w_ratio, h_ratio);
 
         // reflect negative x,y position to displayOutput
         if (displayOutput.x < 0) { // x has negative value
-            LOG_DEBUG("minus x");
+            BINLOG_DEBUG("minus x");
             if (displayOutput.w + displayOutput.x > 0) {
-                LOG_DEBUG("  calculate width");
-                LOG_DEBUG("    w:%u = %lf / %lf", (uint16_t)((double)(displayOutput.w + displayOutput.x) / w_ratio),
-                          (double)(displayOutput.w + displayOutput.x), w_ratio);
+                BINLOG_DEBUG("  calculate width");
+                BINLOG_DEBUG("    w:%u = %lf / %lf", (uint16_t)((double)(displayOutput.w + displayOutput.x) / w_ratio),
+                             (double)(displayOutput.w + displayOutput.x), w_ratio);
                 inputRect.w     = (uint16_t)((double)(displayOutput.w + displayOutput.x) / w_ratio);
                 displayOutput.w = displayOutput.w + displayOutput.x;
             } else {
                 inputRect.w     = 0;
                 displayOutput.w = 0;
             }
-            LOG_DEBUG("  calculate x pos");
-            LOG_DEBUG("    x:%d = %lf / %lf", (int16_t)((double)(inputRect.x - displayOutput.x) / w_ratio),
-                      (double)(inputRect.x - displayOutput.x), w_ratio);
+            BINLOG_DEBUG("  calculate x pos");
+            BINLOG_DEBUG("    x:%d = %lf / %lf", (int16_t)((double)(inputRect.x - displayOutput.x) / w_ratio),
+                         (double)(inputRect.x - displayOutput.x), w_ratio);
             inputRect.x     = (int16_t)((double)(inputRect.x - displayOutput.x) / w_ratio);
             displayOutput.x = 0;
         } else if ((uint16_t)displayOutput.x + displayOutput.w >
                    videoSink->maxUpscaleSize.w) { // x+w value over display width
-            LOG_DEBUG("plus x");
-            LOG_DEBUG("  calculate width");
+            BINLOG_DEBUG("plus x");
+            BINLOG_DEBUG("  calculate width");
             // crop when inputRect out of displayRect
-            LOG_DEBUG("    w:%u = %u / %lf",
-                      (uint16_t)((double)(videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x) / w_ratio),
-                      (videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x), w_ratio);
+            BINLOG_DEBUG("    w:%u = %u / %lf",
+                         (uint16_t)((double)(videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x) / w_ratio),
+                         (videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x), w_ratio);
             inputRect.w     = (uint16_t)((double)(videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x) / w_ratio);
             displayOutput.w = videoSink->maxUpscaleSize.w - (uint16_t)displayOutput.x;
         }
 
         if (displayOutput.y < 0) {
-            LOG_DEBUG("minus y\n");
+            BINLOG_DEBUG("minus y\n");
             // TODO(ekwang_: reflect negative x,y position to inputRect
             if (displayOutput.h + displayOutput.y > 0) {
-                LOG_DEBUG("  calculate height");
-                LOG_DEBUG("    h:%u = %lf / %lf", (uint16_t)((double)(displayOutput.h + displayOutput.y) / h_ratio),
-                          (double)(displayOutput.h + displayOutput.y), h_ratio);
+                BINLOG_DEBUG("  calculate height");
+                BINLOG_DEBUG("    h:%u = %lf / %lf", (uint16_t)((double)(displayOutput.h + displayOutput.y) / h_ratio),
+                             (double)(displayOutput.h + displayOutput.y), h_ratio);
                 inputRect.h     = (uint16_t)((double)(displayOutput.h + displayOutput.y) / h_ratio);
                 displayOutput.h = displayOutput.h + displayOutput.y;
             } else {
                 inputRect.h     = 0;
                 displayOutput.h = 0;
             }
-            LOG_DEBUG("  calculate y pos");
-            LOG_DEBUG("    y:%d = %lf / %lf", (int16_t)((double)(inputRect.y - displayOutput.y) / h_ratio),
-                      (double)(inputRect.y - displayOutput.y), h_ratio);
+            BINLOG_DEBUG("  calculate y pos");
+            BINLOG_DEBUG("    y:%d = %lf / %lf", (int16_t)((double)(inputRect.y - displayOutput.y) / h_ratio),
+                         (double)(inputRect.y - displayOutput.y), h_ratio);
             inputRect.y     = (int16_t)((double)(inputRect.y - displayOutput.y) / h_ratio);
             displayOutput.y = 0;
         } else if ((uint16_t)displayOutput.y + displayOutput.h > videoSink->maxUpscaleSize.h) {
-            LOG_DEBUG("plus y");
-            LOG_DEBUG("  calculate height");
+            BINLOG_DEBUG("plus y");
+            BINLOG_DEBUG("  calculate height");
             // crop when inputRect out of displayRect
-            LOG_DEBUG("    h:%u = %u / %lf",
-                      (uint16_t)((double)(videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y) / h_ratio),
-                      (videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y), h_ratio);
+            BINLOG_DEBUG("    h:%u = %u / %lf",
+                         (uint16_t)((double)(videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y) / h_ratio),
+                         (videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y), h_ratio);
             inputRect.h     = (uint16_t)((double)(videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y) / h_ratio);
             displayOutput.h = videoSink->maxUpscaleSize.h - (uint16_t)displayOutput.y;
         }
@@ -639,14 +1013,15 @@ pbnjson::JValue VideoService::setDisplayWindow(LSHelpers::JsonRequest &request)
     }
 
     // TEMPORARY CODE start: after AV Mute Manager done, this part will BE DELETED!!! mayyoon_181106
-    if (!val->video->setWindowBlanking(videoSink->wId, false, videoSink->appliedInputRect.toVALRect(),
-                                       videoSink->scaledOutputRect.toVALRect())) {
+    if (!VAL_CALL("video.setWindowBlanking", val->video, setWindowBlanking, videoSink->wId, false,
+                  videoSink->appliedInputRect.toVALRect(), videoSink->scaledOutputRect.toVALRect())) {
         return API_ERROR_HAL_ERROR;
     }
+    recordFirstUnblank(*videoSink);
     // TEMPORARY CODE end
 
     client->available = true;
-    LOG_DEBUG("all info are filled for client");
+    BINLOG_DEBUG("all info are filled for client");
 
     if (opacitySet) {
         videoSink->opacity = opacity;
@@ -741,45 +1116,30 @@ pbnjson::JValue VideoService::setDisplayResolution(LSHelpers::JsonRequest &reque
     VAL_VIDEO_SIZE_T res;
     res.h = h;
     res.w = w;
-    val->video->setDisplayResolution(res, display_path);
+    VAL_CALL("video.setDisplayResolution", val->video, setDisplayResolution, res, display_path);
+    refreshCapabilities();
 
     return true;
 }
 
 pbnjson::JValue VideoService::getSupportedResolutions(LSHelpers::JsonRequest &request)
 {
-    JArray dispArray;
-    int ret;
-    int numDisplay;
-    pbnjson::JValue response;
-    pbnjson::JValue param = pbnjson::JValue();
-
-    response = val->video->getParam(VAL_CTRL_NUM_CONNECTOR, param);
-
-    JsonParser parser{response};
-    parser.get("returnValue", ret);
-
-    if (!ret || !parser.finishParse())
-        return API_ERROR_SCHEMA_VALIDATION(parser.getError());
-    parser.get("numConnector", numDisplay);
+    std::shared_ptr<const VideoCapabilities> capabilities = mCapabilities.get();
+    if (!capabilities->connectorsKnown)
+        return API_ERROR_HAL_ERROR;
 
-    std::string dispStr = "disp";
-    for (int i = 0; i < numDisplay; i++) {
-        auto modeList = val->video->getSupportedResolutions(i);
+    JArray dispArray;
+    for (size_t i = 0; i < capabilities->modes.size(); i++) {
         JArray modeArray;
-        for (auto m : modeList) {
-            std::stringstream s;
-            s << m.w << "x" << m.h;
-            std::cout << s.str() << std::endl;
-            JValue mode = JObject{{"name", s.str()}, {"w", m.w}, {"h", m.h}};
-            modeArray.append(mode);
+        for (const DisplayMode &mode : capabilities->modes[i]) {
+            modeArray.append(JObject{{"name", mode.name}, {"w", mode.w}, {"h", mode.h}});
         }
-        JValue disp = JObject{{dispStr + std::to_string(i), modeArray}};
-        dispArray.append(disp);
+        dispArray.append(JObject{{"disp" + std::to_string(i), modeArray}});
     }
     return JObject{{"returnValue", true}, {"modes", dispArray}};
 }
 
+// Runs on the reader thread.
 pbnjson::JValue VideoService::getStatus(LSHelpers::JsonRequest &request)
 {
     bool subscribe = false;
@@ -789,52 +1149,169 @@ pbnjson::JValue VideoService::getStatus(LSHelpers::JsonRequest &request)
     if (!request.finishParse())
         return API_ERROR_SCHEMA_VALIDATION(request.getError());
 
-    JValue response = this->buildStatus();
-    response.put("subscribed", subscribe);
-    response.put("returnValue", true);
-
     if (subscribe) {
-        this->mSinkStatusSubscription.post(response);
-        this->mSinkStatusSubscription.addSubscription(request);
-    } else {
-        // TODO: no way to unsubscription. LSHelpers doesn't provide method.
+        // This runs on mReader while the main loop posts updates. The reply is sent in sequence with them,
+        // so it cannot overtake an update with a newer state.
+        request.defer();
+        this->mSinkStatusSubscription.addSubscription(request.getMessage(), [this]() {
+            JValue response = buildStatus(*currentState());
+            response.put("subscribed", true);
+            response.put("returnValue", true);
+            return response;
+        });
+        return true; // Ignored, the request is deferred.
     }
 
-    // TODO(ekwang): temp for debug
-    for (uint16_t i = 0; i < mClients.size(); i++)
-        mClients[i].debug_print("client info");
-
+    // TODO: no way to unsubscription. LSHelpers doesn't provide method.
+    JValue response = buildStatus(*currentState());
+    response.put("subscribed", false);
+    response.put("returnValue", true);
     return response;
 }
 
 void VideoService::sendSinkUpdateToSubscribers()
 {
+    publishState();
+
     if (!this->mSinkStatusSubscription.hasSubscribers()) {
         return;
     }
 
-    JValue response = this->buildStatus();
+    if (mHoldStatusUpdates) {
+        mStatusUpdateHeld = true;
+        return;
+    }
+
+    JValue response = buildStatus(*currentState());
     response.put("subscribed", true);
     this->mSinkStatusSubscription.post(response);
 }
 
-pbnjson::JValue VideoService::buildStatus()
+// Publish a copy of the current state for the read-only methods.
+void VideoService::publishState()
+{
+    std::shared_ptr<const VideoServiceState> previous = currentState();
+    std::shared_ptr<VideoServiceState> state          = std::make_shared<VideoServiceState>();
+    state->sinks                             = mSinks;
+    state->clients                           = mClients;
+
+    for (VideoClient &client : state->clients) {
+        client.videoinfoObj = nullptr; // Owned by mClients
+    }
+
+    std::atomic_store(&mState, std::shared_ptr<const VideoServiceState>(std::move(state)));
+
+    if (mJournaling)
+        journalState(previous.get());
+
+    // Replies to repeated control calls are only valid for the state they were made in.
+    invalidateChangedReplies(previous.get());
+}
+
+std::shared_ptr<const VideoServiceState> VideoService::currentState() const { return std::atomic_load(&mState); }
+
+// Drop the cached replies about the sinks and clients that changed since the previously published state,
+// compared by the journaled fields. Replies about the others stay valid.
+void VideoService::invalidateChangedReplies(const VideoServiceState *previous)
+{
+    if (!previous || previous->sinks.size() != mSinks.size()) {
+        mService.invalidateReplyCache();
+        return;
+    }
+
+    for (const VideoSink &sink : mSinks) {
+        const VideoSink *before = findSink(previous->sinks, sink.name);
+        if (!before) {
+            mService.invalidateReplyCache();
+            return;
+        }
+        if (!journalDiffers(sink, *before))
+            continue;
+
+        mService.invalidateReplyCache("sink", sink.name);
+        if (!sink.connectedClientId.empty())
+            mService.invalidateReplyCache("context", sink.connectedClientId);
+        if (!before->connectedClientId.empty() && before->connectedClientId != sink.connectedClientId)
+            mService.invalidateReplyCache("context", before->connectedClientId);
+    }
+
+    for (const VideoClient &client : mClients) {
+        const VideoClient *before = findClient(previous->clients, client.clientId);
+        if (before && !journalDiffers(client, *before))
+            continue;
+
+        mService.invalidateReplyCache("context", client.clientId);
+        mService.invalidateReplyCache("sink", client.sinkName);
+        if (before && before->sinkName != client.sinkName)
+            mService.invalidateReplyCache("sink", before->sinkName);
+    }
+
+    for (const VideoClient &client : previous->clients) {
+        if (!getClientInfo(client.clientId)) {
+            mService.invalidateReplyCache("context", client.clientId);
+            mService.invalidateReplyCache("sink", client.sinkName);
+        }
+    }
+}
+
+// Mirror the sinks and clients into the journal. With the previously published state, only the sinks
+// and clients that changed since are serialized, so a resize writes one sink and one client.
+// Without it, everything is compared with the journal, as when journaling starts.
+void VideoService::journalState(const VideoServiceState *previous)
+{
+    for (const VideoSink &sink : mSinks) {
+        const VideoSink *before = previous ? findSink(previous->sinks, sink.name) : nullptr;
+        if (!before || journalDiffers(sink, *before))
+            mJournal.put(JOURNAL_SINK + sink.name, sinkToJournal(sink).stringify());
+    }
+
+    std::vector<std::string> removed;
+    if (previous) {
+        for (const VideoClient &client : previous->clients) {
+            if (!getClientInfo(client.clientId))
+                removed.push_back(JOURNAL_CLIENT + client.clientId);
+        }
+    } else {
+        for (const auto &entry : mJournal.entries()) {
+            if (entry.first.compare(0, JOURNAL_CLIENT.size(), JOURNAL_CLIENT) == 0 &&
+                !getClientInfo(entry.first.substr(JOURNAL_CLIENT.size())))
+                removed.push_back(entry.first);
+        }
+    }
+    for (const std::string &key : removed) {
+        mJournal.remove(key);
+    }
+
+    for (const VideoClient &client : mClients) {
+        const VideoClient *before = previous ? findClient(previous->clients, client.clientId) : nullptr;
+        if (!before || journalDiffers(client, *before))
+            mJournal.put(JOURNAL_CLIENT + client.clientId, clientToJournal(client).stringify());
+    }
+}
+
+pbnjson::JValue VideoService::buildStatus(const VideoServiceState &state)
 {
     JArray videoStatus;
-    for (VideoSink &sink : mSinks) {
-        videoStatus.append(buildVideoSinkStatus(sink));
+    for (const VideoSink &sink : state.sinks) {
+        videoStatus.append(buildVideoSinkStatus(state, sink));
     }
 
     return JObject{{"video", videoStatus}};
 }
 
-pbnjson::JValue VideoService::buildVideoSinkStatus(VideoSink &vsink)
+pbnjson::JValue VideoService::buildVideoSinkStatus(const VideoServiceState &state, const VideoSink &vsink)
 {
-    VideoClient *client            = nullptr;
+    const VideoClient *client      = nullptr;
     pbnjson::JValue videoinfo_jval = JValue();
 
     if (vsink.connected) {
-        client = getClientInfo(vsink.name, true);
+        for (const VideoClient &candidate : state.clients) {
+            if (candidate.activation && candidate.sinkName == vsink.name) {
+                client = &candidate;
+                break;
+            }
+        }
+
         if (!client) {
             // Note : In this case, unregister is called before disconnect
             return API_ERROR_INVALID_PARAMETERS("Invalid client: %s", vsink.name.c_str());
@@ -849,12 +1326,12 @@ pbnjson::JValue VideoService::buildVideoSinkStatus(VideoSink &vsink)
 
             // TODO(ekwang): for test to get member info
             VideoInfoMedia *videoinfomedia = static_cast<VideoInfoMedia *>(client->videoinfoObj);
-            LOG_DEBUG("get videoinfo_val's hdrType:%s", videoinfomedia->hdrType.c_str());
+            BINLOG_DEBUG("get videoinfo_val's hdrType:%s", videoinfomedia->hdrType.c_str());
         }
 #endif
     }
 
-    LOG_DEBUG("buildVideoSinkStatus sink: %s, connected:%d", vsink.name.c_str(), vsink.connected);
+    BINLOG_DEBUG("buildVideoSinkStatus sink: %s, connected:%d", vsink.name.c_str(), vsink.connected);
 
     return JObject{
         {"sink", vsink.name},
@@ -908,104 +1385,220 @@ pbnjson::JValue VideoService::setParam(LSHelpers::JsonRequest &request)
     return JObject{{"returnValue", (bool)ret}};
 }
 
+pbnjson::JValue VideoService::getMetrics(LSHelpers::JsonRequest &request)
+{
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
+    JValue response = MetricsRegistry::global().toJValue();
+    response.put("returnValue", true);
+
+    JArray offenders;
+    for (const RateLimiter::CallerStats &stats : mService.getRateLimiter().topOffenders(METRICS_TOP_OFFENDERS)) {
+        offenders.append(JObject{{"caller", stats.caller},
+                                 {"rejected", static_cast<int64_t>(stats.rejected)},
+                                 {"coalesced", static_cast<int64_t>(stats.coalesced)}});
+    }
+    response.put("rateLimitedCallers", offenders);
+    response.put("startup", Startup::toJValue());
+
+    SubscriptionPoint::Stats status = mSinkStatusSubscription.getStats();
+    response.put("statusSubscription",
+                 JObject{{"subscribers", static_cast<int64_t>(mSinkStatusSubscription.getSubscriberCount())},
+                         {"posted", static_cast<int64_t>(status.posted)},
+                         {"sent", static_cast<int64_t>(status.sent)},
+                         {"collapsed", static_cast<int64_t>(status.collapsed)},
+                         {"failed", static_cast<int64_t>(status.failed)},
+                         {"cutOff", static_cast<int64_t>(status.cutOff)},
+                         {"deferred", static_cast<int64_t>(status.deferred)}});
+
+    JObject dispatch;
+    for (MethodPriority priority : {MethodPriority::Control, MethodPriority::Query}) {
+        ServicePoint::PriorityStats stats = mService.getPriorityStats(priority);
+        dispatch.put(priority == MethodPriority::Control ? "control" : "query",
+                     JObject{{"dispatched", static_cast<int64_t>(stats.dispatched)},
+                             {"totalDelayUs", static_cast<int64_t>(stats.totalDelayUs)},
+                             {"maxDelayUs", static_cast<int64_t>(stats.maxDelayUs)},
+                             {"aged", static_cast<int64_t>(stats.aged)},
+                             {"queued", static_cast<int64_t>(stats.queued)}});
+    }
+    response.put("dispatch", dispatch);
+
+    JObject replyCache;
+    for (const auto &method : mService.getReplyCacheStats()) {
+        replyCache.put(method.first, JObject{{"hits", static_cast<int64_t>(method.second.hits)},
+                                             {"misses", static_cast<int64_t>(method.second.misses)}});
+    }
+    response.put("replyCache", replyCache);
+
+    return response;
+}
+
+pbnjson::JValue VideoService::getTrace(LSHelpers::JsonRequest &request)
+{
+    bool clear = false;
+
+    request.get("clear", clear).optional(true);
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
+    JValue response = Tracer::global().toChromeTrace();
+    response.put("returnValue", true);
+
+    if (clear)
+        Tracer::global().clear();
+
+    return response;
+}
+
+pbnjson::JValue VideoService::getHalJournal(LSHelpers::JsonRequest &request)
+{
+    bool clear  = false;
+    bool enable = HalJournal::isEnabled();
+
+    request.get("clear", clear).optional(true);
+    request.get("enable", enable).optional(true);
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
+    // Off by default, recording formats the arguments of every HAL call.
+    HalJournal::setEnabled(enable);
+
+    JValue response = HalJournal::toJValue();
+    response.put("enabled", enable);
+    response.put("returnValue", true);
+
+    if (clear)
+        HalJournal::clear();
+
+    return response;
+}
+
+pbnjson::JValue VideoService::setCapture(LSHelpers::JsonRequest &request)
+{
+    bool enable      = false;
+    int64_t maxBytes = CAPTURE_DEFAULT_BYTES;
+
+    request.get("enable", enable);
+    request.get("maxBytes", maxBytes).optional(true);
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
+    if (maxBytes < 1024 || maxBytes > CAPTURE_MAX_BYTES)
+        return API_ERROR_INVALID_PARAMETERS("maxBytes out of range 1024 - %lld", (long long)CAPTURE_MAX_BYTES);
+
+    // Creating and flushing the file can block on storage, so it is done on mReader.
+    // The file is fixed at build time, callers can not choose where the service writes.
+    AsyncRequest async = mService.async(request);
+    async.await(
+        mReader,
+        [enable, maxBytes]() {
+            if (!enable) {
+                Capture::global().stop();
+                return true;
+            }
+            return Capture::global().start(CAPTURE_FILE, static_cast<size_t>(maxBytes));
+        },
+        [](bool &done) -> JValue {
+            if (!done)
+                return API_ERROR_INVALID_STATUS("Failed to create %s", CAPTURE_FILE);
+
+            Capture::Stats stats = Capture::global().getStats();
+            return JObject{{"returnValue", true},
+                           {"enabled", Capture::global().isEnabled()},
+                           {"path", CAPTURE_FILE},
+                           {"records", static_cast<int64_t>(stats.records)},
+                           {"dropped", static_cast<int64_t>(stats.dropped)},
+                           {"bytes", static_cast<int64_t>(stats.bytes)}};
+        });
+
+    return true; // Ignored, the request is deferred.
+}
+
+gboolean VideoService::logMetricsCB(gpointer user_data)
+{
+    MetricsRegistry::global().logSummary();
+    return G_SOURCE_CONTINUE;
+}
+
+// Runs on the reader thread. Answered from the capability cache.
 pbnjson::JValue VideoService::getParam(LSHelpers::JsonRequest &request)
 {
     std::string command;
     std::string sinkName;
-    pbnjson::JValue response;
     int wId          = 0;
-    int ret          = false;
     bool sinkNameSet = false;
 
     request.get("command", command);
     request.get("sink", sinkName).optional(true).checkValueRead(sinkNameSet);
 
+    if (!request.finishParse())
+        return API_ERROR_SCHEMA_VALIDATION(request.getError());
+
     LOG_DEBUG("command:%s", command.c_str());
 
     if (sinkNameSet) {
-        VideoSink *videoSink = getVideoSink(sinkName);
-        if (!videoSink) {
+        std::shared_ptr<const VideoServiceState> state = currentState();
+        auto sink = std::find_if(state->sinks.begin(), state->sinks.end(),
+                                 [&sinkName](const VideoSink &s) { return s.name == sinkName; });
+        if (sink == state->sinks.end()) {
             return API_ERROR_INVALID_PARAMETERS("Invalid sink: %s", sinkName.c_str());
         }
-        wId = videoSink->wId;
+        wId = sink->wId;
         LOG_DEBUG("sink:%s, wId:%d", sinkName.c_str(), wId);
     }
 
-    if (VAL_DEV_RPI == val->getDevice()) {
-        pbnjson::JValue param = JValue();
-
-        if (command == VAL_CTRL_DRM_RESOURCES) {
-            int planeId = 0;
-            int crtcId  = 0;
-            int connId  = 0;
-            std::string rsp_sink;
-
-            param    = pbnjson::JValue{{"wId", wId}};
-            response = val->video->getParam(command, param);
-            response.put("sink", sinkName);
-
-            // parse response to check validataion
-            JsonParser parser{response};
-            parser.get("returnValue", ret);
-            if (ret == true) {
-                parser.get("sink", rsp_sink);
-                parser.get("planeId", planeId);
-                parser.get("crtcId", crtcId);
-                parser.get("connId", connId);
-            }
-            if (!parser.finishParse())
-                return API_ERROR_SCHEMA_VALIDATION(parser.getError());
-
-            LOG_DEBUG("command:%s ret:%d value:(sink:%s, plane:%d, crtc:%d, conn:%d)", command.c_str(), ret,
-                      rsp_sink.c_str(), planeId, crtcId, connId);
-        } else if (command == VAL_CTRL_NUM_CONNECTOR) {
-            int numConnector = 0;
-
-            response = val->video->getParam(command, param);
+    std::shared_ptr<const VideoCapabilities> capabilities = mCapabilities.get();
+    if (VAL_DEV_RPI != capabilities->device)
+        return API_ERROR_NOT_IMPLEMENTED;
 
-            // parse response to check validataion
-            JsonParser parser{response};
-            parser.get("returnValue", ret);
-            if (ret == true) {
-                parser.get("numConnector", numConnector);
-            }
-            if (!parser.finishParse())
-                return API_ERROR_SCHEMA_VALIDATION(parser.getError());
+    if (command == VAL_CTRL_DRM_RESOURCES) {
+        auto resources = capabilities->drmResources.find(wId);
+        if (resources == capabilities->drmResources.end())
+            return API_ERROR_HAL_ERROR;
 
-            LOG_DEBUG("command:%s ret:%d value:(numCon:%d)", command.c_str(), ret, numConnector);
-        } else {
-            // Unknown command
-            if (!request.finishParse())
-                return API_ERROR_SCHEMA_VALIDATION(request.getError());
+        LOG_DEBUG("command:%s value:(sink:%s, plane:%d, crtc:%d, conn:%d)", command.c_str(), sinkName.c_str(),
+                  resources->second.planeId, resources->second.crtcId, resources->second.connId);
+        return JObject{{"returnValue", true},
+                       {"sink", sinkName},
+                       {"planeId", resources->second.planeId},
+                       {"crtcId", resources->second.crtcId},
+                       {"connId", resources->second.connId}};
+    } else if (command == VAL_CTRL_NUM_CONNECTOR) {
+        if (!capabilities->connectorsKnown)
+            return API_ERROR_HAL_ERROR;
 
-            return API_ERROR_INVALID_PARAMETERS("Unknown command %s", command.c_str());
-        }
-    } else {
-        return API_ERROR_NOT_IMPLEMENTED;
+        LOG_DEBUG("command:%s value:(numCon:%zu)", command.c_str(), capabilities->modes.size());
+        return JObject{{"returnValue", true}, {"numConnector", static_cast<int>(capabilities->modes.size())}};
     }
 
-    if (!request.finishParse())
-        return API_ERROR_SCHEMA_VALIDATION(request.getError());
-
-    return response;
+    return API_ERROR_INVALID_PARAMETERS("Unknown command %s", command.c_str());
 }
 
-// TODO(ekwang) : almost same as getSupportedResolution()
 void VideoService::readVideoCapabilities(VideoSink &sink)
 {
-    VAL_VIDEO_SIZE_T minDownSize, maxUpScale;
-
-    std::vector<VAL_PLANE_T> supportedPlanes = val->video->getVideoPlanes();
-    if (supportedPlanes.size() > sink.wId) {
-        sink.minDownscaleSize = supportedPlanes[sink.wId].minSizeT;
-        sink.maxUpscaleSize   = supportedPlanes[sink.wId].maxSizeT;
+    std::shared_ptr<const VideoCapabilities> capabilities = mCapabilities.get();
+    if (capabilities->planes.size() > sink.wId) {
+        sink.minDownscaleSize = capabilities->planes[sink.wId].minSizeT;
+        sink.maxUpscaleSize   = capabilities->planes[sink.wId].maxSizeT;
     } else {
         LOG_ERROR(MSGID_SINK_SETUP_ERROR, 0, "Invalid SinkId");
     }
 }
 
+// Display hotplug or mode change. The plane limits of the connected sinks may have changed.
+void VideoService::refreshCapabilities()
+{
+    mCapabilities.refresh(val);
+    for (VideoSink &sink : mSinks) {
+        if (sink.connected)
+            readVideoCapabilities(sink);
+    }
+    publishState();
+}
+
 // TODO:: Move this to AspectRatioSetting (Rename AspectRatioSetting to appropriate name)
-bool VideoService::applyVideoOutputRects(VideoSink &sink, VideoClient client, VideoRect &inputRect,
+bool VideoService::applyVideoOutputRects(VideoSink &sink, const VideoClient &client, VideoRect &inputRect,
                                          VideoRect &outputRect, VideoRect &sourceRect)
 {
     LOG_DEBUG("applyVideoOutputRects called with inputRect {x:%d, y:%d, w:%u, h:%u},"
@@ -1045,8 +1638,8 @@ bool VideoService::applyVideoOutputRects(VideoSink &sink, VideoClient client, Vi
         adaptive       = videoinfomedia->adaptive;
     }
 
-    return val->video->applyScaling(sink.wId, client.sourceRect.toVALRect(), adaptive,
-                                    sink.appliedInputRect.toVALRect(), sink.scaledOutputRect.toVALRect());
+    return VAL_CALL("video.applyScaling", val->video, applyScaling, sink.wId, client.sourceRect.toVALRect(), adaptive,
+                    sink.appliedInputRect.toVALRect(), sink.scaledOutputRect.toVALRect());
 }
 
 bool VideoService::applyCompositing()
@@ -1074,12 +1667,13 @@ bool VideoService::applyCompositing()
     for (VAL_WINDOW_INFO_T zsink : zorder)
         LOG_DEBUG("wId %d, uAlpha %d", zsink.wId, zsink.uAlpha);
 
-    return val->video->setCompositionParams(zorder);
+    return VAL_CALL("video.setCompositionParams", val->video, setCompositionParams, zorder);
 }
 
 // TODO: move this to PQ section!!!
 bool VideoService::applyVideoFilters(VideoSink &sink, const std::string &sourceName)
 {
+    TraceSpan span("applyVideoFilters");
     // Just a copy of what TVService is calling, with parameters taken from tvservice as well.
     int32_t sharpness_control[7];
 
@@ -1123,9 +1717,12 @@ bool VideoService::applyVideoFilters(VideoSink &sink, const std::string &sourceN
     }
 
     // Don't consider there calls return value. These HAL calls are product dependent.
-    val->controls->configureVideoSettings(SHARPNESS_Control, sink.wId, sharpness_control);
-    val->controls->configureVideoSettings(PQ_Control, sink.wId, picture_control);
-    val->controls->configureVideoSettings(BLACK_LEVEL_Control, sink.wId, black_levels);
+    VAL_CALL("controls.configureVideoSettings", val->controls, configureVideoSettings, SHARPNESS_Control, sink.wId,
+             sharpness_control);
+    VAL_CALL("controls.configureVideoSettings", val->controls, configureVideoSettings, PQ_Control, sink.wId,
+             picture_control);
+    VAL_CALL("controls.configureVideoSettings", val->controls, configureVideoSettings, BLACK_LEVEL_Control, sink.wId,
+             black_levels);
 
     return true;
 }
@@ -1135,6 +1732,9 @@ pbnjson::JValue VideoService::setAspectRatio(ARC_MODE_NAME_MAP_T currentAspectMo
                                              int32_t allDirZoomVRatio, int32_t vertZoomVRatio,
                                              int32_t vertZoomVPosition)
 {
+    // Scaling changes outside of the luna control methods.
+    mService.invalidateReplyCache();
+
     mAspectRatioControl.setParams(currentAspectMode, allDirZoomHPosition, allDirZoomHRatio, allDirZoomVPosition,
                                   allDirZoomVRatio, vertZoomVRatio, vertZoomVPosition);
 
@@ -1165,7 +1765,8 @@ pbnjson::JValue VideoService::setBasicPictureCtrl(int8_t brightness, int8_t cont
 {
     LOG_DEBUG("set basic pictureControl properties %d %d %d %d", brightness, contrast, saturation, hue);
     int32_t uiVal[] = {brightness, contrast, saturation, hue};
-    return val->controls->configureVideoSettings(PQ_Control, VAL_VIDEO_WID_1, uiVal);
+    return VAL_CALL("controls.configureVideoSettings", val->controls, configureVideoSettings, PQ_Control,
+                    VAL_VIDEO_WID_1, uiVal);
 }
 
 pbnjson::JValue VideoService::setSharpness(int8_t sharpness, int8_t hSharpness, int8_t vSharpness)
@@ -1173,7 +1774,8 @@ pbnjson::JValue VideoService::setSharpness(int8_t sharpness, int8_t hSharpness,
     LOG_DEBUG("set setSharpness properties %d %d %d", sharpness, hSharpness, vSharpness);
 
     int32_t uiVal[] = {1, sharpness, hSharpness, vSharpness, 1, 0, 7};
-    return val->controls->configureVideoSettings(SHARPNESS_Control, VAL_VIDEO_WID_1, uiVal);
+    return VAL_CALL("controls.configureVideoSettings", val->controls, configureVideoSettings, SHARPNESS_Control,
+                    VAL_VIDEO_WID_1, uiVal);
 }
 
 bool VideoService::setDualVideo(bool enable)
@@ -1182,7 +1784,7 @@ bool VideoService::setDualVideo(bool enable)
         return true;
     }
 
-    if (!val->video->setDualVideo(enable)) {
+    if (!VAL_CALL("video.setDualVideo", val->video, setDualVideo, enable)) {
         return false;
     }
 
@@ -1193,7 +1795,7 @@ bool VideoService::setDualVideo(bool enable)
 VideoSink *VideoService::getVideoSink(const std::string &sinkName)
 {
     for (VideoSink &sink : mSinks) {
-        LOG_DEBUG("compare msink name:%s, sinkname:%s", sink.name.c_str(), sinkName.c_str());
+        BINLOG_DEBUG("compare msink name:%s, sinkname:%s", sink.name.c_str(), sinkName.c_str());
         if (sink.name == sinkName)
             return &sink;
     }
@@ -1206,6 +1808,7 @@ bool VideoService::addClientInfo(std::string clientId)
     if (nullptr == getClientInfo(clientId)) {
         mClients.push_back(VideoClient(clientId));
         LOG_DEBUG("addClientInfo %s, mClients size:%d", clientId.c_str(), mClients.size());
+        publishState();
         return true;
     }
 
@@ -1223,6 +1826,7 @@ bool VideoService::removeClientInfo(std::string clientId)
                 delete iter->videoinfoObj;
             mClients.erase(iter);
             LOG_DEBUG("clientId:%s earased. mClients size:%d", clientId.c_str(), mClients.size());
+            publishState();
             return true;
         } else
             ++iter;
@@ -1232,33 +1836,33 @@ bool VideoService::removeClientInfo(std::string clientId)
     return false;
 };
 
-VideoClient *VideoService::getClientInfo(const std::string clientId)
+VideoClient *VideoService::getClientInfo(const std::string &clientId)
 {
-    LOG_DEBUG("getClientInfo Id: %s", clientId.c_str());
+    BINLOG_DEBUG("getClientInfo Id: %s", clientId.c_str());
 
     for (VideoClient &client : mClients) {
-        LOG_DEBUG("compare pid : %s, %s", client.clientId.c_str(), clientId.c_str());
+        BINLOG_DEBUG("compare pid : %s, %s", client.clientId.c_str(), clientId.c_str());
         if (client.clientId == clientId) {
             return &client;
         }
     }
 
-    LOG_DEBUG("no matched info for %s", clientId.c_str());
+    BINLOG_DEBUG("no matched info for %s", clientId.c_str());
     return nullptr;
 };
 
-VideoClient *VideoService::getClientInfo(const std::string sinkName, bool activation)
+VideoClient *VideoService::getClientInfo(const std::string &sinkName, bool activation)
 {
-    LOG_DEBUG("getClientInfo with sinkname: %s", sinkName.c_str());
+    BINLOG_DEBUG("getClientInfo with sinkname: %s", sinkName.c_str());
 
     for (VideoClient &client : mClients) {
-        LOG_DEBUG("compare sink : %s, %s", client.sinkName.c_str(), sinkName.c_str());
+        BINLOG_DEBUG("compare sink : %s, %s", client.sinkName.c_str(), sinkName.c_str());
         if (client.activation == activation && client.sinkName == sinkName) {
             return &client;
         }
     }
 
-    LOG_DEBUG("no matched info for %s", sinkName.c_str());
+    BINLOG_DEBUG("no matched info for %s", sinkName.c_str());
     return nullptr;
 };
 
@@ -16,33 +16,59 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "ls2-helpers.hpp"
 #include "aspectratiosetting.h"
+#include "capabilitycache.h"
+#include "displayhotplug.h"
 #include "picturesettings.h"
+#include "statejournal.h"
 #include "videoinfotypes.h"
+#include "videorequests.h"
 #include "videoservicetypes.h"
 #include <val_api.h>
 
+// Copy of the service state read by the read-only methods.
+// Published as a whole after every change and never modified afterwards, so it can be read from any thread.
+struct VideoServiceState {
+    std::vector<VideoSink> sinks;
+    std::vector<VideoClient> clients; // videoinfoObj is not copied
+};
+
 class VideoService
 {
 public:
-    VideoService(LS::Handle &handle);
+    // journalPath: state journal for restoring the sinks after a crash, see StateJournal. Empty to not keep one.
+    explicit VideoService(LS::Handle &handle, const std::string &journalPath = "");
     VideoService(const VideoService &) = delete;
     VideoService &operator=(const VideoService &) = delete;
     ~VideoService();
 
+    // Set up the sinks and start handling calls. Calls wait from construction until this is called,
+    // so the service can be on the bus while the HAL initializes. Call once, on the luna main loop,
+    // after VAL::initialize returned.
+    void halInitialized();
+
+    // Handover to a new process, see Handover. exportState returns the sinks and clients for the new
+    // process. handOver stops handling calls, the sinks are left connected when the service is destroyed.
+    std::string exportState();
+    void handOver();
+    // In the new process, before halInitialized: the state received from the old one, restored like
+    // the journal of a previous run.
+    void adoptState(const std::string &state);
+
     // Luna handlers
     pbnjson::JValue _register(LSHelpers::JsonRequest &request);
     pbnjson::JValue unregister(LSHelpers::JsonRequest &request);
     pbnjson::JValue connect(LSHelpers::JsonRequest &request);
     pbnjson::JValue disconnect(LSHelpers::JsonRequest &request);
-    pbnjson::JValue blankVideo(LSHelpers::JsonRequest &request);
-    pbnjson::JValue setDisplayWindow(LSHelpers::JsonRequest &request);
-    pbnjson::JValue setVideoData(LSHelpers::JsonRequest &request);
+    pbnjson::JValue blankVideo(LSHelpers::JsonRequest &request, BlankVideoRequest &params);
+    pbnjson::JValue setDisplayWindow(LSHelpers::JsonRequest &request, SetDisplayWindowRequest &params);
+    pbnjson::JValue setVideoData(LSHelpers::JsonRequest &request, SetVideoDataRequest &params);
     pbnjson::JValue setCompositing(LSHelpers::JsonRequest &request);
     pbnjson::JValue getVideoLimits(LSHelpers::JsonRequest &request);
     pbnjson::JValue getOutputCapabilities(LSHelpers::JsonRequest &request);
@@ -51,6 +77,10 @@ public:
     pbnjson::JValue setDisplayResolution(LSHelpers::JsonRequest &request);
     pbnjson::JValue getParam(LSHelpers::JsonRequest &request);
     pbnjson::JValue setParam(LSHelpers::JsonRequest &request);
+    pbnjson::JValue getMetrics(LSHelpers::JsonRequest &request);
+    pbnjson::JValue getTrace(LSHelpers::JsonRequest &request);
+    pbnjson::JValue setCapture(LSHelpers::JsonRequest &request);
+    pbnjson::JValue getHalJournal(LSHelpers::JsonRequest &request);
 
     inline void setAppIdChangedObserver(AspectRatioSetting *object,
                                         void (AspectRatioSetting::*callbackHandler)(std::string &appId))
@@ -63,6 +93,9 @@ public:
     pbnjson::JValue setBasicPictureCtrl(int8_t brightness, int8_t contrast, int8_t saturation, int8_t hue);
     pbnjson::JValue setSharpness(int8_t sharpness, int8_t hSharpness, int8_t vSharpness);
 
+    // getStatus reply for a state, without returnValue and subscribed.
+    static pbnjson::JValue buildStatus(const VideoServiceState &state);
+
 private:
     VAL *val;
 
@@ -72,37 +105,70 @@ private:
     void sendSinkUpdateToSubscribers();
 
     void readVideoCapabilities(VideoSink &sink);
-    bool applyVideoOutputRects(VideoSink &sink, VideoClient client, VideoRect &inputRect, VideoRect &outputRect,
-                               VideoRect &SourceRect);
+    void refreshCapabilities();
+    bool applyVideoOutputRects(VideoSink &sink, const VideoClient &client, VideoRect &inputRect,
+                               VideoRect &outputRect, VideoRect &SourceRect);
     bool applyVideoFilters(VideoSink &sink, const std::string &sourceName);
     bool applyCompositing();
 
     bool doDisconnectVideo(VideoSink &video);
+    void recordFirstUnblank(VideoSink &video);
 
     bool initI2C();
 
     bool addClientInfo(std::string clientId);
     bool removeClientInfo(std::string clientId);
-    VideoClient *getClientInfo(const std::string clientId);
-    VideoClient *getClientInfo(const std::string sinkName, bool activation);
+    VideoClient *getClientInfo(const std::string &clientId);
+    VideoClient *getClientInfo(const std::string &sinkName, bool activation);
     bool LoadClientInfotoVideoSink(VideoSink &sink, VideoClient &client);
 
-    pbnjson::JValue buildStatus();
-    pbnjson::JValue buildVideoSinkStatus(VideoSink &vsink);
+    void publishState();
+    std::shared_ptr<const VideoServiceState> currentState() const;
+    void invalidateChangedReplies(const VideoServiceState *previous);
+
+    void journalState(const VideoServiceState *previous);
+    void restoreState();
+    bool restoreSink(VideoSink &sink, const VideoSink &saved);
+    bool adoptSink(VideoSink &sink, const VideoSink &saved);
+
+    static pbnjson::JValue buildVideoSinkStatus(const VideoServiceState &state, const VideoSink &vsink);
 
     void converToDisplayResolution(VideoRect &outputRect);
 
+    static gboolean logMetricsCB(gpointer user_data);
+
     // Data members
     std::vector<VideoSink> mSinks;
     std::vector<VideoClient> mClients;
 
+    // Read by the read-only methods on mReader too. Refreshed on display hotplug and mode changes.
+    CapabilityCache mCapabilities;
+    std::unique_ptr<DisplayHotplug> mHotplug;
+
+    // Latest published state, swapped atomically. Read by the read-only methods on mReader.
+    std::shared_ptr<const VideoServiceState> mState;
+
     LSHelpers::ServicePoint mService;
     LSHelpers::SubscriptionPoint mSinkStatusSubscription;
 
     bool mDualVideoEnabled;
+    bool mHoldStatusUpdates; // A batch is running, status is sent when it is done
+    bool mStatusUpdateHeld;
 
     AspectRatioControl mAspectRatioControl;
 
     typedef std::function<void(std::string &)> AppIDChangeSettingsCallback;
     AppIDChangeSettingsCallback mAppIdChangedNotify;
+
+    guint mMetricsLogSource;
+
+    StateJournal mJournal;
+    bool mJournaling; // The journal holds the state of the previous run until it is restored
+    bool mHandedOver; // The sinks belong to the next process now
+    bool mAdopted;    // The state was handed over, its planes are still set up by the previous process
+    gint64 mHandoverStart; // When the previous process stopped answering, monotonic microseconds, 0 if none
+
+    // Runs the read-only methods and the capture file work of setCapture. Last member, so it is stopped
+    // before anything the methods use is destroyed.
+    LSHelpers::Executor mReader;
 };
@@ -17,37 +17,31 @@
 #include "videoservicetypes.h"
 #include "logging.h"
 
-void VideoRect::parseFromJson(const pbnjson::JValue &value)
-{
-    LSHelpers::JsonParser::parseValue(value["x"], x);
-    LSHelpers::JsonParser::parseValue(value["y"], y);
-    LSHelpers::JsonParser::parseValue(value["width"], w);
-    LSHelpers::JsonParser::parseValue(value["height"], h);
-}
-
 bool VideoRect::contains(VideoRect &inside)
 {
     return x <= inside.x && y <= inside.y && x + w >= inside.x + inside.w && y + h >= inside.y + inside.h;
 }
 
-pbnjson::JValue VideoRect::toJValue()
+pbnjson::JValue VideoRect::toJValue() const { return LSHelpers::jsonFieldsToJValue(*this); }
+
+bool VideoRect::operator==(const VideoRect &other) const
 {
-    return pbnjson::JValue{{"x", this->x}, {"y", this->y}, {"width", this->w}, {"height", this->h}};
+    return x == other.x && y == other.y && w == other.w && h == other.h;
 }
 
-bool VideoRect::operator==(VideoRect &other) { return x == other.x && y == other.y && w == other.w && h == other.h; }
-
-pbnjson::JValue VideoSize::toJValue() { return pbnjson::JValue{{"width", this->w}, {"height", this->h}}; }
+pbnjson::JValue VideoSize::toJValue() const { return LSHelpers::jsonFieldsToJValue(*this); }
 
-void VideoRect::debug_print(std::string prefix) const
+void VideoRect::debug_print(const char *prefix) const
 {
-    LOG_DEBUG("%s [x:%d, y:%d, w:%d, h:%d]", prefix.c_str(), x, y, w, h);
+    BINLOG_DEBUG("%s [x:%d, y:%d, w:%d, h:%d]", prefix, x, y, w, h);
 }
 
-void VideoClient::debug_print(std::string prefix) const
+void VideoClient::debug_print(const char *prefix) const
 {
-    LOG_DEBUG("%s - clientId:%s, sinkName:%s, sourceName:%s, port:%d", prefix.c_str(), clientId.c_str(),
-              sinkName.c_str(), sourceName.c_str(), sourcePort);
-    outputRect.debug_print(prefix + ".outputRect");
-    sourceRect.debug_print(prefix + ".sourceRect");
+    BINLOG_DEBUG("%s - clientId:%s, sinkName:%s, sourceName:%s, port:%d", prefix, clientId.c_str(), sinkName.c_str(),
+                 sourceName.c_str(), sourcePort);
+    BINLOG_DEBUG("%s.outputRect [x:%d, y:%d, w:%d, h:%d]", prefix, outputRect.x, outputRect.y, outputRect.w,
+                 outputRect.h);
+    BINLOG_DEBUG("%s.sourceRect [x:%d, y:%d, w:%d, h:%d]", prefix, sourceRect.x, sourceRect.y, sourceRect.w,
+                 sourceRect.h);
 }
@@ -37,10 +37,16 @@ public:
     uint16_t w;
     uint16_t h;
 
-    pbnjson::JValue toJValue();
+    pbnjson::JValue toJValue() const;
+
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
+    {
+        fields(LSHelpers::jsonField("width", &VideoSize::w));
+        fields(LSHelpers::jsonField("height", &VideoSize::h));
+    }
 };
 
-class VideoRect : public LSHelpers::JsonDataObject
+class VideoRect
 {
 public:
     VideoRect(int16_t x, int16_t y, uint16_t w, uint16_t h) : x(x), y(y), w(w), h(h){};
@@ -48,11 +54,10 @@ public:
     VideoRect() : x(0), y(0), w(0), h(0){};
     // TODO:: Can we Move this to val or use val_video_rect
     VideoRect(VAL_VIDEO_RECT_T valRect) : x(valRect.x), y(valRect.y), w(valRect.w), h(valRect.h){};
-    void parseFromJson(const pbnjson::JValue &value) override;
-    pbnjson::JValue toJValue();
+    pbnjson::JValue toJValue() const;
     bool contains(VideoRect &inside);
 
-    bool operator==(VideoRect &other);
+    bool operator==(const VideoRect &other) const;
 
     VideoRect &operator=(const VideoRect &other)
     {
@@ -64,7 +69,7 @@ public:
         return *this;
     }
 
-    VAL_VIDEO_RECT_T toVALRect() { return VAL_VIDEO_RECT_T{(uint16_t)x, (uint16_t)y, w, h}; }
+    VAL_VIDEO_RECT_T toVALRect() const { return VAL_VIDEO_RECT_T{(uint16_t)x, (uint16_t)y, w, h}; }
 
     // TODO(ekwang): scale with different ratio of width and height
     VideoRect scale(double scale)
@@ -75,7 +80,15 @@ public:
 
     bool isValid() const { return w > 0 && h > 0; }
 
-    void debug_print(std::string prefix) const;
+    void debug_print(const char *prefix) const;
+
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
+    {
+        fields(LSHelpers::jsonField("x", &VideoRect::x));
+        fields(LSHelpers::jsonField("y", &VideoRect::y));
+        fields(LSHelpers::jsonField("width", &VideoRect::w));
+        fields(LSHelpers::jsonField("height", &VideoRect::h));
+    }
 
 public:
     int16_t x;
@@ -84,18 +97,18 @@ public:
     uint16_t h;
 };
 
-class Composition : public LSHelpers::JsonDataObject
+class Composition
 {
 public:
     std::string sink;
     int opacity; // alpha
     int zOrder;
 
-    void parseFromJson(const pbnjson::JValue &value) override
+    template <typename Visitor> static void describeJsonFields(Visitor &fields)
     {
-        LSHelpers::JsonParser::parseValue(value["sink"], sink);
-        LSHelpers::JsonParser::parseValue(value["opacity"], opacity);
-        LSHelpers::JsonParser::parseValue(value["zOrder"], zOrder);
+        fields(LSHelpers::jsonField("sink", &Composition::sink));
+        fields(LSHelpers::jsonField("opacity", &Composition::opacity));
+        fields(LSHelpers::jsonField("zOrder", &Composition::zOrder));
     }
 };
 
@@ -104,7 +117,7 @@ class VideoSink
 {
 public:
     VideoSink(const std::string &_name, uint8_t _zorder, VAL_VIDEO_WID_T _wId)
-        : name(_name), wId(_wId), connected(false), muted(true), opacity(255), zOrder(_zorder)
+        : name(_name), wId(_wId), connected(false), muted(true), connectedAt(0), opacity(255), zOrder(_zorder)
     {
     }
 
@@ -113,6 +126,7 @@ public:
     VAL_VIDEO_WID_T wId; // 0 = main, 1 = sub
     bool connected;
     bool muted;
+    int64_t connectedAt; // Monotonic time of the connect call, microseconds. 0 after the first unblank.
 
     std::string connectedClientId; // Connected clientId of VideoClient
 
@@ -141,7 +155,7 @@ public:
     {
     }
 
-    void debug_print(std::string prefix) const;
+    void debug_print(const char *prefix) const;
 
     bool activation; // set true when video connected using this object
     bool available;  // set true when values are filled with valid value
@@ -1,6 +1,7 @@
 #!/usr/bin/python2
 import unittest
 import luna_utils as luna
+import threading
 import time
 
 API_URL = "com.webos.service.videooutput/"
@@ -158,6 +159,15 @@ class TestVideoMethods(luna.TestBase):
         self.mute(SINK_MAIN, False)
         time.sleep(SLEEP_TIME)
 
+    def testNestedFieldError(self):
+        print("[testNestedFieldError]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        ret = luna.call(API_URL + "display/setDisplayWindow",
+                        {"sink": SINK_MAIN, "fullScreen": False, "displayOutput": {"y": 0, "width": 640, "height": 360}})
+        self.assertIsFail(ret)
+        self.assertEqual(ret["errorText"], "Failed to validate against schema: Field 'displayOutput' not a number")
+
     def testSetVideoDataAndDisplayWindow(self):
         print("[testSetVideoDataAndDisplayWindow]")
         self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
@@ -274,6 +284,230 @@ class TestVideoMethods(luna.TestBase):
                     {"sink": SINK_SUB, "fullScreen":True, "opacity":30, "zOrder": 1},
                     self.statusSub, {"video":[{"sink": "MAIN", "opacity":130, "zOrder":0}, {"sink": "SUB0", "opacity":30, "zOrder":1}]})
 
+    def testBatch(self):
+        print("[testBatch]")
+        self.checkLunaCallSuccessAndSubscriptionUpdate(
+                API_URL + "batch",
+                {"calls": [
+                    {"category": "/", "method": "connect",
+                     "params": {"outputMode": "DISPLAY", "sink": SINK_MAIN, "source": SOURCE_NAME, "sourcePort": SOURCE_PORT}},
+                    {"category": "/", "method": "setVideoData",
+                     "params": {"sink": SINK_MAIN, "contentType": "media", "frameRate":29.5,
+                                "width":SOURCE_WIDTH, "height":SOURCE_HEIGHT, "scanType":"progressive"}},
+                    {"category": "/display", "method": "setDisplayWindow",
+                     "params": {"sink": SINK_MAIN, "fullScreen": True,
+                                "sourceInput": {"x":0, "y":0, "width":SOURCE_WIDTH, "height":SOURCE_HEIGHT}}}]},
+                self.statusSub,
+                {"video":[{"sink": SINK_MAIN,
+                    "connectedSource": SOURCE_NAME,
+                    "connectedSourcePort": SOURCE_PORT,
+                    "fullScreen": True,
+                    "width":SOURCE_WIDTH,
+                    "height":SOURCE_HEIGHT,
+                    "frameRate":29.5}]})
+
+        # Stops at the first failed call
+        ret = luna.call(API_URL + "batch",
+                {"calls": [
+                    {"category": "/", "method": "blankVideo", "params": {"sink": "INVALID", "blank": True}},
+                    {"category": "/", "method": "blankVideo", "params": {"sink": SINK_MAIN, "blank": True}}]})
+        self.assertIsFail(ret)
+        self.assertContainsData(ret, {"failedCall": 0})
+        self.assertEqual(len(ret["results"]), 1)
+
+        # Subscriptions and nested batches are not allowed
+        ret = luna.call(API_URL + "batch",
+                {"stopOnError": False,
+                 "calls": [
+                    {"category": "/", "method": "getStatus", "params": {"subscribe": True}},
+                    {"category": "/", "method": "batch", "params": {"calls": []}},
+                    {"category": "/", "method": "getStatus"}]})
+        self.assertIsFail(ret)
+        self.assertContainsData(ret, {"failedCall": 0})
+        self.assertEqual(len(ret["results"]), 3)
+        self.assertIsSuccess(ret["results"][2])
+
+    def testRepeatedCalls(self):
+        print("[testRepeatedCalls]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+        self.mute(SINK_MAIN, True)
+
+        # Repeats are answered from the reply cache
+        hits = luna.call(API_URL + "debug/getMetrics", {})["replyCache"]["/blankVideo"]["hits"]
+        for i in range(3):
+            self.assertIsSuccess(luna.call(API_URL + "blankVideo", {"sink": SINK_MAIN, "blank": True}))
+        ret = luna.call(API_URL + "debug/getMetrics", {})
+        # The first call repeats the mute above, so it may be a hit as well.
+        self.assertTrue(ret["replyCache"]["/blankVideo"]["hits"] >= hits + 2)
+
+        # Calls that change the state still reach the service
+        self.mute(SINK_MAIN, False)
+        self.mute(SINK_MAIN, True)
+
+    def testGetMetrics(self):
+        print("[testGetMetrics]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        ret = luna.call(API_URL + "debug/getMetrics", {})
+        self.assertIsSuccess(ret)
+        self.assertTrue(ret["methods"]["/connect"]["calls"] > 0)
+        self.assertTrue(ret["histograms"]["val.video.connect"]["count"] > 0)
+        self.assertTrue(ret["dispatch"]["control"]["dispatched"] > 0)
+        # getMetrics itself is a query.
+        self.assertTrue(ret["dispatch"]["query"]["dispatched"] > 0)
+
+    def testQueriesUnderControlLoad(self):
+        print("[testQueriesUnderControlLoad]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        # Control calls keep arriving while the queries are made, so the main loop is never idle.
+        stop = threading.Event()
+        def controlLoad():
+            blank = True
+            while not stop.is_set():
+                luna.call(API_URL + "blankVideo", {"sink": SINK_MAIN, "blank": blank})
+                blank = not blank
+
+        workers = [threading.Thread(target=controlLoad) for i in range(4)]
+        for worker in workers:
+            worker.start()
+        try:
+            for i in range(10):
+                start = time.time()
+                ret = luna.call(API_URL + "debug/getMetrics", {})
+                self.assertIsSuccess(ret)
+                # Bounded by the maximum queue delay, not by the end of the control load.
+                self.assertTrue(time.time() - start < 1.0)
+                self.assertIn("aged", ret["dispatch"]["query"])
+        finally:
+            stop.set()
+            for worker in workers:
+                worker.join()
+
+        self.assertIsSuccess(luna.call(API_URL + "blankVideo", {"sink": SINK_MAIN, "blank": False}))
+
+    def testStatusSubscriptionCounters(self):
+        print("[testStatusSubscriptionCounters]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        before = luna.call(API_URL + "debug/getMetrics", {})["statusSubscription"]
+        self.mute(SINK_MAIN, True)
+        after = luna.call(API_URL + "debug/getMetrics", {})["statusSubscription"]
+
+        # One update, handed to every subscriber once.
+        self.assertEqual(after["posted"], before["posted"] + 1)
+        self.assertEqual(after["sent"], before["sent"] + after["subscribers"])
+        for counter in ["collapsed", "failed", "cutOff", "deferred"]:
+            self.assertEqual(after[counter], before[counter])
+
+    def testStartupPhases(self):
+        print("[testStartupPhases]")
+        ret = luna.call(API_URL + "debug/getMetrics", {})
+        self.assertIsSuccess(ret)
+        phases = [phase["name"] for phase in ret["startup"]["phases"]]
+        # The HAL initializes while the loop runs, settings replies come in at any time.
+        ordered = [phase for phase in phases
+                   if phase in ["main", "videoService", "busRegistered", "halInitStarted", "halInitDone", "ready"]]
+        self.assertEqual(ordered, ["main", "videoService", "busRegistered", "halInitStarted", "halInitDone", "ready"])
+        self.assertIn("mainLoopEntered", phases)
+        for phase in ret["startup"]["phases"]:
+            self.assertTrue(phase["sinceStartMs"] >= 0)
+
+    def testGetTrace(self):
+        print("[testGetTrace]")
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+        self.mute(SINK_MAIN, False)
+
+        ret = luna.call(API_URL + "debug/getTrace", {"clear": True})
+        self.assertIsSuccess(ret)
+        names = [event["name"] for event in ret["traceEvents"]]
+        self.assertIn("/connect", names)
+        self.assertIn("val.video.connect", names)
+        self.assertIn("connectToFirstUnblank", names)
+
+        ret = luna.call(API_URL + "debug/getMetrics", {})
+        self.assertTrue(ret["histograms"]["video.connectToFirstUnblankUs"]["count"] > 0)
+
+    def testGetHalJournal(self):
+        print("[testGetHalJournal]")
+        ret = luna.call(API_URL + "debug/getHalJournal", {"clear": True, "enable": True})
+        self.assertIsSuccess(ret)
+        self.assertTrue(ret["enabled"])
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        ret = luna.call(API_URL + "debug/getHalJournal", {})
+        self.assertIsSuccess(ret)
+        self.assertTrue(ret["requests"]["/connect"] >= 1)
+        connects = [call for call in ret["calls"] if call["name"] == "video.connect"]
+        self.assertTrue(len(connects) > 0)
+        self.assertEqual(connects[-1]["method"], "/connect")
+
+        ret = luna.call(API_URL + "debug/getHalJournal", {"clear": True, "enable": False})
+        self.assertFalse(ret["enabled"])
+        self.mute(SINK_MAIN, True)
+        ret = luna.call(API_URL + "debug/getHalJournal", {})
+        self.assertEqual(ret["calls"], [])
+
+    def testCapabilitiesCached(self):
+        print("[testCapabilitiesCached]")
+        self.assertIsSuccess(luna.call(API_URL + "debug/getHalJournal", {"clear": True, "enable": True}))
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+
+        ret = luna.call(API_URL + "display/getOutputCapabilities", {})
+        self.assertIsSuccess(ret)
+        self.assertTrue(ret["numPlanes"] > 0)
+
+        ret = luna.call(API_URL + "debug/getHalJournal", {})
+        names = [call["name"] for call in ret["calls"]]
+        self.assertNotIn("video.getVideoPlanes", names)
+        self.assertNotIn("video.getParam", names)
+        self.assertIsSuccess(luna.call(API_URL + "debug/getHalJournal", {"clear": True, "enable": False}))
+
+    def testSetCapture(self):
+        print("[testSetCapture]")
+        ret = luna.call(API_URL + "debug/setCapture", {"enable": True, "maxBytes": 65536})
+        self.assertIsSuccess(ret)
+        self.assertTrue(ret["enabled"])
+
+        self.connect(SINK_MAIN, SOURCE_NAME, SOURCE_PORT, "")
+        self.assertIsSuccess(luna.call(API_URL + "getStatus", {}))
+
+        ret = luna.call(API_URL + "debug/setCapture", {"enable": False})
+        self.assertIsSuccess(ret)
+        self.assertFalse(ret["enabled"])
+        self.assertTrue(ret["records"] > 0)
+        self.assertTrue(ret["bytes"] <= 65536)
+
+        self.checkLunaCallFail(API_URL + "debug/setCapture", {"enable": True, "maxBytes": 1})
+
+    def testSetCaptureInBatch(self):
+        print("[testSetCaptureInBatch]")
+        # setCapture replies after its file work on the reader thread, the batch waits for each reply in turn
+        ret = luna.call(API_URL + "batch",
+                {"calls": [
+                    {"category": "/debug", "method": "setCapture", "params": {"enable": True, "maxBytes": 65536}},
+                    {"category": "/", "method": "getStatus"},
+                    {"category": "/debug", "method": "setCapture", "params": {"enable": False}}]})
+        self.assertIsSuccess(ret)
+        self.assertEqual(len(ret["results"]), 3)
+        self.assertIsSuccess(ret["results"][0])
+        self.assertTrue(ret["results"][0]["enabled"])
+        self.assertTrue(ret["results"][0]["bytes"] > 0)
+        self.assertIsSuccess(ret["results"][1])
+        self.assertIsSuccess(ret["results"][2])
+        self.assertFalse(ret["results"][2]["enabled"])
+        self.assertEqual(ret["results"][2]["path"], ret["results"][0]["path"])
+
+    def testMainLoopLag(self):
+        print("[testMainLoopLag]")
+        time.sleep(0.5)
+
+        ret = luna.call(API_URL + "debug/getMetrics", {})
+        self.assertIsSuccess(ret)
+        lag = ret["histograms"]["mainloop.lagUs"]
+        self.assertTrue(lag["count"] > 0)
+        self.assertTrue(lag["p50"] <= lag["max"])
+
 if __name__ == '__main__':
     luna.VERBOSE = False
     unittest.main()